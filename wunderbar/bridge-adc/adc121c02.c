@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include <twi_master.h>
+#include "twi_trace.h"
 
 #include "adc121c02.h"
 
@@ -52,8 +53,9 @@ adc121c02_stop(void)
 uint16_t
 adc121c02_sample(void)
 {
-        uint16_t val;
+        uint8_t val[2];
 
-        adc121c02_read_register(ADC121C02_CONFIG, &val, sizeof(val));
-        return (val);
+        /* MSB first, the alert flag and three zero bits above the 12 bit result */
+        adc121c02_read_register(ADC121C02_RESULT, val, sizeof(val));
+        return ((val[0] & 0x0f) << 8 | val[1]);
 }
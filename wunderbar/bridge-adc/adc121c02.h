@@ -3,3 +3,6 @@
 void adc121c02_init(void);
 void adc121c02_stop(void);
 uint16_t adc121c02_sample(void);
+
+/* ms to a fresh sample, the converter free-runs once initialized */
+#define ADC121C02_LATENCY 1
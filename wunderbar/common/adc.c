@@ -0,0 +1,60 @@
+#include <stddef.h>
+
+#include <nrf.h>
+#include <nrf_soc.h>
+
+#include "adc.h"
+
+static struct adc_conv *owner;
+
+void
+ADC_IRQHandler(void)
+{
+	if (NRF_ADC->EVENTS_END == 0)
+		return;
+	NRF_ADC->EVENTS_END = 0;
+	NRF_ADC->TASKS_STOP = 1;
+	NRF_ADC->ENABLE = ADC_ENABLE_ENABLE_Disabled;
+	if (owner == NULL)
+		return;
+	owner->result = NRF_ADC->RESULT;
+	owner->state = ADC_CONV_DONE;
+	task_event_signal(&owner->done);
+	owner = NULL;
+}
+
+/* from a task: the ADC interrupt runs at the same priority */
+bool
+adc_start(struct adc_conv *conv)
+{
+	if (owner != NULL) {
+		conv->state = ADC_CONV_DEFERRED;
+		return false;
+	}
+	owner = conv;
+	conv->state = ADC_CONV_RUNNING;
+	task_event_clear(&conv->done);
+
+	NRF_ADC->CONFIG = conv->config;
+	NRF_ADC->EVENTS_END = 0;
+	NRF_ADC->INTENSET = ADC_INTENSET_END_Msk;
+	sd_nvic_ClearPendingIRQ(ADC_IRQn);
+	sd_nvic_SetPriority(ADC_IRQn, NRF_APP_PRIORITY_LOW);
+	sd_nvic_EnableIRQ(ADC_IRQn);
+	NRF_ADC->ENABLE = ADC_ENABLE_ENABLE_Enabled;
+	NRF_ADC->TASKS_START = 1;
+	return true;
+}
+
+/* after the await: a conversion that never ended is given up */
+void
+adc_finish(struct adc_conv *conv)
+{
+	if (conv->state != ADC_CONV_RUNNING)
+		return;
+	NRF_ADC->TASKS_STOP = 1;
+	NRF_ADC->ENABLE = ADC_ENABLE_ENABLE_Disabled;
+	conv->state = ADC_CONV_FAILED;
+	if (owner == conv)
+		owner = NULL;
+}
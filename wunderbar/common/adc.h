@@ -0,0 +1,53 @@
+#ifndef ADC_H
+#define ADC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "task.h"
+
+/*
+ * Interrupt driven single conversions on the nRF51 ADC, shared by
+ * tasks.
+ *
+ * A conversion carries its own NRF_ADC->CONFIG, so users that want
+ * different inputs (noiselvl's microphone, broadcast.c's supply
+ * voltage) take turns: adc_start() fails while another conversion is in
+ * flight and TASK_AWAIT_ADC() then tries again after ADC_BUSY_WAIT ms.
+ * The ADC is enabled only for the length of a conversion.  The result
+ * is in `result' once `state' is ADC_CONV_DONE.
+ */
+
+#define ADC_TIMEOUT	2	/* ms, a 10 bit conversion takes 68 us */
+#define ADC_BUSY_WAIT	1	/* ms */
+
+enum adc_conv_state {
+	ADC_CONV_IDLE,
+	ADC_CONV_RUNNING,
+	ADC_CONV_DEFERRED,	/* another conversion was in flight */
+	ADC_CONV_DONE,
+	ADC_CONV_FAILED,
+};
+
+struct adc_conv {
+	struct task_event done;
+	uint32_t config;	/* NRF_ADC->CONFIG for this conversion */
+	uint16_t result;
+	uint8_t state;
+};
+
+/* convert `conv' from task `t', waiting for a busy ADC first */
+#define TASK_AWAIT_ADC(t, conv) \
+	do { \
+		if (adc_start(conv)) \
+			task_wait((t), &(conv)->done, ADC_TIMEOUT); \
+		else \
+			task_sleep((t), ADC_BUSY_WAIT); \
+		TASK_YIELD_POINT(t); \
+		adc_finish(conv); \
+	} while ((conv)->state == ADC_CONV_DEFERRED)
+
+bool adc_start(struct adc_conv *conv);
+void adc_finish(struct adc_conv *conv);
+
+#endif /* ADC_H */
@@ -0,0 +1,140 @@
+#include <stddef.h>
+#include <string.h>
+
+#include <nrf_soc.h>
+
+#include "batch.h"
+#include "config.h"
+#include "wunderbar_uuid.h"
+
+static void
+put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+void
+batch_flush(struct batch *b)
+{
+	if (b->count == 0)
+		return;
+	vtimer_stop(&b->timer);
+	put16(b->buf, vtimer_now() - b->first);
+	notify_send(&b->txq, b->buf, b->len);
+	b->count = 0;
+	b->len = 0;
+}
+
+static void
+batch_timer_cb(struct vtimer *t)
+{
+	batch_flush((void *)((char *)t - offsetof(struct batch, timer)));
+}
+
+void
+batch_add(struct batch *b, const void *sample)
+{
+	uint8_t size = b->format.sample_size;
+	uint32_t now = vtimer_now();
+
+	if (b->count != 0 &&
+	    (now - b->last > UINT16_MAX || b->len + BATCH_TIME_SIZE + size > BATCH_PAYLOAD))
+		batch_flush(b);
+	if (b->count == 0) {
+		b->first = now;
+		b->len = BATCH_TIME_SIZE;	/* age, filled in on flush */
+		if (b->format.max_latency != 0)
+			vtimer_start(&b->timer, b->format.max_latency, 0);
+	} else {
+		put16(&b->buf[b->len], now - b->last);
+		b->len += BATCH_TIME_SIZE;
+	}
+	memcpy(&b->buf[b->len], sample, size);
+	b->len += size;
+	b->count++;
+	b->last = now;
+	if (b->format.max_latency == 0 || b->len + BATCH_TIME_SIZE + size > BATCH_PAYLOAD)
+		batch_flush(b);
+}
+
+bool
+batch_enabled(struct batch *b)
+{
+	return b->enabled;
+}
+
+void
+batch_disconnected(struct batch *b)
+{
+	vtimer_stop(&b->timer);
+	notify_reset(&b->txq);
+	b->enabled = 0;
+	b->count = 0;
+	b->len = 0;
+}
+
+static void
+data_status_cb(struct service_desc *srv, struct char_desc *c, const int8_t status)
+{
+	struct batch *b = (struct batch *)c;
+
+	if (status & BLE_GATT_HVX_NOTIFICATION) {
+		b->enabled = 1;
+	} else {
+		batch_flush(b);
+		b->enabled = 0;
+	}
+	if (b->status_cb != NULL)
+		b->status_cb(srv, c, status);
+}
+
+static void
+format_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct batch *b = (void *)((char *)c - offsetof(struct batch, format_char));
+	*valp = &b->format;
+	*lenp = sizeof(b->format);
+}
+
+static void
+format_write_cb(struct service_desc *srv, struct char_desc *c, const void *val, const uint16_t len)
+{
+	struct batch *b = (void *)((char *)c - offsetof(struct batch, format_char));
+
+	if (len < sizeof(b->format.max_latency))
+		return;
+	memcpy(&b->format.max_latency, val, sizeof(b->format.max_latency));
+	batch_flush(b);
+	config_changed();
+}
+
+void
+batch_init(struct batch *b, uint8_t sample_size, batch_status_cb_t *status_cb)
+{
+	b->status_cb = status_cb;
+	b->timer.cb = batch_timer_cb;
+	b->format.sample_size = sample_size;
+	b->format.time_size = BATCH_TIME_SIZE;
+	b->format.time_unit = 1;
+	b->format.max_latency = BATCH_DEFAULT_LATENCY;
+	notify_init(&b->txq, &b->data_char, b->tx_slots, BATCH_TX_DEPTH,
+		BATCH_PAYLOAD, NOTIFY_ALL);
+}
+
+void
+batch_char_add(struct service_desc *srv, struct batch *b)
+{
+	simble_srv_char_add(srv, &b->data_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_BATCH_CHAR,
+		u8"batched",
+		BATCH_PAYLOAD);
+	b->data_char.notify = 1;
+	b->data_char.notify_status_cb = data_status_cb;
+	simble_srv_char_add(srv, &b->format_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_BATCH_FORMAT_CHAR,
+		u8"batch format",
+		sizeof(b->format));
+	b->format_char.read_cb = format_read_cb;
+	b->format_char.write_cb = format_write_cb;
+}
@@ -0,0 +1,72 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simble.h"
+#include "vtimer.h"
+#include "notify.h"
+
+/*
+ * Several samples per notification.
+ *
+ * A service gets a "batched" characteristic next to its plain one.  While
+ * a client has notifications on for it, samples are collected into one
+ * ATT payload and sent when the next one would not fit, or when the first
+ * sample has waited max_latency ms.  A notification reads:
+ *
+ *	u16 age		ms between the first sample and sending
+ *	sample		sample_size bytes, as on the plain characteristic
+ *	{ u16 dt; sample }...	dt: ms since the previous sample
+ *
+ * The "batch format" characteristic describes this layout with struct
+ * batch_format, so a client can decode any service the same way;
+ * writing a u16 to it changes max_latency.
+ *
+ * A sample that does not fit twice is not batched: one per notification
+ * is what the plain characteristic already does.  sensor_add() leaves
+ * the characteristics out for such a service; motion's 12 byte samples
+ * go packed through its "compressed" characteristic instead (codec.h).
+ */
+
+#define BATCH_PAYLOAD		20	/* ATT_MTU 23 - 3 */
+#define BATCH_TIME_SIZE		2
+#define BATCH_DEFAULT_LATENCY	2000	/* ms */
+#define BATCH_TX_DEPTH		2	/* full batches waiting for TX buffers */
+/* two samples of `size' bytes fit into one notification */
+#define BATCH_FITS(size)	(2 * ((size) + BATCH_TIME_SIZE) <= BATCH_PAYLOAD)
+
+struct batch_format {
+	uint8_t sample_size;
+	uint8_t time_size;	/* bytes per time stamp */
+	uint8_t time_unit;	/* ms per time stamp count */
+	uint16_t max_latency;	/* ms */
+} __attribute__((__packed__));
+
+typedef void (batch_status_cb_t)(struct service_desc *s, struct char_desc *c, const int8_t status);
+
+struct batch {
+	struct char_desc data_char;	/* keep first, see batch_char_add() */
+	struct char_desc format_char;
+	struct vtimer timer;
+	batch_status_cb_t *status_cb;
+	uint8_t enabled;
+	uint8_t count;
+	uint8_t len;
+	uint32_t first;		/* ms, the first sample */
+	uint32_t last;		/* ms, the latest sample */
+	struct batch_format format;
+	uint8_t buf[BATCH_PAYLOAD];
+	struct notify_queue txq;
+	uint8_t tx_slots[NOTIFY_SLOTS(BATCH_TX_DEPTH, BATCH_PAYLOAD)];
+};
+
+void batch_init(struct batch *b, uint8_t sample_size, batch_status_cb_t *status_cb);
+void batch_char_add(struct service_desc *srv, struct batch *b);
+bool batch_enabled(struct batch *b);
+void batch_add(struct batch *b, const void *sample);
+void batch_flush(struct batch *b);
+void batch_disconnected(struct batch *b);
+
+#endif /* BATCH_H */
@@ -0,0 +1,226 @@
+#include <stddef.h>
+#include <string.h>
+
+#include <nrf.h>
+#include <nrf_soc.h>
+#include <ble.h>
+
+#include "broadcast.h"
+#include "adc.h"
+#include "config.h"
+#include "task.h"
+#include "vtimer.h"
+#include "wunderbar_uuid.h"
+
+#define RESTART_DELAY	10	/* ms, lets simble restart advertising first */
+
+#define BATTERY_ADC_CONFIG \
+	((ADC_CONFIG_RES_10bit << ADC_CONFIG_RES_Pos) | \
+	(ADC_CONFIG_INPSEL_SupplyOneThirdPrescaling << ADC_CONFIG_INPSEL_Pos) | \
+	(ADC_CONFIG_REFSEL_VBG << ADC_CONFIG_REFSEL_Pos) | \
+	(ADC_CONFIG_PSEL_Disabled << ADC_CONFIG_PSEL_Pos) | \
+	(ADC_CONFIG_EXTREFSEL_None << ADC_CONFIG_EXTREFSEL_Pos))
+
+static struct {
+	struct char_desc config_char;
+	struct broadcast_config config;
+	struct config_item saved;
+	struct vtimer timer;
+	struct task task;
+	struct adc_conv battery_adc;
+	const char *name;
+	broadcast_cb_t *cb;
+	uint32_t battery_time;
+	uint8_t connected;
+	uint8_t type;
+	uint8_t seq;
+	uint8_t battery;
+	uint8_t len;
+	uint8_t payload[BROADCAST_MAX_PAYLOAD];
+} bc;
+
+static void
+adv_data_set(void)
+{
+	uint8_t adv[BLE_GAP_ADV_MAX_SIZE];
+	uint8_t sr[BLE_GAP_ADV_MAX_SIZE];
+	uint8_t alen = 0;
+	uint8_t nlen = strlen(bc.name);
+
+	adv[alen++] = 2;
+	adv[alen++] = BLE_GAP_AD_TYPE_FLAGS;
+	adv[alen++] = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+	adv[alen++] = 6 + bc.len;
+	adv[alen++] = BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA;
+	adv[alen++] = BROADCAST_COMPANY_ID & 0xff;
+	adv[alen++] = BROADCAST_COMPANY_ID >> 8;
+	adv[alen++] = bc.type;
+	adv[alen++] = bc.seq;
+	adv[alen++] = bc.battery;
+	memcpy(&adv[alen], bc.payload, bc.len);
+	alen += bc.len;
+
+	if (nlen > sizeof(sr) - 2)
+		nlen = sizeof(sr) - 2;
+	sr[0] = nlen + 1;
+	sr[1] = BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME;
+	memcpy(&sr[2], bc.name, nlen);
+	sd_ble_gap_adv_data_set(adv, alen, sr, nlen + 2);
+}
+
+/* only while disconnected: a connection stops advertising */
+static void
+adv_restart(void)
+{
+	uint32_t interval = (uint32_t)bc.config.interval * 1000 / 625;
+	ble_gap_adv_params_t params = {
+		.type = BLE_GAP_ADV_TYPE_ADV_IND,
+		.fp = BLE_GAP_ADV_FP_ANY,
+		.timeout = 0,
+	};
+
+	if (interval < BLE_GAP_ADV_INTERVAL_MIN)
+		interval = BLE_GAP_ADV_INTERVAL_MIN;
+	if (interval > BLE_GAP_ADV_INTERVAL_MAX)
+		interval = BLE_GAP_ADV_INTERVAL_MAX;
+	params.interval = interval;
+	sd_ble_gap_adv_stop();
+	adv_data_set();
+	sd_ble_gap_adv_start(&params);
+}
+
+static void
+restart_timer_cb(struct vtimer *t)
+{
+	if (bc.config.enable && !bc.connected)
+		adv_restart();
+}
+
+/*
+ * VDD through the 1/3 prescaler against the 1.2 V band gap, converted
+ * through adc.h, which takes turns with noiselvl's conversions.
+ */
+static enum task_status
+battery_task(struct task *t)
+{
+	int32_t mv;
+
+	TASK_BEGIN(t);
+	TASK_AWAIT_ADC(t, &bc.battery_adc);
+	if (bc.battery_adc.state == ADC_CONV_DONE) {
+		/* 2.0 V empty, 3.0 V full */
+		mv = (int32_t)bc.battery_adc.result * 3600 / 1024;
+		mv = (mv - 2000) / 10;
+		bc.battery = mv < 0 ? 0 : mv > 100 ? 100 : mv;
+		bc.battery_time = vtimer_now();
+		if (bc.config.enable)
+			adv_data_set();
+	}
+	TASK_END(t);
+}
+
+void
+broadcast_update(const void *payload, uint8_t len)
+{
+	if (len > sizeof(bc.payload))
+		len = sizeof(bc.payload);
+	memcpy(bc.payload, payload, len);
+	bc.len = len;
+	bc.seq++;
+	if (!bc.config.enable)
+		return;
+	if (bc.battery == 0xff || vtimer_now() - bc.battery_time >= BROADCAST_BATTERY_PERIOD)
+		task_kick(&bc.task, battery_task);
+	adv_data_set();
+}
+
+bool
+broadcast_enabled(void)
+{
+	return bc.config.enable;
+}
+
+void
+broadcast_connected(void)
+{
+	bc.connected = 1;
+	vtimer_stop(&bc.timer);
+}
+
+void
+broadcast_disconnected(void)
+{
+	bc.connected = 0;
+	if (bc.config.enable)
+		vtimer_start(&bc.timer, RESTART_DELAY, 0);
+}
+
+void
+broadcast_start(void)
+{
+	simble_adv_start();
+	if (bc.config.enable) {
+		/* kept from before the reset, see config.h */
+		adv_restart();
+		if (bc.cb != NULL)
+			bc.cb(true);
+	}
+}
+
+static void
+config_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	*valp = &bc.config;
+	*lenp = sizeof(bc.config);
+}
+
+static void
+config_write_cb(struct service_desc *srv, struct char_desc *c, const void *val, const uint16_t len)
+{
+	const struct broadcast_config *config = val;
+
+	if (len < sizeof(*config))
+		return;
+	bc.config.enable = config->enable != 0;
+	if (config->interval != 0)
+		bc.config.interval = config->interval;
+	if (bc.connected) {
+		/* takes effect when advertising resumes on disconnect */
+		if (bc.config.enable)
+			adv_data_set();
+	} else if (bc.config.enable) {
+		adv_restart();
+	} else {
+		/* back to simble's own advertising data */
+		sd_ble_gap_adv_stop();
+		simble_adv_start();
+	}
+	if (bc.cb != NULL)
+		bc.cb(bc.config.enable);
+	config_changed();
+}
+
+void
+broadcast_init(const char *name, enum broadcast_type type, broadcast_cb_t *cb)
+{
+	bc.name = name;
+	bc.type = type;
+	bc.cb = cb;
+	bc.battery = 0xff;
+	bc.config.interval = BROADCAST_DEFAULT_INTERVAL;
+	bc.timer.cb = restart_timer_cb;
+	bc.battery_adc.config = BATTERY_ADC_CONFIG;
+	config_add(&bc.saved, CONFIG_KEY(CONFIG_OWNER_BROADCAST, 0),
+		&bc.config, sizeof(bc.config));
+}
+
+void
+broadcast_char_add(struct service_desc *srv)
+{
+	simble_srv_char_add(srv, &bc.config_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_BROADCAST_CHAR,
+		u8"broadcast",
+		sizeof(bc.config));
+	bc.config_char.read_cb = config_read_cb;
+	bc.config_char.write_cb = config_write_cb;
+}
@@ -0,0 +1,57 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simble.h"
+
+/*
+ * Sensor values in the advertising data, for scanners that never
+ * connect.
+ *
+ * When broadcasting is on, the module keeps sampling without a
+ * connection and every sample refreshes a manufacturer specific AD
+ * structure:
+ *
+ *	u16 company	BROADCAST_COMPANY_ID
+ *	u8 type		enum broadcast_type, selects the payload layout
+ *	u8 seq		incremented with every new payload
+ *	u8 battery	%, 0xff if not measured yet
+ *	payload		module specific, see the module's *_broadcast struct
+ *
+ * The device name moves to the scan response to make room.  The module
+ * stays connectable; the "broadcast" characteristic takes
+ * { u8 enable; u16 interval } with the advertising interval in ms.
+ */
+
+#define BROADCAST_COMPANY_ID		0xffff	/* no SIG id assigned, test range */
+#define BROADCAST_MAX_PAYLOAD		21	/* what is left of the 31 bytes */
+#define BROADCAST_DEFAULT_INTERVAL	1000	/* ms */
+#define BROADCAST_BATTERY_PERIOD	(60UL * 1000)	/* ms between measurements */
+
+enum broadcast_type {
+	BROADCAST_TEMP_RH = 1,
+	BROADCAST_MOTION,
+	BROADCAST_NOISE,
+	BROADCAST_PROXIMITY_RGB,
+	BROADCAST_BRIDGE_ADC,
+};
+
+struct broadcast_config {
+	uint8_t enable;
+	uint16_t interval;	/* ms */
+} __attribute__((__packed__));
+
+/* called when broadcasting is switched on or off */
+typedef void (broadcast_cb_t)(bool enabled);
+
+void broadcast_init(const char *name, enum broadcast_type type, broadcast_cb_t *cb);
+void broadcast_char_add(struct service_desc *srv);
+void broadcast_start(void);
+void broadcast_update(const void *payload, uint8_t len);
+bool broadcast_enabled(void);
+void broadcast_connected(void);
+void broadcast_disconnected(void);
+
+#endif /* BROADCAST_H */
@@ -0,0 +1,16 @@
+# Sources shared between the wunderbar modules.  A module lists the files
+# it needs in SRCS and includes this fragment before build.mk.
+
+COMMONDIR?= ../common
+
+VPATH+= ${COMMONDIR}
+CFLAGS+= -I${COMMONDIR}
+
+# `make TWI_TRACE=1' builds with the TWI transaction tracer (twi_trace.h)
+ifdef TWI_TRACE
+CFLAGS+= -DTWI_TRACE
+SRCS+= twi_trace.c
+endif
+
+# keep the image out of the data pages at the top of the flash (flash.h)
+LDFLAGS+= ${COMMONDIR}/reserve.ld
@@ -0,0 +1,259 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "config.h"
+#include "flash.h"
+#include "task.h"
+#include "vtimer.h"
+
+#define CONFIG_MAGIC	0x4346UL	/* "CF" */
+#define HEADER_WORDS	2		/* magic << 16 | generation, complement */
+#define ERASED		0xffffffffUL
+#define PENDING		0x00800000UL	/* in the size byte until the data is in */
+#define WORDS(size)	(((size) + 3) / 4)
+
+static struct {
+	struct task task;
+	struct vtimer timer;
+	struct config_item *items;
+	uint32_t *page;		/* active page, NULL before the first update */
+	uint16_t generation;
+	uint16_t end;		/* words in use on the active page */
+	uint8_t loaded;
+	/* the update in progress */
+	struct config_item *it;
+	uint32_t *dst;
+	uint16_t pos;		/* word on dst to write next */
+	uint8_t fresh;		/* dst is the other page, erased */
+	uint8_t failed;
+	uint8_t words;
+	uint8_t record_words;
+	uint8_t retries;
+	struct flash_op flash;
+	uint32_t buf[1 + WORDS(CONFIG_MAX_SIZE)];
+} cfg;
+
+static uint16_t
+page_words(void)
+{
+	return flash_page_size() / sizeof(uint32_t);
+}
+
+static uint8_t
+crc8(uint8_t crc, const uint8_t *p, uint8_t len)
+{
+	while (len-- != 0) {
+		crc ^= *p++;
+		for (uint8_t i = 0; i < 8; i++)
+			crc = crc & 0x80 ? crc << 1 ^ 0x07 : crc << 1;
+	}
+	return crc;
+}
+
+/* the first word of a record */
+static uint32_t
+record(uint16_t key, uint8_t size, const void *val)
+{
+	uint8_t head[3] = { key, key >> 8, size };
+
+	return key | (uint32_t)size << 16 |
+		(uint32_t)crc8(crc8(0, head, sizeof(head)), val, size) << 24;
+}
+
+/* both header words complete, whatever a reset left */
+static bool
+valid(const uint32_t *page)
+{
+	return page[0] >> 16 == CONFIG_MAGIC && page[1] == ~page[0];
+}
+
+/* the next intact record from word `*pos' on, NULL at the end of the log */
+static const uint32_t *
+next(const uint32_t *page, uint16_t *pos)
+{
+	while (*pos < page_words() && page[*pos] != ERASED) {
+		const uint32_t *r = &page[*pos];
+		uint8_t size = (r[0] & ~PENDING) >> 16;
+
+		if (size > CONFIG_MAX_SIZE || *pos + 1 + WORDS(size) > page_words()) {
+			/* a torn header, the rest of the page is lost */
+			*pos = page_words();
+			break;
+		}
+		*pos += 1 + WORDS(size);
+		if (record(r[0], size, r + 1) == r[0])	/* implies not PENDING */
+			return r;
+	}
+	return NULL;
+}
+
+static void
+rescan(void)
+{
+	uint16_t pos = HEADER_WORDS;
+
+	while (next(cfg.page, &pos) != NULL)
+		/* NOTHING */;
+	cfg.end = pos;
+}
+
+static const uint32_t *
+find(uint16_t key)
+{
+	const uint32_t *r, *found = NULL;
+	uint16_t pos = HEADER_WORDS;
+
+	if (cfg.page == NULL)
+		return NULL;
+	while ((r = next(cfg.page, &pos)) != NULL)
+		if ((uint16_t)r[0] == key)
+			found = r;
+	return found;
+}
+
+static bool
+stored(const struct config_item *it)
+{
+	const uint32_t *r = find(it->key);
+
+	return r != NULL && (uint8_t)(r[0] >> 16) == it->size &&
+		memcmp(r + 1, it->val, it->size) == 0;
+}
+
+/* words the settings that changed take */
+static uint16_t
+pending(void)
+{
+	uint16_t words = 0;
+
+	for (struct config_item *it = cfg.items; it != NULL; it = it->next)
+		if (!stored(it))
+			words += 1 + WORDS(it->size);
+	return words;
+}
+
+static void
+stage(const struct config_item *it)
+{
+	cfg.buf[0] = record(it->key, it->size, it->val) | PENDING;
+	memset(&cfg.buf[1], 0xff, sizeof(cfg.buf) - sizeof(cfg.buf[0]));
+	memcpy(&cfg.buf[1], it->val, it->size);
+	cfg.words = 1 + WORDS(it->size);
+	cfg.record_words = cfg.words;
+}
+
+/* write cfg.buf to cfg.dst + cfg.pos; checked and retried like history.c */
+#define CONFIG_WRITE(t) \
+	do { \
+		for (cfg.retries = 0; cfg.retries < FLASH_RETRIES; cfg.retries++) { \
+			TASK_AWAIT_FLASH(t, &cfg.flash, \
+				flash_write(cfg.dst + cfg.pos, cfg.buf, cfg.words, &cfg.flash)); \
+			if (flash_written(cfg.dst + cfg.pos, cfg.buf, cfg.words)) \
+				break; \
+		} \
+	} while (0)
+
+static enum task_status
+config_task(struct task *t)
+{
+	TASK_BEGIN(t);
+	cfg.failed = 0;
+	cfg.fresh = cfg.page == NULL || cfg.end + pending() > page_words();
+	if (cfg.fresh) {
+		cfg.dst = flash_page(FLASH_CONFIG_FIRST);
+		if (cfg.page == cfg.dst)
+			cfg.dst = flash_page(FLASH_CONFIG_FIRST + 1);
+		cfg.pos = HEADER_WORDS;
+		for (cfg.retries = 0; cfg.retries < FLASH_RETRIES; cfg.retries++) {
+			TASK_AWAIT_FLASH(t, &cfg.flash, flash_erase(cfg.dst, &cfg.flash));
+			if (flash_erased(cfg.dst))
+				break;
+		}
+		cfg.failed = cfg.retries == FLASH_RETRIES;
+	} else {
+		cfg.dst = cfg.page;
+		cfg.pos = cfg.end;
+	}
+	for (cfg.it = cfg.items; cfg.it != NULL && !cfg.failed; cfg.it = cfg.it->next) {
+		if (!cfg.fresh && stored(cfg.it))
+			continue;
+		/*
+		 * The record stays PENDING until its data verified; one that
+		 * does not is skipped like one a reset cut short.
+		 */
+		stage(cfg.it);
+		CONFIG_WRITE(t);
+		if (cfg.retries < FLASH_RETRIES) {
+			cfg.buf[0] &= ~PENDING;
+			cfg.words = 1;
+			CONFIG_WRITE(t);
+		}
+		cfg.pos += cfg.record_words;
+	}
+	if (cfg.fresh && !cfg.failed) {
+		/* the header last: until it is there the old page counts */
+		cfg.buf[0] = CONFIG_MAGIC << 16 | (uint16_t)(cfg.generation + 1);
+		cfg.buf[1] = ~cfg.buf[0];
+		cfg.words = HEADER_WORDS;
+		cfg.pos = 0;
+		CONFIG_WRITE(t);
+		if (valid(cfg.dst)) {
+			cfg.page = cfg.dst;
+			cfg.generation++;
+		}
+	}
+	if (cfg.page != NULL)
+		rescan();
+	TASK_END(t);
+}
+
+static void
+timer_cb(struct vtimer *t)
+{
+	task_kick(&cfg.task, config_task);
+}
+
+static void
+load(void)
+{
+	uint32_t *a = flash_page(FLASH_CONFIG_FIRST);
+	uint32_t *b = flash_page(FLASH_CONFIG_FIRST + 1);
+
+	cfg.loaded = 1;
+	cfg.timer.cb = timer_cb;
+	if (valid(a) && (!valid(b) || (int16_t)(a[0] - b[0]) > 0))
+		cfg.page = a;
+	else if (valid(b))
+		cfg.page = b;
+	else
+		return;
+	cfg.generation = cfg.page[0];
+	rescan();
+}
+
+/* register a setting and load its stored value; false if there is none */
+bool
+config_add(struct config_item *it, uint16_t key, void *val, uint8_t size)
+{
+	const uint32_t *r;
+
+	if (!cfg.loaded)
+		load();
+	it->key = key;
+	it->val = val;
+	it->size = size < CONFIG_MAX_SIZE ? size : CONFIG_MAX_SIZE;
+	it->next = cfg.items;
+	cfg.items = it;
+	r = find(key);
+	if (r == NULL || (uint8_t)(r[0] >> 16) != it->size)
+		return false;
+	memcpy(val, r + 1, it->size);
+	return true;
+}
+
+void
+config_changed(void)
+{
+	if (cfg.loaded)
+		vtimer_start(&cfg.timer, CONFIG_DELAY, 0);
+}
@@ -0,0 +1,53 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Settings that survive a reset.
+ *
+ * A setting is a RAM variable registered under a key with config_add(),
+ * which loads the stored value into it if there is one.  Modules add
+ * their settings while they build their services, so everything is in
+ * place before advertising starts.  A write callback that changes a
+ * setting calls config_changed(); CONFIG_DELAY ms after the last change
+ * a task appends every setting that differs from its stored value, so
+ * a burst of GATT writes costs one flash update and the writes
+ * themselves never wait for the flash.
+ *
+ * The store is a log in two flash pages (flash.h) used in turn.  Each
+ * record is a word
+ *
+ *	u16 key, u8 size, u8 crc	crc8 over key, size and data
+ *
+ * followed by the value padded to whole words, and the last record of a
+ * key wins.  The record goes in with bit 7 of the size set, cleared by a
+ * second write of the word once the data is in, so a record a reset cut
+ * short is skipped.  When the active page is full, the other one is
+ * erased, the current value of every registered setting is written to
+ * it and only then its header, the magic and a generation followed by
+ * their complement, which makes it the active page.  A reset during the
+ * switch leaves the old page in charge.  Appending spreads the wear over
+ * the page; each switch costs one erase.
+ */
+
+#define CONFIG_MAX_SIZE	16	/* bytes per setting */
+#define CONFIG_DELAY	2000	/* ms */
+
+/* keys, one byte of owner and one of setting */
+#define CONFIG_KEY(owner, n)	((uint16_t)((owner) << 8 | (n)))
+#define CONFIG_OWNER_SENSOR	0x00	/* + the sensor's index, see sensor.h */
+#define CONFIG_OWNER_BROADCAST	0xf0
+
+struct config_item {
+	struct config_item *next;
+	void *val;
+	uint16_t key;
+	uint8_t size;
+};
+
+bool config_add(struct config_item *it, uint16_t key, void *val, uint8_t size);
+void config_changed(void);
+
+#endif /* CONFIG_H */
@@ -0,0 +1,137 @@
+#include <string.h>
+
+#include <nrf_soc.h>
+#include <ble.h>
+
+#include "connparam.h"
+#include "vtimer.h"
+#include "wunderbar_uuid.h"
+
+#define MIN_INTERVAL	6	/* 1.25 ms units, 7.5 ms */
+
+static struct {
+	struct char_desc status_char;
+	struct vtimer timer;
+	ble_gap_conn_params_t want;
+	ble_gap_conn_params_t asked;	/* zero until the first request */
+	uint8_t connected;
+	struct connparam_status status;
+} cp;
+
+static void ble_evt(ble_evt_t *evt);
+
+static struct simble_hook hook = {.ble_evt = ble_evt};
+
+static void
+compute(uint32_t period, ble_gap_conn_params_t *p)
+{
+	uint32_t interval, latency, timeout;
+
+	if (period == 0)
+		period = CONNPARAM_IDLE_PERIOD;
+	interval = period < CONNPARAM_MAX_INTERVAL ? period : CONNPARAM_MAX_INTERVAL;
+	latency = period / interval - 1;
+	if (latency > CONNPARAM_MAX_LATENCY)
+		latency = CONNPARAM_MAX_LATENCY;
+	/* the spec wants more than twice the longest gap between events */
+	timeout = 4 * (latency + 1) * interval;
+	if (timeout < CONNPARAM_MIN_TIMEOUT)
+		timeout = CONNPARAM_MIN_TIMEOUT;
+
+	p->max_conn_interval = interval * 4 / 5;
+	if (p->max_conn_interval < MIN_INTERVAL)
+		p->max_conn_interval = MIN_INTERVAL;
+	p->min_conn_interval = p->max_conn_interval / 2;
+	if (p->min_conn_interval < MIN_INTERVAL)
+		p->min_conn_interval = MIN_INTERVAL;
+	p->slave_latency = latency;
+	p->conn_sup_timeout = timeout / 10;
+}
+
+static void
+request_cb(struct vtimer *t)
+{
+	if (!cp.connected || memcmp(&cp.want, &cp.asked, sizeof(cp.want)) == 0)
+		return;
+	if (sd_ble_gap_conn_param_update(CONNPARAM_CONN_HANDLE, &cp.want) != NRF_SUCCESS) {
+		/* most likely a procedure still running */
+		cp.status.failures++;
+		vtimer_start(&cp.timer, CONNPARAM_DELAY, 0);
+		return;
+	}
+	cp.asked = cp.want;
+	cp.status.requests++;
+}
+
+/* thread mode, from simble's event loop: what the central settled on */
+static void
+ble_evt(ble_evt_t *evt)
+{
+	ble_gap_conn_params_t *p;
+
+	switch (evt->header.evt_id) {
+	case BLE_GAP_EVT_CONNECTED:
+		p = &evt->evt.gap_evt.params.connected.conn_params;
+		break;
+	case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+		p = &evt->evt.gap_evt.params.conn_param_update.conn_params;
+		break;
+	default:
+		return;
+	}
+	cp.status.min_interval = p->min_conn_interval;
+	cp.status.max_interval = p->max_conn_interval;
+	cp.status.slave_latency = p->slave_latency;
+	cp.status.timeout = p->conn_sup_timeout;
+}
+
+void
+connparam_want(uint32_t period)
+{
+	ble_gap_conn_params_t p;
+
+	compute(period, &p);
+	if (memcmp(&p, &cp.want, sizeof(p)) == 0)
+		return;
+	cp.want = p;
+	sd_ble_gap_ppcp_set(&cp.want);
+	/* a request that is due soon anyway takes the new values along */
+	if (cp.connected && !cp.timer.armed)
+		vtimer_start(&cp.timer, CONNPARAM_DELAY, 0);
+}
+
+void
+connparam_connected(void)
+{
+	if (cp.connected)
+		return;
+	cp.connected = 1;
+	memset(&cp.asked, 0, sizeof(cp.asked));
+	cp.timer.cb = request_cb;
+	vtimer_start(&cp.timer, CONNPARAM_FIRST_DELAY, 0);
+}
+
+void
+connparam_disconnected(void)
+{
+	cp.connected = 0;
+	vtimer_stop(&cp.timer);
+}
+
+static void
+status_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	*valp = &cp.status;
+	*lenp = sizeof(cp.status);
+}
+
+void
+connparam_char_add(struct service_desc *srv)
+{
+	simble_srv_char_add(srv, &cp.status_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_CONN_PARAMS_CHAR,
+		u8"connection parameters",
+		sizeof(cp.status));
+	cp.status_char.read_cb = status_read_cb;
+	simble_hook_add(&hook);
+}
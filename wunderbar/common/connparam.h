@@ -0,0 +1,50 @@
+#ifndef CONNPARAM_H
+#define CONNPARAM_H
+
+#include <stdint.h>
+
+#include "simble.h"
+
+/*
+ * Connection parameters that follow the traffic.
+ *
+ * The module tells connparam_want() how often it has something to
+ * notify, 0 when nothing is subscribed, and gets a connection interval
+ * of about that period, up to CONNPARAM_MAX_INTERVAL, with enough slave
+ * latency to skip the connection events in between: a 1 Hz sensor
+ * wakes the radio once a second, a 100 Hz stream gets the shortest
+ * interval.  The latency is bounded so a write from the central still
+ * gets through within CONNPARAM_MAX_INTERVAL * (CONNPARAM_MAX_LATENCY + 1).
+ *
+ * A change is requested with an L2CAP connection parameter update
+ * CONNPARAM_DELAY ms after it settles, CONNPARAM_FIRST_DELAY ms after
+ * connecting at the earliest, and set as the preferred parameters for
+ * the next connection.  The central has the last word: "connection
+ * parameters" reads back struct connparam_status with the parameters
+ * the link runs with, as the last connect or update GAP event reported
+ * them, and how the requests went.
+ */
+
+#define CONNPARAM_MAX_INTERVAL	200	/* ms */
+#define CONNPARAM_MAX_LATENCY	9	/* connection events */
+#define CONNPARAM_IDLE_PERIOD	1000	/* ms, the traffic assumed without any */
+#define CONNPARAM_MIN_TIMEOUT	4000	/* ms */
+#define CONNPARAM_FIRST_DELAY	5000	/* ms */
+#define CONNPARAM_DELAY		1000	/* ms */
+#define CONNPARAM_CONN_HANDLE	0	/* the S110 has one link */
+
+struct connparam_status {
+	uint16_t min_interval;	/* 1.25 ms units, the interval in effect */
+	uint16_t max_interval;	/* 1.25 ms units, the same */
+	uint16_t slave_latency;
+	uint16_t timeout;	/* 10 ms units */
+	uint16_t requests;	/* updates the softdevice took */
+	uint16_t failures;	/* updates it refused, tried again */
+} __attribute__((__packed__));
+
+void connparam_want(uint32_t period);
+void connparam_connected(void);
+void connparam_disconnected(void);
+void connparam_char_add(struct service_desc *srv);
+
+#endif /* CONNPARAM_H */
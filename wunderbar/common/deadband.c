@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "deadband.h"
+#include "config.h"
+#include "vtimer.h"
+#include "wunderbar_uuid.h"
+
+static int32_t
+channel(struct deadband *d, const uint8_t *p)
+{
+	if (d->width == 2)
+		return d->is_signed ? (int16_t)(p[0] | p[1] << 8) : (uint16_t)(p[0] | p[1] << 8);
+	return d->is_signed ? (int8_t)p[0] : p[0];
+}
+
+static bool
+moved(struct deadband *d, const uint8_t *sample)
+{
+	for (uint8_t i = 0; i < d->sample_size; i += d->width) {
+		int32_t ref = channel(d, &d->last[i]);
+		uint32_t band = (uint32_t)labs(ref) * d->config.relative / 1000;
+
+		if (band < d->config.absolute)
+			band = d->config.absolute;
+		if ((uint32_t)labs(channel(d, &sample[i]) - ref) > band)
+			return true;
+	}
+	return false;
+}
+
+bool
+deadband_pass(struct deadband *d, const void *sample)
+{
+	uint32_t now = vtimer_now();
+
+	if (d->config.absolute == 0 && d->config.relative == 0)
+		return true;
+	if (d->primed && !moved(d, sample) &&
+	    (d->config.heartbeat == 0 || now - d->sent < d->config.heartbeat))
+		return false;
+	memcpy(d->last, sample, d->sample_size);
+	d->sent = now;
+	d->primed = 1;
+	return true;
+}
+
+/* let the next sample through, e.g. for a client that just subscribed */
+void
+deadband_reset(struct deadband *d)
+{
+	d->primed = 0;
+}
+
+static void
+config_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct deadband *d = (struct deadband *)c;
+	*valp = &d->config;
+	*lenp = sizeof(d->config);
+}
+
+static void
+config_write_cb(struct service_desc *srv, struct char_desc *c, const void *val, const uint16_t len)
+{
+	struct deadband *d = (struct deadband *)c;
+
+	if (len < sizeof(d->config))
+		return;
+	memcpy(&d->config, val, sizeof(d->config));
+	deadband_reset(d);
+	config_changed();
+}
+
+void
+deadband_init(struct deadband *d, uint8_t sample_size, uint8_t width, bool is_signed)
+{
+	d->sample_size = sample_size;
+	d->width = width;
+	d->is_signed = is_signed;
+}
+
+void
+deadband_char_add(struct service_desc *srv, struct deadband *d)
+{
+	simble_srv_char_add(srv, &d->config_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_DEADBAND_CHAR,
+		u8"dead band",
+		sizeof(d->config));
+	d->config_char.read_cb = config_read_cb;
+	d->config_char.write_cb = config_write_cb;
+}
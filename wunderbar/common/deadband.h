@@ -0,0 +1,60 @@
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simble.h"
+
+/*
+ * Report on change.
+ *
+ * A dead band sits between a service's sampler and its notifications.
+ * A sample passes when any of its channels moved further than the band
+ * away from the value that passed last, or when nothing passed for
+ * `heartbeat' ms.  The half width of the band is the larger of
+ *
+ *	absolute			in raw units of the characteristic
+ *	|last value| * relative / 1000	relative in per mille
+ *
+ * Both at 0 turn the band off and every sample passes; a heartbeat of 0
+ * means no heartbeat.  The heartbeat is checked at each sample, so it
+ * fires up to one sampling period late.
+ *
+ * Samples held back still go to the history log (history.h), like any
+ * sample the client did not get.  A history block only stores its first
+ * sample's time and the sampling period, so a sample left out would
+ * shift the time of every later one in the block; and a held back
+ * sample is close to the one before it, so it costs about a byte a
+ * channel.  Notifications and history together give the full series.
+ * The "dead band" characteristic reads and writes struct
+ * deadband_config.
+ * Samples are made of channels of `width' (1 or 2) bytes, like in
+ * history.h.
+ */
+
+#define DEADBAND_MAX_SAMPLE	8	/* bytes, proximity's RGB */
+
+struct deadband_config {
+	uint16_t absolute;
+	uint16_t relative;	/* per mille */
+	uint32_t heartbeat;	/* ms */
+} __attribute__((__packed__));
+
+struct deadband {
+	struct char_desc config_char;	/* keep first, see deadband_char_add() */
+	struct deadband_config config;
+	uint8_t sample_size;
+	uint8_t width;
+	uint8_t is_signed;
+	uint8_t primed;		/* `last' holds a value that passed */
+	uint32_t sent;		/* ms, when `last' passed */
+	uint8_t last[DEADBAND_MAX_SAMPLE];
+};
+
+void deadband_init(struct deadband *d, uint8_t sample_size, uint8_t width, bool is_signed);
+void deadband_char_add(struct service_desc *srv, struct deadband *d);
+bool deadband_pass(struct deadband *d, const void *sample);
+void deadband_reset(struct deadband *d);
+
+#endif /* DEADBAND_H */
@@ -0,0 +1,72 @@
+#ifndef EVQ_H
+#define EVQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Lock free event ring for one producer and one consumer.
+ *
+ * An interrupt handler posts what it captured and returns; the consumer
+ * takes the events out later, from a context that the producer may
+ * preempt.  Only the producer writes `head' and only the consumer writes
+ * `tail', each after the slot it covers, so neither side needs a
+ * critical region.  The nRF51 has a single in-order core, so keeping the
+ * compiler from reordering the accesses is enough.
+ *
+ * A full ring drops the new event and counts it in `dropped'.
+ */
+
+#define EVQ_DEPTH	8	/* power of two */
+
+#define EVQ_BARRIER()	__asm__ volatile ("" ::: "memory")
+
+struct evq_event {
+	uint8_t type;
+	uint16_t a;
+	uint16_t b;
+};
+
+struct evq {
+	volatile uint8_t head;
+	volatile uint8_t tail;
+	uint16_t dropped;
+	struct evq_event ev[EVQ_DEPTH];
+};
+
+/* producer side */
+static inline bool
+evq_post(struct evq *q, uint8_t type, uint16_t a, uint16_t b)
+{
+	uint8_t head = q->head;
+	struct evq_event *e;
+
+	if ((uint8_t)(head - q->tail) == EVQ_DEPTH) {
+		q->dropped++;
+		return false;
+	}
+	e = &q->ev[head % EVQ_DEPTH];
+	e->type = type;
+	e->a = a;
+	e->b = b;
+	EVQ_BARRIER();
+	q->head = head + 1;
+	return true;
+}
+
+/* consumer side; false once the ring is empty */
+static inline bool
+evq_get(struct evq *q, struct evq_event *e)
+{
+	uint8_t tail = q->tail;
+
+	if (tail == q->head)
+		return false;
+	EVQ_BARRIER();
+	*e = q->ev[tail % EVQ_DEPTH];
+	EVQ_BARRIER();
+	q->tail = tail + 1;
+	return true;
+}
+
+#endif /* EVQ_H */
@@ -0,0 +1,103 @@
+#include <stddef.h>
+#include <string.h>
+
+#include <nrf.h>
+#include <nrf_soc.h>
+
+#include "flash.h"
+#include "simble.h"
+
+static void soc_evt(uint32_t evt);
+
+static struct flash_op *current;
+static struct simble_hook hook = {.soc_evt = soc_evt};
+static bool hooked;
+
+uint16_t
+flash_page_size(void)
+{
+	return NRF_FICR->CODEPAGESIZE;
+}
+
+uint32_t *
+flash_page(uint8_t n)
+{
+	uint32_t top = NRF_FICR->CODESIZE * NRF_FICR->CODEPAGESIZE;
+
+	if (n >= FLASH_RESERVED_PAGES)
+		return NULL;
+	if (NRF_UICR->BOOTLOADERADDR != 0xffffffff)
+		top = NRF_UICR->BOOTLOADERADDR;
+	return (uint32_t *)(top - (n + 1) * NRF_FICR->CODEPAGESIZE);
+}
+
+/* thread mode, from simble's event loop; the other SoC events are not ours */
+static void
+soc_evt(uint32_t evt)
+{
+	uint8_t nested;
+
+	if (evt != NRF_EVT_FLASH_OPERATION_SUCCESS &&
+	    evt != NRF_EVT_FLASH_OPERATION_ERROR)
+		return;
+	sd_nvic_critical_region_enter(&nested);
+	if (current != NULL) {
+		current->state = evt == NRF_EVT_FLASH_OPERATION_SUCCESS ?
+			FLASH_OP_DONE : FLASH_OP_FAILED;
+		task_event_signal(&current->done);
+		current = NULL;
+	}
+	sd_nvic_critical_region_exit(nested);
+}
+
+/* callers are tasks, the event loop they preempt cannot come in between */
+static void
+begin(struct flash_op *op)
+{
+	if (!hooked) {
+		simble_hook_add(&hook);
+		hooked = true;
+	}
+	task_event_clear(&op->done);
+}
+
+static bool
+started(struct flash_op *op, uint32_t err)
+{
+	if (err == NRF_SUCCESS) {
+		op->state = FLASH_OP_RUNNING;
+		current = op;
+		return true;
+	}
+	op->state = err == NRF_ERROR_BUSY ? FLASH_OP_DEFERRED : FLASH_OP_FAILED;
+	return false;
+}
+
+bool
+flash_erase(const uint32_t *page, struct flash_op *op)
+{
+	begin(op);
+	return started(op, sd_flash_page_erase((uint32_t)page / NRF_FICR->CODEPAGESIZE));
+}
+
+bool
+flash_write(uint32_t *dst, const uint32_t *src, uint16_t words, struct flash_op *op)
+{
+	begin(op);
+	return started(op, sd_flash_write(dst, src, words));
+}
+
+bool
+flash_erased(const uint32_t *page)
+{
+	for (uint16_t i = 0; i < NRF_FICR->CODEPAGESIZE / sizeof(*page); i++)
+		if (page[i] != 0xffffffff)
+			return false;
+	return true;
+}
+
+bool
+flash_written(const uint32_t *dst, const uint32_t *src, uint16_t words)
+{
+	return memcmp(dst, src, words * sizeof(*dst)) == 0;
+}
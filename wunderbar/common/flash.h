@@ -0,0 +1,69 @@
+#ifndef FLASH_H
+#define FLASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "task.h"
+
+/*
+ * Data pages at the top of the application flash, right below the
+ * bootloader when one is installed.  Page 0 is the highest one.
+ *
+ * Erase and write go through the softdevice, which fits them between
+ * radio events and reports the outcome as a SoC event.  flash.c sees
+ * the SoC events through a simble_hook, in thread mode from simble's
+ * event loop, next to whoever else wants them, and signals the task
+ * that started the operation.  The softdevice runs one
+ * operation at a time; TASK_AWAIT_FLASH() waits for a busy flash before
+ * it starts the next one.  Callers still check the flash contents with
+ * flash_erased() or flash_written() afterwards, and start the operation
+ * again if it did not happen.
+ *
+ * The pages are kept out of the image by reserve.ld.
+ */
+
+#define FLASH_RESERVED_PAGES	10
+#define FLASH_HISTORY_PAGES	8	/* pages 0..7, for history.h */
+#define FLASH_CONFIG_FIRST	8	/* two pages, for config.h */
+#define FLASH_BUSY_WAIT		5	/* ms between tries while another operation runs */
+#define FLASH_TIMEOUT		250	/* ms, radio activity can hold back an erase */
+#define FLASH_RETRIES		3
+
+enum flash_op_state {
+	FLASH_OP_IDLE,
+	FLASH_OP_RUNNING,
+	FLASH_OP_DEFERRED,	/* the flash was busy, not started */
+	FLASH_OP_DONE,
+	FLASH_OP_FAILED,
+};
+
+struct flash_op {
+	struct task_event done;
+	uint8_t state;
+};
+
+/*
+ * Start `start' (a flash_erase() or flash_write() call on `op') and
+ * await its SoC event from task `t', starting it again while the flash
+ * is busy with somebody else's operation.
+ */
+#define TASK_AWAIT_FLASH(t, op, start) \
+	do { \
+		if (start) \
+			task_wait((t), &(op)->done, FLASH_TIMEOUT); \
+		else if ((op)->state == FLASH_OP_DEFERRED) \
+			task_sleep((t), FLASH_BUSY_WAIT); \
+		else \
+			break; \
+		TASK_YIELD_POINT(t); \
+	} while ((op)->state == FLASH_OP_DEFERRED)
+
+uint32_t *flash_page(uint8_t n);
+uint16_t flash_page_size(void);
+bool flash_erase(const uint32_t *page, struct flash_op *op);
+bool flash_write(uint32_t *dst, const uint32_t *src, uint16_t words, struct flash_op *op);
+bool flash_erased(const uint32_t *page);
+bool flash_written(const uint32_t *dst, const uint32_t *src, uint16_t words);
+
+#endif /* FLASH_H */
@@ -0,0 +1,322 @@
+#include <stddef.h>
+#include <string.h>
+
+#include <nrf_soc.h>
+
+#include "history.h"
+#include "flash.h"
+#include "vtimer.h"
+#include "wunderbar_uuid.h"
+
+#define BLOCK_WORDS	(HISTORY_BLOCK_SIZE / sizeof(uint32_t))
+
+static uint16_t
+blocks_per_page(void)
+{
+	return flash_page_size() / HISTORY_BLOCK_SIZE;
+}
+
+static uint32_t
+flash_blocks(struct history *h)
+{
+	return h->flash_pages * blocks_per_page();
+}
+
+static struct history_block *
+flash_block(struct history *h, uint32_t n)
+{
+	uint32_t slot = n % flash_blocks(h);
+	uint32_t *page = flash_page(h->flash_first + slot / blocks_per_page());
+
+	return (struct history_block *)page + slot % blocks_per_page();
+}
+
+static const struct history_block *
+block(struct history *h, uint32_t n)
+{
+	if ((int32_t)(n - h->ram_head) >= 0)
+		return &h->ram[n % h->ram_blocks];
+	return flash_block(h, n);
+}
+
+/* free blocks before `n' */
+static void
+release(struct history *h, uint32_t n)
+{
+	if ((int32_t)(n - h->head) <= 0)
+		return;
+	h->head = n;
+	if ((int32_t)(h->ram_head - n) < 0)
+		h->ram_head = n;
+	if ((int32_t)(h->drain - n * HISTORY_BLOCK_SIZE) < 0)
+		h->drain = n * HISTORY_BLOCK_SIZE;
+}
+
+static bool
+must_spill(struct history *h)
+{
+	/* keep a free slot so that closing a block never has to wait */
+	return h->flash_pages != 0 && h->ram_head != h->tail &&
+		h->tail - h->ram_head + 2 >= h->ram_blocks;
+}
+
+static enum task_status
+history_task(struct task *t)
+{
+	struct history *h = (void *)((char *)t - offsetof(struct history, task));
+	const struct history_block *src;
+	uint32_t end;
+	uint8_t n;
+
+	TASK_BEGIN(t);
+	for (;;) {
+		if (must_spill(h)) {
+			h->spill = h->ram_head;
+			if (h->spill % flash_blocks(h) % blocks_per_page() == 0) {
+				/* the page we are about to erase holds the oldest blocks */
+				release(h, h->spill + blocks_per_page() - flash_blocks(h));
+				for (h->retries = 0; h->retries < FLASH_RETRIES; h->retries++) {
+					TASK_AWAIT_FLASH(t, &h->flash,
+						flash_erase((uint32_t *)flash_block(h, h->spill), &h->flash));
+					if (flash_erased((uint32_t *)flash_block(h, h->spill)))
+						break;
+				}
+				if (h->retries == FLASH_RETRIES) {
+					h->flash_pages = 0;	/* give up on the flash */
+					continue;
+				}
+			}
+			for (h->retries = 0; h->retries < FLASH_RETRIES; h->retries++) {
+				TASK_AWAIT_FLASH(t, &h->flash,
+					flash_write((uint32_t *)flash_block(h, h->spill),
+						(uint32_t *)&h->ram[h->spill % h->ram_blocks],
+						BLOCK_WORDS, &h->flash));
+				if (flash_written((uint32_t *)flash_block(h, h->spill),
+					(uint32_t *)&h->ram[h->spill % h->ram_blocks], BLOCK_WORDS))
+					break;
+			}
+			if (h->retries == FLASH_RETRIES)
+				h->flash_pages = 0;
+			else if (h->ram_head == h->spill)	/* not released meanwhile */
+				h->ram_head++;
+			continue;
+		}
+		if (!h->draining)
+			break;
+
+		/*
+		 * Chunks must not be dropped: only queue behind a free slot,
+		 * and not before the gateway subscribed.
+		 */
+		if (!h->subscribed || notify_queued(&h->txq) == HISTORY_TX_DEPTH) {
+			TASK_SLEEP(t, HISTORY_RETRY);
+			continue;
+		}
+		end = h->tail * HISTORY_BLOCK_SIZE;
+		if (h->drain == end) {
+			h->packet.offset = end;
+			notify_send(&h->txq, &h->packet, sizeof(h->packet.offset));
+			h->draining = 0;
+			continue;
+		}
+		src = block(h, h->drain / HISTORY_BLOCK_SIZE);
+		n = HISTORY_BLOCK_SIZE - h->drain % HISTORY_BLOCK_SIZE;
+		if (n > HISTORY_CHUNK)
+			n = HISTORY_CHUNK;
+		h->packet.offset = h->drain;
+		memcpy(h->packet.data, (const uint8_t *)src + h->drain % HISTORY_BLOCK_SIZE, n);
+		notify_send(&h->txq, &h->packet, sizeof(h->packet.offset) + n);
+		h->drain += n;
+	}
+	TASK_END(t);
+}
+
+static bool
+next_block(struct history *h)
+{
+	if (h->tail + 1 - h->ram_head >= h->ram_blocks) {
+		if (h->flash_pages != 0)
+			return false;	/* spill still running */
+		release(h, h->ram_head + 1);
+	}
+	h->tail++;
+	h->ram[h->tail % h->ram_blocks].count = 0;
+	if (must_spill(h))
+		task_kick(&h->task, history_task);
+	return true;
+}
+
+static uint8_t
+encode(struct history *h, const uint8_t *sample, uint8_t *out)
+{
+	uint8_t *p = out;
+
+	for (uint8_t i = 0; i < h->sample_size; i += h->width) {
+		int16_t d;
+		uint16_t z;
+
+		if (h->width == 2)
+			d = (int16_t)((sample[i] | sample[i + 1] << 8) -
+				(h->last[i] | h->last[i + 1] << 8));
+		else
+			d = (int8_t)(sample[i] - h->last[i]);
+		z = (uint16_t)(d << 1) ^ (uint16_t)(d >> 15);
+		while (z >= 0x80) {
+			*p++ = z | 0x80;
+			z >>= 7;
+		}
+		*p++ = z;
+	}
+	return p - out;
+}
+
+void
+history_add(struct history *h, const void *sample, uint32_t period)
+{
+	struct history_block *b = &h->ram[h->tail % h->ram_blocks];
+	uint8_t delta[HISTORY_MAX_SAMPLE * 2];
+	uint8_t len;
+
+	if (!h->logging)
+		return;
+	if (b->count != 0) {
+		len = encode(h, sample, delta);
+		if (b->period == period && b->count < UINT8_MAX &&
+		    b->length + len <= sizeof(b->data)) {
+			memcpy(&b->data[b->length], delta, len);
+			b->length += len;
+			b->count++;
+			goto out;
+		}
+		if (!next_block(h)) {
+			h->dropped++;
+			return;
+		}
+		b = &h->ram[h->tail % h->ram_blocks];
+	}
+	b->seq = h->seq;
+	b->time = vtimer_now();
+	b->period = period;
+	b->count = 1;
+	b->length = h->sample_size;
+	memcpy(b->data, sample, h->sample_size);
+out:
+	memcpy(h->last, sample, h->sample_size);
+	h->seq++;
+}
+
+bool
+history_logging(struct history *h)
+{
+	return h->logging;
+}
+
+void
+history_disconnected(struct history *h)
+{
+	h->draining = 0;
+	h->subscribed = 0;
+	notify_reset(&h->txq);
+}
+
+static void
+data_status_cb(struct service_desc *srv, struct char_desc *c, const int8_t status)
+{
+	struct history *h = (struct history *)c;
+
+	h->subscribed = (status & BLE_GATT_HVX_NOTIFICATION) != 0;
+}
+
+/* thread mode, under a critical region: history_add() runs from SWI3 */
+static void
+drain(struct history *h, uint32_t offset)
+{
+	/* make what was logged so far downloadable */
+	if (h->ram[h->tail % h->ram_blocks].count != 0)
+		next_block(h);
+	if ((int32_t)(offset - h->tail * HISTORY_BLOCK_SIZE) > 0)
+		offset = h->tail * HISTORY_BLOCK_SIZE;
+	release(h, offset / HISTORY_BLOCK_SIZE);
+	h->drain = offset;
+	if ((int32_t)(offset - h->head * HISTORY_BLOCK_SIZE) < 0)
+		h->drain = h->head * HISTORY_BLOCK_SIZE;
+	h->draining = 1;
+	task_kick(&h->task, history_task);
+}
+
+static void
+ctrl_write_cb(struct service_desc *srv, struct char_desc *c, const void *val, const uint16_t len)
+{
+	struct history *h = (void *)((char *)c - offsetof(struct history, ctrl_char));
+	const uint8_t *cmd = val;
+	uint32_t offset = 0;
+	uint8_t nested;
+
+	if (len >= 1 + sizeof(offset))
+		memcpy(&offset, cmd + 1, sizeof(offset));
+	sd_nvic_critical_region_enter(&nested);
+	switch (cmd[0]) {
+	case HISTORY_STOP_LOGGING:
+		h->logging = 0;
+		break;
+	case HISTORY_START_LOGGING:
+		h->logging = 1;
+		break;
+	case HISTORY_DRAIN:
+		drain(h, offset);
+		break;
+	case HISTORY_CANCEL:
+		h->draining = 0;
+		break;
+	}
+	sd_nvic_critical_region_exit(nested);
+}
+
+static void
+ctrl_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct history *h = (void *)((char *)c - offsetof(struct history, ctrl_char));
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	h->status.first = h->head * HISTORY_BLOCK_SIZE;
+	h->status.end = h->tail * HISTORY_BLOCK_SIZE;
+	h->status.seq = h->seq;
+	h->status.dropped = h->dropped;
+	h->status.logging = h->logging;
+	sd_nvic_critical_region_exit(nested);
+	*valp = &h->status;
+	*lenp = sizeof(h->status);
+}
+
+void
+history_init(struct history *h, struct history_block *ram, uint8_t ram_blocks,
+	uint8_t sample_size, uint8_t width, uint8_t flash_first, uint8_t flash_pages)
+{
+	h->ram = ram;
+	h->ram_blocks = ram_blocks;
+	h->sample_size = sample_size;
+	h->width = width;
+	h->flash_first = flash_first;
+	h->flash_pages = flash_pages;
+	h->ram[0].count = 0;
+}
+
+void
+history_char_add(struct service_desc *srv, struct history *h)
+{
+	simble_srv_char_add(srv, &h->data_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_HISTORY_CHAR,
+		u8"history",
+		sizeof(h->packet));
+	h->data_char.notify = 1;
+	h->data_char.notify_status_cb = data_status_cb;
+	notify_init(&h->txq, &h->data_char, h->tx, HISTORY_TX_DEPTH,
+		sizeof(h->packet), NOTIFY_ALL);
+	simble_srv_char_add(srv, &h->ctrl_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_HISTORY_CTRL_CHAR,
+		u8"history control",
+		sizeof(h->status));
+	h->ctrl_char.read_cb = ctrl_read_cb;
+	h->ctrl_char.write_cb = ctrl_write_cb;
+}
@@ -0,0 +1,120 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simble.h"
+#include "flash.h"
+#include "notify.h"
+#include "task.h"
+
+/*
+ * Store-and-forward sample log.
+ *
+ * While logging is on, samples that could not be notified are appended
+ * to a ring of fixed size blocks in RAM.  When the ring runs full the
+ * oldest block is spilled to the reserved flash pages (flash.h) if the
+ * module gave the history any; otherwise the oldest block is dropped.
+ * The history only lives as long as the firmware runs.
+ *
+ * Block layout, all little endian:
+ *
+ *	u32 seq		sequence number of the first sample
+ *	u32 time	ms, vtimer_now() of the first sample
+ *	u32 period	ms between samples
+ *	u8 count	samples in the block
+ *	u8 length	bytes of data used
+ *	data		first sample verbatim, then per sample and per
+ *			channel the difference to the previous value,
+ *			zigzag encoded as a base 128 varint
+ *
+ * A sample is sample_size bytes made of channels of `width' (1 or 2)
+ * bytes; differences wrap around at the channel width.
+ *
+ * The blocks form a byte stream, block n at offset n * HISTORY_BLOCK_SIZE.
+ * The gateway drains it through two characteristics:
+ *
+ *	"history" notifies { u32 offset; up to HISTORY_CHUNK bytes }
+ *	through notify_send(), as fast as the TX buffers allow.  A
+ *	notification without data marks the end of the stream.
+ *
+ *	"history control" takes { u8 cmd; u32 offset }.  HISTORY_DRAIN
+ *	frees everything before `offset' and notifies from there on, so
+ *	a gateway resumes an interrupted download with the offset it
+ *	received last.  Reading it returns struct history_status.
+ */
+
+#define HISTORY_BLOCK_SIZE	64
+#define HISTORY_MAX_SAMPLE	12	/* bytes, motion's accel + gyro */
+#define HISTORY_CHUNK		16	/* stream bytes per notification */
+#define HISTORY_RETRY		10	/* ms to wait for TX buffers */
+#define HISTORY_TX_DEPTH	2	/* chunks queued behind the softdevice */
+#define HISTORY_RAM_BLOCKS	4	/* a good size for a module's buffer */
+
+enum history_cmd {
+	HISTORY_STOP_LOGGING = 0,
+	HISTORY_START_LOGGING = 1,
+	HISTORY_DRAIN = 2,
+	HISTORY_CANCEL = 3,
+};
+
+struct history_block {
+	uint32_t seq;
+	uint32_t time;
+	uint32_t period;
+	uint8_t count;
+	uint8_t length;
+	uint8_t data[HISTORY_BLOCK_SIZE - 14];
+} __attribute__((__packed__, __aligned__(4)));
+
+struct history_packet {
+	uint32_t offset;
+	uint8_t data[HISTORY_CHUNK];
+} __attribute__((__packed__));
+
+struct history_status {
+	uint32_t first;		/* offset of the oldest block kept */
+	uint32_t end;		/* offset past the last complete block */
+	uint32_t seq;		/* next sample */
+	uint16_t dropped;	/* samples lost to a full log */
+	uint8_t logging;
+} __attribute__((__packed__));
+
+struct history {
+	struct char_desc data_char;	/* keep first, see history_char_add() */
+	struct char_desc ctrl_char;
+	struct task task;
+	struct flash_op flash;
+	struct notify_queue txq;
+	struct history_block *ram;
+	uint8_t ram_blocks;
+	uint8_t flash_first;	/* reserved flash page, see flash.h */
+	uint8_t flash_pages;
+	uint8_t sample_size;
+	uint8_t width;
+	uint8_t logging;
+	uint8_t draining;
+	uint8_t subscribed;	/* to "history" */
+	uint8_t retries;
+	uint32_t head;		/* oldest block kept */
+	uint32_t ram_head;	/* oldest block still in RAM */
+	uint32_t tail;		/* block being filled */
+	uint32_t spill;		/* block being written to flash */
+	uint32_t seq;
+	uint32_t drain;		/* offset of the next notification */
+	uint16_t dropped;
+	uint8_t last[HISTORY_MAX_SAMPLE];
+	struct history_packet packet;
+	struct history_status status;
+	uint8_t tx[NOTIFY_SLOTS(HISTORY_TX_DEPTH, sizeof(struct history_packet))];
+};
+
+void history_init(struct history *h, struct history_block *ram, uint8_t ram_blocks,
+	uint8_t sample_size, uint8_t width, uint8_t flash_first, uint8_t flash_pages);
+void history_char_add(struct service_desc *srv, struct history *h);
+void history_add(struct history *h, const void *sample, uint32_t period);
+bool history_logging(struct history *h);
+void history_disconnected(struct history *h);
+
+#endif /* HISTORY_H */
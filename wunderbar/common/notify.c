@@ -0,0 +1,166 @@
+#include <stddef.h>
+#include <string.h>
+
+#include <nrf_soc.h>
+#include <ble.h>
+
+#include "notify.h"
+#include "wunderbar_uuid.h"
+
+static void ble_evt(ble_evt_t *evt);
+static void idle(void);
+
+static struct notify_queue *waiting;
+static bool tx_full;		/* no TX buffer left until the next TX_COMPLETE */
+static struct simble_hook hook = {.ble_evt = ble_evt, .idle = idle};
+static bool hooked;
+
+/* all queue manipulation below runs inside a critical region */
+
+static uint8_t *
+slot(struct notify_queue *q, uint8_t i)
+{
+	return &q->slots[(q->head + i) % q->depth * (q->slot_size + 1)];
+}
+
+static void
+push(struct notify_queue *q, const void *val, uint8_t len)
+{
+	uint8_t *s;
+
+	if (len > q->slot_size)
+		len = q->slot_size;
+	if (q->count == q->depth) {
+		q->head = (q->head + 1) % q->depth;
+		q->count--;
+		q->stats.dropped++;
+	}
+	s = slot(q, q->count);
+	s[0] = len;
+	memcpy(s + 1, val, len);
+	q->count++;
+	if (q->count > q->stats.high_water)
+		q->stats.high_water = q->count;
+	if (!q->waiting) {
+		q->waiting = 1;
+		q->next = waiting;
+		waiting = q;
+	}
+}
+
+/* send queued values in order; false if the softdevice ran full */
+static bool
+drain(struct notify_queue *q)
+{
+	while (q->count != 0) {
+		uint8_t *s = slot(q, 0);
+
+		if (simble_srv_char_notify(q->c, false, s[0], s + 1) == BLE_ERROR_NO_TX_BUFFERS) {
+			q->stats.retries++;
+			tx_full = true;
+			return false;
+		}
+		/* sent, or the client went away: the value is done either way */
+		q->head = (q->head + 1) % q->depth;
+		q->count--;
+	}
+	return true;
+}
+
+static void
+unlink(struct notify_queue *q)
+{
+	for (struct notify_queue **p = &waiting; *p != NULL; p = &(*p)->next) {
+		if (*p == q) {
+			*p = q->next;
+			break;
+		}
+	}
+	q->waiting = 0;
+}
+
+/* buffers came free; idle() sends on */
+static void
+ble_evt(ble_evt_t *evt)
+{
+	if (evt->header.evt_id == BLE_EVT_TX_COMPLETE ||
+	    evt->header.evt_id == BLE_GAP_EVT_DISCONNECTED)
+		tx_full = false;
+}
+
+/* thread mode, each time simble's event loop wakes up */
+static void
+idle(void)
+{
+	uint8_t nested;
+
+	if (tx_full)
+		return;
+	sd_nvic_critical_region_enter(&nested);
+	while (waiting != NULL && drain(waiting))
+		unlink(waiting);
+	sd_nvic_critical_region_exit(nested);
+}
+
+void
+notify_send(struct notify_queue *q, const void *val, uint8_t len)
+{
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	push(q, val, len);
+	sd_nvic_critical_region_exit(nested);
+}
+
+/* values waiting for TX buffers */
+uint8_t
+notify_queued(struct notify_queue *q)
+{
+	return q->count;
+}
+
+void
+notify_reset(struct notify_queue *q)
+{
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	q->count = 0;
+	if (q->waiting)
+		unlink(q);
+	sd_nvic_critical_region_exit(nested);
+}
+
+void
+notify_init(struct notify_queue *q, struct char_desc *c, uint8_t *slots,
+	uint8_t depth, uint8_t slot_size, enum notify_policy policy)
+{
+	q->c = c;
+	q->slots = slots;
+	q->slot_size = slot_size;
+	q->depth = policy == NOTIFY_NEWEST ? 1 : depth;
+	q->policy = policy;
+	q->stats.depth = q->depth;
+	if (!hooked) {
+		simble_hook_add(&hook);
+		hooked = true;
+	}
+}
+
+static void
+stats_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct notify_queue *q = (struct notify_queue *)c;
+	*valp = &q->stats;
+	*lenp = sizeof(q->stats);
+}
+
+void
+notify_char_add(struct service_desc *srv, struct notify_queue *q)
+{
+	simble_srv_char_add(srv, &q->stats_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_TX_STATS_CHAR,
+		u8"tx stats",
+		sizeof(q->stats));
+	q->stats_char.read_cb = stats_read_cb;
+}
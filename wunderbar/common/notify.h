@@ -0,0 +1,62 @@
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simble.h"
+
+/*
+ * Notifications that survive a full softdevice TX queue.
+ *
+ * notify_send() only puts the value into the queue of that
+ * characteristic, so interrupt handlers and tasks can call it without
+ * touching the BLE stack.  simble's event loop sends the queues on in
+ * thread mode each time it wakes up, which is right after the handler
+ * that queued returns.  When all TX buffers are taken the rest waits
+ * until BLE_EVT_TX_COMPLETE reports buffers free again.  The caller
+ * knows whether its client subscribed: a value queued without one is
+ * dropped when its turn comes.
+ *
+ * NOTIFY_NEWEST keeps one slot and replaces what is in there: right for
+ * slow sensors where only the current value matters.  NOTIFY_ALL keeps
+ * every value, up to the queue depth, and drops the oldest beyond that.
+ */
+
+enum notify_policy {
+	NOTIFY_NEWEST,
+	NOTIFY_ALL,
+};
+
+/* queue storage for `depth' values of up to `size' bytes */
+#define NOTIFY_SLOTS(depth, size)	((depth) * ((size) + 1))
+
+struct notify_stats {
+	uint16_t dropped;	/* values lost to a full queue */
+	uint16_t retries;	/* sends that found no free TX buffer */
+	uint8_t high_water;	/* most values queued at once */
+	uint8_t depth;
+} __attribute__((__packed__));
+
+struct notify_queue {
+	struct char_desc stats_char;	/* keep first, see notify_char_add() */
+	struct notify_queue *next;	/* queues waiting for TX buffers */
+	struct char_desc *c;
+	uint8_t *slots;
+	uint8_t slot_size;
+	uint8_t depth;
+	uint8_t policy;
+	uint8_t head;
+	uint8_t count;
+	uint8_t waiting;
+	struct notify_stats stats;
+};
+
+void notify_init(struct notify_queue *q, struct char_desc *c, uint8_t *slots,
+	uint8_t depth, uint8_t slot_size, enum notify_policy policy);
+void notify_send(struct notify_queue *q, const void *val, uint8_t len);
+uint8_t notify_queued(struct notify_queue *q);
+void notify_reset(struct notify_queue *q);
+void notify_char_add(struct service_desc *srv, struct notify_queue *q);
+
+#endif /* NOTIFY_H */
@@ -0,0 +1,95 @@
+#include <stddef.h>
+
+#include "power.h"
+#include "wunderbar_uuid.h"
+
+static struct power_domain *domains;
+static struct char_desc power_char;
+static struct power_stats power_report[POWER_MAX_DOMAINS];
+
+static void
+power_off(struct power_domain *d)
+{
+	d->set(false);
+	d->on = 0;
+	d->stats.on_time += vtimer_now() - d->since;
+}
+
+static void
+power_linger_cb(struct vtimer *t)
+{
+	struct power_domain *d = (struct power_domain *)t;
+
+	if (d->users == 0 && d->on)
+		power_off(d);
+}
+
+/* ms until the domain is usable */
+uint32_t
+power_get(struct power_domain *d)
+{
+	uint32_t up;
+
+	d->users++;
+	vtimer_stop(&d->linger_timer);
+	if (!d->on) {
+		d->set(true);
+		d->on = 1;
+		d->since = vtimer_now();
+		d->stats.switches++;
+	}
+	up = vtimer_now() - d->since;
+	return up < d->settle ? d->settle - up : 0;
+}
+
+void
+power_put(struct power_domain *d)
+{
+	if (d->users == 0 || --d->users != 0)
+		return;
+	if (d->linger == 0)
+		power_off(d);
+	else
+		vtimer_start(&d->linger_timer, d->linger, 0);
+}
+
+/* starts off */
+void
+power_init(struct power_domain *d, power_switch_t *set, uint16_t settle, uint16_t linger)
+{
+	struct power_domain **p;
+
+	d->set = set;
+	d->settle = settle;
+	d->linger = linger;
+	d->linger_timer.cb = power_linger_cb;
+	d->set(false);
+	for (p = &domains; *p != NULL; p = &(*p)->next)
+		;
+	*p = d;
+}
+
+static void
+power_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	uint8_t n = 0;
+
+	for (struct power_domain *d = domains; d != NULL && n < POWER_MAX_DOMAINS; d = d->next) {
+		power_report[n] = d->stats;
+		if (d->on)
+			power_report[n].on_time += vtimer_now() - d->since;
+		n++;
+	}
+	*valp = power_report;
+	*lenp = n * sizeof(power_report[0]);
+}
+
+void
+power_char_add(struct service_desc *srv)
+{
+	simble_srv_char_add(srv, &power_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_POWER_CHAR,
+		u8"power",
+		sizeof(power_report));
+	power_char.read_cb = power_read_cb;
+}
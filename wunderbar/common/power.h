@@ -0,0 +1,61 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simble.h"
+#include "vtimer.h"
+#include "task.h"
+
+/*
+ * Reference counted power domains.
+ *
+ * A domain is hardware that users switch on around their work: the I2C
+ * bus and the sensor behind it, an analog front end, an LED.  The
+ * first power_get() switches it on and returns the ms it still needs
+ * to settle; power_put() from the last user starts the linger time,
+ * and only when no user came back by then does the domain go off.  A
+ * linger about as long as the settle time costs at most what one more
+ * power up would.
+ *
+ * "power" (power_char_add()) returns struct power_stats for every
+ * domain, in the order they were initialised.  Users run at
+ * NRF_APP_PRIORITY_LOW, like the linger timer.
+ */
+
+#define POWER_MAX_DOMAINS	3
+
+typedef void (power_switch_t)(bool on);
+
+struct power_stats {
+	uint32_t on_time;	/* ms */
+	uint16_t switches;	/* times switched on */
+} __attribute__((__packed__));
+
+struct power_domain {
+	struct vtimer linger_timer;	/* keep first, see power_linger_cb() */
+	struct power_domain *next;
+	power_switch_t *set;
+	uint16_t settle;	/* ms from on until usable */
+	uint16_t linger;	/* ms kept on after the last user */
+	uint8_t users;
+	uint8_t on;
+	uint32_t since;		/* vtimer_now() when it switched on */
+	struct power_stats stats;
+};
+
+/* power_get() from task `t', resuming once the domain has settled */
+#define TASK_POWER_GET(t, d) \
+	do { \
+		uint32_t settle_ = power_get(d); \
+		if (settle_ != 0) \
+			TASK_SLEEP((t), settle_); \
+	} while (0)
+
+void power_init(struct power_domain *d, power_switch_t *set, uint16_t settle, uint16_t linger);
+uint32_t power_get(struct power_domain *d);
+void power_put(struct power_domain *d);
+void power_char_add(struct service_desc *srv);
+
+#endif /* POWER_H */
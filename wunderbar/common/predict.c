@@ -0,0 +1,108 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "predict.h"
+#include "config.h"
+#include "vtimer.h"
+#include "wunderbar_uuid.h"
+
+static int32_t
+predicted(struct predict *p, uint32_t now)
+{
+	return p->model.value +
+		(int64_t)p->model.slope * (int32_t)(now - p->model.time) / PREDICT_ONE;
+}
+
+void
+predict_add(struct predict *p, int32_t value)
+{
+	uint32_t now = vtimer_now();
+	int32_t dt = now - p->model.time;
+	int64_t slope = 0;
+
+	if (p->primed && labs(value - predicted(p, now)) <= p->bound)
+		return;
+	if (p->primed && dt > 0)
+		slope = (int64_t)(value - p->model.value) * PREDICT_ONE / dt;
+	if (slope > INT32_MAX)
+		slope = INT32_MAX;
+	else if (slope < INT32_MIN)
+		slope = INT32_MIN;
+	p->model.slope = slope;
+	p->model.time = now;
+	p->model.value = value;
+	p->primed = 1;
+	notify_send(&p->txq, &p->model, sizeof(p->model));
+}
+
+bool
+predict_enabled(struct predict *p)
+{
+	return p->subscribed && p->bound != 0;
+}
+
+void
+predict_disconnected(struct predict *p)
+{
+	notify_reset(&p->txq);
+	p->subscribed = 0;
+	p->primed = 0;
+}
+
+static void
+model_status_cb(struct service_desc *srv, struct char_desc *c, const int8_t status)
+{
+	struct predict *p = (struct predict *)c;
+
+	p->subscribed = (status & BLE_GATT_HVX_NOTIFICATION) != 0;
+	p->primed = 0;
+	if (p->status_cb != NULL)
+		p->status_cb(srv, c, status);
+}
+
+static void
+bound_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct predict *p = (void *)((char *)c - offsetof(struct predict, bound_char));
+	*valp = &p->bound;
+	*lenp = sizeof(p->bound);
+}
+
+static void
+bound_write_cb(struct service_desc *srv, struct char_desc *c, const void *val, const uint16_t len)
+{
+	struct predict *p = (void *)((char *)c - offsetof(struct predict, bound_char));
+
+	if (len < sizeof(p->bound))
+		return;
+	memcpy(&p->bound, val, sizeof(p->bound));
+	p->primed = 0;
+	config_changed();
+}
+
+void
+predict_init(struct predict *p, predict_status_cb_t *status_cb)
+{
+	p->status_cb = status_cb;
+	notify_init(&p->txq, &p->model_char, p->tx_slots, 1,
+		sizeof(p->model), NOTIFY_NEWEST);
+}
+
+void
+predict_char_add(struct service_desc *srv, struct predict *p)
+{
+	simble_srv_char_add(srv, &p->model_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_PREDICT_CHAR,
+		u8"prediction",
+		sizeof(p->model));
+	p->model_char.notify = 1;
+	p->model_char.notify_status_cb = model_status_cb;
+	simble_srv_char_add(srv, &p->bound_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_PREDICT_BOUND_CHAR,
+		u8"prediction bound",
+		sizeof(p->bound));
+	p->bound_char.read_cb = bound_read_cb;
+	p->bound_char.write_cb = bound_write_cb;
+}
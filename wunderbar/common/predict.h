@@ -0,0 +1,59 @@
+#ifndef PREDICT_H
+#define PREDICT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simble.h"
+#include "notify.h"
+
+/*
+ * Dual prediction for slowly drifting values.
+ *
+ * Device and gateway run the same linear model.  The gateway computes
+ * the value at device time t as
+ *
+ *	value + slope * (t - time) / 65536000
+ *
+ * in 64 bit integers, dividing towards zero: slope is in raw units per
+ * second, 16.16 fixed point.  As long as every sample stays within
+ * `bound' raw units of that prediction nothing is sent.  A sample that
+ * does not becomes the new anchor and the slope is refit from the old
+ * anchor to it; the new struct predict_model is notified on the
+ * "prediction" characteristic.  The first sample after subscribing is
+ * sent with a slope of 0.
+ *
+ * "prediction bound" reads and writes the u16 bound; 0, the default,
+ * turns prediction off.  While it is on and a client subscribed to
+ * "prediction", the service sends no plain notifications.
+ */
+
+#define PREDICT_ONE	(65536LL * 1000)	/* slope of 1 unit per ms */
+
+struct predict_model {
+	uint32_t time;		/* ms, vtimer_now() of the anchor sample */
+	int32_t value;		/* the anchor sample */
+	int32_t slope;		/* units per s, 16.16 */
+} __attribute__((__packed__));
+
+typedef void (predict_status_cb_t)(struct service_desc *s, struct char_desc *c, const int8_t status);
+
+struct predict {
+	struct char_desc model_char;	/* keep first, see predict_char_add() */
+	struct char_desc bound_char;
+	predict_status_cb_t *status_cb;
+	uint8_t subscribed;
+	uint8_t primed;		/* model holds an anchor */
+	uint16_t bound;
+	struct predict_model model;
+	struct notify_queue txq;
+	uint8_t tx_slots[NOTIFY_SLOTS(1, sizeof(struct predict_model))];
+};
+
+void predict_init(struct predict *p, predict_status_cb_t *status_cb);
+void predict_char_add(struct service_desc *srv, struct predict *p);
+bool predict_enabled(struct predict *p);
+void predict_add(struct predict *p, int32_t value);
+void predict_disconnected(struct predict *p);
+
+#endif /* PREDICT_H */
@@ -0,0 +1,133 @@
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "sampler.h"
+#include "wunderbar_uuid.h"
+
+enum sampler_state {
+	SAMPLER_IDLE = 0,
+	SAMPLER_WARMUP,		/* waiting to start the acquisition */
+	SAMPLER_ACQUIRING,	/* acquisition running, tick ahead */
+	SAMPLER_LATE,		/* tick passed, sample still missing */
+};
+
+static void sampler_timer_cb(struct vtimer *t);
+
+static void
+arm(struct sampler *s, uint32_t at, uint16_t slack, uint32_t now)
+{
+	int32_t delay = at - now;
+	s->timer.slack = slack;
+	vtimer_start(&s->timer, delay > 0 ? delay : 0, 0);
+}
+
+static void
+schedule_acquisition(struct sampler *s, uint32_t now)
+{
+	uint32_t lead = s->latency + SAMPLER_SLACK;
+	if (lead > s->period)
+		lead = s->period;
+	s->state = SAMPLER_WARMUP;
+	arm(s, s->tick - lead, SAMPLER_SLACK, now);
+}
+
+static void
+deliver(struct sampler *s)
+{
+	uint32_t now = vtimer_now();
+	int32_t error = now - s->tick;
+
+	s->stats.last_error = error;
+	if ((uint32_t)abs(error) > s->stats.max_error)
+		s->stats.max_error = abs(error);
+	if (error > 0)
+		s->stats.late++;
+	s->deliver(s);
+
+	s->tick += s->period;
+	if ((int32_t)(s->tick - now) <= 0)	/* overran, skip the missed ticks */
+		s->tick = now + s->period;
+	schedule_acquisition(s, now);
+}
+
+static void
+sampler_timer_cb(struct vtimer *t)
+{
+	struct sampler *s = (void *)((char *)t - offsetof(struct sampler, timer));
+
+	switch (s->state) {
+	case SAMPLER_WARMUP:
+		s->state = SAMPLER_ACQUIRING;
+		s->ready = 0;
+		arm(s, s->tick, 0, vtimer_now());
+		s->acquire(s);
+		break;
+	case SAMPLER_ACQUIRING:
+		if (s->ready)
+			deliver(s);
+		else
+			s->state = SAMPLER_LATE;
+		break;
+	default:
+		break;
+	}
+}
+
+void
+sampler_ready(struct sampler *s)
+{
+	s->ready = 1;
+	if (s->state == SAMPLER_LATE)
+		deliver(s);
+}
+
+void
+sampler_init(struct sampler *s, uint16_t latency, sampler_cb_t *acquire, sampler_cb_t *deliver)
+{
+	s->latency = latency;
+	s->acquire = acquire;
+	s->deliver = deliver;
+	s->timer.cb = sampler_timer_cb;
+	s->state = SAMPLER_IDLE;
+}
+
+void
+sampler_start(struct sampler *s, uint32_t period)
+{
+	uint32_t now = vtimer_now();
+
+	s->period = period;
+	s->tick = now + period;
+	schedule_acquisition(s, now);
+}
+
+void
+sampler_stop(struct sampler *s)
+{
+	vtimer_stop(&s->timer);
+	s->state = SAMPLER_IDLE;
+}
+
+bool
+sampler_running(struct sampler *s)
+{
+	return s->state != SAMPLER_IDLE;
+}
+
+static void
+stats_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct sampler *s = (struct sampler *)c;
+	*valp = &s->stats;
+	*lenp = sizeof(s->stats);
+}
+
+void
+sampler_char_add(struct service_desc *srv, struct sampler *s)
+{
+	simble_srv_char_add(srv, &s->stats_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_DEADLINE_ERROR_CHAR,
+		u8"deadline error",
+		sizeof(s->stats));
+	s->stats_char.read_cb = stats_read_cb;
+}
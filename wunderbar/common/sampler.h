@@ -0,0 +1,55 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simble.h"
+#include "vtimer.h"
+
+/*
+ * Pipelined periodic sampling.
+ *
+ * A sensor declares its warm-up + conversion latency; the sampler calls
+ * acquire() that far ahead of each sampling tick, so that deliver() can
+ * send the notification on the tick itself.  acquire() may finish
+ * synchronously or later on; either way it reports the sample with
+ * sampler_ready().  If the sample is not there by the tick, delivery
+ * happens as soon as it is and the miss is counted.
+ *
+ * The deadline error of every delivery is kept in the sampler and can be
+ * exposed with sampler_char_add().
+ */
+
+#define SAMPLER_SLACK	10	/* ms an acquisition may start late */
+
+struct sampler;
+typedef void (sampler_cb_t)(struct sampler *s);
+
+struct sampler_stats {
+	int16_t last_error;	/* ms, delivery time - sampling tick */
+	uint16_t max_error;	/* ms, largest absolute error seen */
+	uint16_t late;		/* deliveries that missed their tick */
+} __attribute__((__packed__));
+
+struct sampler {
+	struct char_desc stats_char;	/* keep first, see sampler_char_add() */
+	struct vtimer timer;
+	uint32_t tick;		/* ms, the next sampling tick */
+	uint32_t period;
+	uint16_t latency;	/* ms, warm-up + conversion */
+	uint8_t state;
+	uint8_t ready;
+	sampler_cb_t *acquire;
+	sampler_cb_t *deliver;
+	struct sampler_stats stats;
+};
+
+void sampler_init(struct sampler *s, uint16_t latency, sampler_cb_t *acquire, sampler_cb_t *deliver);
+void sampler_start(struct sampler *s, uint32_t period);
+void sampler_stop(struct sampler *s);
+bool sampler_running(struct sampler *s);
+void sampler_ready(struct sampler *s);
+void sampler_char_add(struct service_desc *srv, struct sampler *s);
+
+#endif /* SAMPLER_H */
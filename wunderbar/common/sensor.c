@@ -0,0 +1,398 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "sensor.h"
+#include "broadcast.h"
+#include "power.h"
+#include "connparam.h"
+#include "wunderbar_uuid.h"
+
+static struct sensor *sensors;
+
+static struct sensor *
+sensor_of(struct sampler *sm)
+{
+	return (void *)((char *)sm - offsetof(struct sensor, sampler));
+}
+
+/* the value as one number, for the scalar only features */
+static int32_t
+scalar(struct sensor *s)
+{
+	const struct sensor_desc *d = s->desc;
+	const uint8_t *p = d->value;
+
+	if (d->width == 2)
+		return d->is_signed ? (int16_t)(p[0] | p[1] << 8) : (uint16_t)(p[0] | p[1] << 8);
+	return d->is_signed ? (int8_t)p[0] : p[0];
+}
+
+/* the sampling period in effect, see sensor.h */
+uint32_t
+sensor_period(struct sensor *s)
+{
+	uint32_t min = SENSOR_MIN_PERIOD;
+
+	if (s->desc->batch_min_period != 0 && (batch_enabled(&s->batch) || s->bulk))
+		min = s->desc->batch_min_period;
+	return s->sampling_period > min ? s->sampling_period : min;
+}
+
+/* ms between the notifications of all running channels, 0 for none */
+static uint32_t
+traffic(void)
+{
+	uint32_t min = 0;
+
+	for (struct sensor *s = sensors; s != NULL; s = s->next) {
+		uint32_t period;
+
+		if (!sampler_running(&s->sampler))
+			continue;
+		period = sensor_period(s);
+		if (batch_enabled(&s->batch)) {
+			/* a batch goes out when full or max_latency after its first sample */
+			uint32_t full = period * (BATCH_PAYLOAD / (s->desc->size + BATCH_TIME_SIZE));
+			uint32_t latency = s->batch.format.max_latency;
+
+			period = latency != 0 && latency < full ? latency : full;
+		}
+		if (min == 0 || period < min)
+			min = period;
+	}
+	return min;
+}
+
+static void
+start(struct sensor *s)
+{
+	sampler_start(&s->sampler, sensor_period(s));
+	connparam_want(traffic());
+}
+
+static void
+stop(struct sensor *s)
+{
+	sampler_stop(&s->sampler);
+	connparam_want(traffic());
+}
+
+/* stop sampling unless somebody still takes the samples */
+static void
+release(struct sensor *s)
+{
+	if (s->subscribers == 0 && !sensor_active(s))
+		stop(s);
+}
+
+static void
+sensor_acquire(struct sampler *sm)
+{
+	struct sensor *s = sensor_of(sm);
+
+	s->desc->acquire(s);
+}
+
+static void
+sensor_deliver(struct sampler *sm)
+{
+	struct sensor *s = sensor_of(sm);
+	const struct sensor_desc *d = s->desc;
+
+	if (d->deliver != NULL)
+		d->deliver(s);
+	else
+		broadcast_update(d->value, d->size);
+	if (d->stats != NULL)
+		stats_add(d->stats, scalar(s));
+	if (d->predict != NULL && predict_enabled(d->predict))
+		predict_add(d->predict, scalar(s));
+	else if (d->deadband != NULL && !deadband_pass(d->deadband, d->value))
+		history_add(&s->history, d->value, sensor_period(s));
+	else if (batch_enabled(&s->batch))
+		batch_add(&s->batch, d->value);
+	else if (s->subscribers & SENSOR_SUB_VALUE)
+		notify_send(&s->txq, d->value, d->size);
+	else
+		history_add(&s->history, d->value, sensor_period(s));
+}
+
+void
+sensor_ready(struct sensor *s, bool ok)
+{
+	if (ok) {
+		s->sampled = vtimer_now();
+		s->cached = 1;
+		/* value_read_cb() answers reads from here, no GATT update */
+		seqlock_write(&s->latest, s->desc->value, s->desc->size);
+	}
+	sampler_ready(&s->sampler);
+}
+
+/* the last sample is at most max_age old */
+static bool
+fresh(struct sensor *s)
+{
+	return s->cached && s->max_age != 0 && vtimer_now() - s->sampled <= s->max_age;
+}
+
+bool
+sensor_active(struct sensor *s)
+{
+	return history_logging(&s->history) || broadcast_enabled();
+}
+
+void
+sensor_broadcast_cb(bool enabled)
+{
+	for (struct sensor *s = sensors; s != NULL; s = s->next) {
+		if (enabled)
+			start(s);
+		else
+			release(s);
+	}
+}
+
+static void
+sensor_connected(struct service_desc *srv)
+{
+	struct sensor *s = (struct sensor *)srv;
+
+	broadcast_connected();
+	connparam_connected();
+	connparam_want(traffic());
+	if (s->desc->connect != NULL)
+		s->desc->connect(s);
+}
+
+static void
+sensor_disconnected(struct service_desc *srv)
+{
+	struct sensor *s = (struct sensor *)srv;
+	const struct sensor_desc *d = s->desc;
+
+	broadcast_disconnected();
+	connparam_disconnected();
+	batch_disconnected(&s->batch);
+	notify_reset(&s->txq);
+	if (d->deadband != NULL)
+		deadband_reset(d->deadband);
+	if (d->stats != NULL)
+		stats_disconnected(d->stats);
+	if (d->predict != NULL)
+		predict_disconnected(d->predict);
+	history_disconnected(&s->history);
+	s->subscribers = 0;
+	if (sensor_active(s))
+		start(s);
+	else
+		stop(s);
+	if (d->disconnect != NULL)
+		d->disconnect(s);
+}
+
+static void
+value_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct sensor *s = (struct sensor *)srv;
+	const struct sensor_desc *d = s->desc;
+
+	/*
+	 * A stale sample still answers: waiting here would hold up the
+	 * GATT read.  The new one is on its way for the next read and for
+	 * subscribers.
+	 */
+	if (!fresh(s))
+		d->acquire(s);
+	/* nothing measured yet: an empty value rather than zeros */
+	if (!s->cached) {
+		*lenp = 0;
+		return;
+	}
+	/* the task may be filling in the next sample already */
+	seqlock_read(&s->latest, s->snapshot, d->size);
+	*valp = s->snapshot;
+	*lenp = d->size;
+}
+
+static uint8_t
+subscriber(struct sensor *s, struct char_desc *c)
+{
+	const struct sensor_desc *d = s->desc;
+
+	if (c == &s->value_char)
+		return SENSOR_SUB_VALUE;
+	if (c == &s->batch.data_char)
+		return SENSOR_SUB_BATCH;
+	if (d->stats != NULL && c == &d->stats->report_char)
+		return SENSOR_SUB_STATS;
+	if (d->predict != NULL && c == &d->predict->model_char)
+		return SENSOR_SUB_PREDICT;
+	return SENSOR_SUB_MODULE;
+}
+
+/* for the value characteristic and everything else a client subscribes to */
+void
+sensor_status_cb(struct service_desc *srv, struct char_desc *c, const int8_t status)
+{
+	struct sensor *s = (struct sensor *)srv;
+
+	if (status & BLE_GATT_HVX_NOTIFICATION) {
+		if (s->desc->deadband != NULL)
+			deadband_reset(s->desc->deadband);
+		s->subscribers |= subscriber(s, c);
+		start(s);
+	} else {
+		s->subscribers &= ~subscriber(s, c);
+		release(s);
+	}
+}
+
+static void
+period_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct sensor *s = (struct sensor *)srv;
+	*valp = &s->sampling_period;
+	*lenp = sizeof(s->sampling_period);
+}
+
+static void
+period_write_cb(struct service_desc *srv, struct char_desc *c,
+	const void *val, const uint16_t len)
+{
+	struct sensor *s = (struct sensor *)srv;
+	uint32_t period = 0;
+
+	/* the format says uint24, take what the client wrote */
+	memcpy(&period, val, len < sizeof(period) ? len : sizeof(period));
+	s->sampling_period = period > SENSOR_MIN_BATCH_PERIOD ? period : SENSOR_MIN_BATCH_PERIOD;
+	start(s);
+	config_changed();
+}
+
+static void
+max_age_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct sensor *s = (struct sensor *)srv;
+	*valp = &s->max_age;
+	*lenp = sizeof(s->max_age);
+}
+
+static void
+max_age_write_cb(struct service_desc *srv, struct char_desc *c,
+	const void *val, const uint16_t len)
+{
+	struct sensor *s = (struct sensor *)srv;
+	uint32_t max_age = 0;
+
+	memcpy(&max_age, val, len < sizeof(max_age) ? len : sizeof(max_age));
+	s->max_age = max_age;
+	config_changed();
+}
+
+static void
+keep(struct sensor *s, enum sensor_config n, void *val, uint8_t size)
+{
+	config_add(&s->config[n], CONFIG_KEY(CONFIG_OWNER_SENSOR + s->index, n), val, size);
+}
+
+/* setting `n' of the module, loaded into `val' if it was stored */
+bool
+sensor_config_add(struct sensor *s, struct config_item *it, uint8_t n,
+	void *val, uint8_t size)
+{
+	return config_add(it, CONFIG_KEY(CONFIG_OWNER_SENSOR + s->index,
+		SENSOR_CONFIG_MODULE + n), val, size);
+}
+
+/* after the parts set their defaults */
+static void
+restore(struct sensor *s)
+{
+	const struct sensor_desc *d = s->desc;
+
+	keep(s, SENSOR_CONFIG_PERIOD, &s->sampling_period, sizeof(s->sampling_period));
+	keep(s, SENSOR_CONFIG_MAX_AGE, &s->max_age, sizeof(s->max_age));
+	keep(s, SENSOR_CONFIG_BATCH, &s->batch.format.max_latency,
+		sizeof(s->batch.format.max_latency));
+	if (d->deadband != NULL)
+		keep(s, SENSOR_CONFIG_DEADBAND, &d->deadband->config, sizeof(d->deadband->config));
+	if (d->stats != NULL)
+		keep(s, SENSOR_CONFIG_STATS, &d->stats->window, sizeof(d->stats->window));
+	if (d->predict != NULL)
+		keep(s, SENSOR_CONFIG_PREDICT, &d->predict->bound, sizeof(d->predict->bound));
+}
+
+void
+sensor_init(struct sensor *s, const struct sensor_desc *d)
+{
+	s->desc = d;
+	s->sampling_period = SENSOR_DEFAULT_PERIOD;
+	s->max_age = SENSOR_DEFAULT_MAX_AGE;
+	s->index = sensors != NULL ? sensors->index + 1 : 0;
+	s->next = sensors;
+	sensors = s;
+
+	simble_srv_init(s, simble_get_vendor_uuid_class(), d->service_uuid);
+	simble_srv_char_add(s, &s->value_char,
+		simble_get_vendor_uuid_class(), d->char_uuid,
+		d->name,
+		d->size);
+	if (d->format != 0)
+		simble_srv_char_attach_format(&s->value_char, d->format, 0, d->unit);
+	s->value_char.read_cb = value_read_cb;
+	s->value_char.notify = 1;
+	s->value_char.notify_status_cb = sensor_status_cb;
+	simble_srv_char_add(s, &s->period_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_SAMPLING_PERIOD_CHAR,
+		u8"sampling period",
+		sizeof(s->sampling_period));
+	/* resolution 1 ms, up to 16777216 (4 hours) */
+	simble_srv_char_attach_format(&s->period_char,
+		BLE_GATT_CPF_FORMAT_UINT24, 0, ORG_BLUETOOTH_UNIT_UNITLESS);
+	s->period_char.read_cb = period_read_cb;
+	s->period_char.write_cb = period_write_cb;
+	simble_srv_char_add(s, &s->max_age_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_MAX_AGE_CHAR,
+		u8"max age",
+		sizeof(s->max_age));
+	s->max_age_char.read_cb = max_age_read_cb;
+	s->max_age_char.write_cb = max_age_write_cb;
+	s->connect_cb = sensor_connected;
+	s->disconnect_cb = sensor_disconnected;
+
+	sampler_init(&s->sampler, d->latency, sensor_acquire, sensor_deliver);
+	sampler_char_add(s, &s->sampler);
+	history_init(&s->history, d->log, HISTORY_RAM_BLOCKS,
+		d->size, d->width, d->flash_first, d->flash_pages);
+	history_char_add(s, &s->history);
+	batch_init(&s->batch, d->size, sensor_status_cb);
+	/* left out, batch_enabled() stays false */
+	if (BATCH_FITS(d->size))
+		batch_char_add(s, &s->batch);
+	if (d->deadband != NULL) {
+		deadband_init(d->deadband, d->size, d->width, d->is_signed);
+		deadband_char_add(s, d->deadband);
+	}
+	if (d->stats != NULL) {
+		stats_init(d->stats, sensor_status_cb);
+		stats_char_add(s, d->stats);
+	}
+	if (d->predict != NULL) {
+		predict_init(d->predict, sensor_status_cb);
+		predict_char_add(s, d->predict);
+	}
+	if (d->flags & SENSOR_BROADCAST_CHAR)
+		broadcast_char_add(s);
+	if (d->flags & SENSOR_POWER_CHAR)
+		power_char_add(s);
+	if (d->flags & SENSOR_CONN_CHAR)
+		connparam_char_add(s);
+	if (d->char_add != NULL)
+		d->char_add(s);
+	notify_init(&s->txq, &s->value_char, d->tx_slots, d->tx_depth, d->size,
+		d->tx_depth > 1 ? NOTIFY_ALL : NOTIFY_NEWEST);
+	notify_char_add(s, &s->txq);
+	restore(s);
+	simble_srv_register(s);
+}
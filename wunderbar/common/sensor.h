@@ -0,0 +1,166 @@
+#ifndef SENSOR_H
+#define SENSOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simble.h"
+#include "sampler.h"
+#include "history.h"
+#include "batch.h"
+#include "notify.h"
+#include "deadband.h"
+#include "stats.h"
+#include "predict.h"
+#include "seqlock.h"
+#include "config.h"
+#include "task.h"
+
+/*
+ * Table driven sensor services.
+ *
+ * A module describes each of its sensor channels with a const struct
+ * sensor_desc and sensor_init() builds the service from it: the value
+ * characteristic, "sampling period", the sampler and everything that
+ * hangs off a sample (history.h, batch.h, notify.h, deadband.h, stats.h,
+ * predict.h, broadcast.h).  The module only supplies the hooks:
+ *
+ *	acquire()	start a measurement of the channel; when it is done
+ *			the module stores the value in *desc->value and
+ *			calls sensor_ready()
+ *	deliver()	optional, sees every sample before it goes out;
+ *			without it the value itself is broadcast
+ *	char_add()	optional, adds module specific characteristics
+ *	connect()	optional
+ *	disconnect()	optional, after sampling was stopped or kept
+ *			running, see sensor_active()
+ *
+ * A read of the value characteristic never waits for the sensor.  It
+ * returns the last sample, and when that is older than "max age" (ms,
+ * 0 for always) it also calls acquire(), so the next read gets a new
+ * one.  Before the first sample a read returns an empty value, so a
+ * client never takes zeros for a measurement.  Reads during a stream
+ * cost the sensor nothing.  Reads are answered from a copy that
+ * sensor_ready() publishes through a seqlock (seqlock.h), so a sample
+ * being taken never shows half written.  Values are at most
+ * SEQLOCK_MAX bytes.  Dead band, statistics and prediction only run
+ * for a channel that gives them storage.
+ *
+ * The settings of a channel, "sampling period", "max age" and those of
+ * the batch, dead band, statistics and prediction, are kept in flash
+ * (config.h) under the channel's index, the order of the sensor_init()
+ * calls, and come back after a reset.  A module keeps its own settings
+ * under the same index with sensor_config_add() from its char_add().
+ *
+ * Whenever a channel starts or stops sampling, the connection
+ * parameters are fitted to what all channels notify (connparam.h).
+ *
+ * Sampling periods below SENSOR_MIN_PERIOD are only used while the
+ * client takes the samples batched (batch.h, for samples that fit twice
+ * into a notification) or through a module's own bulk characteristic,
+ * which sets `bulk', and only for channels with a
+ * batch_min_period; otherwise the written period is raised to the
+ * minimum when sampling starts.  A module characteristic that needs
+ * samples while it is subscribed passes its status on to
+ * sensor_status_cb().
+ *
+ * Each characteristic that takes samples has a bit in `subscribers'.
+ * Sampling stops when the last one unsubscribes, unless the channel is
+ * still logging or broadcasting (sensor_active()).
+ */
+
+#define SENSOR_DEFAULT_PERIOD	1000UL	/* ms */
+#define SENSOR_MIN_PERIOD	250UL	/* ms */
+#define SENSOR_MIN_BATCH_PERIOD	2UL	/* ms, batch_min_period can not go lower */
+#define SENSOR_DEFAULT_MAX_AGE	1000UL	/* ms */
+
+/* settings kept in flash, per channel */
+enum sensor_config {
+	SENSOR_CONFIG_PERIOD,
+	SENSOR_CONFIG_MAX_AGE,
+	SENSOR_CONFIG_BATCH,
+	SENSOR_CONFIG_DEADBAND,
+	SENSOR_CONFIG_STATS,
+	SENSOR_CONFIG_PREDICT,
+	SENSOR_CONFIG_ITEMS
+};
+
+/* first key of the module's own settings, see sensor_config_add() */
+#define SENSOR_CONFIG_MODULE	0x80
+
+/* sensor.subscribers */
+#define SENSOR_SUB_VALUE	0x01
+#define SENSOR_SUB_BATCH	0x02
+#define SENSOR_SUB_STATS	0x04
+#define SENSOR_SUB_PREDICT	0x08
+#define SENSOR_SUB_MODULE	0x10	/* the module's own, e.g. motion's compressed */
+
+/* sensor_desc.flags */
+#define SENSOR_BROADCAST_CHAR	0x1	/* the service carries "broadcast" */
+#define SENSOR_POWER_CHAR	0x2	/* the service carries "power", power.h */
+#define SENSOR_CONN_CHAR	0x4	/* and "connection parameters", connparam.h */
+
+struct sensor;
+typedef void (sensor_cb_t)(struct sensor *s);
+
+struct sensor_desc {
+	uint16_t service_uuid;
+	uint16_t char_uuid;
+	const char *name;
+	void *value;		/* the latest sample */
+	uint8_t size;		/* bytes of the value */
+	uint8_t width;		/* bytes per channel, 1 or 2 */
+	uint8_t is_signed;
+	uint8_t format;		/* BLE_GATT_CPF_FORMAT_*, 0 for none */
+	uint16_t unit;		/* ORG_BLUETOOTH_UNIT_*, with format */
+	uint16_t latency;	/* ms, see sampler.h */
+	uint16_t batch_min_period;	/* ms, shortest period while batching */
+	uint8_t flags;
+	uint8_t tx_depth;	/* > 1 notifies every value, see notify.h */
+	uint8_t *tx_slots;	/* NOTIFY_SLOTS(tx_depth, size) bytes */
+	struct history_block *log;	/* HISTORY_RAM_BLOCKS */
+	uint8_t flash_first;	/* history pages, see flash.h */
+	uint8_t flash_pages;
+	struct deadband *deadband;	/* optional */
+	struct stats *stats;		/* optional, scalar channels only */
+	struct predict *predict;	/* optional, scalar channels only */
+	sensor_cb_t *acquire;
+	sensor_cb_t *deliver;
+	sensor_cb_t *char_add;
+	sensor_cb_t *connect;
+	sensor_cb_t *disconnect;
+};
+
+struct sensor {
+	struct service_desc;
+	const struct sensor_desc *desc;
+	struct sensor *next;
+	uint8_t index;		/* in sensor_init() order */
+	struct char_desc value_char;
+	struct char_desc period_char;
+	struct char_desc max_age_char;
+	uint32_t sampling_period;
+	uint32_t max_age;	/* ms a sample answers reads */
+	uint32_t sampled;	/* vtimer_now() of the last sample */
+	uint8_t cached;
+	uint8_t bulk;		/* a module characteristic takes the samples */
+	uint8_t subscribers;	/* SENSOR_SUB_*, notifying characteristics */
+	struct seqlock latest;	/* the value as of the last sample */
+	uint8_t snapshot[SEQLOCK_MAX];	/* what a read returns */
+	struct sampler sampler;
+	struct history history;
+	struct batch batch;
+	struct notify_queue txq;
+	struct config_item config[SENSOR_CONFIG_ITEMS];
+};
+
+void sensor_init(struct sensor *s, const struct sensor_desc *desc);
+void sensor_ready(struct sensor *s, bool ok);
+bool sensor_active(struct sensor *s);
+uint32_t sensor_period(struct sensor *s);
+void sensor_status_cb(struct service_desc *srv, struct char_desc *c, const int8_t status);
+void sensor_broadcast_cb(bool enabled);
+bool sensor_config_add(struct sensor *s, struct config_item *it, uint8_t n,
+	void *val, uint8_t size);
+
+#endif /* SENSOR_H */
@@ -0,0 +1,50 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Latest value shared between a writer running at interrupt priority
+ * and a reader in thread mode, e.g. a sample and a GATT read of it.
+ *
+ * The writer fills the copy the reader is not using and then bumps
+ * `seq'; the reader copies the current one and starts over if `seq'
+ * moved meanwhile.  The writer never waits, and since it preempts the
+ * reader and never the other way round, each write costs a reader at
+ * most one retry.
+ */
+
+#define SEQLOCK_MAX	12	/* bytes, motion's accel + gyro */
+
+#define SEQLOCK_BARRIER()	__asm__ volatile ("" ::: "memory")
+
+struct seqlock {
+	volatile uint8_t seq;
+	uint8_t buf[2][SEQLOCK_MAX];
+};
+
+static inline void
+seqlock_write(struct seqlock *l, const void *val, uint8_t len)
+{
+	uint8_t next = l->seq + 1;
+
+	memcpy(l->buf[next & 1], val, len);
+	SEQLOCK_BARRIER();
+	l->seq = next;
+}
+
+static inline void
+seqlock_read(struct seqlock *l, void *val, uint8_t len)
+{
+	uint8_t seq;
+
+	do {
+		seq = l->seq;
+		SEQLOCK_BARRIER();
+		memcpy(val, l->buf[seq & 1], len);
+		SEQLOCK_BARRIER();
+	} while (l->seq != seq);
+}
+
+#endif /* SEQLOCK_H */
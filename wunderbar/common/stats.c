@@ -0,0 +1,165 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "stats.h"
+#include "config.h"
+#include "wunderbar_uuid.h"
+
+/*
+ * The mean keeps more bits than the report: each sample's delta / count
+ * truncates, and at .8 that walks a trending window's mean off by a
+ * tenth of a count.
+ */
+#define MEAN_SHIFT	(STATS_MEAN_FRAC - STATS_FRAC)
+
+static void
+reset(struct stats *st)
+{
+	st->count = 0;
+	st->mean = 0;
+	st->m2 = 0;
+}
+
+static uint32_t
+isqrt(uint64_t v)
+{
+	uint64_t r = 0, bit = 1ULL << 62;
+
+	while (bit > v)
+		bit >>= 2;
+	while (bit != 0) {
+		if (v >= r + bit) {
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		} else {
+			r >>= 1;
+		}
+		bit >>= 2;
+	}
+	return r;
+}
+
+void
+stats_add(struct stats *st, int32_t value)
+{
+	int64_t x = (int64_t)value << STATS_MEAN_FRAC;
+	int64_t delta;
+
+	if (st->count == UINT16_MAX)
+		return;
+	if (st->count == 0 || value < st->min)
+		st->min = value;
+	if (st->count == 0 || value > st->max)
+		st->max = value;
+	st->count++;
+	delta = x - st->mean;
+	st->mean += delta / st->count;
+	/* the deviations at .8 keep the product clear of 64 bits */
+	st->m2 += (delta >> MEAN_SHIFT) * ((x - st->mean) >> MEAN_SHIFT) >> STATS_FRAC;
+}
+
+static void
+window_cb(struct vtimer *t)
+{
+	struct stats *st = (void *)((char *)t - offsetof(struct stats, timer));
+
+	if (st->count == 0)
+		return;
+	st->report.count = st->count;
+	st->report.min = st->min;
+	st->report.max = st->max;
+	st->report.mean = (st->mean + (1 << (MEAN_SHIFT - 1))) >> MEAN_SHIFT;
+	/* variance is .8, its root needs .16 to come out .8 */
+	st->report.stddev = st->count < 2 ? 0 :
+		isqrt((uint64_t)(st->m2 / (st->count - 1)) << STATS_FRAC);
+	notify_send(&st->txq, &st->report, sizeof(st->report));
+	reset(st);
+}
+
+static void
+start(struct stats *st)
+{
+	reset(st);
+	vtimer_start(&st->timer, st->window, st->window);
+}
+
+void
+stats_disconnected(struct stats *st)
+{
+	vtimer_stop(&st->timer);
+	notify_reset(&st->txq);
+	st->enabled = 0;
+}
+
+static void
+report_status_cb(struct service_desc *srv, struct char_desc *c, const int8_t status)
+{
+	struct stats *st = (struct stats *)c;
+
+	st->enabled = (status & BLE_GATT_HVX_NOTIFICATION) != 0;
+	if (st->enabled)
+		start(st);
+	else
+		vtimer_stop(&st->timer);
+	if (st->status_cb != NULL)
+		st->status_cb(srv, c, status);
+}
+
+static void
+report_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct stats *st = (struct stats *)c;
+	*valp = &st->report;
+	*lenp = sizeof(st->report);
+}
+
+static void
+window_read_cb(struct service_desc *srv, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct stats *st = (void *)((char *)c - offsetof(struct stats, window_char));
+	*valp = &st->window;
+	*lenp = sizeof(st->window);
+}
+
+static void
+window_write_cb(struct service_desc *srv, struct char_desc *c, const void *val, const uint16_t len)
+{
+	struct stats *st = (void *)((char *)c - offsetof(struct stats, window_char));
+
+	if (len < sizeof(st->window))
+		return;
+	memcpy(&st->window, val, sizeof(st->window));
+	if (st->window < STATS_MIN_WINDOW)
+		st->window = STATS_MIN_WINDOW;
+	if (st->enabled)
+		start(st);
+	config_changed();
+}
+
+void
+stats_init(struct stats *st, stats_status_cb_t *status_cb)
+{
+	st->status_cb = status_cb;
+	st->window = STATS_DEFAULT_WINDOW;
+	st->timer.cb = window_cb;
+	notify_init(&st->txq, &st->report_char, st->tx_slots, 1,
+		sizeof(st->report), NOTIFY_NEWEST);
+}
+
+void
+stats_char_add(struct service_desc *srv, struct stats *st)
+{
+	simble_srv_char_add(srv, &st->report_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_STATS_CHAR,
+		u8"statistics",
+		sizeof(st->report));
+	st->report_char.notify = 1;
+	st->report_char.notify_status_cb = report_status_cb;
+	st->report_char.read_cb = report_read_cb;
+	simble_srv_char_add(srv, &st->window_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_STATS_WINDOW_CHAR,
+		u8"statistics window",
+		sizeof(st->window));
+	st->window_char.read_cb = window_read_cb;
+	st->window_char.write_cb = window_write_cb;
+}
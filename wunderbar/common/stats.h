@@ -0,0 +1,63 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "simble.h"
+#include "vtimer.h"
+#include "notify.h"
+
+/*
+ * Windowed statistics of a service's samples.
+ *
+ * Every sample the service delivers is folded into a running count,
+ * min, max and Welford mean and variance.  While a client subscribed to
+ * the "statistics" characteristic, struct stats_report is notified at
+ * the end of every window and the sums start over.  "statistics window"
+ * reads and writes the u32 window in ms.
+ *
+ * Samples are passed as int32_t, which holds every sample type of the
+ * modules; mean and deviation are 24.8 fixed point in the same raw
+ * units.  stats_add() and the window timer both run at
+ * NRF_APP_PRIORITY_LOW and never preempt each other.
+ */
+
+#define STATS_DEFAULT_WINDOW	(60UL * 1000)	/* ms */
+#define STATS_MIN_WINDOW	1000UL		/* ms */
+#define STATS_FRAC		8		/* fraction bits of mean and deviation */
+#define STATS_MEAN_FRAC		16		/* of the running mean, see stats_add() */
+
+struct stats_report {
+	uint16_t count;		/* samples in the window */
+	int32_t min;
+	int32_t max;
+	int32_t mean;		/* 24.8 */
+	uint32_t stddev;	/* 24.8, sample standard deviation */
+} __attribute__((__packed__));
+
+typedef void (stats_status_cb_t)(struct service_desc *s, struct char_desc *c, const int8_t status);
+
+struct stats {
+	struct char_desc report_char;	/* keep first, see stats_char_add() */
+	struct char_desc window_char;
+	struct vtimer timer;
+	stats_status_cb_t *status_cb;
+	uint8_t enabled;
+	uint32_t window;	/* ms */
+	uint16_t count;
+	int32_t min;
+	int32_t max;
+	int64_t mean;		/* .16 */
+	int64_t m2;		/* sum of squared deviations, .8 */
+	struct stats_report report;
+	struct notify_queue txq;
+	uint8_t tx_slots[NOTIFY_SLOTS(1, sizeof(struct stats_report))];
+};
+
+void stats_init(struct stats *st, stats_status_cb_t *status_cb);
+void stats_char_add(struct service_desc *srv, struct stats *st);
+void stats_add(struct stats *st, int32_t value);
+void stats_disconnected(struct stats *st);
+
+#endif /* STATS_H */
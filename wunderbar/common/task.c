@@ -0,0 +1,257 @@
+#include <stddef.h>
+
+#include <nrf_soc.h>
+
+#include "task.h"
+#include "vtimer.h"
+
+#define TASK_IRQn	SWI3_IRQn
+
+enum task_state {
+	TASK_IDLE = 0,
+	TASK_RUNNABLE,
+	TASK_RUNNING,
+	TASK_BLOCKED,
+};
+
+static struct {
+	struct task *run_head;
+	struct task *run_tail;
+	struct task *sleeping;
+	struct vtimer timer;
+} sched;
+
+static inline bool
+before(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
+/* all list manipulation below runs inside a critical region */
+
+static void
+enqueue(struct task *t)
+{
+	if (t->state == TASK_RUNNABLE)
+		return;
+	t->state = TASK_RUNNABLE;
+	t->next = NULL;
+	if (sched.run_tail != NULL)
+		sched.run_tail->next = t;
+	else
+		sched.run_head = t;
+	sched.run_tail = t;
+	sd_nvic_SetPendingIRQ(TASK_IRQn);
+}
+
+static struct task *
+dequeue(void)
+{
+	struct task *t = sched.run_head;
+	if (t != NULL) {
+		sched.run_head = t->next;
+		if (sched.run_head == NULL)
+			sched.run_tail = NULL;
+		t->state = TASK_RUNNING;
+	}
+	return t;
+}
+
+static void
+arm_timer(void)
+{
+	if (sched.sleeping == NULL) {
+		vtimer_stop(&sched.timer);
+		return;
+	}
+	int32_t delay = sched.sleeping->wake - vtimer_now();
+	vtimer_start(&sched.timer, delay > 0 ? delay : 0, 0);
+}
+
+static void
+sleep_insert(struct task *t, uint32_t ms)
+{
+	struct task **p = &sched.sleeping;
+
+	t->wake = vtimer_now() + ms;
+	while (*p != NULL && !before(t->wake, (*p)->wake))
+		p = &(*p)->next;
+	t->next = *p;
+	*p = t;
+	if (sched.sleeping == t)
+		arm_timer();
+}
+
+static void
+sleep_remove(struct task *t)
+{
+	for (struct task **p = &sched.sleeping; *p != NULL; p = &(*p)->next) {
+		if (*p == t) {
+			*p = t->next;
+			if (p == &sched.sleeping)
+				arm_timer();
+			return;
+		}
+	}
+}
+
+static void
+timer_cb(struct vtimer *timer)
+{
+	uint8_t nested;
+	uint32_t now = vtimer_now();
+
+	sd_nvic_critical_region_enter(&nested);
+	while (sched.sleeping != NULL && !before(now, sched.sleeping->wake)) {
+		struct task *t = sched.sleeping;
+		sched.sleeping = t->next;
+		if (t->event != NULL) {
+			t->event->waiter = NULL;
+			t->event = NULL;
+			t->timed_out = 1;
+		}
+		enqueue(t);
+	}
+	arm_timer();
+	sd_nvic_critical_region_exit(nested);
+}
+
+void
+SWI3_IRQHandler(void)
+{
+	uint8_t nested;
+
+	for (;;) {
+		sd_nvic_critical_region_enter(&nested);
+		struct task *t = dequeue();
+		sd_nvic_critical_region_exit(nested);
+		if (t == NULL)
+			break;
+
+		enum task_status status = t->fn(t);
+
+		sd_nvic_critical_region_enter(&nested);
+		if (status == TASK_DONE && t->again) {
+			/* kicked after its last look at the work */
+			t->again = 0;
+			t->state = TASK_IDLE;
+			enqueue(t);
+		} else if (status == TASK_DONE)
+			t->state = TASK_IDLE;
+		else if (t->state == TASK_RUNNING)
+			t->state = TASK_BLOCKED;
+		sd_nvic_critical_region_exit(nested);
+	}
+}
+
+void
+task_init(void)
+{
+	sched.timer.cb = timer_cb;
+	sd_nvic_ClearPendingIRQ(TASK_IRQn);
+	sd_nvic_SetPriority(TASK_IRQn, NRF_APP_PRIORITY_LOW);
+	sd_nvic_EnableIRQ(TASK_IRQn);
+}
+
+void
+task_start(struct task *t, task_fn_t *fn)
+{
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	if (t->state == TASK_BLOCKED) {
+		if (t->event != NULL)
+			t->event->waiter = NULL;
+		sleep_remove(t);
+	}
+	t->fn = fn;
+	t->lc = 0;
+	t->event = NULL;
+	t->timed_out = 0;
+	t->again = 0;
+	enqueue(t);
+	sd_nvic_critical_region_exit(nested);
+}
+
+/*
+ * Start `t' unless it is already running.  A running task polls its work,
+ * and is run once more if it was kicked too late to see it.
+ */
+void
+task_kick(struct task *t, task_fn_t *fn)
+{
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	if (!task_running(t))
+		task_start(t, fn);
+	else
+		t->again = 1;
+	sd_nvic_critical_region_exit(nested);
+}
+
+bool
+task_running(struct task *t)
+{
+	return t->state != TASK_IDLE;
+}
+
+void
+task_sleep(struct task *t, uint32_t ms)
+{
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	t->timed_out = 0;
+	sleep_insert(t, ms);
+	sd_nvic_critical_region_exit(nested);
+}
+
+void
+task_wait(struct task *t, struct task_event *ev, uint32_t ms)
+{
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	t->timed_out = 0;
+	if (ev->pending) {
+		ev->pending = 0;
+		enqueue(t);
+	} else {
+		ev->waiter = t;
+		t->event = ev;
+		if (ms != 0)
+			sleep_insert(t, ms);
+	}
+	sd_nvic_critical_region_exit(nested);
+}
+
+bool
+task_timed_out(struct task *t)
+{
+	return t->timed_out;
+}
+
+void
+task_event_signal(struct task_event *ev)
+{
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	struct task *t = ev->waiter;
+	if (t != NULL) {
+		ev->waiter = NULL;
+		t->event = NULL;
+		sleep_remove(t);
+		enqueue(t);
+	} else {
+		ev->pending = 1;
+	}
+	sd_nvic_critical_region_exit(nested);
+}
+
+void
+task_event_clear(struct task_event *ev)
+{
+	ev->pending = 0;
+}
@@ -0,0 +1,75 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Stackless cooperative tasks (protothreads).
+ *
+ * A task body is a function that returns at every await and resumes at
+ * the same place when it is run again.  Locals do not survive an await;
+ * keep state in the module context.  A task costs sizeof(struct task).
+ *
+ * Tasks run from SWI3 at NRF_APP_PRIORITY_LOW, the priority the rtc and
+ * vtimer callbacks run at, so they never preempt each other or those
+ * callbacks.  While no task is runnable the CPU sleeps in
+ * sd_app_evt_wait() in simble_process_event_loop().
+ *
+ * Timeouts share one vtimer.  Events are signalled from interrupt
+ * handlers with task_event_signal(); a signal with no waiter is kept
+ * until the next await on that event.
+ */
+
+enum task_status {
+	TASK_WAITING,
+	TASK_DONE,
+};
+
+struct task;
+struct task_event;
+typedef enum task_status (task_fn_t)(struct task *t);
+
+struct task {
+	struct task *next;	/* run queue or sleep list */
+	task_fn_t *fn;
+	struct task_event *event;
+	uint32_t wake;		/* ms, vtimer_now() time base */
+	uint16_t lc;		/* resume point */
+	uint8_t state;
+	uint8_t timed_out;
+	uint8_t again;		/* kicked while running */
+};
+
+struct task_event {
+	struct task *waiter;
+	uint8_t pending;
+};
+
+#define TASK_BEGIN(t)	switch ((t)->lc) { case 0:
+#define TASK_END(t)	} (t)->lc = 0; return TASK_DONE
+
+#define TASK_YIELD_POINT(t) \
+	do { (t)->lc = __LINE__; return TASK_WAITING; case __LINE__:; } while (0)
+
+/* give up the CPU for `ms' milliseconds */
+#define TASK_SLEEP(t, ms) \
+	do { task_sleep((t), (ms)); TASK_YIELD_POINT(t); } while (0)
+
+/* wait for `ev', at most `ms' milliseconds (0: forever); see task_timed_out() */
+#define TASK_AWAIT(t, ev, ms) \
+	do { task_wait((t), (ev), (ms)); TASK_YIELD_POINT(t); } while (0)
+
+void task_init(void);
+void task_start(struct task *t, task_fn_t *fn);
+void task_kick(struct task *t, task_fn_t *fn);
+bool task_running(struct task *t);
+
+void task_sleep(struct task *t, uint32_t ms);
+void task_wait(struct task *t, struct task_event *ev, uint32_t ms);
+bool task_timed_out(struct task *t);
+
+void task_event_signal(struct task_event *ev);
+void task_event_clear(struct task_event *ev);
+
+#endif /* TASK_H */
@@ -0,0 +1,124 @@
+#include <nrf.h>
+#include <nrf_soc.h>
+
+#include "twi_async.h"
+#include "twi_trace.h"
+
+#define TWI_INT_MASK (TWI_INTENSET_STOPPED_Msk | TWI_INTENSET_RXDREADY_Msk | \
+		TWI_INTENSET_TXDSENT_Msk | TWI_INTENSET_ERROR_Msk)
+
+static struct {
+	uint8_t *data;
+	uint8_t address;
+	uint8_t length;
+	uint8_t index;
+	uint8_t stop;
+	uint8_t result;
+	uint8_t busy;
+	uint32_t trace_start;
+	struct task_event *done;
+} xfer;
+
+static void
+complete(bool result)
+{
+	NRF_TWI1->INTENCLR = TWI_INT_MASK;
+	NRF_TWI1->SHORTS = 0;
+	xfer.busy = 0;
+	xfer.result = result;
+	twi_trace_end(xfer.trace_start, xfer.address, xfer.data, xfer.length, result);
+	task_event_signal(xfer.done);
+}
+
+void
+SPI1_TWI1_IRQHandler(void)
+{
+	if (NRF_TWI1->EVENTS_ERROR != 0) {
+		NRF_TWI1->EVENTS_ERROR = 0;
+		NRF_TWI1->ERRORSRC = NRF_TWI1->ERRORSRC;
+		xfer.result = false;
+		NRF_TWI1->SHORTS = 0;
+		NRF_TWI1->TASKS_STOP = 1;
+		/* finishes on STOPPED */
+	}
+	if (NRF_TWI1->EVENTS_TXDSENT != 0) {
+		NRF_TWI1->EVENTS_TXDSENT = 0;
+		if (xfer.result) {
+			if (++xfer.index < xfer.length)
+				NRF_TWI1->TXD = xfer.data[xfer.index];
+			else if (xfer.stop)
+				NRF_TWI1->TASKS_STOP = 1;
+			else
+				complete(true);	/* bus kept for a repeated start */
+		}
+	}
+	if (NRF_TWI1->EVENTS_RXDREADY != 0) {
+		NRF_TWI1->EVENTS_RXDREADY = 0;
+		xfer.data[xfer.index++] = NRF_TWI1->RXD;
+		/* the byte clocked in next is the last one: stop after it */
+		if (xfer.index == xfer.length - 1)
+			NRF_TWI1->SHORTS = TWI_SHORTS_BB_STOP_Msk;
+		if (xfer.index < xfer.length)
+			NRF_TWI1->TASKS_RESUME = 1;
+	}
+	if (NRF_TWI1->EVENTS_STOPPED != 0) {
+		NRF_TWI1->EVENTS_STOPPED = 0;
+		complete(xfer.result);
+	}
+}
+
+bool
+twi_async_transfer(uint8_t address, uint8_t *data, uint8_t length, bool issue_stop, struct task_event *done)
+{
+	if (length == 0 || xfer.busy) {
+		xfer.result = false;
+		return false;
+	}
+	xfer.data = data;
+	xfer.address = address;
+	xfer.length = length;
+	xfer.index = 0;
+	xfer.stop = issue_stop;
+	xfer.result = true;
+	xfer.busy = 1;
+	xfer.done = done;
+	task_event_clear(done);
+	xfer.trace_start = twi_trace_begin();
+
+	NRF_TWI1->EVENTS_STOPPED = 0;
+	NRF_TWI1->EVENTS_RXDREADY = 0;
+	NRF_TWI1->EVENTS_TXDSENT = 0;
+	NRF_TWI1->EVENTS_ERROR = 0;
+	NRF_TWI1->ADDRESS = address >> 1;
+	sd_nvic_ClearPendingIRQ(SPI1_TWI1_IRQn);
+	sd_nvic_SetPriority(SPI1_TWI1_IRQn, NRF_APP_PRIORITY_LOW);
+	sd_nvic_EnableIRQ(SPI1_TWI1_IRQn);
+	NRF_TWI1->INTENSET = TWI_INT_MASK;
+
+	if (address & TWI_READ_BIT) {
+		/* suspend after every byte so we can pick the stop point */
+		NRF_TWI1->SHORTS = length == 1 ? TWI_SHORTS_BB_STOP_Msk : TWI_SHORTS_BB_SUSPEND_Msk;
+		NRF_TWI1->TASKS_STARTRX = 1;
+	} else {
+		NRF_TWI1->SHORTS = 0;
+		NRF_TWI1->TXD = data[0];
+		NRF_TWI1->TASKS_STARTTX = 1;
+	}
+	return true;
+}
+
+bool
+twi_async_result(void)
+{
+	return xfer.result;
+}
+
+void
+twi_async_abort(void)
+{
+	NRF_TWI1->INTENCLR = TWI_INT_MASK;
+	NRF_TWI1->SHORTS = 0;
+	NRF_TWI1->TASKS_STOP = 1;
+	xfer.busy = 0;
+	xfer.result = false;
+}
@@ -0,0 +1,35 @@
+#ifndef TWI_ASYNC_H
+#define TWI_ASYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <twi_master.h>
+
+#include "task.h"
+
+/*
+ * Interrupt driven TWI transfers for tasks, on the TWI1 instance that
+ * twi_master_init() configured.  Same arguments as twi_master_transfer();
+ * completion is signalled on `done' and the outcome is returned by
+ * twi_async_result().  The blocking driver must not be used while a
+ * transfer is in flight.
+ */
+
+#define TWI_ASYNC_TIMEOUT	10	/* ms */
+
+/* start a transfer and await it from task `t' */
+#define TASK_AWAIT_TWI(t, ev, address, data, length, stop) \
+	do { \
+		if (twi_async_transfer((address), (data), (length), (stop), (ev))) { \
+			TASK_AWAIT((t), (ev), TWI_ASYNC_TIMEOUT); \
+			if (task_timed_out(t)) \
+				twi_async_abort(); \
+		} \
+	} while (0)
+
+bool twi_async_transfer(uint8_t address, uint8_t *data, uint8_t length, bool issue_stop, struct task_event *done);
+bool twi_async_result(void);
+void twi_async_abort(void);
+
+#endif /* TWI_ASYNC_H */
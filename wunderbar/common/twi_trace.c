@@ -0,0 +1,186 @@
+#ifdef TWI_TRACE
+
+#include <string.h>
+
+#include <nrf.h>
+
+#include "simble.h"
+#include "twi_trace.h"
+#include "vtimer.h"
+#include "wunderbar_uuid.h"
+
+#undef twi_master_transfer
+
+#define TRACE_CHUNK 2
+
+struct twi_trace_ctx {
+	struct service_desc;
+	struct char_desc stats_char;
+	struct char_desc trace_char;
+	struct twi_trace_entry ring[TWI_TRACE_RING_SIZE];
+	uint8_t head;
+	uint8_t tail;
+	uint16_t overruns;
+	uint32_t window_start;
+	struct twi_trace_stats current[TWI_TRACE_MAX_DEVICES];
+	struct twi_trace_stats last[TWI_TRACE_MAX_DEVICES];
+	struct twi_trace_stats snapshot[TWI_TRACE_MAX_DEVICES];
+	struct twi_trace_entry chunk[TRACE_CHUNK];
+};
+
+static struct twi_trace_ctx trace_ctx;
+
+/*
+ * TIMER1 only runs between begin and end, so the HFCLK is not held on
+ * while the bus is idle.  Transfers never overlap: the bus is owned by
+ * one caller at a time.
+ */
+static void
+timer_start(void)
+{
+	NRF_TIMER1->TASKS_CLEAR = 1;
+	NRF_TIMER1->TASKS_START = 1;
+}
+
+static uint32_t
+timer_stop(void)
+{
+	NRF_TIMER1->TASKS_CAPTURE[3] = 1;
+	NRF_TIMER1->TASKS_STOP = 1;
+	NRF_TIMER1->TASKS_SHUTDOWN = 1;
+	return NRF_TIMER1->CC[3];
+}
+
+static void
+roll_window(struct twi_trace_ctx *ctx, uint32_t now)
+{
+	if (now - ctx->window_start < TWI_TRACE_WINDOW)
+		return;
+	memcpy(ctx->last, ctx->current, sizeof(ctx->last));
+	memset(ctx->current, 0, sizeof(ctx->current));
+	ctx->window_start = now;
+}
+
+static struct twi_trace_stats *
+device_stats(struct twi_trace_ctx *ctx, uint8_t address)
+{
+	for (int i = 0; i < TWI_TRACE_MAX_DEVICES; i++) {
+		struct twi_trace_stats *st = &ctx->current[i];
+		if (st->address == address)
+			return st;
+		if (st->address == 0) {
+			st->address = address;
+			return st;
+		}
+	}
+	return NULL;
+}
+
+uint32_t
+twi_trace_begin(void)
+{
+	timer_start();
+	return vtimer_now();
+}
+
+/* runs from the TWI interrupt for asynchronous transfers */
+void
+twi_trace_end(uint32_t start, uint8_t address, const uint8_t *data, uint8_t length, bool result)
+{
+	struct twi_trace_ctx *ctx = &trace_ctx;
+	uint32_t duration = timer_stop();
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	if ((uint8_t)(ctx->head - ctx->tail) == TWI_TRACE_RING_SIZE) {
+		/* drop the oldest entry, the newest ones are more useful */
+		ctx->tail++;
+		ctx->overruns++;
+	}
+	struct twi_trace_entry *e = &ctx->ring[ctx->head % TWI_TRACE_RING_SIZE];
+	e->timestamp = start;
+	e->duration = duration > UINT16_MAX ? UINT16_MAX : duration;
+	e->address = address;
+	e->length = length;
+	e->data0 = length > 0 ? data[0] : 0;
+	e->result = result;
+	ctx->head++;
+
+	roll_window(ctx, vtimer_now());
+	struct twi_trace_stats *st = device_stats(ctx, address >> 1);
+	if (st != NULL) {
+		st->transactions++;
+		st->bytes += length;
+		st->bus_us += duration;
+		if (!result)
+			st->errors++;
+	}
+	sd_nvic_critical_region_exit(nested);
+}
+
+bool
+twi_trace_transfer(uint8_t address, uint8_t *data, uint8_t length, bool issue_stop)
+{
+	uint32_t start = twi_trace_begin();
+	bool result = twi_master_transfer(address, data, length, issue_stop);
+	twi_trace_end(start, address, data, length, result);
+	return result;
+}
+
+static void
+stats_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct twi_trace_ctx *ctx = (struct twi_trace_ctx *)s;
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	roll_window(ctx, vtimer_now());
+	memcpy(ctx->snapshot, ctx->last, sizeof(ctx->snapshot));
+	sd_nvic_critical_region_exit(nested);
+	*valp = ctx->snapshot;
+	*lenp = sizeof(ctx->snapshot);
+}
+
+static void
+trace_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+	struct twi_trace_ctx *ctx = (struct twi_trace_ctx *)s;
+	uint8_t n = 0;
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	while (n < TRACE_CHUNK && ctx->tail != ctx->head) {
+		ctx->chunk[n++] = ctx->ring[ctx->tail % TWI_TRACE_RING_SIZE];
+		ctx->tail++;
+	}
+	sd_nvic_critical_region_exit(nested);
+	*valp = ctx->chunk;
+	*lenp = n * sizeof(ctx->chunk[0]);
+}
+
+void
+twi_trace_init(void)
+{
+	struct twi_trace_ctx *ctx = &trace_ctx;
+
+	NRF_TIMER1->TASKS_STOP = 1;
+	NRF_TIMER1->MODE = TIMER_MODE_MODE_Timer;
+	NRF_TIMER1->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	NRF_TIMER1->PRESCALER = 4; /* 16 MHz / 2^4 = 1 MHz */
+	ctx->window_start = vtimer_now();
+
+	simble_srv_init(ctx, simble_get_vendor_uuid_class(), VENDOR_UUID_DEBUG_SERVICE);
+	simble_srv_char_add(ctx, &ctx->stats_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_TWI_STATS_CHAR,
+		u8"TWI bus stats",
+		sizeof(ctx->last));
+	simble_srv_char_add(ctx, &ctx->trace_char,
+		simble_get_vendor_uuid_class(), VENDOR_UUID_TWI_TRACE_CHAR,
+		u8"TWI trace",
+		sizeof(ctx->chunk));
+	ctx->stats_char.read_cb = stats_read_cb;
+	ctx->trace_char.read_cb = trace_read_cb;
+	simble_srv_register(ctx);
+}
+
+#endif /* TWI_TRACE */
@@ -0,0 +1,66 @@
+#ifndef TWI_TRACE_H
+#define TWI_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <twi_master.h>
+
+/*
+ * Optional TWI transaction tracer, enabled with -DTWI_TRACE.
+ *
+ * Drivers include this header after <twi_master.h>; with tracing on,
+ * every twi_master_transfer() is routed through twi_trace_transfer(),
+ * which timestamps it with vtimer_now(), times it with TIMER1 (1 MHz,
+ * started and stopped around the transfer) and records it in a RAM
+ * ring.  Per-device counters are aggregated over one minute
+ * windows.  Both are exported through a debug service: the stats
+ * characteristic holds the last complete window, and every read of the
+ * trace characteristic drains the two oldest ring entries, so a host
+ * can dump the whole trace by reading until it gets an empty value.
+ *
+ * The ring is filled from the TWI interrupt and drained from GATT reads,
+ * both sides under a critical region.  Without TWI_TRACE everything
+ * below compiles away and common.mk leaves twi_trace.c out of the build.
+ */
+
+#define TWI_TRACE_RING_SIZE	32	/* entries, power of two */
+#define TWI_TRACE_MAX_DEVICES	2
+#define TWI_TRACE_WINDOW	60000UL	/* ms */
+
+struct twi_trace_entry {
+	uint32_t timestamp;	/* ms, vtimer_now() at the start of the transfer */
+	uint16_t duration;	/* us, saturates */
+	uint8_t address;	/* 8-bit address, bit 0 set for reads */
+	uint8_t length;
+	uint8_t data0;		/* first byte: register for most writes */
+	uint8_t result;		/* 1 on success */
+} __attribute__((__packed__));
+
+struct twi_trace_stats {
+	uint32_t bus_us;
+	uint16_t transactions;
+	uint16_t bytes;
+	uint8_t address;	/* 7-bit address, 0 = unused slot */
+	uint8_t errors;
+} __attribute__((__packed__));
+
+#ifdef TWI_TRACE
+
+void twi_trace_init(void);
+uint32_t twi_trace_begin(void);
+void twi_trace_end(uint32_t start, uint8_t address, const uint8_t *data, uint8_t length, bool result);
+bool twi_trace_transfer(uint8_t address, uint8_t *data, uint8_t length, bool issue_stop);
+
+#define twi_master_transfer(address, data, length, stop) \
+	twi_trace_transfer((address), (data), (length), (stop))
+
+#else
+
+static inline void twi_trace_init(void) {}
+static inline uint32_t twi_trace_begin(void) { return 0; }
+static inline void twi_trace_end(uint32_t start, uint8_t address, const uint8_t *data, uint8_t length, bool result) {}
+
+#endif /* TWI_TRACE */
+
+#endif /* TWI_TRACE_H */
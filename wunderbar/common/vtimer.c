@@ -0,0 +1,162 @@
+#include <stddef.h>
+
+#include <nrf.h>
+#include <nrf_soc.h>
+
+#include "vtimer.h"
+
+#define LFCLK_FREQUENCY_LOG2	15	/* 32768 Hz */
+#define RTC_COUNTER_MASK	0xffffffUL
+
+struct vtimer_stats vtimer_stats;
+
+static struct {
+	uint8_t rtc_id;
+	struct vtimer *head;
+	/* millisecond clock derived from the RTC counter */
+	uint32_t ms;
+	uint32_t counter;
+	uint32_t frac;
+} vt;
+
+static inline bool
+before(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
+uint32_t
+vtimer_now(void)
+{
+	uint8_t nested;
+	sd_nvic_critical_region_enter(&nested);
+	uint32_t counter = NRF_RTC1->COUNTER;
+	uint32_t ticks = (counter - vt.counter) & RTC_COUNTER_MASK;
+	vt.counter = counter;
+	uint64_t scaled = (uint64_t)ticks * (NRF_RTC1->PRESCALER + 1) * 1000 + vt.frac;
+	vt.ms += scaled >> LFCLK_FREQUENCY_LOG2;
+	vt.frac = scaled & ((1 << LFCLK_FREQUENCY_LOG2) - 1);
+	uint32_t now = vt.ms;
+	sd_nvic_critical_region_exit(nested);
+	return now;
+}
+
+static void
+unlink(struct vtimer *t)
+{
+	for (struct vtimer **p = &vt.head; *p != NULL; p = &(*p)->next) {
+		if (*p == t) {
+			*p = t->next;
+			break;
+		}
+	}
+	t->armed = 0;
+}
+
+static void
+insert(struct vtimer *t)
+{
+	struct vtimer **p = &vt.head;
+	while (*p != NULL && !before(t->deadline, (*p)->deadline))
+		p = &(*p)->next;
+	t->next = *p;
+	*p = t;
+	t->armed = 1;
+}
+
+/* RTC ticks covering `ms', the slot counts ticks of PRESCALER + 1 */
+static uint32_t
+ticks(uint32_t ms)
+{
+	uint32_t per_tick = (NRF_RTC1->PRESCALER + 1) * 1000;
+
+	return ((uint64_t)ms << LFCLK_FREQUENCY_LOG2) / per_tick +
+		(((uint64_t)ms << LFCLK_FREQUENCY_LOG2) % per_tick != 0);
+}
+
+/*
+ * Sleep until the earliest deadline + slack.  Only timers due before
+ * that point can pull the wakeup in, so the scan stops there.
+ */
+static void
+reschedule(uint32_t now)
+{
+	if (vt.head == NULL) {
+		rtc_update_cfg(ticks(VTIMER_MAX_SLEEP), vt.rtc_id, false);
+		return;
+	}
+	uint32_t wake = vt.head->deadline + vt.head->slack;
+	for (struct vtimer *t = vt.head->next; t != NULL && before(t->deadline, wake); t = t->next) {
+		if (before(t->deadline + t->slack, wake))
+			wake = t->deadline + t->slack;
+	}
+	int32_t delay = wake - now;
+	if (delay < 1)
+		delay = 1;
+	if (delay > VTIMER_MAX_SLEEP)
+		delay = VTIMER_MAX_SLEEP;
+	rtc_update_cfg(ticks(delay), vt.rtc_id, true);
+}
+
+void
+vtimer_rtc_cb(struct rtc_ctx *ctx)
+{
+	uint8_t nested;
+
+	vtimer_stats.wakeups++;
+	for (;;) {
+		uint32_t now = vtimer_now();
+		sd_nvic_critical_region_enter(&nested);
+		struct vtimer *t = vt.head;
+		if (t == NULL || before(now, t->deadline)) {
+			reschedule(now);
+			sd_nvic_critical_region_exit(nested);
+			break;
+		}
+		unlink(t);
+		if (t->period != 0) {
+			t->deadline += t->period;
+			if (before(t->deadline, now))	/* overran, drop the missed ticks */
+				t->deadline = now + t->period;
+			insert(t);
+		}
+		sd_nvic_critical_region_exit(nested);
+		vtimer_stats.fired++;
+		t->cb(t);
+	}
+}
+
+void
+vtimer_init(uint8_t rtc_id)
+{
+	vt.rtc_id = rtc_id;
+}
+
+void
+vtimer_start(struct vtimer *t, uint32_t delay, uint32_t period)
+{
+	uint8_t nested;
+	uint32_t now = vtimer_now();
+
+	sd_nvic_critical_region_enter(&nested);
+	if (t->armed)
+		unlink(t);
+	t->deadline = now + delay + VTIMER_GUARD;
+	t->period = period;
+	insert(t);
+	reschedule(now);
+	sd_nvic_critical_region_exit(nested);
+}
+
+void
+vtimer_stop(struct vtimer *t)
+{
+	uint8_t nested;
+
+	sd_nvic_critical_region_enter(&nested);
+	if (t->armed) {
+		unlink(t);
+		reschedule(vtimer_now());
+	}
+	sd_nvic_critical_region_exit(nested);
+}
@@ -0,0 +1,64 @@
+#ifndef VTIMER_H
+#define VTIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rtc.h"
+
+/*
+ * Virtual timers multiplexed onto a single rtc_ctx slot.
+ *
+ * Armed timers are kept in a list sorted by deadline and the RTC slot is
+ * always programmed for the next wakeup only.  Each timer carries a
+ * slack: it may fire up to that many ms late, so the wakeup is put off to
+ * the earliest deadline + slack and every timer due by then fires in the
+ * same wakeup.
+ *
+ * A timer never fires before `delay' ms passed.  vtimer_now() only
+ * moves on whole RTC ticks and drops the part of a ms, so a start may
+ * be close to VTIMER_GUARD ms later than it reads; the first deadline
+ * is put that much further out.
+ *
+ * The slot is reserved in the module's rtc_ctx with VTIMER_RTC_SLOT and
+ * handed to vtimer_init() before rtc_init().  Callbacks run from the RTC
+ * interrupt, like plain rtc callbacks do.
+ */
+
+#define VTIMER_MAX_SLEEP	(60UL * 1000)	/* ms, well inside a counter wrap */
+#define VTIMER_GUARD		2	/* ms, a tick and the dropped fraction */
+
+struct vtimer;
+typedef void (vtimer_cb_t)(struct vtimer *t);
+
+struct vtimer {
+	struct vtimer *next;
+	uint32_t deadline;	/* ms, vtimer_now() time base */
+	uint32_t period;	/* ms, 0 for one-shot timers */
+	uint16_t slack;		/* ms the timer may fire late */
+	uint8_t armed;
+	vtimer_cb_t *cb;
+};
+
+struct vtimer_stats {
+	uint32_t wakeups;
+	uint32_t fired;
+};
+
+void vtimer_rtc_cb(struct rtc_ctx *ctx);
+
+#define VTIMER_RTC_SLOT { \
+		.type = PERIODIC, \
+		.period = VTIMER_MAX_SLEEP, \
+		.enabled = false, \
+		.cb = vtimer_rtc_cb, \
+	}
+
+void vtimer_init(uint8_t rtc_id);
+void vtimer_start(struct vtimer *t, uint32_t delay, uint32_t period);
+void vtimer_stop(struct vtimer *t);
+uint32_t vtimer_now(void);
+
+extern struct vtimer_stats vtimer_stats;
+
+#endif /* VTIMER_H */
@@ -0,0 +1,40 @@
+#ifndef WUNDERBAR_UUID_H
+#define WUNDERBAR_UUID_H
+
+/*
+ * Vendor UUIDs used by the shared module code, on top of the ones
+ * simble.h hands out.  They live in the same vendor base, well clear
+ * of the simble range.
+ */
+enum wunderbar_vendor_uuid {
+	VENDOR_UUID_DEBUG_SERVICE = 0x2100,
+	VENDOR_UUID_TWI_STATS_CHAR = 0x2101,
+	VENDOR_UUID_TWI_TRACE_CHAR = 0x2102,
+	VENDOR_UUID_DEADLINE_ERROR_CHAR = 0x2110,
+	VENDOR_UUID_HISTORY_CHAR = 0x2120,
+	VENDOR_UUID_HISTORY_CTRL_CHAR = 0x2121,
+	VENDOR_UUID_BATCH_CHAR = 0x2130,
+	VENDOR_UUID_BATCH_FORMAT_CHAR = 0x2131,
+	VENDOR_UUID_TX_STATS_CHAR = 0x2140,
+	VENDOR_UUID_BROADCAST_CHAR = 0x2150,
+	VENDOR_UUID_DEADBAND_CHAR = 0x2160,
+	VENDOR_UUID_PREDICT_CHAR = 0x2170,
+	VENDOR_UUID_PREDICT_BOUND_CHAR = 0x2171,
+	VENDOR_UUID_STATS_CHAR = 0x2180,
+	VENDOR_UUID_STATS_WINDOW_CHAR = 0x2181,
+	VENDOR_UUID_MOTION_CONFIG_CHAR = 0x2190,
+	VENDOR_UUID_ORIENTATION_CHAR = 0x2191,
+	VENDOR_UUID_VIBRATION_CHAR = 0x2192,
+	VENDOR_UUID_VIBRATION_CONFIG_CHAR = 0x2193,
+	VENDOR_UUID_SHOCK_CHAR = 0x2194,
+	VENDOR_UUID_SHOCK_CONFIG_CHAR = 0x2195,
+	VENDOR_UUID_SHOCK_DATA_CHAR = 0x2196,
+	VENDOR_UUID_STEPS_CHAR = 0x2197,
+	VENDOR_UUID_ACTIVITY_CHAR = 0x2198,
+	VENDOR_UUID_COMPRESSED_CHAR = 0x2199,
+	VENDOR_UUID_MAX_AGE_CHAR = 0x21a0,
+	VENDOR_UUID_POWER_CHAR = 0x21b0,
+	VENDOR_UUID_CONN_PARAMS_CHAR = 0x21b1,
+};
+
+#endif /* WUNDERBAR_UUID_H */
@@ -0,0 +1,16 @@
+#ifndef BATT_SERV_H
+#define BATT_SERV_H
+
+/*
+ * Host stand-in for simble's battery service: it takes RTC slot 3 for
+ * a periodic battery reading and measures the supply on the ADC.
+ */
+
+struct rtc_ctx;
+
+#define BATT_SERV_RTC_ID	3
+#define BATT_SERV_PERIOD	60000	/* ticks */
+
+void batt_serv_init(struct rtc_ctx *ctx);
+
+#endif /* BATT_SERV_H */
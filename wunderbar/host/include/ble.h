@@ -0,0 +1,128 @@
+#ifndef BLE_H
+#define BLE_H
+
+/*
+ * Host stand-in for the S110 BLE API: the GAP calls, events and
+ * constants the modules use, implemented by ../sim/simble.c.
+ */
+
+#include <stdint.h>
+
+#define BLE_ERROR_INVALID_CONN_HANDLE		0x3001
+#define BLE_ERROR_INVALID_ATTR_HANDLE		0x3002
+#define BLE_ERROR_NO_TX_BUFFERS			0x3004
+#define BLE_ERROR_GATTS_SYS_ATTR_MISSING	0x3401
+
+#define BLE_CONN_HANDLE_INVALID			0xffff
+
+#define BLE_GATT_HVX_INVALID			0x00
+#define BLE_GATT_HVX_NOTIFICATION		0x01
+#define BLE_GATT_HVX_INDICATION			0x02
+
+#define BLE_GATT_CPF_FORMAT_BOOLEAN		0x01
+#define BLE_GATT_CPF_FORMAT_UINT8		0x04
+#define BLE_GATT_CPF_FORMAT_UINT16		0x06
+#define BLE_GATT_CPF_FORMAT_UINT24		0x07
+#define BLE_GATT_CPF_FORMAT_UINT32		0x08
+#define BLE_GATT_CPF_FORMAT_SINT8		0x0c
+#define BLE_GATT_CPF_FORMAT_SINT16		0x0e
+#define BLE_GATT_CPF_FORMAT_SINT32		0x10
+#define BLE_GATT_CPF_FORMAT_FLOAT32		0x14
+#define BLE_GATT_CPF_FORMAT_UTF8S		0x19
+#define BLE_GATT_CPF_FORMAT_STRUCT		0x1b
+
+#define ORG_BLUETOOTH_UNIT_UNITLESS		0x2700
+#define ORG_BLUETOOTH_UNIT_DEGREE_CELSIUS	0x272f
+#define ORG_BLUETOOTH_UNIT_PERCENTAGE		0x27ad
+
+#define BLE_GAP_ADV_TYPE_ADV_IND		0x00
+#define BLE_GAP_ADV_TYPE_ADV_DIRECT_IND		0x01
+#define BLE_GAP_ADV_TYPE_ADV_SCAN_IND		0x02
+#define BLE_GAP_ADV_TYPE_ADV_NONCONN_IND	0x03
+#define BLE_GAP_ADV_FP_ANY			0x00
+#define BLE_GAP_ADV_INTERVAL_MIN		0x0020
+#define BLE_GAP_ADV_NONCON_INTERVAL_MIN		0x00a0
+#define BLE_GAP_ADV_INTERVAL_MAX		0x4000
+#define BLE_GAP_ADV_MAX_SIZE			31
+
+#define BLE_GAP_AD_TYPE_FLAGS			0x01
+#define BLE_GAP_AD_TYPE_SHORT_LOCAL_NAME	0x08
+#define BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME	0x09
+#define BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA 0xff
+#define BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE 0x06
+
+#define BLE_GAP_CP_MIN_CONN_INTVL_MIN		0x0006
+#define BLE_GAP_CP_MAX_CONN_INTVL_MAX		0x0c80
+#define BLE_GAP_CP_SLAVE_LATENCY_MAX		0x01f3
+#define BLE_GAP_CP_CONN_SUP_TIMEOUT_MIN		0x000a
+#define BLE_GAP_CP_CONN_SUP_TIMEOUT_MAX		0x0c80
+
+typedef struct {
+	uint8_t type;
+	const void *p_peer_addr;
+	uint8_t fp;
+	const void *p_whitelist;
+	uint16_t interval;	/* 0.625 ms units */
+	uint16_t timeout;	/* s */
+} ble_gap_adv_params_t;
+
+typedef struct {
+	uint16_t min_conn_interval;	/* 1.25 ms units */
+	uint16_t max_conn_interval;
+	uint16_t slave_latency;
+	uint16_t conn_sup_timeout;	/* 10 ms units */
+} ble_gap_conn_params_t;
+
+#define BLE_EVT_TX_COMPLETE			0x01
+#define BLE_GAP_EVT_CONNECTED			0x10
+#define BLE_GAP_EVT_DISCONNECTED		0x11
+#define BLE_GAP_EVT_CONN_PARAM_UPDATE		0x12
+
+typedef struct {
+	uint16_t evt_id;
+	uint16_t evt_len;
+} ble_evt_hdr_t;
+
+typedef struct {
+	uint8_t count;		/* packets the peer acknowledged */
+} ble_evt_tx_complete_t;
+
+typedef struct {
+	uint16_t conn_handle;
+	union {
+		ble_evt_tx_complete_t tx_complete;
+	} params;
+} ble_common_evt_t;
+
+typedef struct {
+	ble_gap_conn_params_t conn_params;	/* the link starts with */
+} ble_gap_evt_connected_t;
+
+typedef struct {
+	ble_gap_conn_params_t conn_params;	/* in effect now */
+} ble_gap_evt_conn_param_update_t;
+
+typedef struct {
+	uint16_t conn_handle;
+	union {
+		ble_gap_evt_connected_t connected;
+		ble_gap_evt_conn_param_update_t conn_param_update;
+	} params;
+} ble_gap_evt_t;
+
+typedef struct {
+	ble_evt_hdr_t header;
+	union {
+		ble_common_evt_t common_evt;
+		ble_gap_evt_t gap_evt;
+	} evt;
+} ble_evt_t;
+
+uint32_t sd_ble_gap_adv_data_set(uint8_t const *p_data, uint8_t dlen, uint8_t const *p_sr_data, uint8_t srdlen);
+uint32_t sd_ble_gap_adv_start(ble_gap_adv_params_t const *p_adv_params);
+uint32_t sd_ble_gap_adv_stop(void);
+uint32_t sd_ble_gap_conn_param_update(uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params);
+uint32_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const *p_conn_params);
+uint32_t sd_ble_tx_buffer_count_get(uint8_t *p_count);
+
+#endif /* BLE_H */
@@ -0,0 +1,9 @@
+#ifndef I2C_H
+#define I2C_H
+
+/* Host stand-in for simble's switch of the sensor supply and I2C pull ups. */
+
+void enable_i2c(void);
+void disable_i2c(void);
+
+#endif /* I2C_H */
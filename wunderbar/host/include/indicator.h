@@ -0,0 +1,8 @@
+#ifndef INDICATOR_H
+#define INDICATOR_H
+
+/* Host stand-in for simble's connection indicator LED. */
+
+void ind_init(void);
+
+#endif /* INDICATOR_H */
@@ -0,0 +1,330 @@
+#ifndef NRF_H
+#define NRF_H
+
+/*
+ * Host stand-in for the nRF51 device header.  The register blocks hold
+ * the registers the modules touch, under their data sheet names; they
+ * are plain memory owned by the simulated peripherals in ../sim.  Only
+ * the field and bit names matter, the layout is not the chip's.
+ */
+
+#include <stdint.h>
+
+#define __I	volatile const
+#define __O	volatile
+#define __IO	volatile
+
+typedef enum {
+	POWER_CLOCK_IRQn = 0,
+	RADIO_IRQn = 1,
+	UART0_IRQn = 2,
+	SPI0_TWI0_IRQn = 3,
+	SPI1_TWI1_IRQn = 4,
+	GPIOTE_IRQn = 6,
+	ADC_IRQn = 7,
+	TIMER0_IRQn = 8,
+	TIMER1_IRQn = 9,
+	TIMER2_IRQn = 10,
+	RTC0_IRQn = 11,
+	TEMP_IRQn = 12,
+	RNG_IRQn = 13,
+	ECB_IRQn = 14,
+	CCM_AAR_IRQn = 15,
+	WDT_IRQn = 16,
+	RTC1_IRQn = 17,
+	QDEC_IRQn = 18,
+	LPCOMP_IRQn = 19,
+	SWI0_IRQn = 20,
+	SWI1_IRQn = 21,
+	SWI2_IRQn = 22,
+	SWI3_IRQn = 23,
+	SWI4_IRQn = 24,
+	SWI5_IRQn = 25,
+} IRQn_Type;
+
+#define SIM_IRQ_COUNT	26
+
+typedef struct {
+	__O uint32_t TASKS_LFCLKSTART;
+	__O uint32_t TASKS_LFCLKSTOP;
+	__IO uint32_t EVENTS_LFCLKSTARTED;
+	__IO uint32_t LFCLKSRC;
+	__I uint32_t HFCLKSTAT;
+} NRF_CLOCK_Type;
+
+typedef struct {
+	__O uint32_t TASKS_CONSTLAT;
+	__O uint32_t TASKS_LOWPWR;
+} NRF_POWER_Type;
+
+typedef struct {
+	__I uint32_t CODEPAGESIZE;
+	__I uint32_t CODESIZE;
+} NRF_FICR_Type;
+
+typedef struct {
+	__IO uint32_t CLENR0;
+	__IO uint32_t RBPCONF;
+	__IO uint32_t XTALFREQ;
+	__I uint32_t FWID;
+	__IO uint32_t BOOTLOADERADDR;
+} NRF_UICR_Type;
+
+typedef struct {
+	__IO uint32_t OUT;
+	__IO uint32_t OUTSET;
+	__IO uint32_t OUTCLR;
+	__I uint32_t IN;
+	__IO uint32_t DIR;
+	__IO uint32_t DIRSET;
+	__IO uint32_t DIRCLR;
+	__IO uint32_t PIN_CNF[32];
+} NRF_GPIO_Type;
+
+typedef struct {
+	__O uint32_t TASKS_OUT[4];
+	__IO uint32_t EVENTS_IN[4];
+	__IO uint32_t EVENTS_PORT;
+	__IO uint32_t INTENSET;
+	__IO uint32_t INTENCLR;
+	__IO uint32_t CONFIG[4];
+	__IO uint32_t POWER;
+} NRF_GPIOTE_Type;
+
+typedef struct {
+	__O uint32_t TASKS_START;
+	__O uint32_t TASKS_STOP;
+	__O uint32_t TASKS_COUNT;
+	__O uint32_t TASKS_CLEAR;
+	__O uint32_t TASKS_SHUTDOWN;
+	__O uint32_t TASKS_CAPTURE[4];
+	__IO uint32_t EVENTS_COMPARE[4];
+	__IO uint32_t SHORTS;
+	__IO uint32_t INTENSET;
+	__IO uint32_t INTENCLR;
+	__IO uint32_t MODE;
+	__IO uint32_t BITMODE;
+	__IO uint32_t PRESCALER;
+	__IO uint32_t CC[4];
+	__IO uint32_t POWER;
+} NRF_TIMER_Type;
+
+typedef struct {
+	__O uint32_t TASKS_START;
+	__O uint32_t TASKS_STOP;
+	__O uint32_t TASKS_CLEAR;
+	__O uint32_t TASKS_TRIGOVRFLW;
+	__IO uint32_t EVENTS_TICK;
+	__IO uint32_t EVENTS_OVRFLW;
+	__IO uint32_t EVENTS_COMPARE[4];
+	__IO uint32_t INTENSET;
+	__IO uint32_t INTENCLR;
+	__IO uint32_t EVTEN;
+	__IO uint32_t EVTENSET;
+	__IO uint32_t EVTENCLR;
+	__I uint32_t COUNTER;
+	__IO uint32_t PRESCALER;
+	__IO uint32_t CC[4];
+	__IO uint32_t POWER;
+} NRF_RTC_Type;
+
+typedef struct {
+	__O uint32_t TASKS_STARTRX;
+	__O uint32_t TASKS_STARTTX;
+	__O uint32_t TASKS_STOP;
+	__O uint32_t TASKS_SUSPEND;
+	__O uint32_t TASKS_RESUME;
+	__IO uint32_t EVENTS_STOPPED;
+	__IO uint32_t EVENTS_RXDREADY;
+	__IO uint32_t EVENTS_TXDSENT;
+	__IO uint32_t EVENTS_ERROR;
+	__IO uint32_t EVENTS_BB;
+	__IO uint32_t EVENTS_SUSPENDED;
+	__IO uint32_t SHORTS;
+	__IO uint32_t INTENSET;
+	__IO uint32_t INTENCLR;
+	__IO uint32_t ERRORSRC;
+	__IO uint32_t ENABLE;
+	__IO uint32_t PSELSCL;
+	__IO uint32_t PSELSDA;
+	__I uint32_t RXD;
+	__IO uint32_t TXD;
+	__IO uint32_t FREQUENCY;
+	__IO uint32_t ADDRESS;
+	__IO uint32_t POWER;
+} NRF_TWI_Type;
+
+typedef struct {
+	__O uint32_t TASKS_START;
+	__O uint32_t TASKS_STOP;
+	__IO uint32_t EVENTS_END;
+	__IO uint32_t INTENSET;
+	__IO uint32_t INTENCLR;
+	__I uint32_t BUSY;
+	__IO uint32_t ENABLE;
+	__IO uint32_t CONFIG;
+	__I uint32_t RESULT;
+	__IO uint32_t POWER;
+} NRF_ADC_Type;
+
+extern NRF_CLOCK_Type sim_nrf_clock;
+extern NRF_POWER_Type sim_nrf_power;
+extern NRF_FICR_Type sim_nrf_ficr;
+extern NRF_UICR_Type sim_nrf_uicr;
+extern NRF_GPIO_Type sim_nrf_gpio;
+extern NRF_GPIOTE_Type sim_nrf_gpiote;
+extern NRF_TIMER_Type sim_nrf_timer[3];
+extern NRF_RTC_Type sim_nrf_rtc1;
+extern NRF_TWI_Type sim_nrf_twi1;
+extern NRF_ADC_Type sim_nrf_adc;
+
+#define NRF_CLOCK	(&sim_nrf_clock)
+#define NRF_POWER	(&sim_nrf_power)
+#define NRF_FICR	(&sim_nrf_ficr)
+#define NRF_UICR	(&sim_nrf_uicr)
+#define NRF_GPIO	(&sim_nrf_gpio)
+#define NRF_GPIOTE	(&sim_nrf_gpiote)
+#define NRF_TIMER0	(&sim_nrf_timer[0])
+#define NRF_TIMER1	(&sim_nrf_timer[1])
+#define NRF_TIMER2	(&sim_nrf_timer[2])
+#define NRF_RTC1	(&sim_nrf_rtc1)
+#define NRF_TWI1	(&sim_nrf_twi1)
+#define NRF_ADC		(&sim_nrf_adc)
+
+/* CLOCK */
+#define CLOCK_LFCLKSRC_SRC_Pos			0
+#define CLOCK_LFCLKSRC_SRC_RC			0
+#define CLOCK_LFCLKSRC_SRC_Xtal			1
+#define CLOCK_LFCLKSRC_SRC_Synth		2
+#define CLOCK_HFCLKSTAT_SRC_Msk			0x1
+#define CLOCK_HFCLKSTAT_STATE_Msk		0x10000
+
+/* GPIO */
+#define GPIO_PIN_CNF_DIR_Pos			0
+#define GPIO_PIN_CNF_DIR_Input			0
+#define GPIO_PIN_CNF_DIR_Output			1
+#define GPIO_PIN_CNF_INPUT_Pos			1
+#define GPIO_PIN_CNF_INPUT_Connect		0
+#define GPIO_PIN_CNF_INPUT_Disconnect		1
+#define GPIO_PIN_CNF_PULL_Pos			2
+#define GPIO_PIN_CNF_PULL_Disabled		0
+#define GPIO_PIN_CNF_PULL_Pulldown		1
+#define GPIO_PIN_CNF_PULL_Pullup		3
+#define GPIO_PIN_CNF_PULL_Msk			(3 << GPIO_PIN_CNF_PULL_Pos)
+
+/* GPIOTE */
+#define GPIOTE_CONFIG_MODE_Pos			0
+#define GPIOTE_CONFIG_MODE_Msk			0x3
+#define GPIOTE_CONFIG_MODE_Disabled		0
+#define GPIOTE_CONFIG_MODE_Event		1
+#define GPIOTE_CONFIG_MODE_Task			3
+#define GPIOTE_CONFIG_PSEL_Pos			8
+#define GPIOTE_CONFIG_PSEL_Msk			(0x1f << GPIOTE_CONFIG_PSEL_Pos)
+#define GPIOTE_CONFIG_POLARITY_Pos		16
+#define GPIOTE_CONFIG_POLARITY_Msk		(0x3 << GPIOTE_CONFIG_POLARITY_Pos)
+#define GPIOTE_CONFIG_POLARITY_LoToHi		1
+#define GPIOTE_CONFIG_POLARITY_HiToLo		2
+#define GPIOTE_CONFIG_POLARITY_Toggle		3
+#define GPIOTE_CONFIG_OUTINIT_Pos		20
+#define GPIOTE_CONFIG_OUTINIT_Msk		(1 << GPIOTE_CONFIG_OUTINIT_Pos)
+#define GPIOTE_INTENSET_IN0_Msk			0x1
+#define GPIOTE_INTENSET_IN1_Msk			0x2
+#define GPIOTE_INTENSET_IN2_Msk			0x4
+#define GPIOTE_INTENSET_IN3_Msk			0x8
+#define GPIOTE_POWER_POWER_Pos			0
+#define GPIOTE_POWER_POWER_Disabled		0
+#define GPIOTE_POWER_POWER_Enabled		1
+
+/* TIMER */
+#define TIMER_MODE_MODE_Timer			0
+#define TIMER_MODE_MODE_Counter			1
+#define TIMER_BITMODE_BITMODE_16Bit		0
+#define TIMER_BITMODE_BITMODE_08Bit		1
+#define TIMER_BITMODE_BITMODE_24Bit		2
+#define TIMER_BITMODE_BITMODE_32Bit		3
+#define TIMER_SHORTS_COMPARE0_CLEAR_Msk		0x1
+#define TIMER_SHORTS_COMPARE1_CLEAR_Msk		0x2
+#define TIMER_SHORTS_COMPARE2_CLEAR_Msk		0x4
+#define TIMER_SHORTS_COMPARE3_CLEAR_Msk		0x8
+#define TIMER_SHORTS_COMPARE0_STOP_Msk		0x100
+#define TIMER_SHORTS_COMPARE1_STOP_Msk		0x200
+#define TIMER_SHORTS_COMPARE2_STOP_Msk		0x400
+#define TIMER_SHORTS_COMPARE3_STOP_Msk		0x800
+#define TIMER_INTENSET_COMPARE0_Msk		0x10000
+#define TIMER_POWER_POWER_Pos			0
+#define TIMER_POWER_POWER_Disabled		0
+#define TIMER_POWER_POWER_Enabled		1
+
+/* RTC */
+#define RTC_EVTENSET_COMPARE0_Msk		0x10000
+#define RTC_EVTENSET_COMPARE1_Msk		0x20000
+#define RTC_EVTENSET_COMPARE2_Msk		0x40000
+#define RTC_EVTENSET_COMPARE3_Msk		0x80000
+#define RTC_INTENSET_COMPARE0_Msk		0x10000
+#define RTC_INTENSET_COMPARE1_Msk		0x20000
+#define RTC_INTENSET_COMPARE2_Msk		0x40000
+#define RTC_INTENSET_COMPARE3_Msk		0x80000
+
+/* TWI */
+#define TWI_SHORTS_BB_SUSPEND_Msk		0x1
+#define TWI_SHORTS_BB_STOP_Msk			0x2
+#define TWI_INTENSET_STOPPED_Msk		0x2
+#define TWI_INTENSET_RXDREADY_Msk		0x4
+#define TWI_INTENSET_TXDSENT_Msk		0x80
+#define TWI_INTENSET_ERROR_Msk			0x200
+#define TWI_INTENSET_BB_Msk			0x4000
+#define TWI_ERRORSRC_OVERRUN_Msk		0x1
+#define TWI_ERRORSRC_ANACK_Msk			0x2
+#define TWI_ERRORSRC_DNACK_Msk			0x4
+#define TWI_ENABLE_ENABLE_Disabled		0
+#define TWI_ENABLE_ENABLE_Enabled		5
+#define TWI_FREQUENCY_FREQUENCY_Pos		0
+#define TWI_FREQUENCY_FREQUENCY_K100		0x01980000
+#define TWI_FREQUENCY_FREQUENCY_K250		0x04000000
+#define TWI_FREQUENCY_FREQUENCY_K400		0x06680000
+
+/* ADC */
+#define ADC_INTENSET_END_Msk			0x1
+#define ADC_INTENCLR_END_Msk			0x1
+#define ADC_INTENCLR_END_Enabled		1
+#define ADC_ENABLE_ENABLE_Disabled		0
+#define ADC_ENABLE_ENABLE_Enabled		1
+#define ADC_CONFIG_RES_Pos			0
+#define ADC_CONFIG_RES_Msk			0x3
+#define ADC_CONFIG_RES_8bit			0
+#define ADC_CONFIG_RES_9bit			1
+#define ADC_CONFIG_RES_10bit			2
+#define ADC_CONFIG_INPSEL_Pos			2
+#define ADC_CONFIG_INPSEL_Msk			(0x7 << ADC_CONFIG_INPSEL_Pos)
+#define ADC_CONFIG_INPSEL_AnalogInputNoPrescaling	0
+#define ADC_CONFIG_INPSEL_AnalogInputTwoThirdsPrescaling 1
+#define ADC_CONFIG_INPSEL_AnalogInputOneThirdPrescaling	2
+#define ADC_CONFIG_INPSEL_SupplyTwoThirdsPrescaling	5
+#define ADC_CONFIG_INPSEL_SupplyOneThirdPrescaling	6
+#define ADC_CONFIG_REFSEL_Pos			5
+#define ADC_CONFIG_REFSEL_Msk			(0x3 << ADC_CONFIG_REFSEL_Pos)
+#define ADC_CONFIG_REFSEL_VBG			0
+#define ADC_CONFIG_REFSEL_External		1
+#define ADC_CONFIG_REFSEL_SupplyOneHalfPrescaling	2
+#define ADC_CONFIG_REFSEL_SupplyOneThirdPrescaling	3
+#define ADC_CONFIG_PSEL_Pos			8
+#define ADC_CONFIG_PSEL_Msk			(0xff << ADC_CONFIG_PSEL_Pos)
+#define ADC_CONFIG_PSEL_Disabled		0
+#define ADC_CONFIG_PSEL_AnalogInput0		0x01
+#define ADC_CONFIG_PSEL_AnalogInput1		0x02
+#define ADC_CONFIG_PSEL_AnalogInput2		0x04
+#define ADC_CONFIG_PSEL_AnalogInput3		0x08
+#define ADC_CONFIG_PSEL_AnalogInput4		0x10
+#define ADC_CONFIG_PSEL_AnalogInput5		0x20
+#define ADC_CONFIG_PSEL_AnalogInput6		0x40
+#define ADC_CONFIG_PSEL_AnalogInput7		0x80
+#define ADC_CONFIG_EXTREFSEL_Pos		16
+#define ADC_CONFIG_EXTREFSEL_None		0
+
+/* PPI */
+#define PPI_CHEN_CH0_Msk			0x1
+#define PPI_CHEN_CH1_Msk			0x2
+#define PPI_CHEN_CH2_Msk			0x4
+#define PPI_CHEN_CH3_Msk			0x8
+
+#endif /* NRF_H */
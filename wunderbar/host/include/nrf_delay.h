@@ -0,0 +1,15 @@
+#ifndef NRF_DELAY_H
+#define NRF_DELAY_H
+
+#include <stdint.h>
+
+/* busy waits: simulated time passes with nothing else running */
+void nrf_delay_us(uint32_t us);
+
+static inline void
+nrf_delay_ms(uint32_t ms)
+{
+	nrf_delay_us(ms * 1000);
+}
+
+#endif /* NRF_DELAY_H */
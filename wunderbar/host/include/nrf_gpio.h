@@ -0,0 +1,60 @@
+#ifndef NRF_GPIO_H
+#define NRF_GPIO_H
+
+/* Host copy of the SDK's GPIO helpers, they only touch the registers. */
+
+#include <stdint.h>
+
+#include "nrf.h"
+
+typedef enum {
+	NRF_GPIO_PIN_NOPULL = GPIO_PIN_CNF_PULL_Disabled,
+	NRF_GPIO_PIN_PULLDOWN = GPIO_PIN_CNF_PULL_Pulldown,
+	NRF_GPIO_PIN_PULLUP = GPIO_PIN_CNF_PULL_Pullup,
+} nrf_gpio_pin_pull_t;
+
+static inline void
+nrf_gpio_cfg_output(uint32_t pin)
+{
+	NRF_GPIO->PIN_CNF[pin] = GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos;
+}
+
+static inline void
+nrf_gpio_cfg_input(uint32_t pin, nrf_gpio_pin_pull_t pull)
+{
+	NRF_GPIO->PIN_CNF[pin] = (GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos) |
+		(pull << GPIO_PIN_CNF_PULL_Pos);
+}
+
+/*
+ * The latch itself: OUTSET and OUTCLR are plain memory here, a second
+ * write before the simulator looks would replace the first.
+ */
+static inline void
+nrf_gpio_pin_set(uint32_t pin)
+{
+	NRF_GPIO->OUT |= 1UL << pin;
+}
+
+static inline void
+nrf_gpio_pin_clear(uint32_t pin)
+{
+	NRF_GPIO->OUT &= ~(1UL << pin);
+}
+
+static inline void
+nrf_gpio_pin_write(uint32_t pin, uint32_t value)
+{
+	if (value)
+		nrf_gpio_pin_set(pin);
+	else
+		nrf_gpio_pin_clear(pin);
+}
+
+static inline uint32_t
+nrf_gpio_pin_read(uint32_t pin)
+{
+	return (NRF_GPIO->IN >> pin) & 1UL;
+}
+
+#endif /* NRF_GPIO_H */
@@ -0,0 +1,36 @@
+#ifndef NRF_GPIOTE_H
+#define NRF_GPIOTE_H
+
+/* Host copy of the SDK's GPIOTE helpers, they only touch the registers. */
+
+#include <stdint.h>
+
+#include "nrf.h"
+
+typedef enum {
+	NRF_GPIOTE_POLARITY_LOTOHI = GPIOTE_CONFIG_POLARITY_LoToHi,
+	NRF_GPIOTE_POLARITY_HITOLO = GPIOTE_CONFIG_POLARITY_HiToLo,
+	NRF_GPIOTE_POLARITY_TOGGLE = GPIOTE_CONFIG_POLARITY_Toggle,
+} nrf_gpiote_polarity_t;
+
+typedef enum {
+	NRF_GPIOTE_INITIAL_VALUE_LOW = 0,
+	NRF_GPIOTE_INITIAL_VALUE_HIGH = 1,
+} nrf_gpiote_outinit_t;
+
+static inline void
+nrf_gpiote_task_config(uint32_t channel, uint32_t pin, nrf_gpiote_polarity_t polarity, nrf_gpiote_outinit_t init)
+{
+	NRF_GPIOTE->CONFIG[channel] = (GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos) |
+		(pin << GPIOTE_CONFIG_PSEL_Pos) |
+		(polarity << GPIOTE_CONFIG_POLARITY_Pos) |
+		(init << GPIOTE_CONFIG_OUTINIT_Pos);
+}
+
+static inline void
+nrf_gpiote_unconfig(uint32_t channel)
+{
+	NRF_GPIOTE->CONFIG[channel] = GPIOTE_CONFIG_MODE_Disabled << GPIOTE_CONFIG_MODE_Pos;
+}
+
+#endif /* NRF_GPIOTE_H */
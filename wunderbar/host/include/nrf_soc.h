@@ -0,0 +1,87 @@
+#ifndef NRF_SOC_H
+#define NRF_SOC_H
+
+/*
+ * Host stand-in for the S110 SoC library: the calls the modules make,
+ * implemented by ../sim/softdevice.c.
+ */
+
+#include <stdint.h>
+
+#include "nrf.h"
+
+#define NRF_SUCCESS			0
+#define NRF_ERROR_INTERNAL		3
+#define NRF_ERROR_NO_MEM		4
+#define NRF_ERROR_NOT_FOUND		5
+#define NRF_ERROR_NOT_SUPPORTED		6
+#define NRF_ERROR_INVALID_PARAM		7
+#define NRF_ERROR_INVALID_STATE		8
+#define NRF_ERROR_INVALID_LENGTH	9
+#define NRF_ERROR_INVALID_ADDR		16
+#define NRF_ERROR_BUSY			17
+
+#define NRF_APP_PRIORITY_HIGH		1
+#define NRF_APP_PRIORITY_LOW		3
+
+#define NRF_CLOCK_HFCLK_RUNNING		1
+
+enum NRF_RADIO_NOTIFICATION_TYPES {
+	NRF_RADIO_NOTIFICATION_TYPE_NONE = 0,
+	NRF_RADIO_NOTIFICATION_TYPE_INT_ON_ACTIVE,
+	NRF_RADIO_NOTIFICATION_TYPE_INT_ON_INACTIVE,
+	NRF_RADIO_NOTIFICATION_TYPE_INT_ON_BOTH,
+};
+
+enum NRF_RADIO_NOTIFICATION_DISTANCES {
+	NRF_RADIO_NOTIFICATION_DISTANCE_NONE = 0,
+	NRF_RADIO_NOTIFICATION_DISTANCE_800US,
+	NRF_RADIO_NOTIFICATION_DISTANCE_1740US,
+};
+
+enum NRF_POWER_MODES {
+	NRF_POWER_MODE_CONSTLAT,
+	NRF_POWER_MODE_LOWPWR,
+};
+
+enum NRF_SOC_EVTS {
+	NRF_EVT_HFCLKSTARTED,
+	NRF_EVT_POWER_FAILURE_WARNING,
+	NRF_EVT_FLASH_OPERATION_SUCCESS,
+	NRF_EVT_FLASH_OPERATION_ERROR,
+	NRF_EVT_RADIO_BLOCKED,
+	NRF_EVT_RADIO_CANCELED,
+	NRF_EVT_RADIO_SIGNAL_CALLBACK_INVALID_RETURN,
+	NRF_EVT_RADIO_SESSION_IDLE,
+	NRF_EVT_RADIO_SESSION_CLOSED,
+	NRF_EVT_NUMBER_OF_EVTS,
+};
+
+uint32_t sd_nvic_EnableIRQ(IRQn_Type irq);
+uint32_t sd_nvic_DisableIRQ(IRQn_Type irq);
+uint32_t sd_nvic_GetPendingIRQ(IRQn_Type irq, uint32_t *pending);
+uint32_t sd_nvic_SetPendingIRQ(IRQn_Type irq);
+uint32_t sd_nvic_ClearPendingIRQ(IRQn_Type irq);
+uint32_t sd_nvic_SetPriority(IRQn_Type irq, uint32_t priority);
+uint32_t sd_nvic_critical_region_enter(uint8_t *is_nested_critical_region);
+uint32_t sd_nvic_critical_region_exit(uint8_t is_nested_critical_region);
+
+uint32_t sd_app_evt_wait(void);
+uint32_t sd_evt_get(uint32_t *evt_id);
+uint32_t sd_power_mode_set(uint8_t power_mode);
+
+uint32_t sd_clock_hfclk_request(void);
+uint32_t sd_clock_hfclk_release(void);
+uint32_t sd_clock_hfclk_is_running(uint32_t *is_running);
+
+uint32_t sd_ppi_channel_enable_get(uint32_t *channel_enable);
+uint32_t sd_ppi_channel_enable_set(uint32_t channel_enable_set_msk);
+uint32_t sd_ppi_channel_enable_clr(uint32_t channel_enable_clr_msk);
+uint32_t sd_ppi_channel_assign(uint8_t channel_num, const volatile void *evt_endpoint, const volatile void *task_endpoint);
+
+uint32_t sd_radio_notification_cfg_set(uint8_t type, uint8_t distance);
+
+uint32_t sd_flash_write(uint32_t *p_dst, uint32_t const *p_src, uint32_t size);
+uint32_t sd_flash_page_erase(uint32_t page_number);
+
+#endif /* NRF_SOC_H */
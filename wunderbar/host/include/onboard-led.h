@@ -0,0 +1,14 @@
+#ifndef ONBOARD_LED_H
+#define ONBOARD_LED_H
+
+/* Host stand-in for simble's onboard LED. */
+
+enum onboard_led_state {
+	ONBOARD_LED_OFF,
+	ONBOARD_LED_ON,
+	ONBOARD_LED_TOGGLE,
+};
+
+void onboard_led(enum onboard_led_state state);
+
+#endif /* ONBOARD_LED_H */
@@ -0,0 +1,38 @@
+#ifndef RTC_H
+#define RTC_H
+
+/*
+ * Host stand-in for simble's RTC1 multiplexer, see ../sim/simble_rtc.c.
+ * RTC1 runs with PRESCALER 32, about 1 ms per tick; slot i uses compare
+ * channel i and its period is in ticks.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RTC_PRESCALER	32
+#define RTC_SLOTS	4
+
+struct rtc_ctx;
+
+typedef void (rtc_evt_cb_t)(struct rtc_ctx *ctx);
+
+struct rtc_x_ctx {
+	enum {
+		PERIODIC,
+		ONE_SHOT,
+	} type;
+	uint32_t period;
+	bool enabled;
+	rtc_evt_cb_t *cb;
+};
+
+struct rtc_ctx {
+	struct rtc_x_ctx rtc_x[RTC_SLOTS];
+};
+
+void rtc_init(struct rtc_ctx *ctx);
+void rtc_update_cfg(uint32_t period, uint8_t id, bool enabled);
+bool rtc_oneshot_timer(uint32_t period, rtc_evt_cb_t *cb);
+
+#endif /* RTC_H */
@@ -0,0 +1,96 @@
+#ifndef SIMBLE_H
+#define SIMBLE_H
+
+/*
+ * Host stand-in for simble, the BLE glue library the modules link
+ * against.  The calls are the library's; ../sim/simble.c plays the
+ * softdevice and the central on the other end of the link, see sim.h.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nrf_soc.h"
+#include "ble.h"
+
+struct service_desc;
+struct char_desc;
+
+typedef void (char_read_cb_t)(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp);
+typedef void (char_write_cb_t)(struct service_desc *s, struct char_desc *c, const void *val, const uint16_t len);
+typedef void (char_notify_status_cb_t)(struct service_desc *s, struct char_desc *c, const int8_t status);
+
+struct char_desc {
+	uint16_t length;
+	unsigned notify : 1;
+	unsigned indicate : 1;
+	char_read_cb_t *read_cb;
+	char_write_cb_t *write_cb;
+	char_notify_status_cb_t *notify_status_cb;
+
+	/* simulator side, see sim.h */
+	const char *desc;
+	uint16_t uuid;
+	uint8_t format;
+	int8_t exponent;
+	uint16_t unit;
+	int8_t status;			/* CCCD the central wrote */
+	uint8_t *value;			/* the attribute, `length' bytes */
+	struct service_desc *srv;
+	struct char_desc *next;
+};
+
+struct service_desc {
+	void (*connect_cb)(struct service_desc *s);
+	void (*disconnect_cb)(struct service_desc *s);
+
+	/* simulator side; prefixed, the modules embed this anonymously */
+	uint16_t sim_uuid;
+	struct char_desc *sim_chars;
+	struct service_desc *sim_next;
+};
+
+enum {
+	VENDOR_UUID_SENSOR_SERVICE = 0x2000,
+	VENDOR_UUID_SENSOR_SERVICE_2,
+	VENDOR_UUID_RAW_CHAR,
+	VENDOR_UUID_SAMPLING_PERIOD_CHAR,
+	VENDOR_UUID_HUMID_CHAR,
+	VENDOR_UUID_TEMP_CHAR,
+	VENDOR_UUID_SOUND_CHAR,
+	VENDOR_UUID_MOTION_CHAR,
+	VENDOR_UUID_PROXIMITY_CHAR,
+	VENDOR_UUID_COLOR_CHAR,
+	VENDOR_UUID_ADC_CHAR,
+	VENDOR_UUID_IR_CHAR,
+};
+
+void simble_init(const char *name);
+void simble_adv_start(void);
+void simble_process_event_loop(void);
+uint8_t simble_get_vendor_uuid_class(void);
+
+/*
+ * Hooks into simble_process_event_loop(), run in thread mode each time
+ * the loop wakes up, which is after any interrupt handler: soc_evt for
+ * every SoC event sd_evt_get() returns, ble_evt for every BLE event
+ * after simble handled it, then idle once the events are done.  Members
+ * may be NULL.
+ */
+struct simble_hook {
+	void (*soc_evt)(uint32_t evt);
+	void (*ble_evt)(ble_evt_t *evt);
+	void (*idle)(void);
+	struct simble_hook *next;
+};
+
+void simble_hook_add(struct simble_hook *h);
+
+void simble_srv_init(void *srv, uint8_t uuid_class, uint16_t uuid);
+void simble_srv_register(void *srv);
+void simble_srv_char_add(void *srv, struct char_desc *c, uint8_t uuid_class, uint16_t uuid, const char *desc, uint16_t length);
+void simble_srv_char_attach_format(struct char_desc *c, uint8_t format, int8_t exponent, uint16_t unit);
+void simble_srv_char_update(struct char_desc *c, void *val);
+uint32_t simble_srv_char_notify(struct char_desc *c, bool indicate, uint16_t len, void *val);
+
+#endif /* SIMBLE_H */
@@ -0,0 +1,19 @@
+#ifndef TWI_MASTER_H
+#define TWI_MASTER_H
+
+/*
+ * Host stand-in for the SDK's blocking TWI driver, on the simulated
+ * bus of ../sim/twi.c.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TWI_READ_BIT		0x01
+#define TWI_ISSUE_STOP		((bool)true)
+#define TWI_DONT_ISSUE_STOP	((bool)false)
+
+bool twi_master_init(void);
+bool twi_master_transfer(uint8_t address, uint8_t *data, uint8_t data_length, bool issue_stop_condition);
+
+#endif /* TWI_MASTER_H */
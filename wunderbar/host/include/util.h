@@ -0,0 +1,10 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+/* Host copy of simble's util.h. */
+
+#include <endian.h>
+
+#define ROUNDED_DIV(a, b)	(((a) + ((b) / 2)) / (b))
+
+#endif /* UTIL_H */
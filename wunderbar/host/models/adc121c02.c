@@ -0,0 +1,70 @@
+#include <math.h>
+
+#include "models.h"
+
+/*
+ * ADC121C02: the first byte of a write sets the pointer, further bytes
+ * write the register.  The conversion result (pointer 0) reads MSB
+ * first, alert flag in bit 15, the 8 bit registers read as one byte.
+ */
+
+#define RESULT		0
+#define CONFIG		2
+
+static bool
+start(struct sim_twi_device *d, bool read)
+{
+	struct sim_adc121c02 *m = (struct sim_adc121c02 *)d;
+
+	m->addressed = !read;
+	m->pos = 0;
+	if (read && m->ptr == RESULT) {
+		double v = sim_signal_at(&m->input, sim_now()) / m->vref * 4096;
+
+		m->result = v < 0 ? 0 : v > 4095 ? 4095 : lround(v);
+		m->conversions++;
+	}
+	return true;
+}
+
+static bool
+write(struct sim_twi_device *d, uint8_t byte)
+{
+	struct sim_adc121c02 *m = (struct sim_adc121c02 *)d;
+
+	if (m->addressed) {
+		m->addressed = 0;
+		m->ptr = byte & 7;
+		return true;
+	}
+	if (m->ptr == CONFIG)
+		m->config = byte;
+	return true;
+}
+
+static uint8_t
+read(struct sim_twi_device *d, bool last)
+{
+	struct sim_adc121c02 *m = (struct sim_adc121c02 *)d;
+
+	switch (m->ptr) {
+	case RESULT:
+		return m->pos++ == 0 ? m->result >> 8 : m->result;
+	case CONFIG:
+		return m->config;
+	}
+	return 0;
+}
+
+void
+sim_adc121c02_attach(struct sim_adc121c02 *m)
+{
+	m->dev.name = "ADC121C02";
+	m->dev.address = 0x55;
+	m->dev.start = start;
+	m->dev.write = write;
+	m->dev.read = read;
+	if (m->vref == 0)
+		m->vref = 3.3;
+	sim_twi_attach(&m->dev);
+}
@@ -0,0 +1,164 @@
+#include <math.h>
+
+#include "models.h"
+
+/*
+ * HTU21D: commands are single bytes, a measurement is read back as
+ * MSB, LSB with the status in the low two bits, and a CRC-8 (x^8 +
+ * x^5 + x^4 + 1) over both.
+ */
+
+#define CMD_TEMP_HOLD		0xe3
+#define CMD_RH_HOLD		0xe5
+#define CMD_TEMP		0xf3
+#define CMD_RH			0xf5
+#define CMD_WRITE_USER		0xe6
+#define CMD_READ_USER		0xe7
+#define CMD_RESET		0xfe
+
+#define USER_DEFAULT		0x02
+#define STATUS_RH		0x02
+#define RESET_TIME		SIM_MS(15)
+
+static uint8_t
+crc8(const uint8_t *p, int n)
+{
+	uint8_t crc = 0;
+
+	while (n-- > 0) {
+		crc ^= *p++;
+		for (int i = 0; i < 8; i++)
+			crc = crc & 0x80 ? crc << 1 ^ 0x31 : crc << 1;
+	}
+	return crc;
+}
+
+static uint16_t
+raw(double v, double offset, double span)
+{
+	double r = (v + offset) / span * 65536;
+
+	if (r < 0)
+		r = 0;
+	if (r > 65535)
+		r = 65535;
+	return (uint16_t)r;
+}
+
+/* the conversion samples its input when it ends */
+static void
+convert(struct sim_htu21 *m)
+{
+	uint16_t r;
+
+	if (m->cmd == CMD_TEMP || m->cmd == CMD_TEMP_HOLD)
+		r = raw(sim_signal_at(&m->temp, m->ready), 46.85, 175.72) & 0xfffc;
+	else
+		r = (raw(sim_signal_at(&m->rh, m->ready), 6, 125) & 0xfffc) | STATUS_RH;
+	m->result[0] = r >> 8;
+	m->result[1] = r;
+	m->result[2] = crc8(m->result, 2);
+	m->valid = 1;
+	m->busy = 0;
+	m->measurements++;
+}
+
+static bool
+start(struct sim_twi_device *d, bool read)
+{
+	struct sim_htu21 *m = (struct sim_htu21 *)d;
+
+	if (m->busy && sim_now() < m->ready) {
+		if (read && m->cmd != CMD_RESET)
+			m->early_reads++;
+		return false;
+	}
+	if (m->busy) {
+		if (m->cmd == CMD_RESET)
+			m->busy = 0;
+		else
+			convert(m);
+	}
+	m->pos = 0;
+	if (read && m->cmd != CMD_READ_USER && !m->valid)
+		return false;
+	if (!read)
+		m->cmd = 0;
+	return true;
+}
+
+static bool
+write(struct sim_twi_device *d, uint8_t byte)
+{
+	struct sim_htu21 *m = (struct sim_htu21 *)d;
+
+	if (m->cmd == CMD_WRITE_USER) {
+		m->user = byte;
+		m->cmd = 0;
+		return true;
+	}
+	m->cmd = byte;
+	switch (byte) {
+	case CMD_TEMP:
+	case CMD_TEMP_HOLD:
+		m->busy = 1;
+		m->valid = 0;
+		m->ready = sim_now() + SIM_HTU21_TEMP_TIME;
+		return true;
+	case CMD_RH:
+	case CMD_RH_HOLD:
+		m->busy = 1;
+		m->valid = 0;
+		m->ready = sim_now() + SIM_HTU21_RH_TIME;
+		return true;
+	case CMD_RESET:
+		m->busy = 1;
+		m->valid = 0;
+		m->user = USER_DEFAULT;
+		m->ready = sim_now() + RESET_TIME;
+		return true;
+	case CMD_WRITE_USER:
+	case CMD_READ_USER:
+		return true;
+	}
+	CHECKF(0, "HTU21: unknown command %#x", byte);
+	return false;
+}
+
+static uint8_t
+read(struct sim_twi_device *d, bool last)
+{
+	struct sim_htu21 *m = (struct sim_htu21 *)d;
+
+	if (m->cmd == CMD_READ_USER)
+		return m->user;
+	if (m->pos < sizeof(m->result))
+		return m->result[m->pos++];
+	return 0xff;
+}
+
+static void
+power(struct sim_twi_device *d, bool on)
+{
+	struct sim_htu21 *m = (struct sim_htu21 *)d;
+
+	m->busy = 0;
+	m->valid = 0;
+	m->cmd = 0;
+	m->user = USER_DEFAULT;
+}
+
+void
+sim_htu21_attach(struct sim_htu21 *m)
+{
+	m->dev.name = "HTU21";
+	m->dev.address = 0x40;
+	m->dev.on_sensor_supply = 1;
+	m->dev.startup = SIM_HTU21_STARTUP;
+	m->dev.start = start;
+	m->dev.write = write;
+	m->dev.read = read;
+	m->dev.power = power;
+	m->user = USER_DEFAULT;
+	sim_twi_attach(&m->dev);
+}
@@ -0,0 +1,156 @@
+#ifndef MODELS_H
+#define MODELS_H
+
+/*
+ * Sensor models on the simulated TWI bus (sim.h), scripted by the
+ * scenarios.
+ *
+ * What a model measures is a struct sim_signal: a constant, points
+ * interpolated linearly over time (held before the first and after the
+ * last) or a function of time.  Each model attaches itself with
+ * sim_twi_attach(); the scenario sets the signals and reads the
+ * counters.  Conversion times and register behaviour follow the data
+ * sheets, not the firmware's constants, so firmware that waits too
+ * little reads stale data or a NACK.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+struct sim_signal_point {
+	double t;	/* s */
+	double v;
+};
+
+struct sim_signal {
+	double value;
+	const struct sim_signal_point *points;
+	unsigned npoints;
+	double (*fn)(double t, void *arg);
+	void *arg;
+};
+
+double sim_signal_at(const struct sim_signal *s, sim_time_t t);
+
+/* sin(2 pi freq t + phase) * amplitude + offset, as a sim_signal fn */
+struct sim_sine {
+	double freq;	/* Hz */
+	double amplitude;
+	double offset;
+	double phase;	/* rad */
+};
+double sim_sine(double t, void *arg);
+
+/*
+ * HTU21D humidity and temperature sensor at 0x40 on the sensor supply.
+ * No-hold measurements take the maximum conversion time, a read before
+ * NACKs; results carry the status bits and the CRC.
+ */
+#define SIM_HTU21_TEMP_TIME	SIM_MS(50)	/* 14 bit */
+#define SIM_HTU21_RH_TIME	SIM_MS(16)	/* 12 bit */
+#define SIM_HTU21_STARTUP	SIM_MS(15)
+
+struct sim_htu21 {
+	struct sim_twi_device dev;
+	struct sim_signal temp;		/* deg C */
+	struct sim_signal rh;		/* % */
+	unsigned long measurements;
+	unsigned long early_reads;	/* NACKed, the conversion ran */
+
+	uint8_t cmd;
+	uint8_t busy;
+	sim_time_t ready;
+	uint8_t result[3];
+	uint8_t pos;
+	uint8_t valid;
+	uint8_t user;
+};
+
+void sim_htu21_attach(struct sim_htu21 *m);
+
+/*
+ * MPU-6500 at 0x68, on the module supply: it keeps its setup while the
+ * sensor supply is off, as the firmware expects.  Samples are taken at the
+ * configured rate while awake, from MPU6500 start-up on; the data
+ * registers, DATA_RDY in INT_STATUS and the accelerometer FIFO follow
+ * them.  The low pass filters are not modelled.
+ */
+#define SIM_MPU6500_STARTUP	SIM_MS(35)	/* gyro, from sleep */
+#define SIM_MPU6500_RESET	SIM_MS(2)
+#define SIM_MPU6500_FIFO	512
+
+struct sim_mpu6500 {
+	struct sim_twi_device dev;
+	struct sim_signal accel[3];	/* g */
+	struct sim_signal gyro[3];	/* dps */
+	unsigned long samples;
+	unsigned long fifo_overflows;
+	unsigned long wakeups;
+
+	uint8_t reg[128];
+	uint8_t ptr;
+	uint8_t addressed;	/* the first byte of a write sets ptr */
+	sim_time_t reset_done;
+	sim_time_t awake;	/* when the samples start */
+	sim_time_t next;	/* the next sample */
+	uint8_t fifo[SIM_MPU6500_FIFO];
+	uint16_t fifo_head;
+	uint16_t fifo_count;
+};
+
+void sim_mpu6500_attach(struct sim_mpu6500 *m);
+
+/*
+ * TCS3771 colour and proximity sensor at 0x29 on the sensor supply.
+ * Once powered on it runs its cycle, proximity, wait and RGBC, and
+ * pulls `int_pin' low on the interrupts enabled and due after a
+ * cycle's persistence.  The RGBC counts are the ambient ones, plus
+ * `led' while `led_pin' is high for the whole integration.
+ */
+#define SIM_TCS3771_CYCLE	SIM_US(2720)
+#define SIM_TCS3771_INIT	SIM_US(2720)
+
+struct sim_tcs3771 {
+	struct sim_twi_device dev;
+	uint8_t int_pin;
+	uint8_t led_pin;
+	struct sim_signal proximity;	/* counts */
+	struct sim_signal ambient[4];	/* clear, red, green, blue counts */
+	double led[4];
+	unsigned long cycles;
+	unsigned long lit;		/* RGBC integrations under the LED */
+
+	uint8_t reg[32];
+	uint8_t ptr;
+	uint8_t addressed;
+	uint8_t phase;
+	uint8_t lit_start;
+	uint8_t pers;
+	struct sim_event event;
+};
+
+void sim_tcs3771_attach(struct sim_tcs3771 *m);
+
+/*
+ * ADC121C02 12 bit ADC at 0x55, powered with the bridge, not from the
+ * sensor supply.  The conversion result register is the input scaled
+ * to `vref', MSB first.
+ */
+struct sim_adc121c02 {
+	struct sim_twi_device dev;
+	struct sim_signal input;	/* V */
+	double vref;
+	unsigned long conversions;
+
+	uint8_t ptr;
+	uint8_t addressed;
+	uint8_t pos;
+	uint8_t config;
+	uint16_t result;
+};
+
+void sim_adc121c02_attach(struct sim_adc121c02 *m);
+
+#endif /* MODELS_H */
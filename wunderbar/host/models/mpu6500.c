@@ -0,0 +1,242 @@
+#include <math.h>
+#include <string.h>
+
+#include "models.h"
+
+/*
+ * MPU-6500: a register file behind a pointer, auto incremented by
+ * reads and writes except on FIFO_R_W.  Sampling is caught up lazily
+ * whenever the bus touches the chip, a transfer sees the registers as
+ * of its start.
+ */
+
+#define SMPLRT_DIV	25
+#define CONFIG		26
+#define GYRO_CONFIG	27
+#define ACCEL_CONFIG	28
+#define FIFO_EN		35
+#define INT_ENABLE	56
+#define INT_STATUS	58
+#define ACCEL_XOUT_H	59
+#define TEMP_OUT_H	65
+#define GYRO_XOUT_H	67
+#define USER_CTRL	106
+#define PWR_MGMT_1	107
+#define FIFO_COUNTH	114
+#define FIFO_COUNTL	115
+#define FIFO_R_W	116
+#define WHO_AM_I	117
+
+#define CONFIG_FIFO_MODE	0x40
+#define FIFO_EN_ACCEL		0x08
+#define INT_DATA_RDY		0x01
+#define INT_FIFO_OFLOW		0x10
+#define USER_CTRL_FIFO_EN	0x40
+#define USER_CTRL_FIFO_RST	0x04
+#define PWR_RESET		0x80
+#define PWR_SLEEP		0x40
+
+/* samples beyond this many are lost to the FIFO anyway */
+#define CATCH_UP		(SIM_MPU6500_FIFO / 6 + 1)
+
+static void
+reset(struct sim_mpu6500 *m)
+{
+	memset(m->reg, 0, sizeof(m->reg));
+	m->reg[PWR_MGMT_1] = PWR_SLEEP;
+	m->reg[WHO_AM_I] = 0x70;
+	m->fifo_head = 0;
+	m->fifo_count = 0;
+}
+
+static bool
+sleeping(struct sim_mpu6500 *m)
+{
+	return m->reg[PWR_MGMT_1] & (PWR_SLEEP | PWR_RESET);
+}
+
+static sim_time_t
+period(struct sim_mpu6500 *m)
+{
+	uint8_t dlpf = m->reg[CONFIG] & 7;
+
+	if (dlpf == 0 || dlpf == 7)
+		return SIM_US(125);
+	return SIM_US(1000) * (1 + m->reg[SMPLRT_DIV]);
+}
+
+static void
+put16(uint8_t *p, double v)
+{
+	long r = lround(v);
+
+	if (r > 32767)
+		r = 32767;
+	if (r < -32768)
+		r = -32768;
+	p[0] = (uint16_t)r >> 8;
+	p[1] = r;
+}
+
+static void
+fifo_push(struct sim_mpu6500 *m, const uint8_t *p, int n)
+{
+	while (n-- > 0) {
+		if (m->fifo_count == SIM_MPU6500_FIFO) {
+			if (m->reg[CONFIG] & CONFIG_FIFO_MODE)
+				return;
+			/* the oldest byte goes */
+			m->fifo_head = (m->fifo_head + 1) % SIM_MPU6500_FIFO;
+			m->fifo_count--;
+			m->reg[INT_STATUS] |= INT_FIFO_OFLOW;
+			m->fifo_overflows++;
+		}
+		m->fifo[(m->fifo_head + m->fifo_count++) % SIM_MPU6500_FIFO] = *p++;
+	}
+}
+
+static void
+sample(struct sim_mpu6500 *m, sim_time_t t)
+{
+	double accel_lsb = 16384 >> (m->reg[ACCEL_CONFIG] >> 3 & 3);
+	double gyro_lsb = 131.0 / (1 << (m->reg[GYRO_CONFIG] >> 3 & 3));
+
+	for (int i = 0; i < 3; i++) {
+		put16(&m->reg[ACCEL_XOUT_H + 2 * i], sim_signal_at(&m->accel[i], t) * accel_lsb);
+		put16(&m->reg[GYRO_XOUT_H + 2 * i], sim_signal_at(&m->gyro[i], t) * gyro_lsb);
+	}
+	put16(&m->reg[TEMP_OUT_H], (25 - 21) * 333.87);
+	m->reg[INT_STATUS] |= INT_DATA_RDY;
+	if ((m->reg[USER_CTRL] & USER_CTRL_FIFO_EN) && (m->reg[FIFO_EN] & FIFO_EN_ACCEL))
+		fifo_push(m, &m->reg[ACCEL_XOUT_H], 6);
+	m->samples++;
+}
+
+static void
+catch_up(struct sim_mpu6500 *m)
+{
+	sim_time_t now = sim_now();
+	sim_time_t p;
+
+	if (m->reg[PWR_MGMT_1] & PWR_RESET) {
+		if (now < m->reset_done)
+			return;
+		reset(m);
+	}
+	if (sleeping(m))
+		return;
+	p = period(m);
+	if (m->next + CATCH_UP * p < now)
+		m->next += (now - m->next) / p * p - CATCH_UP * p;
+	for (; m->next <= now; m->next += p)
+		sample(m, m->next);
+}
+
+static bool
+start(struct sim_twi_device *d, bool read)
+{
+	struct sim_mpu6500 *m = (struct sim_mpu6500 *)d;
+
+	catch_up(m);
+	m->addressed = !read;
+	return true;
+}
+
+static void
+store(struct sim_mpu6500 *m, uint8_t reg, uint8_t val)
+{
+	switch (reg) {
+	case PWR_MGMT_1:
+		if (val & PWR_RESET) {
+			m->reg[PWR_MGMT_1] |= PWR_RESET;
+			m->reset_done = sim_now() + SIM_MPU6500_RESET;
+			return;
+		}
+		if (sleeping(m) && !(val & PWR_SLEEP)) {
+			m->awake = sim_now() + SIM_MPU6500_STARTUP;
+			m->next = m->awake;
+			m->wakeups++;
+		}
+		break;
+	case USER_CTRL:
+		if (val & USER_CTRL_FIFO_RST) {
+			m->fifo_head = 0;
+			m->fifo_count = 0;
+			val &= ~USER_CTRL_FIFO_RST;
+		}
+		break;
+	case INT_STATUS:
+	case WHO_AM_I:
+	case FIFO_COUNTH:
+	case FIFO_COUNTL:
+		return;
+	case FIFO_R_W:
+		fifo_push(m, &val, 1);
+		return;
+	}
+	if (reg >= ACCEL_XOUT_H && reg <= GYRO_XOUT_H + 5)
+		return;
+	m->reg[reg] = val;
+}
+
+static bool
+write(struct sim_twi_device *d, uint8_t byte)
+{
+	struct sim_mpu6500 *m = (struct sim_mpu6500 *)d;
+
+	if (m->addressed) {
+		m->ptr = byte & 0x7f;
+		m->addressed = 0;
+		return true;
+	}
+	/* registers written during a reset keep their reset values */
+	if (!(m->reg[PWR_MGMT_1] & PWR_RESET))
+		store(m, m->ptr, byte);
+	if (m->ptr != FIFO_R_W)
+		m->ptr = (m->ptr + 1) & 0x7f;
+	return true;
+}
+
+static uint8_t
+read(struct sim_twi_device *d, bool last)
+{
+	struct sim_mpu6500 *m = (struct sim_mpu6500 *)d;
+	uint8_t reg = m->ptr;
+	uint8_t val;
+
+	switch (reg) {
+	case FIFO_COUNTH:
+		val = m->fifo_count >> 8;
+		break;
+	case FIFO_COUNTL:
+		val = m->fifo_count;
+		break;
+	case FIFO_R_W:
+		if (m->fifo_count == 0)
+			return 0xff;
+		val = m->fifo[m->fifo_head];
+		m->fifo_head = (m->fifo_head + 1) % SIM_MPU6500_FIFO;
+		m->fifo_count--;
+		return val;
+	case INT_STATUS:
+		val = m->reg[reg];
+		m->reg[reg] = 0;
+		break;
+	default:
+		val = m->reg[reg];
+	}
+	m->ptr = (m->ptr + 1) & 0x7f;
+	return val;
+}
+
+void
+sim_mpu6500_attach(struct sim_mpu6500 *m)
+{
+	m->dev.name = "MPU6500";
+	m->dev.address = 0x68;
+	m->dev.start = start;
+	m->dev.write = write;
+	m->dev.read = read;
+	reset(m);
+	sim_twi_attach(&m->dev);
+}
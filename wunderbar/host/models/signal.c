@@ -0,0 +1,31 @@
+#include <math.h>
+
+#include "models.h"
+
+double
+sim_signal_at(const struct sim_signal *s, sim_time_t now)
+{
+	double t = now / 1e9;
+	const struct sim_signal_point *p = s->points;
+
+	if (s->fn != NULL)
+		return s->fn(t, s->arg);
+	if (s->npoints == 0)
+		return s->value;
+	if (t <= p[0].t)
+		return p[0].v;
+	for (unsigned i = 1; i < s->npoints; i++) {
+		if (t < p[i].t)
+			return p[i - 1].v + (p[i].v - p[i - 1].v) *
+				(t - p[i - 1].t) / (p[i].t - p[i - 1].t);
+	}
+	return p[s->npoints - 1].v;
+}
+
+double
+sim_sine(double t, void *arg)
+{
+	const struct sim_sine *s = arg;
+
+	return s->amplitude * sin(2 * M_PI * s->freq * t + s->phase) + s->offset;
+}
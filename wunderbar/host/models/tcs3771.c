@@ -0,0 +1,273 @@
+#include <math.h>
+#include <string.h>
+
+#include "models.h"
+
+/*
+ * TCS3771: the command byte selects a register (bit 7, type in bits 6
+ * and 5, auto increment or a special function such as clearing the
+ * interrupts).  Once PON is set the chip runs its cycle on its own:
+ * init, proximity, wait and RGBC, each as enabled.
+ */
+
+#define CMD_SELECT	0x80
+#define CMD_TYPE	0x60
+#define CMD_SPECIAL	0x60
+#define CMD_ADDR	0x1f
+
+#define ENABLE		0x00
+#define ATIME		0x01
+#define PTIME		0x02
+#define WTIME		0x03
+#define AILTL		0x04
+#define PILTL		0x08
+#define PERS		0x0c
+#define CONF		0x0d
+#define ID		0x12
+#define STATUS		0x13
+#define CDATAL		0x14
+#define PDATAL		0x1c
+
+#define ENABLE_PON	0x01
+#define ENABLE_AEN	0x02
+#define ENABLE_PEN	0x04
+#define ENABLE_WEN	0x08
+#define ENABLE_AIEN	0x10
+#define ENABLE_PIEN	0x20
+#define STATUS_AVALID	0x01
+#define STATUS_PVALID	0x02
+#define STATUS_AINT	0x10
+#define STATUS_PINT	0x20
+#define CONF_WLONG	0x02
+
+enum phase {
+	PHASE_OFF,
+	PHASE_INIT,
+	PHASE_PROX,
+	PHASE_WAIT,
+	PHASE_RGBC,
+};
+
+static void
+reset(struct sim_tcs3771 *m)
+{
+	sim_cancel(&m->event);
+	memset(m->reg, 0, sizeof(m->reg));
+	m->reg[ATIME] = 0xff;
+	m->reg[PTIME] = 0xff;
+	m->reg[WTIME] = 0xff;
+	m->reg[ID] = 0x11;
+	m->phase = PHASE_OFF;
+	m->pers = 0;
+	sim_gpio_drive(m->int_pin, -1);
+}
+
+static uint16_t
+get16(struct sim_tcs3771 *m, uint8_t reg)
+{
+	return m->reg[reg] | m->reg[reg + 1] << 8;
+}
+
+static void
+put16(struct sim_tcs3771 *m, uint8_t reg, double v, double max)
+{
+	long r = lround(v);
+
+	if (r < 0)
+		r = 0;
+	if (r > max)
+		r = max;
+	m->reg[reg] = r;
+	m->reg[reg + 1] = r >> 8;
+}
+
+static void
+interrupt(struct sim_tcs3771 *m)
+{
+	uint8_t e = m->reg[ENABLE], s = m->reg[STATUS];
+	bool on = ((e & ENABLE_AIEN) && (s & STATUS_AINT)) ||
+		((e & ENABLE_PIEN) && (s & STATUS_PINT));
+
+	/* open drain, active low */
+	sim_gpio_drive(m->int_pin, on ? 0 : -1);
+}
+
+static bool
+outside(struct sim_tcs3771 *m, uint8_t low, uint16_t v)
+{
+	return v < get16(m, low) || v > get16(m, low + 2);
+}
+
+static void
+enter(struct sim_tcs3771 *m, enum phase phase);
+
+/* the phase after `phase' that is enabled, the cycle restarts at proximity */
+static void
+next(struct sim_tcs3771 *m, enum phase phase)
+{
+	uint8_t e = m->reg[ENABLE];
+
+	if (phase < PHASE_PROX && (e & ENABLE_PEN))
+		enter(m, PHASE_PROX);
+	else if (phase < PHASE_WAIT && (e & ENABLE_WEN))
+		enter(m, PHASE_WAIT);
+	else if (phase < PHASE_RGBC && (e & ENABLE_AEN))
+		enter(m, PHASE_RGBC);
+	else if (e & (ENABLE_PEN | ENABLE_WEN | ENABLE_AEN))
+		next(m, PHASE_INIT);
+	else
+		m->phase = PHASE_INIT;	/* idle */
+}
+
+static void
+enter(struct sim_tcs3771 *m, enum phase phase)
+{
+	sim_time_t t;
+
+	m->phase = phase;
+	switch (phase) {
+	case PHASE_PROX:
+		t = (256 - m->reg[PTIME]) * SIM_TCS3771_CYCLE;
+		break;
+	case PHASE_WAIT:
+		t = (256 - m->reg[WTIME]) * SIM_TCS3771_CYCLE;
+		if (m->reg[CONF] & CONF_WLONG)
+			t *= 12;
+		break;
+	case PHASE_RGBC:
+		t = (256 - m->reg[ATIME]) * SIM_TCS3771_CYCLE;
+		m->lit_start = m->led_pin != 0 && sim_gpio_level(m->led_pin) == 1;
+		break;
+	default:
+		t = SIM_TCS3771_INIT;
+	}
+	sim_schedule(&m->event, sim_now() + t);
+}
+
+static void
+phase_done(struct sim_event *e)
+{
+	struct sim_tcs3771 *m = (void *)((char *)e - offsetof(struct sim_tcs3771, event));
+	uint8_t pers = m->reg[PERS];
+
+	switch (m->phase) {
+	case PHASE_PROX:
+		put16(m, PDATAL, sim_signal_at(&m->proximity, sim_now()), 1023);
+		m->reg[STATUS] |= STATUS_PVALID;
+		/* PPERS consecutive cycles out of the thresholds, 0 for every one */
+		if (outside(m, PILTL, get16(m, PDATAL))) {
+			if (++m->pers >= (pers >> 4))
+				m->reg[STATUS] |= STATUS_PINT;
+		} else {
+			m->pers = 0;
+		}
+		break;
+	case PHASE_RGBC: {
+		double max = (256 - m->reg[ATIME]) * 1024.0;
+		bool lit = m->lit_start && sim_gpio_level(m->led_pin) == 1;
+
+		if (max > 65535)
+			max = 65535;
+		for (int i = 0; i < 4; i++)
+			put16(m, CDATAL + 2 * i, sim_signal_at(&m->ambient[i], sim_now()) +
+				(lit ? m->led[i] : 0), max);
+		m->lit += lit;
+		m->cycles++;
+		m->reg[STATUS] |= STATUS_AVALID;
+		/* APERS 0 interrupts every cycle, thresholds or not */
+		if ((pers & 0xf) == 0 || outside(m, AILTL, get16(m, CDATAL)))
+			m->reg[STATUS] |= STATUS_AINT;
+		break;
+	}
+	default:
+		break;
+	}
+	interrupt(m);
+	next(m, m->phase);
+}
+
+static void
+enable(struct sim_tcs3771 *m, uint8_t val)
+{
+	uint8_t was = m->reg[ENABLE];
+
+	m->reg[ENABLE] = val;
+	if (!(val & ENABLE_PON)) {
+		sim_cancel(&m->event);
+		m->phase = PHASE_OFF;
+	} else if (!(was & ENABLE_PON)) {
+		enter(m, PHASE_INIT);
+	} else if (m->phase == PHASE_INIT && !m->event.armed) {
+		next(m, PHASE_INIT);
+	}
+	interrupt(m);
+}
+
+static bool
+start(struct sim_twi_device *d, bool read)
+{
+	struct sim_tcs3771 *m = (struct sim_tcs3771 *)d;
+
+	m->addressed = !read;
+	return true;
+}
+
+static bool
+write(struct sim_twi_device *d, uint8_t byte)
+{
+	struct sim_tcs3771 *m = (struct sim_tcs3771 *)d;
+
+	if (m->addressed) {
+		m->addressed = 0;
+		if (!CHECKF(byte & CMD_SELECT, "TCS3771: command without the select bit"))
+			return false;
+		if ((byte & CMD_TYPE) == CMD_SPECIAL) {
+			/* 5 clears the proximity, 6 the RGBC, 7 both interrupts */
+			if ((byte & CMD_ADDR) & 1)
+				m->reg[STATUS] &= ~STATUS_PINT;
+			if ((byte & CMD_ADDR) & 2)
+				m->reg[STATUS] &= ~STATUS_AINT;
+			interrupt(m);
+			return true;
+		}
+		m->ptr = byte & CMD_ADDR;
+		return true;
+	}
+	if (m->ptr == ENABLE)
+		enable(m, byte);
+	else if (m->ptr < ID)
+		m->reg[m->ptr] = byte;
+	m->ptr = (m->ptr + 1) & CMD_ADDR;
+	return true;
+}
+
+static uint8_t
+read(struct sim_twi_device *d, bool last)
+{
+	struct sim_tcs3771 *m = (struct sim_tcs3771 *)d;
+	uint8_t val = m->reg[m->ptr];
+
+	m->ptr = (m->ptr + 1) & CMD_ADDR;
+	return val;
+}
+
+static void
+power(struct sim_twi_device *d, bool on)
+{
+	reset((struct sim_tcs3771 *)d);
+}
+
+void
+sim_tcs3771_attach(struct sim_tcs3771 *m)
+{
+	m->dev.name = "TCS3771";
+	m->dev.address = 0x29;
+	m->dev.on_sensor_supply = 1;
+	m->dev.start = start;
+	m->dev.write = write;
+	m->dev.read = read;
+	m->dev.power = power;
+	m->event.fire = phase_done;
+	reset(m);
+	sim_twi_attach(&m->dev);
+}
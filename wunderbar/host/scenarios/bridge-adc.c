@@ -0,0 +1,112 @@
+#include <math.h>
+#include <string.h>
+
+#include "sim.h"
+#include "models.h"
+
+/*
+ * bridge-adc: the conversion result on connect and at the sampling
+ * period, following the input, and the converter's automatic mode only
+ * on while connected.
+ */
+
+#define CYCLE(x)	((x) << 5)
+
+static struct sim_signal_point ramp[] = {
+	{6, 0.50},
+	{12, 2.75},
+};
+
+static struct sim_adc121c02 adc = {
+	.input = {.points = ramp, .npoints = 2},
+};
+
+void
+scenario_init(void)
+{
+	sim_adc121c02_attach(&adc);
+}
+
+static uint16_t
+le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static uint16_t
+counts(double v)
+{
+	return lround(v / adc.vref * 4096);
+}
+
+/* notifications n .. n + count - 1 of `c' come `period' ms apart */
+static void
+check_period(struct char_desc *c, unsigned n, unsigned count, double period, double slack)
+{
+	for (unsigned i = n + 1; i < n + count; i++) {
+		const struct sim_notification *a = sim_notification(c, i - 1);
+		const struct sim_notification *b = sim_notification(c, i);
+
+		if (!CHECKF(a != NULL && b != NULL, "notification %u of \"%s\" missing", i, c->desc))
+			return;
+		CHECKF(fabs((b->queued - a->queued) / 1e6 - period) <= slack,
+		    "\"%s\" %u to %u: %.3f ms apart, not %.0f", c->desc, i - 1, i,
+		    (b->queued - a->queued) / 1e6, period);
+	}
+}
+
+void
+scenario(void)
+{
+	struct char_desc *value = sim_char("Bridge-Adc", "Bridge-Adc");
+	struct char_desc *period = sim_char("Bridge-Adc", "sampling period");
+	const struct sim_notification *n;
+	uint32_t ms = 500;
+	uint16_t v;
+
+	CHECK(sim_advertising());
+	sim_run(SIM_MS(100));
+	CHECK(adc.config == 0);
+
+	/* converting from the connection on, a read fetches one result */
+	sim_connect();
+	sim_run(SIM_MS(200));
+	CHECK(adc.config == CYCLE(7));
+	CHECKF(sim_read(value, &v, sizeof(v)) == 2 && v == counts(0.50),
+	    "read %u, not %u", v, counts(0.50));
+	CHECKF(adc.conversions == 1, "%lu conversions", adc.conversions);
+
+	sim_subscribe(value);
+	n = sim_await(value, 3, SIM_S(5));
+	sim_run(sim_conn_interval());
+	if (CHECK(n != NULL))
+		check_period(value, 0, 4, 1000, 10);
+
+	/* faster while the input ramps up, the readings follow it */
+	sim_write(period, &ms, 3);
+	sim_run_until(SIM_S(13));
+	unsigned count = sim_notifications(value);
+	check_period(value, count - 10, 10, 500, 10);
+	for (unsigned i = 0; (n = sim_notification(value, i)) != NULL; i++) {
+		uint16_t lo = counts(sim_signal_at(&adc.input, n->queued - SIM_MS(5)));
+		uint16_t hi = counts(sim_signal_at(&adc.input, n->queued));
+
+		CHECKF(n->len == 2 && le16(n->data) >= lo && le16(n->data) <= hi,
+		    "reading %u: %u, not %u .. %u", i, le16(n->data), lo, hi);
+	}
+	CHECK(le16(sim_notification(value, count - 1)->data) == counts(2.75));
+
+	sim_unsubscribe(value);
+	count = sim_notifications(value);
+	unsigned long conversions = adc.conversions;
+	sim_run(SIM_S(3));
+	CHECK(sim_notifications(value) == count);
+	CHECK(adc.conversions == conversions);
+
+	/* back to power down with the connection */
+	sim_disconnect();
+	sim_run(SIM_MS(100));
+	CHECK(adc.config == 0);
+	CHECK(sim_advertising());
+	CHECK(sim_gap_errors() == 0);
+}
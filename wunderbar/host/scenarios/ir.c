@@ -0,0 +1,189 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "models.h"
+
+/*
+ * ir: an NEC frame decoded from the LED pin, its timing against the
+ * protocol, and the crystal and the carrier timers only running for
+ * the frame.  A power model weighs their on-times with typical nRF51822
+ * currents: rough figures, enough to compare designs, not a measurement.
+ */
+
+#define LED_PIN		25
+#define CARRIER		SIM_US(26)	/* 38 kHz */
+#define LEADER		SIM_US(9000)
+#define BIT_BURST	SIM_US(572)	/* 22 carrier periods */
+/* RTC ticks: 443 and 37 of the LFCLK */
+#define PREAMBLE	(SIM_S(443) / 32768)
+#define TICK		(SIM_S(37) / 32768)
+#define HFCLK_START	SIM_US(1500)
+#define BURSTS		34		/* leader, 32 bits and the stop */
+/* a burst ends when the LED stays dark for longer than a carrier period */
+#define BURST_GAP	SIM_US(100)
+
+#define I_IDLE		3.0	/* uA: system on, RTC and the 32 kHz crystal */
+#define I_HFCLK		470.0	/* uA: the 16 MHz crystal */
+#define I_TIMER		70.0	/* uA: a TIMER running off it */
+#define FRAMES_A_DAY	20
+
+struct payload {
+	uint16_t address;
+	uint16_t command;
+} __attribute__((__packed__));
+
+static struct sim_edge edges[4096];
+static size_t nedges;
+
+struct burst {
+	sim_time_t start;
+	sim_time_t end;
+	unsigned pulses;
+};
+
+/* the bursts in the LED trace, how many there are */
+static unsigned
+bursts(struct burst *b, unsigned size)
+{
+	unsigned n = 0;
+
+	for (size_t i = 0; i < nedges; i++) {
+		if (!edges[i].level)
+			continue;
+		if (n == 0 || edges[i].at - b[n - 1].end > BURST_GAP) {
+			if (n == size)
+				return n + 1;
+			b[n].start = edges[i].at;
+			b[n].pulses = 0;
+			n++;
+		}
+		b[n - 1].end = edges[i].at + CARRIER;
+		b[n - 1].pulses++;
+	}
+	return n;
+}
+
+/* decode a frame, false if it is not NEC */
+static bool
+decode(const struct burst *b, unsigned n, uint8_t out[4])
+{
+	if (!CHECKF(n == BURSTS, "%u bursts", n))
+		return false;
+	CHECKF(llabs((long long)(b[0].end - b[0].start - LEADER)) <= CARRIER,
+	    "leader of %.3f ms", (b[0].end - b[0].start) / 1e6);
+	CHECKF(llabs((long long)(b[1].start - b[0].start - PREAMBLE)) <= SIM_US(5),
+	    "first bit %.3f ms after the leader", (b[1].start - b[0].start) / 1e6);
+	memset(out, 0, 4);
+	for (unsigned i = 1; i < n; i++) {
+		CHECKF(b[i].pulses == 22 && llabs((long long)(b[i].end - b[i].start - BIT_BURST)) <= CARRIER,
+		    "burst %u: %u pulses in %.3f ms", i, b[i].pulses, (b[i].end - b[i].start) / 1e6);
+		if (i == n - 1)
+			break;
+		sim_time_t gap = b[i + 1].start - b[i].start;
+		bool one = llabs((long long)(gap - 2 * TICK)) <= SIM_US(5);
+
+		if (!CHECKF(one || llabs((long long)(gap - TICK)) <= SIM_US(5),
+		    "bit %u: %.3f ms", i - 1, gap / 1e6))
+			return false;
+		if (one)
+			out[(i - 1) / 8] |= 1 << (i - 1) % 8;
+	}
+	return true;
+}
+
+static sim_time_t
+frame(struct char_desc *tx, uint16_t address, uint16_t command)
+{
+	struct payload p = {address, command};
+	struct burst b[BURSTS + 1];
+	sim_time_t hfclk = sim_hfclk_on_time();
+	sim_time_t timer1 = sim_timer_on_time(1);
+	sim_time_t timer2 = sim_timer_on_time(2);
+	sim_time_t constlat = sim_constlat_on_time();
+	sim_time_t start = sim_now();
+	uint8_t got[4];
+	unsigned n;
+
+	sim_gpio_trace(LED_PIN, edges, sizeof(edges) / sizeof(edges[0]), &nedges);
+	sim_write(tx, &p, sizeof(p));
+	/* a write while the frame is out is refused */
+	sim_run(SIM_MS(5));
+	sim_write(tx, &p, sizeof(p));
+	sim_run(SIM_MS(200));
+
+	n = bursts(b, BURSTS + 1);
+	if (!decode(b, n, got))
+		return 0;
+	CHECKF(got[0] == (uint8_t)address && got[1] == (uint8_t)~address &&
+	    got[2] == (uint8_t)command && got[3] == (uint8_t)~command,
+	    "sent %02x %02x %02x %02x for %02x %02x", got[0], got[1], got[2], got[3],
+	    (uint8_t)address, (uint8_t)command);
+	CHECKF(b[0].start - start >= HFCLK_START, "leader %.3f ms after the write, the crystal was not up",
+	    (b[0].start - start) / 1e6);
+	CHECK(sim_gpio_level(LED_PIN) == 0);
+
+	/* the crystal and the carrier only run from the write to the stop burst */
+	sim_time_t len = b[n - 1].end - start;
+	CHECKF(sim_hfclk_on_time() - hfclk <= len + SIM_MS(2),
+	    "HFCLK on for %.3f ms for a %.3f ms frame", (sim_hfclk_on_time() - hfclk) / 1e6, len / 1e6);
+	CHECKF(sim_timer_on_time(1) - timer1 <= len + SIM_MS(2),
+	    "TIMER1 on for %.3f ms for a %.3f ms frame", (sim_timer_on_time(1) - timer1) / 1e6, len / 1e6);
+	CHECKF(sim_timer_on_time(2) - timer2 <= len + SIM_MS(2),
+	    "TIMER2 on for %.3f ms for a %.3f ms frame", (sim_timer_on_time(2) - timer2) / 1e6, len / 1e6);
+	CHECKF(sim_constlat_on_time() - constlat <= len + SIM_MS(2),
+	    "constant latency for %.3f ms for a %.3f ms frame", (sim_constlat_on_time() - constlat) / 1e6,
+	    len / 1e6);
+	return sim_hfclk_on_time() - hfclk;
+}
+
+/* uA s, the model's charge above idle since the on-times given */
+static double
+charge(sim_time_t hfclk, sim_time_t timer1, sim_time_t timer2)
+{
+	return (I_HFCLK * (sim_hfclk_on_time() - hfclk) +
+	    I_TIMER * (sim_timer_on_time(1) - timer1 + sim_timer_on_time(2) - timer2)) / 1e9;
+}
+
+void
+scenario(void)
+{
+	struct char_desc *tx = sim_char("transmitter", "transmitter");
+	sim_time_t on, hfclk, timer1, timer2;
+	double frame_charge, idle;
+
+	CHECK(sim_advertising());
+	sim_run(SIM_MS(100));
+	sim_connect();
+	sim_run(SIM_MS(100));
+	CHECK(sim_hfclk_on_time() == 0);
+
+	hfclk = sim_hfclk_on_time();
+	timer1 = sim_timer_on_time(1);
+	timer2 = sim_timer_on_time(2);
+	on = frame(tx, 0x00, 0x45);
+	frame_charge = charge(hfclk, timer1, timer2);
+	frame(tx, 0x7f, 0xa2);
+
+	/* nothing runs between frames */
+	hfclk = sim_hfclk_on_time();
+	timer1 = sim_timer_on_time(1);
+	timer2 = sim_timer_on_time(2);
+	sim_time_t constlat = sim_constlat_on_time();
+	sim_run(SIM_S(2));
+	CHECK(sim_hfclk_on_time() == hfclk);
+	CHECK(sim_timer_on_time(1) == timer1 && sim_timer_on_time(2) == timer2);
+	CHECK(sim_constlat_on_time() == constlat);
+	CHECK(sim_hfclk_starts() == 2);
+	CHECK(sim_constlat_count() == 2);
+	idle = I_IDLE + charge(hfclk, timer1, timer2) / 2;
+	check_note("HFCLK on for %.3f ms per frame", on / 1e6);
+	check_note("idle %.1f uA (%.0f uA with the crystal held from boot); %.1f uA s a frame, "
+	    "%.2f uA on average at %u frames a day", idle, I_IDLE + I_HFCLK, frame_charge,
+	    idle + frame_charge * FRAMES_A_DAY / 86400, FRAMES_A_DAY);
+
+	sim_disconnect();
+	CHECK(sim_advertising());
+	CHECK(sim_gap_errors() == 0);
+}
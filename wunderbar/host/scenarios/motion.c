@@ -0,0 +1,303 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "models.h"
+
+/*
+ * motion: samples at the sampling period with the chip asleep in
+ * between, the fused attitude through a turn at a constant rate, the
+ * spectrum of a vibration with the samples still on time, steps and a
+ * shock window.
+ */
+
+#define G_LSB		16384	/* +-2 g, the power-on range */
+
+/* what the accelerometer sees on top of gravity, switched by the scenario */
+static struct {
+	double vibration;	/* g, at VIBRATION_HZ on z */
+	double walk;		/* g, at STEP_HZ on z */
+	double shock_at;	/* s, a SHOCK_G knock on x */
+} motion;
+
+#define VIBRATION_HZ	60.0
+#define STEP_HZ		2.0
+#define SHOCK_G		1.5
+#define SHOCK_LEN	0.004	/* s */
+
+#define TURN_DPS	90.0
+#define TURN_LEN	2.0	/* s */
+
+static double
+accel_x(double t, void *arg)
+{
+	return motion.shock_at != 0 && t >= motion.shock_at &&
+		t < motion.shock_at + SHOCK_LEN ? SHOCK_G : 0;
+}
+
+static double
+accel_z(double t, void *arg)
+{
+	return 1 + motion.vibration * sin(2 * M_PI * VIBRATION_HZ * t) +
+		motion.walk * sin(2 * M_PI * STEP_HZ * t);
+}
+
+static struct sim_signal_point turn[4];
+
+static struct sim_mpu6500 mpu = {
+	.accel = {{.fn = accel_x}, {.value = 0}, {.fn = accel_z}},
+	.gyro = {{.value = 0}, {.value = 0}, {.points = turn, .npoints = 4}},
+};
+
+void
+scenario_init(void)
+{
+	sim_mpu6500_attach(&mpu);
+}
+
+static int16_t
+le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t
+le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* notifications n .. n + count - 1 of `c' come `period' ms apart */
+static void
+check_period(struct char_desc *c, unsigned n, unsigned count, double period, double slack)
+{
+	for (unsigned i = n + 1; i < n + count; i++) {
+		const struct sim_notification *a = sim_notification(c, i - 1);
+		const struct sim_notification *b = sim_notification(c, i);
+
+		if (!CHECKF(a != NULL && b != NULL, "notification %u of \"%s\" missing", i, c->desc))
+			return;
+		CHECKF(fabs((b->queued - a->queued) / 1e6 - period) <= slack,
+		    "\"%s\" %u to %u: %.3f ms apart, not %.0f", c->desc, i - 1, i,
+		    (b->queued - a->queued) / 1e6, period);
+	}
+}
+
+/* degrees the Q14 quaternion w, x, y, z turns about z */
+static double
+yaw(const uint8_t *q)
+{
+	return 2 * atan2(le16(&q[6]), le16(&q[0])) * 180 / M_PI;
+}
+
+static void
+set_period(struct char_desc *c, uint32_t ms)
+{
+	sim_write(c, &ms, 3);
+}
+
+static void
+samples(struct char_desc *value)
+{
+	const struct sim_notification *n;
+	unsigned long wakeups = mpu.wakeups;
+
+	sim_subscribe(value);
+	n = sim_await(value, 3, SIM_S(5));
+	if (!CHECK(n != NULL))
+		return;
+	check_period(value, 0, 4, 1000, 10);
+	for (unsigned i = 0; (n = sim_notification(value, i)) != NULL; i++) {
+		CHECKF(n->len == 12, "sample %u: %u bytes", i, n->len);
+		CHECKF(le16(&n->data[0]) == 0 && le16(&n->data[2]) == 0 &&
+		    le16(&n->data[4]) == G_LSB, "sample %u: accel %d %d %d", i,
+		    le16(&n->data[0]), le16(&n->data[2]), le16(&n->data[4]));
+		CHECKF(le16(&n->data[6]) == 0 && le16(&n->data[8]) == 0 &&
+		    le16(&n->data[10]) == 0, "sample %u: gyro %d %d %d", i,
+		    le16(&n->data[6]), le16(&n->data[8]), le16(&n->data[10]));
+	}
+	/* asleep between samples a second apart */
+	CHECKF(mpu.wakeups - wakeups == 4, "%lu wakeups for 4 samples", mpu.wakeups - wakeups);
+	sim_unsubscribe(value);
+}
+
+static void
+orientation(struct char_desc *period, struct char_desc *attitude)
+{
+	double t0 = sim_now() / 1e9 + 0.5;
+	const struct sim_notification *n;
+	unsigned i;
+
+	turn[0] = (struct sim_signal_point){t0, 0};
+	turn[1] = (struct sim_signal_point){t0 + 0.001, TURN_DPS};
+	turn[2] = (struct sim_signal_point){t0 + TURN_LEN, TURN_DPS};
+	turn[3] = (struct sim_signal_point){t0 + TURN_LEN + 0.001, 0};
+
+	set_period(period, 250);
+	sim_subscribe(attitude);
+	sim_run_until(SIM_S(t0 + TURN_LEN + 1));
+	check_period(attitude, 0, sim_notifications(attitude), 250, 10);
+	/* the filter follows within a fusion period */
+	for (i = 0; (n = sim_notification(attitude, i)) != NULL; i++) {
+		double t = n->queued / 1e9 - t0;
+		double want = TURN_DPS * (t < 0 ? 0 : t > TURN_LEN ? TURN_LEN : t);
+
+		CHECKF(fabs(yaw(n->data) - want) <= 3,
+		    "attitude %u at %+.3f s: %.1f deg, not %.1f", i, t, yaw(n->data), want);
+	}
+	if (CHECK(i > 0)) {
+		n = sim_notification(attitude, i - 1);
+		CHECKF(fabs(yaw(n->data) - TURN_DPS * TURN_LEN) <= 3,
+		    "turned %.1f deg, not %.0f", yaw(n->data), TURN_DPS * TURN_LEN);
+		CHECKF(abs(le16(&n->data[2])) < 200 && abs(le16(&n->data[4])) < 200,
+		    "tilted: x %d y %d", le16(&n->data[2]), le16(&n->data[4]));
+	}
+	sim_unsubscribe(attitude);
+	set_period(period, 1000);
+}
+
+static void
+vibration(struct char_desc *value, struct char_desc *period, struct char_desc *spectrum)
+{
+	const struct sim_notification *n;
+	unsigned first;
+
+	motion.vibration = 0.5;
+	set_period(period, 250);
+	sim_subscribe(value);
+	sim_run(SIM_MS(500));
+	first = sim_notifications(value);
+	sim_subscribe(spectrum);
+	n = sim_await(spectrum, 1, SIM_S(2));
+	/* samples on time while the FIFO fills */
+	check_period(value, first, sim_notifications(value) - first, 250, 10);
+	if (CHECK(n != NULL)) {
+		for (unsigned i = 0; (n = sim_notification(spectrum, i)) != NULL; i++) {
+			CHECKF(le16(&n->data[0]) == 1000 && le16(&n->data[2]) == 256,
+			    "spectrum %u: %u points at %u Hz", i, le16(&n->data[2]), le16(&n->data[0]));
+			CHECKF(abs(le16(&n->data[8]) - (int)(VIBRATION_HZ * 10)) <= 10,
+			    "spectrum %u: peak at %.1f Hz", i, le16(&n->data[8]) / 10.0);
+			CHECKF(abs(le16(&n->data[10]) - 500) <= 50,
+			    "spectrum %u: peak of %u mg", i, le16(&n->data[10]));
+			/* v = a / (2 pi f), RMS */
+			double v = motion.vibration * 9.80665 / (2 * M_PI * VIBRATION_HZ) / sqrt(2) * 1e6;
+			CHECKF(fabs(le32(&n->data[4]) - v) <= 0.1 * v,
+			    "spectrum %u: %u um/s, not %.0f", i, le32(&n->data[4]), v);
+		}
+	}
+	sim_unsubscribe(spectrum);
+	sim_unsubscribe(value);
+	set_period(period, 1000);
+	motion.vibration = 0;
+	CHECK(mpu.fifo_overflows == 0);
+}
+
+static void
+steps(struct char_desc *count, struct char_desc *activity)
+{
+	const struct sim_notification *n;
+	unsigned walked;
+
+	sim_subscribe(count);
+	sim_subscribe(activity);
+	sim_run(SIM_S(2));
+	CHECK(sim_notifications(count) == 0);
+	motion.walk = 0.3;
+	sim_run(SIM_S(10));
+	motion.walk = 0;
+	walked = sim_notifications(count);
+	if (CHECK(walked > 0)) {
+		n = sim_notification(count, walked - 1);
+		CHECKF(abs((int)le32(n->data) - (int)(10 * STEP_HZ)) <= 2,
+		    "%u steps, not %.0f", le32(n->data), 10 * STEP_HZ);
+	}
+	n = sim_notification(activity, 0);
+	CHECKF(n != NULL && n->data[0] == 1, "not walking");
+	sim_run(SIM_S(5));
+	CHECK(sim_notifications(count) == walked);
+	n = sim_notification(activity, sim_notifications(activity) - 1);
+	CHECKF(n != NULL && n->data[0] == 0, "not still after walking");
+	sim_unsubscribe(count);
+	sim_unsubscribe(activity);
+}
+
+static void
+shock(struct char_desc *event, struct char_desc *config, struct char_desc *data)
+{
+	struct {
+		uint8_t armed;
+		uint8_t rate_shift;
+		uint16_t threshold;
+	} __attribute__((__packed__)) arm = {1, 0, 1500};
+	const struct sim_notification *n;
+	uint8_t chunk[20];
+	int16_t window[128][3];
+	unsigned got = 0;
+
+	sim_subscribe(event);
+	sim_write(config, &arm, sizeof(arm));
+	sim_run(SIM_MS(500));
+	CHECK(sim_notifications(event) == 0);
+	motion.shock_at = sim_now() / 1e9 + 0.2;
+	n = sim_await(event, 1, SIM_S(1));
+	if (!CHECK(n != NULL))
+		return;
+	CHECKF(sim_notification(event, 0)->data[10] == 2, "first event in state %u",
+	    sim_notification(event, 0)->data[10]);
+	CHECKF(n->data[10] == 3, "second event in state %u", n->data[10]);
+	CHECKF(fabs(le32(n->data) - motion.shock_at * 1000) <= 30,
+	    "shock at %u ms, not %.0f", le32(n->data), motion.shock_at * 1000);
+	double peak = sqrt(SHOCK_G * SHOCK_G + 1) * 1000;
+	CHECKF(fabs(le16(&n->data[4]) - peak) <= 0.02 * peak,
+	    "peak %u mg, not %.0f", le16(&n->data[4]), peak);
+	CHECK(le16(&n->data[6]) == 1000 && le16(&n->data[8]) == 128);
+
+	/* the window, the knock right after the pre trigger samples */
+	for (;;) {
+		uint16_t index;
+
+		CHECK(sim_read(data, chunk, sizeof(chunk)) == sizeof(chunk));
+		index = le16(chunk);
+		if (index >= 128)
+			break;
+		if (!CHECKF(index == got, "chunk at %u, not %u", index, got))
+			break;
+		for (unsigned i = 0; i < 3 && got < 128; i++, got++)
+			for (unsigned axis = 0; axis < 3; axis++)
+				window[got][axis] = le16(&chunk[2 + 6 * i + 2 * axis]);
+	}
+	if (CHECK(got == 128)) {
+		CHECKF(window[63][0] == 0, "knock before the trigger");
+		CHECKF(window[64][0] == SHOCK_G * G_LSB, "trigger sample x %d", window[64][0]);
+		CHECKF(window[70][0] == 0 && window[70][2] == G_LSB, "knock after 4 ms");
+	}
+	sim_unsubscribe(event);
+	motion.shock_at = 0;
+	CHECK(mpu.fifo_overflows == 0);
+}
+
+void
+scenario(void)
+{
+	struct char_desc *value = sim_char("Motion", "Motion");
+	struct char_desc *period = sim_char("Motion", "sampling period");
+
+	CHECK(sim_advertising());
+	sim_run(SIM_MS(100));
+	/* reset and configured, asleep */
+	CHECK(mpu.wakeups == 0);
+	sim_connect();
+	sim_run(SIM_MS(100));
+
+	samples(value);
+	orientation(period, sim_char("Motion", "orientation"));
+	vibration(value, period, sim_char("Motion", "vibration"));
+	steps(sim_char("Motion", "steps"), sim_char("Motion", "activity"));
+	shock(sim_char("Motion", "shock"), sim_char("Motion", "shock config"),
+		sim_char("Motion", "shock data"));
+
+	sim_disconnect();
+	CHECK(sim_advertising());
+	CHECK(sim_gap_errors() == 0);
+}
@@ -0,0 +1,149 @@
+#include <math.h>
+#include <string.h>
+
+#include "sim.h"
+#include "models.h"
+
+/*
+ * noiselvl: the microphone's level through the converter on AIN7,
+ * converted only once the converter has warmed up, notified at the
+ * sampling period with the converter off in between.
+ */
+
+#define PIN_CONVERTER	11	/* active low */
+#define PIN_OPAMP	12
+#define PIN_SWITCH_ON	13
+#define AIN		7
+#define WARMUP		SIM_MS(75)
+#define SETTLING	0.05	/* V, before the converter is up */
+
+static struct sim_signal_point noise[] = {
+	{5, 0.30},
+	{9, 0.90},
+};
+
+static struct {
+	struct sim_signal level;	/* V */
+	struct sim_edge edges[256];
+	size_t nedges;
+	unsigned long conversions;
+	unsigned long early;		/* converted before the warmup was over */
+} mic = {
+	.level = {.points = noise, .npoints = 2},
+};
+
+static bool
+converter_on(void)
+{
+	return sim_gpio_level(PIN_CONVERTER) == 0 && sim_gpio_level(PIN_OPAMP) == 1 &&
+		sim_gpio_level(PIN_SWITCH_ON) == 1;
+}
+
+/* what AIN7 sees, the switch's last edge tells the warmup */
+static double
+mic_volts(void *arg)
+{
+	sim_time_t since = mic.nedges > 0 ? mic.edges[(mic.nedges - 1) % 256].at : 0;
+
+	mic.conversions++;
+	if (!converter_on())
+		return 0;
+	if (sim_now() - since < WARMUP) {
+		mic.early++;
+		return SETTLING;
+	}
+	return sim_signal_at(&mic.level, sim_now());
+}
+
+static uint16_t
+counts(double v)
+{
+	return lround(v / 1.2 * 1023);
+}
+
+void
+scenario_init(void)
+{
+	sim_adc_input(AIN, mic_volts, NULL);
+}
+
+static uint16_t
+le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+/* notifications n .. n + count - 1 of `c' come `period' ms apart */
+static void
+check_period(struct char_desc *c, unsigned n, unsigned count, double period, double slack)
+{
+	for (unsigned i = n + 1; i < n + count; i++) {
+		const struct sim_notification *a = sim_notification(c, i - 1);
+		const struct sim_notification *b = sim_notification(c, i);
+
+		if (!CHECKF(a != NULL && b != NULL, "notification %u of \"%s\" missing", i, c->desc))
+			return;
+		CHECKF(fabs((b->queued - a->queued) / 1e6 - period) <= slack,
+		    "\"%s\" %u to %u: %.3f ms apart, not %.0f", c->desc, i - 1, i,
+		    (b->queued - a->queued) / 1e6, period);
+	}
+}
+
+void
+scenario(void)
+{
+	struct char_desc *level = sim_char("Noise level", "Noise level");
+	const struct sim_notification *n;
+	uint16_t v;
+
+	/* the ring is indexed modulo its size, see mic_volts() */
+	sim_gpio_trace(PIN_SWITCH_ON, mic.edges, 256, &mic.nedges);
+	CHECK(sim_advertising());
+	CHECK(!converter_on());
+	sim_run(SIM_MS(100));
+
+	/* measured on connect */
+	sim_connect();
+	sim_run(SIM_MS(200));
+	CHECK(mic.conversions == 1);
+	CHECK(sim_read(level, &v, sizeof(v)) == 2 && v == counts(0.30));
+	CHECK(!converter_on());
+
+	sim_subscribe(level);
+	n = sim_await(level, 3, SIM_S(5));
+	sim_run(sim_conn_interval());
+	if (CHECK(n != NULL))
+		check_period(level, 0, 4, 1000, 10);
+
+	/* louder, the readings follow */
+	sim_run_until(SIM_S(10));
+	unsigned count = sim_notifications(level);
+	for (unsigned i = 0; (n = sim_notification(level, i)) != NULL; i++) {
+		/* converted up to the pre-warm latency before it went out */
+		uint16_t lo = counts(sim_signal_at(&mic.level, n->queued - SIM_MS(80)));
+		uint16_t hi = counts(sim_signal_at(&mic.level, n->queued));
+
+		CHECKF(n->len == 2 && le16(n->data) >= lo && le16(n->data) <= hi,
+		    "level %u: %u, not %u .. %u", i, le16(n->data), lo, hi);
+	}
+	CHECK(le16(sim_notification(level, count - 1)->data) == counts(0.90));
+	CHECK(mic.early == 0);
+
+	/* the converter only runs around a sample */
+	n = sim_notification(level, count - 1);
+	sim_run_until(n->queued + SIM_MS(200));
+	CHECK(!converter_on());
+	CHECKF(mic.nedges <= 2 * (count + 1), "converter switched %zu times for %u samples",
+	    mic.nedges, count + 1);
+
+	sim_unsubscribe(level);
+	count = sim_notifications(level);
+	unsigned long conversions = mic.conversions;
+	sim_run(SIM_S(3));
+	CHECK(sim_notifications(level) == count);
+	CHECK(mic.conversions == conversions);
+
+	sim_disconnect();
+	CHECK(sim_advertising());
+	CHECK(sim_gap_errors() == 0);
+}
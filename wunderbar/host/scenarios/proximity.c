@@ -0,0 +1,129 @@
+#include <math.h>
+#include <string.h>
+
+#include "sim.h"
+#include "models.h"
+
+/*
+ * proximity: readings at the sampling period off the conversion
+ * interrupt, the LED lighting the colour integration only, and the
+ * sensor supply off between samples.
+ */
+
+#define INT_PIN		25
+#define LED_PIN		21
+
+static struct sim_signal_point approach[] = {
+	{8, 200},
+	{10, 800},
+};
+
+static struct sim_tcs3771 tcs = {
+	.int_pin = INT_PIN,
+	.led_pin = LED_PIN,
+	.proximity = {.points = approach, .npoints = 2},
+	.ambient = {{.value = 1000}, {.value = 300}, {.value = 400}, {.value = 200}},
+	.led = {400, 100, 150, 120},
+};
+
+void
+scenario_init(void)
+{
+	sim_tcs3771_attach(&tcs);
+}
+
+static uint16_t
+le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+/* notifications n .. n + count - 1 of `c' come `period' ms apart */
+static void
+check_period(struct char_desc *c, unsigned n, unsigned count, double period, double slack)
+{
+	for (unsigned i = n + 1; i < n + count; i++) {
+		const struct sim_notification *a = sim_notification(c, i - 1);
+		const struct sim_notification *b = sim_notification(c, i);
+
+		if (!CHECKF(a != NULL && b != NULL, "notification %u of \"%s\" missing", i, c->desc))
+			return;
+		CHECKF(fabs((b->queued - a->queued) / 1e6 - period) <= slack,
+		    "\"%s\" %u to %u: %.3f ms apart, not %.0f", c->desc, i - 1, i,
+		    (b->queued - a->queued) / 1e6, period);
+	}
+}
+
+void
+scenario(void)
+{
+	struct char_desc *prox = sim_char("Proximity", "Proximity");
+	struct char_desc *rgb = sim_char("RGB", "RGB");
+	const struct sim_notification *n;
+	unsigned i;
+
+	CHECK(sim_advertising());
+	sim_run(SIM_MS(100));
+	sim_connect();
+	sim_run(SIM_MS(100));
+	CHECK(!sim_sensor_supply());
+
+	/* proximity alone leaves the LED off */
+	sim_subscribe(prox);
+	n = sim_await(prox, 4, SIM_S(6));
+	sim_run(sim_conn_interval());
+	if (CHECK(n != NULL))
+		check_period(prox, 0, 5, 1000, 10);
+	for (i = 0; (n = sim_notification(prox, i)) != NULL; i++)
+		CHECKF(n->len == 2 && le16(n->data) == 200, "proximity %u: %u", i, le16(n->data));
+	CHECK(tcs.lit == 0);
+	CHECK(tcs.cycles == i);
+
+	/* the colour under the LED, lit for the integration only */
+	sim_subscribe(rgb);
+	n = sim_await(rgb, 2, SIM_S(4));
+	if (CHECK(n != NULL))
+		check_period(rgb, 0, 3, 1000, 10);
+	for (i = 0; (n = sim_notification(rgb, i)) != NULL; i++) {
+		CHECKF(n->len == 8, "colour %u: %u bytes", i, n->len);
+		for (unsigned c = 0; c < 4; c++) {
+			double want = tcs.ambient[c].value + tcs.led[c];
+
+			CHECKF(le16(&n->data[2 * c]) == want, "colour %u channel %u: %u, not %.0f",
+			    i, c, le16(&n->data[2 * c]), want);
+		}
+	}
+	CHECK(tcs.lit == i);
+	CHECK(sim_gpio_level(LED_PIN) == 0);
+	sim_unsubscribe(rgb);
+
+	/* something comes closer */
+	sim_run_until(SIM_S(11));
+	unsigned count = sim_notifications(prox);
+	for (i = 0; (n = sim_notification(prox, i)) != NULL; i++) {
+		/* read at the end of the cycle, up to TCS3771_LATENCY after the request */
+		double lo = sim_signal_at(&tcs.proximity, n->queued - SIM_MS(140));
+		double hi = sim_signal_at(&tcs.proximity, n->queued);
+
+		CHECKF(le16(n->data) >= floor(lo) && le16(n->data) <= ceil(hi),
+		    "proximity %u: %u, not %.0f .. %.0f", i, le16(n->data), lo, hi);
+	}
+	CHECK(le16(sim_notification(prox, count - 1)->data) == 800);
+
+	/* asleep between samples: supply off, the interrupt line released */
+	n = sim_notification(prox, count - 1);
+	sim_run_until(n->queued + SIM_MS(500));
+	CHECK(!sim_sensor_supply());
+	CHECK(sim_gpio_level(INT_PIN) == 1);
+
+	sim_unsubscribe(prox);
+	count = sim_notifications(prox);
+	unsigned long cycles = tcs.cycles;
+	sim_run(SIM_S(3));
+	CHECK(sim_notifications(prox) == count);
+	CHECK(tcs.cycles == cycles);
+
+	sim_disconnect();
+	CHECK(sim_advertising());
+	CHECK(sim_gap_errors() == 0);
+}
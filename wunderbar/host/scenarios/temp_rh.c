@@ -0,0 +1,119 @@
+#include <math.h>
+#include <string.h>
+
+#include "sim.h"
+#include "models.h"
+#include "connparam.h"
+
+/*
+ * temp_rh: readings on connect, notifications at the sampling period
+ * with values following the air, the connection parameters the central
+ * took, and the sensor supply off between samples.
+ */
+
+static struct sim_signal_point warming[] = {
+	{10, 22.2},
+	{16, 28.2},
+};
+
+static struct sim_htu21 htu21 = {
+	.temp = {.points = warming, .npoints = 2},
+	.rh = {.value = 40.4},
+};
+
+void
+scenario_init(void)
+{
+	sim_htu21_attach(&htu21);
+}
+
+/* notifications n .. n + count - 1 of `c' come `period' ms apart */
+static void
+check_period(struct char_desc *c, unsigned n, unsigned count, double period, double slack)
+{
+	for (unsigned i = n + 1; i < n + count; i++) {
+		const struct sim_notification *a = sim_notification(c, i - 1);
+		const struct sim_notification *b = sim_notification(c, i);
+
+		if (!CHECKF(a != NULL && b != NULL, "notification %u of \"%s\" missing", i, c->desc))
+			return;
+		CHECKF(fabs((b->queued - a->queued) / 1e6 - period) <= slack,
+		    "\"%s\" %u to %u: %.3f ms apart, not %.0f", c->desc, i - 1, i,
+		    (b->queued - a->queued) / 1e6, period);
+		CHECKF(b->sent != 0 && b->sent - b->queued <= sim_conn_interval(),
+		    "\"%s\" %u waited for a second connection event", c->desc, i);
+	}
+}
+
+void
+scenario(void)
+{
+	struct char_desc *temp = sim_char("Temperature", "Temperature");
+	struct char_desc *rh = sim_char("Relative Humidity", "Relative Humidity");
+	struct char_desc *period = sim_char("Temperature", "sampling period");
+	struct char_desc *conn = sim_char("Relative Humidity", "connection parameters");
+	struct connparam_status cp;
+	const struct sim_notification *n;
+	uint32_t ms = 2000;
+	int8_t t;
+	uint8_t h;
+
+	CHECK(sim_advertising());
+	sim_run(SIM_MS(100));
+	sim_connect();
+
+	/* both measured on connect, from one power up; nothing to read before */
+	CHECK(sim_read(temp, &t, sizeof(t)) == 0);
+	sim_run(SIM_MS(200));
+	CHECK(htu21.measurements == 2);
+	CHECK(sim_read(temp, &t, sizeof(t)) == 1 && t == 22);
+	CHECK(sim_read(rh, &h, sizeof(h)) == 1 && h == 40);
+	sim_read(conn, &cp, sizeof(cp));
+	CHECK(SIM_US(cp.max_interval * 1250) == SIM_CONN_INTERVAL && cp.requests == 0);
+
+	sim_subscribe(temp);
+	n = sim_await(temp, 5, SIM_S(7));
+	sim_run(sim_conn_interval());
+	if (CHECK(n != NULL))
+		check_period(temp, 0, 6, 1000, 10);
+	for (unsigned i = 0; (n = sim_notification(temp, i)) != NULL; i++)
+		CHECKF((int8_t)n->data[0] == 22, "temperature %u: %d", i, (int8_t)n->data[0]);
+
+	/* a slower period, the air warms up meanwhile */
+	sim_write(period, &ms, 3);
+	sim_run_until(SIM_S(20));
+	unsigned count = sim_notifications(temp);
+	check_period(temp, count - 5, 5, 2000, 10);
+	for (unsigned i = 0; (n = sim_notification(temp, i)) != NULL; i++) {
+		double air = sim_signal_at(&htu21.temp, n->queued);
+
+		CHECKF(fabs((int8_t)n->data[0] - air) <= 1,
+		    "temperature %u: %d, the air %.1f", i, (int8_t)n->data[0], air);
+	}
+	CHECK((int8_t)sim_notification(temp, count - 1)->data[0] == 28);
+
+	/* the parameters the central took, not the range asked for */
+	sim_read(conn, &cp, sizeof(cp));
+	CHECKF(sim_conn_param_updates() != 0 && cp.requests == sim_conn_param_updates() &&
+	    cp.min_interval == cp.max_interval &&
+	    SIM_US(cp.max_interval * 1250) == sim_conn_interval(),
+	    "%u updates, %u requests, interval %u..%u", sim_conn_param_updates(),
+	    cp.requests, cp.min_interval, cp.max_interval);
+
+	/* the sensor only gets power around a measurement */
+	n = sim_notification(temp, count - 1);
+	sim_run_until(n->queued + SIM_MS(1000));
+	CHECK(!sim_sensor_supply());
+	CHECK(htu21.early_reads == 0);
+
+	sim_unsubscribe(temp);
+	count = sim_notifications(temp);
+	unsigned measured = htu21.measurements;
+	sim_run(SIM_S(5));
+	CHECK(sim_notifications(temp) == count);
+	CHECK(htu21.measurements == measured);
+
+	sim_disconnect();
+	CHECK(sim_advertising());
+	CHECK(sim_gap_errors() == 0);
+}
@@ -0,0 +1,142 @@
+#include <math.h>
+
+#include "sim_internal.h"
+
+/*
+ * The 10 bit successive approximation ADC: one conversion per
+ * TASKS_START, END after the data sheet conversion time, with the
+ * CONFIG of the start.  Inputs are functions of time set by the
+ * scenario; the supply defaults to 3 V.
+ */
+
+NRF_ADC_Type sim_nrf_adc;
+
+static const sim_time_t conversion[] = {SIM_US(20), SIM_US(36), SIM_US(68), SIM_US(68)};
+
+static struct {
+	uint32_t inten;
+	uint32_t config;
+	double vdd;
+	double (*input[8])(void *arg);
+	void *arg[8];
+	struct sim_event end;
+} adc;
+
+void
+sim_adc_input(uint8_t ain, double (*volts)(void *arg), void *arg)
+{
+	adc.input[ain] = volts;
+	adc.arg[ain] = arg;
+}
+
+void
+sim_supply(double volts)
+{
+	adc.vdd = volts;
+}
+
+static double
+ain(uint32_t config)
+{
+	uint32_t psel = (config & ADC_CONFIG_PSEL_Msk) >> ADC_CONFIG_PSEL_Pos;
+
+	for (int i = 0; i < 8; i++) {
+		if (psel != 1UL << i)
+			continue;
+		return adc.input[i] != NULL ? adc.input[i](adc.arg[i]) : 0;
+	}
+	CHECKF(0, "ADC conversion with PSEL %02x", psel);
+	return 0;
+}
+
+static uint32_t
+convert(uint32_t config)
+{
+	uint32_t bits = 8 + ((config & ADC_CONFIG_RES_Msk) >> ADC_CONFIG_RES_Pos);
+	double v, ref;
+
+	switch ((config & ADC_CONFIG_INPSEL_Msk) >> ADC_CONFIG_INPSEL_Pos) {
+	case ADC_CONFIG_INPSEL_AnalogInputNoPrescaling:
+		v = ain(config);
+		break;
+	case ADC_CONFIG_INPSEL_AnalogInputTwoThirdsPrescaling:
+		v = ain(config) * 2 / 3;
+		break;
+	case ADC_CONFIG_INPSEL_AnalogInputOneThirdPrescaling:
+		v = ain(config) / 3;
+		break;
+	case ADC_CONFIG_INPSEL_SupplyTwoThirdsPrescaling:
+		v = adc.vdd * 2 / 3;
+		break;
+	case ADC_CONFIG_INPSEL_SupplyOneThirdPrescaling:
+		v = adc.vdd / 3;
+		break;
+	default:
+		CHECKF(0, "ADC conversion with a reserved INPSEL");
+		return 0;
+	}
+	switch ((config & ADC_CONFIG_REFSEL_Msk) >> ADC_CONFIG_REFSEL_Pos) {
+	case ADC_CONFIG_REFSEL_VBG:
+		ref = 1.2;
+		break;
+	case ADC_CONFIG_REFSEL_SupplyOneHalfPrescaling:
+		ref = adc.vdd / 2;
+		break;
+	case ADC_CONFIG_REFSEL_SupplyOneThirdPrescaling:
+		ref = adc.vdd / 3;
+		break;
+	default:
+		CHECKF(0, "ADC conversion against an external reference");
+		return 0;
+	}
+	double max = (1UL << (bits > 10 ? 10 : bits)) - 1;
+	double r = round(v / ref * max);
+	return r < 0 ? 0 : r > max ? max : r;
+}
+
+static void
+end(struct sim_event *e)
+{
+	SIM_REG(sim_nrf_adc.RESULT) = convert(adc.config);
+	SIM_REG(sim_nrf_adc.BUSY) = 0;
+	sim_event_raise(&sim_nrf_adc.EVENTS_END);
+	if (adc.inten & ADC_INTENSET_END_Msk)
+		sim_irq_pend(ADC_IRQn);
+}
+
+void
+sim_adc_init(void)
+{
+	adc.vdd = 3.0;
+	adc.end.fire = end;
+	sim_nrf_adc.POWER = 1;
+}
+
+void
+sim_adc_sync(void)
+{
+	NRF_ADC_Type *a = &sim_nrf_adc;
+
+	adc.inten = (adc.inten | a->INTENSET) & ~a->INTENCLR;
+	a->INTENSET = adc.inten;
+	a->INTENCLR = 0;
+	if (a->TASKS_STOP) {
+		a->TASKS_STOP = 0;
+		sim_cancel(&adc.end);
+		SIM_REG(a->BUSY) = 0;
+	}
+	if (a->TASKS_START) {
+		a->TASKS_START = 0;
+		if (CHECKF(a->ENABLE & 1, "ADC started while disabled") && !a->BUSY) {
+			adc.config = a->CONFIG;
+			SIM_REG(a->BUSY) = 1;
+			sim_schedule(&adc.end, sim_now() +
+				conversion[(adc.config & ADC_CONFIG_RES_Msk) >> ADC_CONFIG_RES_Pos]);
+		}
+	}
+	if (!(a->ENABLE & 1) && a->BUSY) {
+		/* disabling aborts the conversion */
+		sim_cancel(&adc.end);
+		SIM_REG(a->BUSY) = 0;
+	}
+}
@@ -0,0 +1,60 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "check.h"
+
+double (*check_clock)(void);
+
+static unsigned checks;
+static unsigned failures;
+
+static void
+prefix(void)
+{
+	if (check_clock != NULL)
+		printf("[%10.3f ms] ", check_clock());
+}
+
+bool
+check(bool ok, const char *file, int line, const char *fmt, ...)
+{
+	va_list ap;
+
+	checks++;
+	if (ok)
+		return true;
+	failures++;
+	prefix();
+	printf("%s:%d: FAIL: ", file, line);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	putchar('\n');
+	return false;
+}
+
+void
+check_note(const char *fmt, ...)
+{
+	va_list ap;
+
+	prefix();
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	putchar('\n');
+}
+
+int
+check_exit(const char *name)
+{
+	printf("%s: %u checks, %u failed\n", name, checks, failures);
+	fflush(stdout);
+	return failures != 0;
+}
+
+unsigned
+check_failures(void)
+{
+	return failures;
+}
@@ -0,0 +1,27 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+/*
+ * Checks for the host tests.  A failed check is reported with its
+ * location and, under the simulator, the simulated time; the test goes
+ * on.  check_exit() prints the tally and gives the exit status.
+ */
+
+#include <stdbool.h>
+
+#define CHECK(cond) \
+	check(!!(cond), __FILE__, __LINE__, "%s", #cond)
+#define CHECKF(cond, ...) \
+	check(!!(cond), __FILE__, __LINE__, __VA_ARGS__)
+
+bool check(bool ok, const char *file, int line, const char *fmt, ...)
+	__attribute__((format(printf, 4, 5)));
+void check_note(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+int check_exit(const char *name);
+/* failed so far, for a child of sim_boot() to pass on as its status */
+unsigned check_failures(void);
+
+/* the simulator prefixes reports with its time */
+extern double (*check_clock)(void);
+
+#endif /* CHECK_H */
@@ -0,0 +1,197 @@
+#include <string.h>
+
+#include "sim_internal.h"
+
+/*
+ * GPIO and GPIOTE.  A pin's level comes from the GPIOTE task channel
+ * that owns it, its output latch when it is an output, or else an
+ * external driver (a sensor model) or its pull.  IN shows the levels
+ * of the pins with a connected input buffer.  GPIOTE event channels
+ * see the level changes as they happen.  Like the other blocks with a
+ * POWER register, GPIOTE loses its configuration when switched off.
+ */
+
+#define PINS	32
+
+NRF_GPIO_Type sim_nrf_gpio;
+NRF_GPIOTE_Type sim_nrf_gpiote;
+
+static struct {
+	int8_t drive[PINS];
+	uint32_t levels;
+	uint32_t gpiote_inten;
+	uint32_t gpiote_config[4];
+	uint8_t task_level[4];
+	struct {
+		struct sim_edge *buf;
+		size_t size;
+		size_t *count;
+	} trace[PINS];
+} gpio;
+
+static int
+owner(uint8_t pin)
+{
+	if (!(sim_nrf_gpiote.POWER & 1))
+		return -1;
+	for (int i = 0; i < 4; i++) {
+		uint32_t c = gpio.gpiote_config[i];
+		if ((c & GPIOTE_CONFIG_MODE_Msk) == GPIOTE_CONFIG_MODE_Task &&
+		    ((c & GPIOTE_CONFIG_PSEL_Msk) >> GPIOTE_CONFIG_PSEL_Pos) == pin)
+			return i;
+	}
+	return -1;
+}
+
+static int
+level(uint8_t pin)
+{
+	uint32_t cnf = sim_nrf_gpio.PIN_CNF[pin];
+	int ch = owner(pin);
+
+	if (ch >= 0)
+		return gpio.task_level[ch];
+	if (cnf & (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos))
+		return (sim_nrf_gpio.OUT >> pin) & 1;
+	if (gpio.drive[pin] >= 0)
+		return gpio.drive[pin];
+	return ((cnf & GPIO_PIN_CNF_PULL_Msk) >> GPIO_PIN_CNF_PULL_Pos) == GPIO_PIN_CNF_PULL_Pullup;
+}
+
+static void
+edge(uint8_t pin, int now)
+{
+	if (gpio.trace[pin].buf != NULL && *gpio.trace[pin].count < gpio.trace[pin].size) {
+		struct sim_edge *e = &gpio.trace[pin].buf[(*gpio.trace[pin].count)++];
+		e->at = sim_now();
+		e->level = now;
+	}
+	if (!(sim_nrf_gpiote.POWER & 1))
+		return;
+	for (int i = 0; i < 4; i++) {
+		uint32_t c = gpio.gpiote_config[i];
+		if ((c & GPIOTE_CONFIG_MODE_Msk) != GPIOTE_CONFIG_MODE_Event ||
+		    ((c & GPIOTE_CONFIG_PSEL_Msk) >> GPIOTE_CONFIG_PSEL_Pos) != pin)
+			continue;
+		uint32_t polarity = (c & GPIOTE_CONFIG_POLARITY_Msk) >> GPIOTE_CONFIG_POLARITY_Pos;
+		if (polarity == GPIOTE_CONFIG_POLARITY_Toggle ||
+		    (polarity == GPIOTE_CONFIG_POLARITY_LoToHi && now) ||
+		    (polarity == GPIOTE_CONFIG_POLARITY_HiToLo && !now)) {
+			sim_event_raise(&sim_nrf_gpiote.EVENTS_IN[i]);
+			if (gpio.gpiote_inten & (1UL << i))
+				sim_irq_pend(GPIOTE_IRQn);
+		}
+	}
+}
+
+static void
+update(void)
+{
+	uint32_t levels = 0;
+	uint32_t in = 0;
+
+	for (int pin = 0; pin < PINS; pin++) {
+		if (level(pin))
+			levels |= 1UL << pin;
+	}
+	uint32_t changed = levels ^ gpio.levels;
+	gpio.levels = levels;
+	for (int pin = 0; pin < PINS; pin++) {
+		if (!(sim_nrf_gpio.PIN_CNF[pin] & (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos)))
+			in |= levels & (1UL << pin);
+	}
+	SIM_REG(sim_nrf_gpio.IN) = in;
+	for (int pin = 0; pin < PINS; pin++) {
+		if (changed & (1UL << pin))
+			edge(pin, (levels >> pin) & 1);
+	}
+}
+
+void
+sim_gpio_init(void)
+{
+	memset(gpio.drive, -1, sizeof(gpio.drive));
+	for (int pin = 0; pin < PINS; pin++)
+		sim_nrf_gpio.PIN_CNF[pin] = GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos;
+	sim_nrf_gpiote.POWER = GPIOTE_POWER_POWER_Enabled;
+}
+
+void
+sim_gpio_sync(void)
+{
+	NRF_GPIO_Type *g = &sim_nrf_gpio;
+	NRF_GPIOTE_Type *te = &sim_nrf_gpiote;
+
+	g->OUT = (g->OUT | g->OUTSET) & ~g->OUTCLR;
+	g->OUTSET = g->OUTCLR = 0;
+	for (int pin = 0; pin < PINS; pin++) {
+		uint32_t bit = 1UL << pin;
+		if (g->DIRSET & bit)
+			g->PIN_CNF[pin] |= GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos;
+		if (g->DIRCLR & bit)
+			g->PIN_CNF[pin] &= ~(GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos);
+	}
+	g->DIRSET = g->DIRCLR = 0;
+	g->DIR = 0;
+	for (int pin = 0; pin < PINS; pin++) {
+		if (g->PIN_CNF[pin] & (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos))
+			g->DIR |= 1UL << pin;
+	}
+
+	if (!(te->POWER & 1)) {
+		/* off clears the block */
+		uint32_t power = te->POWER;
+		memset(te, 0, sizeof(*te));
+		te->POWER = power;
+		memset(gpio.gpiote_config, 0, sizeof(gpio.gpiote_config));
+		gpio.gpiote_inten = 0;
+	}
+	gpio.gpiote_inten = (gpio.gpiote_inten | te->INTENSET) & ~te->INTENCLR;
+	te->INTENSET = gpio.gpiote_inten;
+	te->INTENCLR = 0;
+	for (int i = 0; i < 4; i++) {
+		uint32_t c = te->CONFIG[i];
+		if (c != gpio.gpiote_config[i] && (c & GPIOTE_CONFIG_MODE_Msk) == GPIOTE_CONFIG_MODE_Task)
+			gpio.task_level[i] = !!(c & GPIOTE_CONFIG_OUTINIT_Msk);
+		gpio.gpiote_config[i] = c;
+		if (te->TASKS_OUT[i]) {
+			te->TASKS_OUT[i] = 0;
+			gpio.task_level[i] ^= 1;
+		}
+	}
+	update();
+}
+
+bool
+sim_gpiote_task(volatile uint32_t *reg)
+{
+	NRF_GPIOTE_Type *te = &sim_nrf_gpiote;
+
+	if ((void *)reg < (void *)te || (void *)reg >= (void *)(te + 1))
+		return false;
+	*reg = 1;
+	sim_gpio_sync();
+	return true;
+}
+
+void
+sim_gpio_drive(uint8_t pin, int level)
+{
+	gpio.drive[pin] = level < 0 ? -1 : !!level;
+	update();
+}
+
+int
+sim_gpio_level(uint8_t pin)
+{
+	return (gpio.levels >> pin) & 1;
+}
+
+void
+sim_gpio_trace(uint8_t pin, struct sim_edge *buf, size_t size, size_t *count)
+{
+	gpio.trace[pin].buf = buf;
+	gpio.trace[pin].size = size;
+	gpio.trace[pin].count = count;
+	*count = 0;
+}
@@ -0,0 +1,75 @@
+#include <nrf_soc.h>
+
+#include "sim_internal.h"
+
+/*
+ * PPI: the channels the application may assign, wired by the
+ * softdevice calls.  An event raised on a wired register triggers the
+ * task in the same instant.
+ */
+
+#define PPI_CHANNELS	8	/* 0..7 are the application's under S110 */
+
+static struct {
+	const volatile void *eep[PPI_CHANNELS];
+	const volatile void *tep[PPI_CHANNELS];
+	uint32_t enabled;
+} ppi;
+
+void
+sim_ppi_init(void)
+{
+}
+
+uint32_t
+sd_ppi_channel_assign(uint8_t channel_num, const volatile void *evt_endpoint, const volatile void *task_endpoint)
+{
+	if (!CHECKF(channel_num < PPI_CHANNELS, "PPI channel %u is the softdevice's", channel_num))
+		return NRF_ERROR_INVALID_PARAM;
+	ppi.eep[channel_num] = evt_endpoint;
+	ppi.tep[channel_num] = task_endpoint;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ppi_channel_enable_get(uint32_t *channel_enable)
+{
+	*channel_enable = ppi.enabled;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ppi_channel_enable_set(uint32_t channel_enable_set_msk)
+{
+	if (!CHECKF((channel_enable_set_msk >> PPI_CHANNELS) == 0, "PPI channels %08x are the softdevice's",
+	    channel_enable_set_msk))
+		return NRF_ERROR_INVALID_PARAM;
+	ppi.enabled |= channel_enable_set_msk;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ppi_channel_enable_clr(uint32_t channel_enable_clr_msk)
+{
+	ppi.enabled &= ~channel_enable_clr_msk;
+	return NRF_SUCCESS;
+}
+
+void
+sim_task_trigger(volatile uint32_t *task)
+{
+	if (sim_timer_task(task) || sim_gpiote_task(task) || sim_rtc_task(task))
+		return;
+	/* a peripheral without PPI support here picks it up at the next sync */
+	*task = 1;
+}
+
+void
+sim_event_raise(volatile uint32_t *event)
+{
+	*event = 1;
+	for (int i = 0; i < PPI_CHANNELS; i++) {
+		if ((ppi.enabled & (1UL << i)) && ppi.eep[i] == event && ppi.tep[i] != NULL)
+			sim_task_trigger((volatile uint32_t *)ppi.tep[i]);
+	}
+}
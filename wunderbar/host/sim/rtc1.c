@@ -0,0 +1,141 @@
+#include "sim_internal.h"
+
+/*
+ * RTC1 on the 32768 Hz LFCLK.  COUNTER is brought up to date whenever
+ * time moves; PRESCALER is latched at START, as on the chip, where it
+ * can only be written while the RTC is stopped.  A compare event is
+ * generated when COUNTER becomes equal to CC[n], so a CC written equal
+ * to COUNTER only matches after a wrap.
+ */
+
+#define LFCLK_HZ	32768
+#define COUNTER_MASK	0xffffffUL
+
+NRF_RTC_Type sim_nrf_rtc1;
+
+static struct {
+	uint8_t running;
+	uint32_t prescaler;
+	uint32_t base;		/* COUNTER at `since' */
+	sim_time_t since;
+	uint32_t inten;
+	uint32_t evten;
+	struct sim_event compare[4];
+} rtc;
+
+/* ticks from `since' to `t' */
+static uint64_t
+ticks(sim_time_t t)
+{
+	return (unsigned __int128)(t - rtc.since) * LFCLK_HZ / ((rtc.prescaler + 1) * 1000000000ULL);
+}
+
+/* when the `n'th tick from `since' happens */
+static sim_time_t
+tick_time(uint64_t n)
+{
+	unsigned __int128 ns = (unsigned __int128)n * (rtc.prescaler + 1) * 1000000000ULL;
+	return rtc.since + (sim_time_t)((ns + LFCLK_HZ - 1) / LFCLK_HZ);
+}
+
+static uint32_t
+counter(void)
+{
+	if (!rtc.running)
+		return rtc.base;
+	return (rtc.base + ticks(sim_now())) & COUNTER_MASK;
+}
+
+void
+sim_rtc_advance(void)
+{
+	SIM_REG(sim_nrf_rtc1.COUNTER) = counter();
+}
+
+static void
+schedule(int i)
+{
+	uint32_t mask = RTC_INTENSET_COMPARE0_Msk << i;
+	struct sim_event *e = &rtc.compare[i];
+
+	if (!rtc.running || !((rtc.inten | rtc.evten) & mask)) {
+		sim_cancel(e);
+		return;
+	}
+	uint64_t now = ticks(sim_now());
+	uint32_t distance = (sim_nrf_rtc1.CC[i] - ((rtc.base + now) & COUNTER_MASK)) & COUNTER_MASK;
+	if (distance == 0)
+		distance = COUNTER_MASK + 1;
+	sim_time_t at = tick_time(now + distance);
+	if (!e->armed || e->at != at)
+		sim_schedule(e, at);
+}
+
+static void
+compare(struct sim_event *e)
+{
+	int i = e - rtc.compare;
+	uint32_t mask = RTC_INTENSET_COMPARE0_Msk << i;
+
+	sim_rtc_advance();
+	if (counter() == (sim_nrf_rtc1.CC[i] & COUNTER_MASK)) {
+		sim_event_raise(&sim_nrf_rtc1.EVENTS_COMPARE[i]);
+		if (rtc.inten & mask)
+			sim_irq_pend(RTC1_IRQn);
+	}
+	schedule(i);
+}
+
+void
+sim_rtc_sync(void)
+{
+	NRF_RTC_Type *r = &sim_nrf_rtc1;
+
+	rtc.inten = (rtc.inten | r->INTENSET) & ~r->INTENCLR;
+	r->INTENSET = rtc.inten;
+	r->INTENCLR = 0;
+	rtc.evten = (rtc.evten | r->EVTENSET) & ~r->EVTENCLR;
+	r->EVTEN = r->EVTENSET = rtc.evten;
+	r->EVTENCLR = 0;
+
+	if (r->TASKS_STOP) {
+		r->TASKS_STOP = 0;
+		rtc.base = counter();
+		rtc.running = 0;
+	}
+	if (r->TASKS_CLEAR) {
+		r->TASKS_CLEAR = 0;
+		rtc.base = 0;
+		rtc.since = sim_now();
+	}
+	if (r->TASKS_TRIGOVRFLW) {
+		r->TASKS_TRIGOVRFLW = 0;
+		rtc.base = 0xfffff0;
+		rtc.since = sim_now();
+	}
+	if (r->TASKS_START) {
+		r->TASKS_START = 0;
+		if (!rtc.running) {
+			rtc.running = 1;
+			rtc.since = sim_now();
+			rtc.prescaler = r->PRESCALER & 0xfff;
+		}
+	}
+	sim_rtc_advance();
+	for (int i = 0; i < 4; i++) {
+		rtc.compare[i].fire = compare;
+		schedule(i);
+	}
+}
+
+bool
+sim_rtc_task(volatile uint32_t *reg)
+{
+	NRF_RTC_Type *r = &sim_nrf_rtc1;
+
+	if ((void *)reg < (void *)r || (void *)reg >= (void *)(r + 1))
+		return false;
+	*reg = 1;
+	sim_rtc_sync();
+	return true;
+}
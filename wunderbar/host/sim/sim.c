@@ -0,0 +1,380 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nrf_soc.h>
+
+#include "sim_internal.h"
+
+/*
+ * The simulator loop: the event list, the interrupt controller and
+ * the entry point.  See sim.h.
+ */
+
+#define THREAD_PRIORITY	4
+
+/* the module's main(), see the Makefile; tests without one start in scenario() */
+void firmware_main(void) __attribute__((weak));
+void scenario_init(void) __attribute__((weak));
+
+/* handlers the firmware may define */
+void POWER_CLOCK_IRQHandler(void) __attribute__((weak));
+void SPI1_TWI1_IRQHandler(void) __attribute__((weak));
+void GPIOTE_IRQHandler(void) __attribute__((weak));
+void ADC_IRQHandler(void) __attribute__((weak));
+void TIMER0_IRQHandler(void) __attribute__((weak));
+void TIMER1_IRQHandler(void) __attribute__((weak));
+void TIMER2_IRQHandler(void) __attribute__((weak));
+void RTC1_IRQHandler(void) __attribute__((weak));
+void SWI0_IRQHandler(void) __attribute__((weak));
+void SWI1_IRQHandler(void) __attribute__((weak));
+void SWI2_IRQHandler(void) __attribute__((weak));
+void SWI3_IRQHandler(void) __attribute__((weak));
+
+static struct {
+	void (*handler)(void);
+	unsigned long count;
+	uint8_t enabled;
+	uint8_t pending;
+	uint8_t priority;
+} nvic[SIM_IRQ_COUNT];
+
+static struct {
+	sim_time_t now;
+	struct sim_event *events;
+	uint8_t priority;	/* of what runs now */
+	uint8_t stalling;
+	uint8_t looping;	/* in simble_process_event_loop() */
+	uint8_t woken;		/* something ran since the loop went round */
+} sim;
+
+sim_time_t
+sim_now(void)
+{
+	return sim.now;
+}
+
+double
+sim_now_ms(void)
+{
+	return sim.now / 1e6;
+}
+
+static void
+advance(sim_time_t t)
+{
+	if (t > sim.now)
+		sim.now = t;
+	sim_rtc_advance();
+}
+
+void
+sim_schedule(struct sim_event *e, sim_time_t at)
+{
+	struct sim_event **p;
+
+	sim_cancel(e);
+	if (at < sim.now)
+		at = sim.now;
+	e->at = at;
+	/* after the events already due then */
+	for (p = &sim.events; *p != NULL && (*p)->at <= at; p = &(*p)->next)
+		;
+	e->next = *p;
+	*p = e;
+	e->armed = 1;
+}
+
+void
+sim_cancel(struct sim_event *e)
+{
+	if (!e->armed)
+		return;
+	for (struct sim_event **p = &sim.events; *p != NULL; p = &(*p)->next) {
+		if (*p == e) {
+			*p = e->next;
+			break;
+		}
+	}
+	e->armed = 0;
+}
+
+static bool
+fire_next(sim_time_t limit)
+{
+	struct sim_event *e = sim.events;
+
+	if (e == NULL || e->at > limit)
+		return false;
+	sim.events = e->next;
+	e->armed = 0;
+	advance(e->at);
+	e->fire(e);
+	return true;
+}
+
+void
+sim_wake(void)
+{
+	sim.woken = 1;
+}
+
+void
+sim_irq_pend(IRQn_Type irq)
+{
+	nvic[irq].pending = 1;
+}
+
+bool
+sim_irq_enabled(IRQn_Type irq)
+{
+	return nvic[irq].enabled;
+}
+
+unsigned long
+sim_irq_count(IRQn_Type irq)
+{
+	return nvic[irq].count;
+}
+
+static void
+sync(void)
+{
+	sim_clock_sync();
+	sim_rtc_sync();
+	sim_timer_sync();
+	sim_gpio_sync();
+	sim_twi_sync();
+	sim_adc_sync();
+}
+
+/*
+ * Run what is pending, highest priority (lowest number, then lowest IRQ)
+ * first.  Back in thread mode, simble's event loop goes round once for
+ * whatever woke it, as it does when sd_app_evt_wait() returns.
+ */
+static void
+dispatch(void)
+{
+	for (;;) {
+		int irq = -1;
+
+		sync();
+		for (int i = 0; i < SIM_IRQ_COUNT; i++) {
+			if (!nvic[i].pending || !nvic[i].enabled ||
+			    nvic[i].priority >= sim.priority)
+				continue;
+			if (irq < 0 || nvic[i].priority < nvic[irq].priority)
+				irq = i;
+		}
+		if (irq < 0) {
+			if (!sim.looping || !sim.woken || sim.priority != THREAD_PRIORITY)
+				return;
+			sim.woken = 0;
+			sim_event_loop();
+			continue;
+		}
+		nvic[irq].pending = 0;
+		if (!CHECKF(nvic[irq].handler != NULL, "IRQ %d enabled without a handler", irq))
+			continue;
+		uint8_t saved = sim.priority;
+		sim.priority = nvic[irq].priority;
+		nvic[irq].count++;
+		nvic[irq].handler();
+		sim.priority = saved;
+		sim.woken = 1;
+		if (!CHECKF(sim_critical_depth() == 0, "IRQ %d returned inside a critical region", irq))
+			sim_clear_critical();
+	}
+}
+
+void
+sim_thread(void (*fn)(void *arg), void *arg)
+{
+	fn(arg);
+	if (!CHECKF(sim_critical_depth() == 0, "thread mode call returned inside a critical region"))
+		sim_clear_critical();
+	sim.woken = 1;
+	dispatch();
+}
+
+/* the scenario ran in thread mode since it last handed over: a loop round is due */
+void
+sim_run_until(sim_time_t t)
+{
+	sim.woken = 1;
+	dispatch();
+	while (fire_next(t))
+		dispatch();
+	advance(t);
+}
+
+void
+sim_run(sim_time_t ns)
+{
+	sim_run_until(sim.now + ns);
+}
+
+bool
+sim_run_for(bool (*done)(void *arg), void *arg, sim_time_t limit)
+{
+	sim_time_t end = sim.now + limit;
+
+	sim.woken = 1;
+	dispatch();
+	while (!done(arg)) {
+		if (!fire_next(end)) {
+			advance(end);
+			return done(arg);
+		}
+		dispatch();
+	}
+	return true;
+}
+
+/*
+ * The hardware goes on while the CPU spins: due events fire, but what
+ * they pend only runs once the spinning handler returned.
+ */
+void
+sim_stall(sim_time_t ns)
+{
+	sim_time_t end = sim.now + ns;
+
+	if (sim.stalling) {
+		advance(end);
+		return;
+	}
+	sim.stalling = 1;
+	sync();
+	while (fire_next(end))
+		;
+	advance(end);
+	sim.stalling = 0;
+}
+
+bool
+sim_tracing(const char *part)
+{
+	static const char *trace;
+	const char *p;
+	size_t n = strlen(part);
+
+	if (trace == NULL && (trace = getenv("SIM_TRACE")) == NULL)
+		trace = "";
+	for (p = trace; (p = strstr(p, part)) != NULL; p += n)
+		if ((p == trace || p[-1] == ',') && (p[n] == '\0' || p[n] == ','))
+			return true;
+	return false;
+}
+
+void
+nrf_delay_us(uint32_t us)
+{
+	sim_stall(SIM_US(us));
+}
+
+/* the softdevice's NVIC calls */
+
+uint32_t
+sd_nvic_EnableIRQ(IRQn_Type irq)
+{
+	nvic[irq].enabled = 1;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_nvic_DisableIRQ(IRQn_Type irq)
+{
+	nvic[irq].enabled = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_nvic_GetPendingIRQ(IRQn_Type irq, uint32_t *pending)
+{
+	*pending = nvic[irq].pending;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_nvic_SetPendingIRQ(IRQn_Type irq)
+{
+	nvic[irq].pending = 1;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_nvic_ClearPendingIRQ(IRQn_Type irq)
+{
+	nvic[irq].pending = 0;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_nvic_SetPriority(IRQn_Type irq, uint32_t priority)
+{
+	/* the application may only use its two levels */
+	if (!CHECKF(priority == NRF_APP_PRIORITY_LOW || priority == NRF_APP_PRIORITY_HIGH,
+	    "IRQ %d at reserved priority %u", irq, priority))
+		return NRF_ERROR_INVALID_PARAM;
+	nvic[irq].priority = priority;
+	return NRF_SUCCESS;
+}
+
+int
+main(int argc, char **argv)
+{
+	nvic[POWER_CLOCK_IRQn].handler = POWER_CLOCK_IRQHandler;
+	nvic[SPI1_TWI1_IRQn].handler = SPI1_TWI1_IRQHandler;
+	nvic[GPIOTE_IRQn].handler = GPIOTE_IRQHandler;
+	nvic[ADC_IRQn].handler = ADC_IRQHandler;
+	nvic[TIMER0_IRQn].handler = TIMER0_IRQHandler;
+	nvic[TIMER1_IRQn].handler = TIMER1_IRQHandler;
+	nvic[TIMER2_IRQn].handler = TIMER2_IRQHandler;
+	nvic[RTC1_IRQn].handler = RTC1_IRQHandler;
+	nvic[SWI0_IRQn].handler = SWI0_IRQHandler;
+	nvic[SWI1_IRQn].handler = SWI1_IRQHandler;
+	nvic[SWI2_IRQn].handler = SWI2_IRQHandler;
+	nvic[SWI3_IRQn].handler = SWI3_IRQHandler;
+	for (int i = 0; i < SIM_IRQ_COUNT; i++)
+		nvic[i].priority = NRF_APP_PRIORITY_LOW;
+	sim.priority = THREAD_PRIORITY;
+	check_clock = sim_now_ms;
+
+	sim_ppi_init();
+	sim_clock_init();
+	sim_flash_init();
+	sim_gpio_init();
+	sim_twi_init();
+	sim_adc_init();
+	sim_link_init();
+
+	if (scenario_init != NULL)
+		scenario_init();
+	if (firmware_main == NULL)
+		simble_process_event_loop();
+	firmware_main();
+	/* simble_process_event_loop() does not return */
+	CHECKF(0, "firmware main() returned");
+	return check_exit(program_invocation_short_name);
+}
+
+/*
+ * Thread mode after the firmware's setup: the scenario drives the
+ * module from here, the loop's own work runs from dispatch().
+ */
+void
+simble_process_event_loop(void)
+{
+	if (!CHECKF(sim_critical_depth() == 0, "main() left a critical region open"))
+		sim_clear_critical();
+	sim.looping = 1;
+	sim.woken = 1;
+	dispatch();
+	scenario();
+	fflush(stdout);
+	exit(check_exit(program_invocation_short_name));
+}
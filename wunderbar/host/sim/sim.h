@@ -0,0 +1,199 @@
+#ifndef SIM_H
+#define SIM_H
+
+/*
+ * Host simulation of an nRF51 running the S110 softdevice, for running
+ * the modules' firmware in virtual time.
+ *
+ * Everything runs on one host thread.  The firmware's main() is built
+ * as firmware_main(); it sets up as on the chip and calls
+ * simble_process_event_loop(), which runs the scenario's scenario()
+ * instead of sleeping.  The scenario is thread mode: it plays the
+ * central (sim_connect(), sim_write(), ...), drives the sensor models
+ * and lets time pass with sim_run().  While time passes, peripherals
+ * set their EVENTS_ registers and pend interrupts when their work is
+ * due, and pending interrupts run to completion by priority.  Time
+ * stands still inside a handler except for busy waits, see sim_stall().
+ *
+ * Peripheral registers are plain memory (include/nrf.h).  The
+ * peripherals act on the TASKS_ and configuration registers the
+ * firmware wrote when control comes back to the simulator, after every
+ * handler and every thread mode call; on the chip too a task takes
+ * effect a few clocks after the write.  Events routed through PPI
+ * trigger their task at once.
+ *
+ * Checks (check.h) count and report failures with the simulated time;
+ * the process exits non-zero if any failed.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nrf.h>
+
+#include "simble.h"
+#include "check.h"
+
+typedef uint64_t sim_time_t;	/* ns since reset */
+
+#define SIM_US(x)	((sim_time_t)(x) * 1000)
+#define SIM_MS(x)	((sim_time_t)(x) * 1000000)
+#define SIM_S(x)	((sim_time_t)(x) * 1000000000)
+
+/* time */
+sim_time_t sim_now(void);
+double sim_now_ms(void);
+void sim_run(sim_time_t ns);
+void sim_run_until(sim_time_t t);
+/* run until `done(arg)' holds or `limit' ns passed, true if it holds */
+bool sim_run_for(bool (*done)(void *arg), void *arg, sim_time_t limit);
+/* a handler busy waits: time passes without anything else running */
+void sim_stall(sim_time_t ns);
+
+/*
+ * Scheduled work of the simulated hardware.  `fire' runs at `at' from
+ * the simulator loop, outside any handler; it may change registers,
+ * pend interrupts and schedule more events.
+ */
+struct sim_event {
+	struct sim_event *next;
+	sim_time_t at;
+	void (*fire)(struct sim_event *e);
+	uint8_t armed;
+};
+
+void sim_schedule(struct sim_event *e, sim_time_t at);
+void sim_cancel(struct sim_event *e);
+
+/* interrupts */
+void sim_irq_pend(IRQn_Type irq);
+bool sim_irq_enabled(IRQn_Type irq);
+/* handler invocations so far */
+unsigned long sim_irq_count(IRQn_Type irq);
+
+/* PPI: set an event register and trigger the tasks wired to it */
+void sim_event_raise(volatile uint32_t *event);
+/* trigger a task register, as PPI does */
+void sim_task_trigger(volatile uint32_t *task);
+
+/* GPIO */
+void sim_gpio_drive(uint8_t pin, int level);	/* an external driver, -1 releases */
+int sim_gpio_level(uint8_t pin);
+/* record the level changes of `pin' */
+struct sim_edge {
+	sim_time_t at;
+	uint8_t level;
+};
+void sim_gpio_trace(uint8_t pin, struct sim_edge *buf, size_t size, size_t *count);
+
+/* ADC inputs, volts */
+void sim_adc_input(uint8_t ain, double (*volts)(void *arg), void *arg);
+void sim_supply(double volts);
+
+/*
+ * The TWI bus.  A device answers its 7 bit address; start() returns
+ * its ACK of the address byte, write() that of a data byte.  Devices
+ * on the sensor supply only answer once it has been on for
+ * `startup' ns, and power() tells them when it switches.
+ */
+struct sim_twi_device {
+	struct sim_twi_device *next;
+	const char *name;
+	uint8_t address;
+	uint8_t on_sensor_supply;
+	sim_time_t startup;
+	bool (*start)(struct sim_twi_device *d, bool read);
+	bool (*write)(struct sim_twi_device *d, uint8_t byte);
+	uint8_t (*read)(struct sim_twi_device *d, bool last);
+	void (*stop)(struct sim_twi_device *d);
+	void (*power)(struct sim_twi_device *d, bool on);
+};
+
+void sim_twi_attach(struct sim_twi_device *d);
+bool sim_sensor_supply(void);
+sim_time_t sim_sensor_supply_since(void);
+unsigned long sim_twi_bytes(void);
+
+/* clocks and power */
+sim_time_t sim_hfclk_on_time(void);	/* crystal running, ns in total */
+unsigned sim_hfclk_starts(void);
+sim_time_t sim_timer_on_time(uint8_t instance);
+unsigned sim_constlat_count(void);
+sim_time_t sim_constlat_on_time(void);
+
+/*
+ * Flash.  The code area is mapped where the firmware expects it
+ * (NRF_FICR), erased.  Operations complete after the data sheet time;
+ * sim_flash_fail() makes the next operations report
+ * NRF_EVT_FLASH_OPERATION_ERROR.  sim_flash_cut() kills the process
+ * while the `n'th word from now is written, for power loss tests run
+ * in a child (see sim_boot()).
+ */
+void sim_flash_fail(unsigned n);
+void sim_flash_cut(unsigned long n);
+unsigned long sim_flash_words(void);
+unsigned long sim_flash_erases(void);
+/*
+ * Power cycle: fork, the child returns true and runs on with the RAM of
+ * the moment, the parent waits for it and returns false with the
+ * child's exit status in `*status', 99 for a cut.  The flash is shared.
+ */
+#define SIM_CUT_STATUS	99
+bool sim_boot(int *status);
+
+/*
+ * The link and the central.  Characteristics are found by the name of
+ * their service's first characteristic and their own name.
+ */
+#define SIM_CONN_INTERVAL	SIM_MS(30)	/* before any update */
+#define SIM_CONN_TIMEOUT	SIM_S(4)	/* supervision, before any update */
+#define SIM_TX_BUFFERS		7
+#define SIM_PACKETS_PER_EVENT	6
+
+struct char_desc *sim_char(const char *service, const char *name);
+void sim_connect(void);
+void sim_disconnect(void);
+bool sim_connected(void);
+sim_time_t sim_conn_interval(void);
+unsigned sim_conn_param_updates(void);
+void sim_subscribe(struct char_desc *c);
+void sim_unsubscribe(struct char_desc *c);
+void sim_write(struct char_desc *c, const void *val, uint16_t len);
+uint16_t sim_read(struct char_desc *c, void *buf, uint16_t size);
+/* thread mode call into the firmware */
+void sim_thread(void (*fn)(void *arg), void *arg);
+
+struct sim_notification {
+	struct char_desc *c;
+	sim_time_t queued;	/* handed to the softdevice */
+	sim_time_t sent;	/* the connection event that carried it, 0 before */
+	uint8_t len;
+	uint8_t data[20];
+};
+
+/*
+ * The notifications on `c' are numbered from 0; sim_notification()
+ * returns the `n'th, NULL if there is none yet, sim_notifications() how
+ * many there are.  sim_await() runs until the `n'th is queued, at most
+ * `limit' ns.
+ */
+unsigned sim_notifications(struct char_desc *c);
+const struct sim_notification *sim_notification(struct char_desc *c, unsigned n);
+const struct sim_notification *sim_await(struct char_desc *c, unsigned n, sim_time_t limit);
+unsigned long sim_tx_refused(void);	/* notify calls that found no buffer */
+
+/* advertising */
+bool sim_advertising(void);
+uint8_t sim_adv_data(uint8_t *buf);
+unsigned long sim_adv_updates(void);
+unsigned long sim_gap_errors(void);	/* calls the softdevice refused */
+
+/*
+ * Implemented by the scenario: scenario_init(), optional, attaches the
+ * models before the firmware's main() runs, scenario() drives it after.
+ */
+void scenario_init(void);
+void scenario(void);
+
+#endif /* SIM_H */
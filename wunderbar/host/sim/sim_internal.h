@@ -0,0 +1,56 @@
+#ifndef SIM_INTERNAL_H
+#define SIM_INTERNAL_H
+
+/* Between the simulator's own files. */
+
+#include "sim.h"
+
+/* act on what the firmware wrote, see sim.h */
+void sim_clock_sync(void);
+void sim_rtc_sync(void);
+void sim_timer_sync(void);
+void sim_gpio_sync(void);
+void sim_twi_sync(void);
+void sim_adc_sync(void);
+
+/* tasks triggered through PPI, true if `reg' belongs to the peripheral */
+bool sim_rtc_task(volatile uint32_t *reg);
+bool sim_timer_task(volatile uint32_t *reg);
+bool sim_gpiote_task(volatile uint32_t *reg);
+
+/* time moved on */
+void sim_rtc_advance(void);
+
+/* simble's event loop: wake it, and one round of it in thread mode */
+void sim_wake(void);
+void sim_event_loop(void);
+
+void sim_ppi_init(void);
+void sim_clock_init(void);
+void sim_flash_init(void);
+void sim_gpio_init(void);
+void sim_twi_init(void);
+void sim_adc_init(void);
+void sim_link_init(void);
+
+/* the softdevice's share of the interrupt logic */
+uint8_t sim_critical_depth(void);
+void sim_clear_critical(void);
+bool sim_radio_notification(void);
+void sim_soc_event(uint32_t evt);
+
+/* twi.c: the sensor supply switched */
+void sim_twi_power(bool on);
+
+/* SIM_TRACE=twi in the environment logs every bus transfer */
+bool sim_tracing(const char *part);
+#define SIM_TRACE(part, ...) \
+	do { \
+		if (sim_tracing(part)) \
+			check_note(part ": " __VA_ARGS__); \
+	} while (0)
+
+/* register writes from the simulator side */
+#define SIM_REG(r)	(*(volatile uint32_t *)&(r))
+
+#endif /* SIM_INTERNAL_H */
@@ -0,0 +1,599 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ble.h>
+#include <nrf_soc.h>
+
+#include "simble.h"
+#include "sim_internal.h"
+
+/*
+ * simble's GATT server and the softdevice's link layer, with the
+ * central on the other end played by the scenario.
+ *
+ * The central connects at SIM_CONN_INTERVAL and accepts parameter
+ * updates, taking the longest interval offered, six intervals after
+ * the request; both report the parameters with a GAP event.  Notifications take one of SIM_TX_BUFFERS transmit
+ * buffers until a connection event carries them, at most
+ * SIM_PACKETS_PER_EVENT per event, which reports them with
+ * BLE_EVT_TX_COMPLETE; with radio notifications on, SWI1 is pended as
+ * each event ends.  simble's own callbacks run in thread mode, like its
+ * event loop, and the loop hands the SoC and BLE events to the hooks and
+ * then runs their idle work.
+ */
+
+#define PARAM_UPDATE_EVENTS	6
+#define BLE_EVENTS		8	/* queued for the event loop */
+
+static struct {
+	const char *name;
+	struct service_desc *services;
+	struct service_desc **tail;
+
+	uint8_t connected;
+	sim_time_t interval;
+	struct sim_event conn_event;
+	uint8_t tx_free;
+	size_t unsent;		/* first notification not carried yet */
+
+	struct sim_notification *log;
+	size_t count;
+	size_t size;
+	unsigned long tx_refused;
+
+	struct sim_event param_event;
+	ble_gap_conn_params_t param_want;
+	uint8_t param_busy;
+	unsigned param_updates;
+	ble_gap_conn_params_t ppcp;
+
+	uint8_t advertising;
+	uint8_t adv[BLE_GAP_ADV_MAX_SIZE];
+	uint8_t adv_len;
+	unsigned long adv_updates;
+	unsigned long gap_errors;
+
+	struct simble_hook *hooks;
+	ble_evt_t events[BLE_EVENTS];
+	uint8_t event_head;
+	uint8_t event_count;
+} ble;
+
+/* simble */
+
+void
+simble_init(const char *name)
+{
+	ble.name = name;
+	ble.tail = &ble.services;
+}
+
+uint8_t
+simble_get_vendor_uuid_class(void)
+{
+	return 2;	/* BLE_UUID_TYPE_VENDOR_BEGIN */
+}
+
+void
+simble_srv_init(void *srv, uint8_t uuid_class, uint16_t uuid)
+{
+	struct service_desc *s = srv;
+
+	s->sim_uuid = uuid;
+	s->sim_chars = NULL;
+	s->sim_next = NULL;
+}
+
+void
+simble_srv_register(void *srv)
+{
+	struct service_desc *s = srv;
+
+	*ble.tail = s;
+	ble.tail = &s->sim_next;
+}
+
+void
+simble_srv_char_add(void *srv, struct char_desc *c, uint8_t uuid_class, uint16_t uuid, const char *desc, uint16_t length)
+{
+	struct service_desc *s = srv;
+	struct char_desc **p;
+
+	c->srv = s;
+	c->uuid = uuid;
+	c->desc = desc;
+	c->length = length;
+	c->value = calloc(1, length > 0 ? length : 1);
+	c->next = NULL;
+	for (p = &s->sim_chars; *p != NULL; p = &(*p)->next)
+		;
+	*p = c;
+}
+
+void
+simble_srv_char_attach_format(struct char_desc *c, uint8_t format, int8_t exponent, uint16_t unit)
+{
+	c->format = format;
+	c->exponent = exponent;
+	c->unit = unit;
+}
+
+void
+simble_srv_char_update(struct char_desc *c, void *val)
+{
+	memcpy(c->value, val, c->length);
+}
+
+uint32_t
+simble_srv_char_notify(struct char_desc *c, bool indicate, uint16_t len, void *val)
+{
+	struct sim_notification *n;
+
+	if (!ble.connected)
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	if (!(c->status & BLE_GATT_HVX_NOTIFICATION))
+		return NRF_ERROR_INVALID_STATE;
+	if (!CHECKF(len <= sizeof(n->data), "%u byte notification on \"%s\"", len, c->desc))
+		return NRF_ERROR_INVALID_LENGTH;
+	if (ble.tx_free == 0) {
+		ble.tx_refused++;
+		return BLE_ERROR_NO_TX_BUFFERS;
+	}
+	ble.tx_free--;
+	if (ble.count == ble.size) {
+		ble.size = ble.size ? ble.size * 2 : 1024;
+		ble.log = realloc(ble.log, ble.size * sizeof(*ble.log));
+	}
+	n = &ble.log[ble.count++];
+	n->c = c;
+	n->queued = sim_now();
+	n->sent = 0;
+	n->len = len;
+	memcpy(n->data, val, len);
+	memcpy(c->value, val, len < c->length ? len : c->length);
+	return NRF_SUCCESS;
+}
+
+void
+simble_hook_add(struct simble_hook *h)
+{
+	h->next = ble.hooks;
+	ble.hooks = h;
+}
+
+/* for the hooks, after simble's own handling */
+static ble_evt_t *
+event(uint16_t id)
+{
+	ble_evt_t *evt;
+
+	if (!CHECKF(ble.event_count < BLE_EVENTS, "BLE event queue overflow"))
+		return NULL;
+	evt = &ble.events[(ble.event_head + ble.event_count++) % BLE_EVENTS];
+	memset(evt, 0, sizeof(*evt));
+	evt->header.evt_id = id;
+	evt->header.evt_len = sizeof(evt->evt);
+	sim_wake();
+	return evt;
+}
+
+void
+sim_event_loop(void)
+{
+	uint32_t soc_evt;
+
+	while (sd_evt_get(&soc_evt) == NRF_SUCCESS)
+		for (struct simble_hook *h = ble.hooks; h != NULL; h = h->next)
+			if (h->soc_evt != NULL)
+				h->soc_evt(soc_evt);
+	while (ble.event_count != 0) {
+		ble_evt_t evt = ble.events[ble.event_head];
+
+		ble.event_head = (ble.event_head + 1) % BLE_EVENTS;
+		ble.event_count--;
+		for (struct simble_hook *h = ble.hooks; h != NULL; h = h->next)
+			if (h->ble_evt != NULL)
+				h->ble_evt(&evt);
+	}
+	for (struct simble_hook *h = ble.hooks; h != NULL; h = h->next)
+		if (h->idle != NULL)
+			h->idle();
+}
+
+static void
+adv_set_name(void)
+{
+	uint8_t adv[BLE_GAP_ADV_MAX_SIZE];
+	uint8_t len = strlen(ble.name);
+
+	if (len > sizeof(adv) - 5)
+		len = sizeof(adv) - 5;
+	adv[0] = 2;
+	adv[1] = BLE_GAP_AD_TYPE_FLAGS;
+	adv[2] = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+	adv[3] = len + 1;
+	adv[4] = BLE_GAP_AD_TYPE_COMPLETE_LOCAL_NAME;
+	memcpy(&adv[5], ble.name, len);
+	sd_ble_gap_adv_data_set(adv, len + 5, NULL, 0);
+}
+
+void
+simble_adv_start(void)
+{
+	ble_gap_adv_params_t params = {
+		.type = BLE_GAP_ADV_TYPE_ADV_IND,
+		.fp = BLE_GAP_ADV_FP_ANY,
+		.interval = 0x0140,	/* 200 ms */
+	};
+
+	adv_set_name();
+	sd_ble_gap_adv_start(&params);
+}
+
+/* the softdevice's GAP */
+
+uint32_t
+sd_ble_gap_adv_data_set(uint8_t const *p_data, uint8_t dlen, uint8_t const *p_sr_data, uint8_t srdlen)
+{
+	if (dlen > BLE_GAP_ADV_MAX_SIZE || srdlen > BLE_GAP_ADV_MAX_SIZE) {
+		ble.gap_errors++;
+		return NRF_ERROR_INVALID_LENGTH;
+	}
+	memcpy(ble.adv, p_data, dlen);
+	ble.adv_len = dlen;
+	ble.adv_updates++;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gap_adv_start(ble_gap_adv_params_t const *p_adv_params)
+{
+	if (ble.connected || ble.advertising) {
+		ble.gap_errors++;
+		return NRF_ERROR_INVALID_STATE;
+	}
+	ble.advertising = 1;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gap_adv_stop(void)
+{
+	if (!ble.advertising)
+		return NRF_ERROR_INVALID_STATE;
+	ble.advertising = 0;
+	return NRF_SUCCESS;
+}
+
+/* the central picks the longest interval offered, the rest as asked */
+static void
+param_update(struct sim_event *e)
+{
+	ble_evt_t *evt = event(BLE_GAP_EVT_CONN_PARAM_UPDATE);
+	ble_gap_conn_params_t *p = &ble.param_want;
+
+	p->min_conn_interval = p->max_conn_interval;
+	ble.interval = SIM_US(p->max_conn_interval * 1250);
+	ble.param_busy = 0;
+	ble.param_updates++;
+	if (evt != NULL)
+		evt->evt.gap_evt.params.conn_param_update.conn_params = *p;
+}
+
+uint32_t
+sd_ble_gap_conn_param_update(uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params)
+{
+	if (!ble.connected) {
+		ble.gap_errors++;
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	}
+	if (ble.param_busy)
+		return NRF_ERROR_BUSY;
+	if (!CHECKF(p_conn_params->min_conn_interval >= BLE_GAP_CP_MIN_CONN_INTVL_MIN &&
+	    p_conn_params->min_conn_interval <= p_conn_params->max_conn_interval &&
+	    p_conn_params->max_conn_interval <= BLE_GAP_CP_MAX_CONN_INTVL_MAX &&
+	    p_conn_params->slave_latency <= BLE_GAP_CP_SLAVE_LATENCY_MAX &&
+	    p_conn_params->conn_sup_timeout >= BLE_GAP_CP_CONN_SUP_TIMEOUT_MIN &&
+	    p_conn_params->conn_sup_timeout <= BLE_GAP_CP_CONN_SUP_TIMEOUT_MAX,
+	    "connection parameters %u..%u latency %u timeout %u out of range",
+	    p_conn_params->min_conn_interval, p_conn_params->max_conn_interval,
+	    p_conn_params->slave_latency, p_conn_params->conn_sup_timeout))
+		return NRF_ERROR_INVALID_PARAM;
+	/* the supervision timeout must outlast the latency */
+	CHECKF(p_conn_params->conn_sup_timeout * 4 >
+	    (1 + p_conn_params->slave_latency) * p_conn_params->max_conn_interval,
+	    "supervision timeout %u too short for interval %u latency %u",
+	    p_conn_params->conn_sup_timeout, p_conn_params->max_conn_interval,
+	    p_conn_params->slave_latency);
+	ble.param_want = *p_conn_params;
+	ble.param_busy = 1;
+	ble.param_event.fire = param_update;
+	sim_schedule(&ble.param_event, sim_now() + PARAM_UPDATE_EVENTS * ble.interval);
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_gap_ppcp_set(ble_gap_conn_params_t const *p_conn_params)
+{
+	ble.ppcp = *p_conn_params;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_ble_tx_buffer_count_get(uint8_t *p_count)
+{
+	*p_count = SIM_TX_BUFFERS;
+	return NRF_SUCCESS;
+}
+
+/* the link */
+
+static void
+conn_event(struct sim_event *e)
+{
+	unsigned packets = 0;
+	ble_evt_t *evt;
+
+	while (ble.unsent < ble.count && packets < SIM_PACKETS_PER_EVENT) {
+		ble.log[ble.unsent++].sent = sim_now();
+		ble.tx_free++;
+		packets++;
+	}
+	if (packets != 0 && (evt = event(BLE_EVT_TX_COMPLETE)) != NULL)
+		evt->evt.common_evt.params.tx_complete.count = packets;
+	if (sim_radio_notification())
+		sim_irq_pend(SWI1_IRQn);
+	sim_schedule(&ble.conn_event, sim_now() + ble.interval);
+}
+
+void
+sim_link_init(void)
+{
+	ble.conn_event.fire = conn_event;
+	ble.tail = &ble.services;
+}
+
+static void
+connected(void *arg)
+{
+	for (struct service_desc *s = ble.services; s != NULL; s = s->sim_next)
+		if (s->connect_cb != NULL)
+			s->connect_cb(s);
+}
+
+static void
+disconnected(void *arg)
+{
+	for (struct service_desc *s = ble.services; s != NULL; s = s->sim_next)
+		if (s->disconnect_cb != NULL)
+			s->disconnect_cb(s);
+	simble_adv_start();
+}
+
+void
+sim_connect(void)
+{
+	ble_evt_t *evt;
+
+	if (!CHECKF(ble.advertising && !ble.connected, "connect to a device that does not advertise"))
+		return;
+	ble.advertising = 0;
+	ble.connected = 1;
+	ble.interval = SIM_CONN_INTERVAL;
+	ble.tx_free = SIM_TX_BUFFERS;
+	ble.unsent = ble.count;
+	for (struct service_desc *s = ble.services; s != NULL; s = s->sim_next)
+		for (struct char_desc *c = s->sim_chars; c != NULL; c = c->next)
+			c->status = 0;
+	sim_schedule(&ble.conn_event, sim_now() + ble.interval);
+	evt = event(BLE_GAP_EVT_CONNECTED);
+	if (evt != NULL)
+		evt->evt.gap_evt.params.connected.conn_params = (ble_gap_conn_params_t){
+			.min_conn_interval = SIM_CONN_INTERVAL / SIM_US(1250),
+			.max_conn_interval = SIM_CONN_INTERVAL / SIM_US(1250),
+			.conn_sup_timeout = SIM_CONN_TIMEOUT / SIM_MS(10),
+		};
+	sim_thread(connected, NULL);
+}
+
+void
+sim_disconnect(void)
+{
+	if (!CHECKF(ble.connected, "disconnect without a connection"))
+		return;
+	ble.connected = 0;
+	sim_cancel(&ble.conn_event);
+	sim_cancel(&ble.param_event);
+	ble.param_busy = 0;
+	/* what was not carried is lost */
+	ble.unsent = ble.count;
+	event(BLE_GAP_EVT_DISCONNECTED);
+	sim_thread(disconnected, NULL);
+}
+
+bool
+sim_connected(void)
+{
+	return ble.connected;
+}
+
+sim_time_t
+sim_conn_interval(void)
+{
+	return ble.interval;
+}
+
+unsigned
+sim_conn_param_updates(void)
+{
+	return ble.param_updates;
+}
+
+/* the central */
+
+struct char_desc *
+sim_char(const char *service, const char *name)
+{
+	for (struct service_desc *s = ble.services; s != NULL; s = s->sim_next) {
+		if (service != NULL && (s->sim_chars == NULL || strcmp(s->sim_chars->desc, service) != 0))
+			continue;
+		for (struct char_desc *c = s->sim_chars; c != NULL; c = c->next)
+			if (strcmp(c->desc, name) == 0)
+				return c;
+	}
+	printf("sim: no characteristic \"%s\" in service \"%s\"\n", name, service ? service : "*");
+	exit(2);
+}
+
+struct gatt_op {
+	struct char_desc *c;
+	const void *val;
+	void *buf;
+	uint16_t len;
+	int8_t status;
+};
+
+static void
+status_op(void *arg)
+{
+	struct gatt_op *op = arg;
+
+	op->c->status = op->status;
+	if (op->c->notify_status_cb != NULL)
+		op->c->notify_status_cb(op->c->srv, op->c, op->status);
+}
+
+void
+sim_subscribe(struct char_desc *c)
+{
+	struct gatt_op op = {.c = c, .status = BLE_GATT_HVX_NOTIFICATION};
+
+	CHECKF(ble.connected && c->notify, "subscribe to \"%s\"", c->desc);
+	sim_thread(status_op, &op);
+}
+
+void
+sim_unsubscribe(struct char_desc *c)
+{
+	struct gatt_op op = {.c = c, .status = 0};
+
+	sim_thread(status_op, &op);
+}
+
+static void
+write_op(void *arg)
+{
+	struct gatt_op *op = arg;
+
+	memcpy(op->c->value, op->val, op->len < op->c->length ? op->len : op->c->length);
+	if (op->c->write_cb != NULL)
+		op->c->write_cb(op->c->srv, op->c, op->val, op->len);
+}
+
+void
+sim_write(struct char_desc *c, const void *val, uint16_t len)
+{
+	struct gatt_op op = {.c = c, .val = val, .len = len};
+
+	CHECKF(ble.connected, "write to \"%s\" without a connection", c->desc);
+	CHECKF(len <= c->length, "%u byte write to \"%s\", %u long", len, c->desc, c->length);
+	sim_thread(write_op, &op);
+}
+
+static void
+read_op(void *arg)
+{
+	struct gatt_op *op = arg;
+	void *val = op->c->value;
+	uint16_t len = op->c->length;
+
+	if (op->c->read_cb != NULL)
+		op->c->read_cb(op->c->srv, op->c, &val, &len);
+	if (len > op->len)
+		len = op->len;
+	memcpy(op->buf, val, len);
+	op->len = len;
+}
+
+uint16_t
+sim_read(struct char_desc *c, void *buf, uint16_t size)
+{
+	struct gatt_op op = {.c = c, .buf = buf, .len = size};
+
+	CHECKF(ble.connected, "read of \"%s\" without a connection", c->desc);
+	sim_thread(read_op, &op);
+	return op.len;
+}
+
+unsigned
+sim_notifications(struct char_desc *c)
+{
+	unsigned n = 0;
+
+	for (size_t i = 0; i < ble.count; i++)
+		if (ble.log[i].c == c)
+			n++;
+	return n;
+}
+
+const struct sim_notification *
+sim_notification(struct char_desc *c, unsigned n)
+{
+	for (size_t i = 0; i < ble.count; i++)
+		if (ble.log[i].c == c && n-- == 0)
+			return &ble.log[i];
+	return NULL;
+}
+
+struct await {
+	struct char_desc *c;
+	unsigned n;
+};
+
+static bool
+arrived(void *arg)
+{
+	struct await *a = arg;
+	return sim_notifications(a->c) > a->n;
+}
+
+const struct sim_notification *
+sim_await(struct char_desc *c, unsigned n, sim_time_t limit)
+{
+	struct await a = {c, n};
+
+	sim_run_for(arrived, &a, limit);
+	return sim_notification(c, n);
+}
+
+unsigned long
+sim_tx_refused(void)
+{
+	return ble.tx_refused;
+}
+
+bool
+sim_advertising(void)
+{
+	return ble.advertising;
+}
+
+uint8_t
+sim_adv_data(uint8_t *buf)
+{
+	memcpy(buf, ble.adv, ble.adv_len);
+	return ble.adv_len;
+}
+
+unsigned long
+sim_adv_updates(void)
+{
+	return ble.adv_updates;
+}
+
+unsigned long
+sim_gap_errors(void)
+{
+	return ble.gap_errors;
+}
@@ -0,0 +1,138 @@
+#include <stddef.h>
+
+#include <nrf.h>
+#include <nrf_soc.h>
+
+#include "rtc.h"
+#include "batt_serv.h"
+#include "i2c.h"
+#include "indicator.h"
+#include "onboard-led.h"
+
+#include "sim_internal.h"
+
+/*
+ * simble's RTC1 multiplexer, battery service and board helpers.  Slot
+ * i of the rtc_ctx runs on compare channel i: CC[i] is set `period'
+ * ticks ahead when the slot is enabled and moved on by `period' when it
+ * fires; a ONE_SHOT slot disables itself.  A module with its own
+ * RTC1_IRQHandler (ir/protocol.c) replaces the multiplexer's.
+ */
+
+#define ONESHOT_ID	2
+
+static struct rtc_ctx *rtc_ctx;
+static unsigned long batt_ticks;
+static enum onboard_led_state led;
+
+static void
+arm(uint8_t id)
+{
+	struct rtc_x_ctx *x = &rtc_ctx->rtc_x[id];
+	uint32_t mask = RTC_INTENSET_COMPARE0_Msk << id;
+
+	/* INTENSET and INTENCLR are plain memory until the simulator syncs */
+	if (x->enabled) {
+		NRF_RTC1->CC[id] = (NRF_RTC1->COUNTER + x->period) & 0xffffff;
+		NRF_RTC1->EVENTS_COMPARE[id] = 0;
+		NRF_RTC1->INTENSET |= mask;
+	} else {
+		NRF_RTC1->INTENCLR |= mask;
+	}
+}
+
+void
+rtc_init(struct rtc_ctx *ctx)
+{
+	rtc_ctx = ctx;
+	NRF_RTC1->PRESCALER = RTC_PRESCALER;
+	sd_nvic_ClearPendingIRQ(RTC1_IRQn);
+	sd_nvic_SetPriority(RTC1_IRQn, NRF_APP_PRIORITY_LOW);
+	sd_nvic_EnableIRQ(RTC1_IRQn);
+	/* leaves the channels of a module driving RTC1 itself alone */
+	for (uint8_t id = 0; id < RTC_SLOTS; id++)
+		if (ctx->rtc_x[id].enabled)
+			arm(id);
+	NRF_RTC1->TASKS_START = 1;
+}
+
+void
+rtc_update_cfg(uint32_t period, uint8_t id, bool enabled)
+{
+	rtc_ctx->rtc_x[id].period = period;
+	rtc_ctx->rtc_x[id].enabled = enabled;
+	arm(id);
+}
+
+bool
+rtc_oneshot_timer(uint32_t period, rtc_evt_cb_t *cb)
+{
+	struct rtc_x_ctx *x = &rtc_ctx->rtc_x[ONESHOT_ID];
+
+	if (x->enabled)
+		return false;
+	x->type = ONE_SHOT;
+	x->cb = cb;
+	rtc_update_cfg(period, ONESHOT_ID, true);
+	return true;
+}
+
+void __attribute__((weak))
+RTC1_IRQHandler(void)
+{
+	for (uint8_t id = 0; id < RTC_SLOTS; id++) {
+		struct rtc_x_ctx *x = &rtc_ctx->rtc_x[id];
+
+		if (NRF_RTC1->EVENTS_COMPARE[id] == 0)
+			continue;
+		NRF_RTC1->EVENTS_COMPARE[id] = 0;
+		if (!x->enabled)
+			continue;
+		if (x->type == PERIODIC) {
+			NRF_RTC1->CC[id] = (NRF_RTC1->CC[id] + x->period) & 0xffffff;
+		} else {
+			x->enabled = false;
+			NRF_RTC1->INTENCLR |= RTC_INTENSET_COMPARE0_Msk << id;
+		}
+		if (x->cb != NULL)
+			x->cb(rtc_ctx);
+	}
+}
+
+static void
+batt_tick(struct rtc_ctx *ctx)
+{
+	batt_ticks++;
+}
+
+void
+batt_serv_init(struct rtc_ctx *ctx)
+{
+	ctx->rtc_x[BATT_SERV_RTC_ID].type = PERIODIC;
+	ctx->rtc_x[BATT_SERV_RTC_ID].period = BATT_SERV_PERIOD;
+	ctx->rtc_x[BATT_SERV_RTC_ID].enabled = true;
+	ctx->rtc_x[BATT_SERV_RTC_ID].cb = batt_tick;
+}
+
+void
+enable_i2c(void)
+{
+	sim_twi_power(true);
+}
+
+void
+disable_i2c(void)
+{
+	sim_twi_power(false);
+}
+
+void
+ind_init(void)
+{
+}
+
+void
+onboard_led(enum onboard_led_state state)
+{
+	led = state == ONBOARD_LED_TOGGLE ? !led : state;
+}
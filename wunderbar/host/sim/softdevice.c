@@ -0,0 +1,407 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <nrf_soc.h>
+
+#include "sim_internal.h"
+
+/*
+ * The softdevice's SoC library: critical regions, the clocks, the
+ * flash, SoC events and the power registers the modules poke.  The
+ * NVIC calls are in sim.c, PPI in ppi.c and the link in simble.c.
+ */
+
+#define HFCLK_STARTUP	SIM_US(1500)	/* 16 MHz crystal */
+#define FLASH_ERASE	SIM_US(21000)	/* per page */
+#define FLASH_WRITE	SIM_US(43)	/* per word */
+#define SOC_EVENTS	8
+
+#define CODE_PAGE_SIZE	1024
+#define CODE_PAGES	256
+/* mapped low enough for the firmware's 32 bit flash addresses */
+#define FLASH_MAPPED	0x10000
+
+NRF_CLOCK_Type sim_nrf_clock;
+NRF_POWER_Type sim_nrf_power;
+NRF_FICR_Type sim_nrf_ficr = {
+	.CODEPAGESIZE = CODE_PAGE_SIZE,
+	.CODESIZE = CODE_PAGES,
+};
+NRF_UICR_Type sim_nrf_uicr = {
+	.CLENR0 = 0xffffffff,
+	.BOOTLOADERADDR = 0xffffffff,
+};
+
+static struct {
+	uint8_t critical;
+	uint8_t radio_notification;
+	uint8_t power_mode;
+	uint8_t constlat;
+	unsigned constlat_count;
+	sim_time_t constlat_since;
+	sim_time_t constlat_total;
+
+	uint8_t hfclk_requested;
+	sim_time_t hfclk_since;
+	sim_time_t hfclk_ready;
+	sim_time_t hfclk_total;
+	unsigned hfclk_starts;
+
+	uint32_t events[SOC_EVENTS];
+	uint8_t event_head;
+	uint8_t event_count;
+
+	struct sim_event flash_done;
+	uint32_t *flash_dst;
+	const uint32_t *flash_src;
+	uint32_t flash_words;	/* 0 for an erase */
+	uint32_t *flash_page;
+	unsigned flash_fail;
+	unsigned long flash_cut;
+	unsigned long flash_written;
+	unsigned long flash_erased;
+} sd;
+
+uint32_t
+sd_nvic_critical_region_enter(uint8_t *is_nested_critical_region)
+{
+	*is_nested_critical_region = sd.critical != 0;
+	sd.critical++;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_nvic_critical_region_exit(uint8_t is_nested_critical_region)
+{
+	if (CHECKF(sd.critical > 0, "critical region exit without enter"))
+		sd.critical--;
+	CHECKF(is_nested_critical_region == (sd.critical != 0),
+	    "critical region exit with nested %u at depth %u", is_nested_critical_region, sd.critical);
+	return NRF_SUCCESS;
+}
+
+uint8_t
+sim_critical_depth(void)
+{
+	return sd.critical;
+}
+
+void
+sim_clear_critical(void)
+{
+	sd.critical = 0;
+}
+
+uint32_t
+sd_app_evt_wait(void)
+{
+	CHECKF(0, "sd_app_evt_wait() outside simble's event loop");
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_power_mode_set(uint8_t power_mode)
+{
+	sd.power_mode = power_mode;
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_radio_notification_cfg_set(uint8_t type, uint8_t distance)
+{
+	sd.radio_notification = type != NRF_RADIO_NOTIFICATION_TYPE_NONE;
+	return NRF_SUCCESS;
+}
+
+bool
+sim_radio_notification(void)
+{
+	return sd.radio_notification;
+}
+
+/* SoC events, fetched with sd_evt_get() from simble's event loop */
+
+void
+sim_soc_event(uint32_t evt)
+{
+	if (!CHECKF(sd.event_count < SOC_EVENTS, "SoC event queue overflow"))
+		return;
+	sd.events[(sd.event_head + sd.event_count++) % SOC_EVENTS] = evt;
+	sim_wake();
+}
+
+uint32_t
+sd_evt_get(uint32_t *evt_id)
+{
+	if (sd.event_count == 0)
+		return NRF_ERROR_NOT_FOUND;
+	*evt_id = sd.events[sd.event_head];
+	sd.event_head = (sd.event_head + 1) % SOC_EVENTS;
+	sd.event_count--;
+	return NRF_SUCCESS;
+}
+
+/* clocks */
+
+uint32_t
+sd_clock_hfclk_request(void)
+{
+	if (!sd.hfclk_requested) {
+		sd.hfclk_requested = 1;
+		sd.hfclk_since = sim_now();
+		sd.hfclk_ready = sim_now() + HFCLK_STARTUP;
+		sd.hfclk_starts++;
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_clock_hfclk_release(void)
+{
+	if (sd.hfclk_requested) {
+		sd.hfclk_requested = 0;
+		sd.hfclk_total += sim_now() - sd.hfclk_since;
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t
+sd_clock_hfclk_is_running(uint32_t *is_running)
+{
+	*is_running = sd.hfclk_requested && sim_now() >= sd.hfclk_ready;
+	return NRF_SUCCESS;
+}
+
+sim_time_t
+sim_hfclk_on_time(void)
+{
+	return sd.hfclk_total + (sd.hfclk_requested ? sim_now() - sd.hfclk_since : 0);
+}
+
+unsigned
+sim_hfclk_starts(void)
+{
+	return sd.hfclk_starts;
+}
+
+unsigned
+sim_constlat_count(void)
+{
+	return sd.constlat_count;
+}
+
+sim_time_t
+sim_constlat_on_time(void)
+{
+	return sd.constlat_total + (sd.constlat ? sim_now() - sd.constlat_since : 0);
+}
+
+/*
+ * The LFCLK runs from reset under the softdevice, but a module may
+ * start it again and spin on EVENTS_LFCLKSTARTED, with no sync point
+ * in between: this thread plays the clock block for that.
+ */
+static void *
+lfclk_thread(void *arg)
+{
+	for (;;) {
+		if (sim_nrf_clock.TASKS_LFCLKSTART) {
+			SIM_REG(sim_nrf_clock.TASKS_LFCLKSTART) = 0;
+			sim_nrf_clock.EVENTS_LFCLKSTARTED = 1;
+		}
+		usleep(20);
+	}
+	return NULL;
+}
+
+void
+sim_clock_init(void)
+{
+	pthread_t t;
+
+	sim_nrf_clock.LFCLKSRC = CLOCK_LFCLKSRC_SRC_Xtal;
+	pthread_create(&t, NULL, lfclk_thread, NULL);
+	pthread_detach(t);
+}
+
+void
+sim_clock_sync(void)
+{
+	if (sim_nrf_clock.TASKS_LFCLKSTART) {
+		SIM_REG(sim_nrf_clock.TASKS_LFCLKSTART) = 0;
+		sim_nrf_clock.EVENTS_LFCLKSTARTED = 1;
+	}
+	if (sim_nrf_power.TASKS_CONSTLAT) {
+		SIM_REG(sim_nrf_power.TASKS_CONSTLAT) = 0;
+		if (!sd.constlat)
+			sd.constlat_since = sim_now();
+		sd.constlat = 1;
+		sd.constlat_count++;
+	}
+	if (sim_nrf_power.TASKS_LOWPWR) {
+		SIM_REG(sim_nrf_power.TASKS_LOWPWR) = 0;
+		if (sd.constlat)
+			sd.constlat_total += sim_now() - sd.constlat_since;
+		sd.constlat = 0;
+	}
+}
+
+/* flash */
+
+void
+sim_flash_init(void)
+{
+	size_t size = CODE_PAGES * CODE_PAGE_SIZE - FLASH_MAPPED;
+	void *p = mmap((void *)FLASH_MAPPED, size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+	if (p != (void *)FLASH_MAPPED) {
+		perror("sim: mapping the flash");
+		exit(2);
+	}
+	memset(p, 0xff, size);
+}
+
+static bool
+in_flash(const void *p, size_t size)
+{
+	uintptr_t a = (uintptr_t)p;
+	return a >= FLASH_MAPPED && a + size <= CODE_PAGES * CODE_PAGE_SIZE;
+}
+
+/* counts down to the power cut, dies on the step that hits it */
+static void
+flash_step(void)
+{
+	if (sd.flash_cut != 0 && --sd.flash_cut == 0) {
+		fflush(stdout);
+		_exit(SIM_CUT_STATUS);
+	}
+}
+
+static void
+flash_done(struct sim_event *e)
+{
+	bool ok = sd.flash_fail == 0;
+
+	if (!ok) {
+		sd.flash_fail--;
+	} else if (sd.flash_words == 0) {
+		if (sd.flash_cut == 1) {
+			/* half the page got erased */
+			memset(sd.flash_page, 0xff, CODE_PAGE_SIZE / 2);
+		} else {
+			memset(sd.flash_page, 0xff, CODE_PAGE_SIZE);
+		}
+		flash_step();
+		sd.flash_erased++;
+	} else {
+		for (uint32_t i = 0; i < sd.flash_words; i++) {
+			uint32_t old = sd.flash_dst[i];
+			uint32_t val = sd.flash_src[i];
+			CHECKF((val & ~old) == 0, "flash word %p written from %08x to %08x without an erase",
+			    (void *)&sd.flash_dst[i], old, val);
+			if (sd.flash_cut == 1)
+				val |= 0x0000ffff;	/* half programmed */
+			sd.flash_dst[i] = old & val;
+			flash_step();
+			sd.flash_written++;
+		}
+	}
+	sd.flash_words = 0;
+	sd.flash_page = NULL;
+	sim_soc_event(ok ? NRF_EVT_FLASH_OPERATION_SUCCESS : NRF_EVT_FLASH_OPERATION_ERROR);
+}
+
+static bool
+flash_busy(void)
+{
+	return sd.flash_done.armed;
+}
+
+uint32_t
+sd_flash_page_erase(uint32_t page_number)
+{
+	uint32_t *page = (uint32_t *)(uintptr_t)(page_number * CODE_PAGE_SIZE);
+
+	if (flash_busy())
+		return NRF_ERROR_BUSY;
+	if (!CHECKF(in_flash(page, CODE_PAGE_SIZE), "erase of page %u outside the data pages", page_number))
+		return NRF_ERROR_INVALID_ADDR;
+	sd.flash_page = page;
+	sd.flash_words = 0;
+	sd.flash_done.fire = flash_done;
+	sim_schedule(&sd.flash_done, sim_now() + FLASH_ERASE);
+	return NRF_SUCCESS;
+}
+
+/* the softdevice reads `p_src' while it writes, it must stay put until the event */
+uint32_t
+sd_flash_write(uint32_t *p_dst, uint32_t const *p_src, uint32_t size)
+{
+	if (flash_busy())
+		return NRF_ERROR_BUSY;
+	if (!CHECKF(((uintptr_t)p_dst & 3) == 0 && ((uintptr_t)p_src & 3) == 0,
+	    "unaligned flash write %p from %p", (void *)p_dst, (const void *)p_src))
+		return NRF_ERROR_INVALID_ADDR;
+	if (!CHECKF(size > 0 && size <= CODE_PAGE_SIZE / 4, "flash write of %u words", size))
+		return NRF_ERROR_INVALID_LENGTH;
+	if (!CHECKF(in_flash(p_dst, size * 4), "flash write to %p outside the data pages", (void *)p_dst))
+		return NRF_ERROR_INVALID_ADDR;
+	sd.flash_dst = p_dst;
+	sd.flash_src = p_src;
+	sd.flash_words = size;
+	sd.flash_done.fire = flash_done;
+	sim_schedule(&sd.flash_done, sim_now() + size * FLASH_WRITE);
+	return NRF_SUCCESS;
+}
+
+void
+sim_flash_fail(unsigned n)
+{
+	sd.flash_fail = n;
+}
+
+void
+sim_flash_cut(unsigned long n)
+{
+	sd.flash_cut = n;
+}
+
+unsigned long
+sim_flash_words(void)
+{
+	return sd.flash_written;
+}
+
+unsigned long
+sim_flash_erases(void)
+{
+	return sd.flash_erased;
+}
+
+bool
+sim_boot(int *status)
+{
+	pid_t pid;
+	int wstatus;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		perror("sim: fork");
+		exit(2);
+	}
+	if (pid == 0)
+		return true;
+	if (waitpid(pid, &wstatus, 0) != pid || !WIFEXITED(wstatus))
+		*status = -1;
+	else
+		*status = WEXITSTATUS(wstatus);
+	return false;
+}
@@ -0,0 +1,245 @@
+#include <string.h>
+
+#include "sim_internal.h"
+
+/*
+ * TIMER0..2.  In timer mode the counter runs at 16 MHz >> PRESCALER
+ * (latched at START); in counter mode TASKS_COUNT increments it.  A
+ * compare event is generated when the counter becomes equal to CC[n];
+ * the CLEAR and STOP shorts act on it at once.  Switching POWER off
+ * resets the registers.
+ */
+
+#define HFCLK_HZ	16000000ULL
+#define TIMERS		3
+
+NRF_TIMER_Type sim_nrf_timer[TIMERS];
+
+static const uint32_t bitmode_mask[] = {0xffff, 0xff, 0xffffff, 0xffffffff};
+
+static struct timer {
+	uint8_t running;
+	uint8_t powered;
+	uint32_t prescaler;
+	uint32_t base;		/* counter at `since' */
+	sim_time_t since;
+	sim_time_t on_since;
+	sim_time_t on_time;
+	uint32_t inten;
+	struct sim_event compare[4];
+} timers[TIMERS];
+
+static inline NRF_TIMER_Type *
+regs(struct timer *t)
+{
+	return &sim_nrf_timer[t - timers];
+}
+
+static uint32_t
+mask(struct timer *t)
+{
+	return bitmode_mask[regs(t)->BITMODE & 3];
+}
+
+static bool
+timer_mode(struct timer *t)
+{
+	return regs(t)->MODE == TIMER_MODE_MODE_Timer;
+}
+
+static uint64_t
+freq(struct timer *t)
+{
+	return HFCLK_HZ >> (t->prescaler > 9 ? 9 : t->prescaler);
+}
+
+static uint32_t
+counter(struct timer *t)
+{
+	if (!t->running || !timer_mode(t))
+		return t->base;
+	return (t->base + (unsigned __int128)(sim_now() - t->since) * freq(t) / 1000000000ULL) & mask(t);
+}
+
+/* make `since' the present, keeping the count */
+static void
+rebase(struct timer *t)
+{
+	t->base = counter(t);
+	t->since = sim_now();
+}
+
+static void
+schedule(struct timer *t)
+{
+	for (int i = 0; i < 4; i++) {
+		struct sim_event *e = &t->compare[i];
+		if (!t->running || !timer_mode(t)) {
+			sim_cancel(e);
+			continue;
+		}
+		uint64_t distance = (regs(t)->CC[i] - counter(t)) & mask(t);
+		if (distance == 0)
+			distance = (uint64_t)mask(t) + 1;
+		/* counted from `since', which may lie a fraction of a tick back */
+		uint64_t elapsed = (unsigned __int128)(sim_now() - t->since) * freq(t) / 1000000000ULL;
+		uint64_t n = elapsed + distance;
+		sim_time_t at = t->since + ((unsigned __int128)n * 1000000000ULL + freq(t) - 1) / freq(t);
+		if (!e->armed || e->at != at)
+			sim_schedule(e, at);
+	}
+}
+
+static void
+start(struct timer *t)
+{
+	if (t->running)
+		return;
+	t->running = 1;
+	t->prescaler = regs(t)->PRESCALER;
+	t->since = sim_now();
+	t->on_since = sim_now();
+}
+
+static void
+stop(struct timer *t)
+{
+	if (!t->running)
+		return;
+	rebase(t);
+	t->running = 0;
+	t->on_time += sim_now() - t->on_since;
+}
+
+static void
+clear(struct timer *t)
+{
+	t->base = 0;
+	t->since = sim_now();
+}
+
+/* the counter reached CC[i] */
+static void
+matched(struct timer *t, int i)
+{
+	NRF_TIMER_Type *r = regs(t);
+
+	sim_event_raise(&r->EVENTS_COMPARE[i]);
+	if (t->inten & (TIMER_INTENSET_COMPARE0_Msk << i))
+		sim_irq_pend(TIMER0_IRQn + (t - timers));
+	if (r->SHORTS & (TIMER_SHORTS_COMPARE0_CLEAR_Msk << i))
+		clear(t);
+	if (r->SHORTS & (TIMER_SHORTS_COMPARE0_STOP_Msk << i))
+		stop(t);
+}
+
+static void
+compare(struct sim_event *e)
+{
+	for (struct timer *t = timers; t < timers + TIMERS; t++) {
+		if (e < t->compare || e >= t->compare + 4)
+			continue;
+		int i = e - t->compare;
+		if (t->running && counter(t) == (regs(t)->CC[i] & mask(t)))
+			matched(t, i);
+		schedule(t);
+		return;
+	}
+}
+
+static void
+count(struct timer *t)
+{
+	if (!t->running || timer_mode(t))
+		return;
+	t->base = (t->base + 1) & mask(t);
+	for (int i = 0; i < 4; i++) {
+		if (t->base == (regs(t)->CC[i] & mask(t)))
+			matched(t, i);
+	}
+}
+
+static void
+sync_one(struct timer *t)
+{
+	NRF_TIMER_Type *r = regs(t);
+
+	if (!(r->POWER & 1)) {
+		if (t->powered) {
+			stop(t);
+			sim_time_t on_time = t->on_time;
+			for (int i = 0; i < 4; i++)
+				sim_cancel(&t->compare[i]);
+			memset(r, 0, sizeof(*r));
+			memset(t, 0, sizeof(*t));
+			t->on_time = on_time;
+		}
+		/* writes to a block that is off are lost */
+		uint32_t power = r->POWER;
+		memset(r, 0, sizeof(*r));
+		r->POWER = power;
+		return;
+	}
+	t->powered = 1;
+	t->inten = (t->inten | r->INTENSET) & ~r->INTENCLR;
+	r->INTENSET = t->inten;
+	r->INTENCLR = 0;
+	for (int i = 0; i < 4; i++) {
+		if (r->TASKS_CAPTURE[i]) {
+			r->TASKS_CAPTURE[i] = 0;
+			r->CC[i] = counter(t);
+		}
+	}
+	if (r->TASKS_STOP) {
+		r->TASKS_STOP = 0;
+		stop(t);
+	}
+	if (r->TASKS_SHUTDOWN) {
+		r->TASKS_SHUTDOWN = 0;
+		stop(t);
+		clear(t);
+	}
+	if (r->TASKS_CLEAR) {
+		r->TASKS_CLEAR = 0;
+		clear(t);
+	}
+	if (r->TASKS_START) {
+		r->TASKS_START = 0;
+		start(t);
+	}
+	if (r->TASKS_COUNT) {
+		r->TASKS_COUNT = 0;
+		count(t);
+	}
+	for (int i = 0; i < 4; i++)
+		t->compare[i].fire = compare;
+	schedule(t);
+}
+
+void
+sim_timer_sync(void)
+{
+	for (struct timer *t = timers; t < timers + TIMERS; t++)
+		sync_one(t);
+}
+
+bool
+sim_timer_task(volatile uint32_t *reg)
+{
+	for (struct timer *t = timers; t < timers + TIMERS; t++) {
+		NRF_TIMER_Type *r = regs(t);
+		if ((void *)reg < (void *)r || (void *)reg >= (void *)(r + 1))
+			continue;
+		*reg = 1;
+		sync_one(t);
+		return true;
+	}
+	return false;
+}
+
+sim_time_t
+sim_timer_on_time(uint8_t instance)
+{
+	struct timer *t = &timers[instance];
+	return t->on_time + (t->running ? sim_now() - t->on_since : 0);
+}
@@ -0,0 +1,341 @@
+#include <stddef.h>
+
+#include <twi_master.h>
+
+#include "sim_internal.h"
+
+/*
+ * TWI1 and the bus behind it, byte by byte.  A transfer is an address
+ * phase then data bytes, nine clocks each at FREQUENCY; events come
+ * when a byte is done.  After a received byte the BB shorts apply: the
+ * TWI suspends (BB_SUSPEND) or stops (BB_STOP) after it.  After a sent
+ * byte the TWI holds the bus until TXD is written, STOP is triggered or
+ * a repeated start begins.  A NACK raises ERROR with ERRORSRC and holds
+ * the bus until STOP.
+ *
+ * twi_master_transfer(), the SDK's blocking driver, talks to the same
+ * devices and burns the bus time with sim_stall().
+ */
+
+#define TXD_EMPTY	0xffffffffUL	/* the firmware writes bytes */
+
+NRF_TWI_Type sim_nrf_twi1;
+
+enum twi_state {
+	TWI_IDLE,
+	TWI_ADDRESS,		/* address byte on the wire */
+	TWI_TX,			/* data byte on the wire */
+	TWI_TX_HELD,		/* byte sent, waiting for TXD, STOP or a restart */
+	TWI_RX,
+	TWI_RX_SUSPENDED,
+	TWI_ERROR_HELD,		/* NACK, waiting for STOP */
+	TWI_STOPPING,
+	TWI_BLOCKING_HELD,	/* twi_master_transfer() without a stop */
+};
+
+static struct {
+	struct sim_twi_device *devices;
+	struct sim_twi_device *dev;
+	enum twi_state state;
+	uint8_t read;
+	uint8_t stop_pending;
+	uint32_t inten;
+	struct sim_event ev;
+	uint8_t supply;
+	sim_time_t supply_since;
+	unsigned long bytes;
+} twi;
+
+static sim_time_t
+bit_time(void)
+{
+	switch (sim_nrf_twi1.FREQUENCY) {
+	case TWI_FREQUENCY_FREQUENCY_K400:
+		return 2500;
+	case TWI_FREQUENCY_FREQUENCY_K250:
+		return 4000;
+	default:
+		return 10000;
+	}
+}
+
+void
+sim_twi_attach(struct sim_twi_device *d)
+{
+	d->next = twi.devices;
+	twi.devices = d;
+}
+
+static bool
+present(struct sim_twi_device *d)
+{
+	if (d == NULL)
+		return false;
+	if (!d->on_sensor_supply)
+		return true;
+	return twi.supply && sim_now() - twi.supply_since >= d->startup;
+}
+
+static struct sim_twi_device *
+find(uint8_t address)
+{
+	for (struct sim_twi_device *d = twi.devices; d != NULL; d = d->next)
+		if (d->address == address)
+			return d;
+	return NULL;
+}
+
+void
+sim_twi_power(bool on)
+{
+	if (on != twi.supply)
+		SIM_TRACE("twi", "sensor supply %s", on ? "on" : "off");
+	if (on == twi.supply)
+		return;
+	twi.supply = on;
+	twi.supply_since = sim_now();
+	for (struct sim_twi_device *d = twi.devices; d != NULL; d = d->next)
+		if (d->on_sensor_supply && d->power != NULL)
+			d->power(d, on);
+}
+
+bool
+sim_sensor_supply(void)
+{
+	return twi.supply;
+}
+
+sim_time_t
+sim_sensor_supply_since(void)
+{
+	return twi.supply_since;
+}
+
+unsigned long
+sim_twi_bytes(void)
+{
+	return twi.bytes;
+}
+
+static void
+event(volatile uint32_t *reg, uint32_t mask)
+{
+	sim_event_raise(reg);
+	if (twi.inten & mask)
+		sim_irq_pend(SPI1_TWI1_IRQn);
+}
+
+static void
+after(enum twi_state state, sim_time_t bits)
+{
+	twi.state = state;
+	sim_schedule(&twi.ev, sim_now() + bits * bit_time());
+}
+
+static void
+nack(uint32_t src)
+{
+	sim_nrf_twi1.ERRORSRC |= src;
+	twi.state = TWI_ERROR_HELD;
+	event(&sim_nrf_twi1.EVENTS_ERROR, TWI_INTENSET_ERROR_Msk);
+}
+
+static void
+begin(bool read)
+{
+	twi.read = read;
+	twi.dev = find(sim_nrf_twi1.ADDRESS);
+	twi.stop_pending = 0;
+	after(TWI_ADDRESS, 9);
+}
+
+static void
+stopping(void)
+{
+	after(TWI_STOPPING, 1);
+}
+
+static void
+byte_done(struct sim_event *e)
+{
+	NRF_TWI_Type *r = &sim_nrf_twi1;
+	bool ok;
+
+	switch (twi.state) {
+	case TWI_ADDRESS:
+		ok = present(twi.dev) && twi.dev->start(twi.dev, twi.read);
+		twi.bytes++;
+		SIM_TRACE("twi", "%s %#x %s", twi.read ? "read" : "write",
+		    sim_nrf_twi1.ADDRESS, ok ? "ack" : "nack");
+		if (!ok) {
+			nack(TWI_ERRORSRC_ANACK_Msk);
+		} else if (twi.read) {
+			after(TWI_RX, 9);
+		} else if (r->TXD != TXD_EMPTY) {
+			after(TWI_TX, 9);
+		} else {
+			twi.state = TWI_TX_HELD;
+		}
+		break;
+	case TWI_TX:
+		ok = present(twi.dev) && twi.dev->write(twi.dev, r->TXD);
+		SIM_TRACE("twi", "  %#04x %s", r->TXD & 0xff, ok ? "ack" : "nack");
+		r->TXD = TXD_EMPTY;
+		twi.bytes++;
+		if (!ok) {
+			nack(TWI_ERRORSRC_DNACK_Msk);
+			break;
+		}
+		twi.state = TWI_TX_HELD;
+		event(&r->EVENTS_TXDSENT, TWI_INTENSET_TXDSENT_Msk);
+		break;
+	case TWI_RX: {
+		uint32_t shorts = r->SHORTS;
+		bool last = (shorts & TWI_SHORTS_BB_STOP_Msk) || twi.stop_pending;
+		SIM_REG(r->RXD) = present(twi.dev) ? twi.dev->read(twi.dev, last) : 0xff;
+		SIM_TRACE("twi", "  %#04x%s", r->RXD, last ? " last" : "");
+		twi.bytes++;
+		event(&r->EVENTS_RXDREADY, TWI_INTENSET_RXDREADY_Msk);
+		if (last)
+			stopping();
+		else if (shorts & TWI_SHORTS_BB_SUSPEND_Msk)
+			twi.state = TWI_RX_SUSPENDED;
+		else
+			after(TWI_RX, 9);
+		return;
+	}
+	case TWI_STOPPING:
+		if (twi.dev != NULL && twi.dev->stop != NULL)
+			twi.dev->stop(twi.dev);
+		twi.dev = NULL;
+		twi.state = TWI_IDLE;
+		SIM_TRACE("twi", "stop");
+		event(&r->EVENTS_STOPPED, TWI_INTENSET_STOPPED_Msk);
+		return;
+	default:
+		return;
+	}
+	if (twi.stop_pending && twi.state != TWI_ERROR_HELD)
+		stopping();
+}
+
+void
+sim_twi_sync(void)
+{
+	NRF_TWI_Type *r = &sim_nrf_twi1;
+
+	twi.inten = (twi.inten | r->INTENSET) & ~r->INTENCLR;
+	r->INTENSET = twi.inten;
+	r->INTENCLR = 0;
+	if (r->TASKS_SUSPEND) {
+		r->TASKS_SUSPEND = 0;
+		if (twi.state == TWI_RX)
+			r->SHORTS |= TWI_SHORTS_BB_SUSPEND_Msk;
+	}
+	if (r->TASKS_STOP) {
+		r->TASKS_STOP = 0;
+		switch (twi.state) {
+		case TWI_ADDRESS:
+		case TWI_TX:
+		case TWI_RX:
+			/* after the byte on the wire */
+			twi.stop_pending = 1;
+			break;
+		case TWI_TX_HELD:
+		case TWI_RX_SUSPENDED:
+		case TWI_ERROR_HELD:
+			stopping();
+			break;
+		default:
+			break;
+		}
+	}
+	if (r->TASKS_STARTTX || r->TASKS_STARTRX) {
+		bool read = r->TASKS_STARTRX;
+		r->TASKS_STARTTX = r->TASKS_STARTRX = 0;
+		if (!CHECKF(r->ENABLE == TWI_ENABLE_ENABLE_Enabled, "TWI started while disabled"))
+			return;
+		if (CHECKF(twi.state == TWI_IDLE || twi.state == TWI_TX_HELD ||
+		    twi.state == TWI_BLOCKING_HELD,
+		    "TWI start while the bus is busy (state %d)", twi.state))
+			begin(read);
+	}
+	if (r->TASKS_RESUME) {
+		r->TASKS_RESUME = 0;
+		if (twi.state == TWI_RX_SUSPENDED)
+			after(TWI_RX, 9);
+	}
+	if (twi.state == TWI_TX_HELD && r->TXD != TXD_EMPTY)
+		after(TWI_TX, 9);
+}
+
+void
+sim_twi_init(void)
+{
+	twi.ev.fire = byte_done;
+	sim_nrf_twi1.TXD = TXD_EMPTY;
+}
+
+/* the SDK driver */
+
+bool
+twi_master_init(void)
+{
+	NRF_TWI_Type *r = &sim_nrf_twi1;
+
+	r->FREQUENCY = TWI_FREQUENCY_FREQUENCY_K100 << TWI_FREQUENCY_FREQUENCY_Pos;
+	r->ENABLE = TWI_ENABLE_ENABLE_Enabled;
+	r->TXD = TXD_EMPTY;
+	return true;
+}
+
+static bool
+blocking_stop(struct sim_twi_device *d)
+{
+	sim_stall(bit_time());
+	if (d != NULL && d->stop != NULL)
+		d->stop(d);
+	twi.state = TWI_IDLE;
+	SIM_TRACE("twi", "stop");
+	return false;
+}
+
+bool
+twi_master_transfer(uint8_t address, uint8_t *data, uint8_t data_length, bool issue_stop_condition)
+{
+	struct sim_twi_device *d = find(address >> 1);
+	bool read = address & TWI_READ_BIT;
+	bool ok;
+
+	if (!CHECKF(twi.state == TWI_IDLE || twi.state == TWI_BLOCKING_HELD,
+	    "blocking TWI transfer while an interrupt driven one runs"))
+		return false;
+	sim_stall(9 * bit_time());
+	twi.bytes++;
+	ok = present(d) && d->start(d, read);
+	SIM_TRACE("twi", "%s %#x %s, blocking", read ? "read" : "write", address >> 1,
+	    ok ? "ack" : "nack");
+	if (!ok)
+		return blocking_stop(d);
+	for (uint8_t i = 0; i < data_length; i++) {
+		sim_stall(9 * bit_time());
+		twi.bytes++;
+		if (!present(d))
+			return blocking_stop(d);
+		if (read) {
+			data[i] = d->read(d, i == data_length - 1);
+			SIM_TRACE("twi", "  %#04x", data[i]);
+		} else {
+			ok = d->write(d, data[i]);
+			SIM_TRACE("twi", "  %#04x %s", data[i], ok ? "ack" : "nack");
+			if (!ok)
+				return blocking_stop(d);
+		}
+	}
+	if (issue_stop_condition) {
+		blocking_stop(d);
+	} else {
+		twi.state = TWI_BLOCKING_HELD;
+	}
+	return true;
+}
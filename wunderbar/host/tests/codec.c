@@ -0,0 +1,257 @@
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "motion/codec.h"
+
+/*
+ * codec: synthetic MPU6500 streams through the encoder and the
+ * reference decoder, which must give back every sample; the ratio
+ * against 12 bytes a sample, never below 1, samples per notification,
+ * a lost packet costing no more than the run to the next keyframe or
+ * raw packet, and the encode time a sample on the host.  Sensor noise is the datasheet's, 2 mg
+ * and 0.06 dps RMS at 41 Hz bandwidth.
+ */
+
+#define RATE		100	/* Hz */
+#define SECONDS		120
+#define SAMPLES		(RATE * SECONDS)
+#define ACCEL_SCALE	8192	/* LSB per g, +-4 g */
+#define GYRO_SCALE	65.5	/* LSB per dps, +-500 dps */
+#define MAX_PACKETS	SAMPLES
+
+static struct mpu6500_data in[SAMPLES], out[SAMPLES];
+static uint8_t packets[MAX_PACKETS][CODEC_PAYLOAD];
+static uint8_t lens[MAX_PACKETS];
+static unsigned npackets;
+static bool oversize;
+
+/* 0..1, the same sequence every run */
+static double
+uniform(void)
+{
+	static uint32_t x = 2463534242u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x / 4294967296.0;
+}
+
+static double
+gauss(void)
+{
+	return sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+}
+
+static uint64_t
+host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint16_t
+lsb(double v)
+{
+	v = round(v);
+	return (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+}
+
+static void
+sample(struct mpu6500_data *d, const double g[3], const double dps[3])
+{
+	d->accel_x = lsb((g[0] + 0.002 * gauss()) * ACCEL_SCALE);
+	d->accel_y = lsb((g[1] + 0.002 * gauss()) * ACCEL_SCALE);
+	d->accel_z = lsb((g[2] + 0.002 * gauss()) * ACCEL_SCALE);
+	d->gyro_x = lsb((dps[0] + 0.06 * gauss()) * GYRO_SCALE);
+	d->gyro_y = lsb((dps[1] + 0.06 * gauss()) * GYRO_SCALE);
+	d->gyro_z = lsb((dps[2] + 0.06 * gauss()) * GYRO_SCALE);
+}
+
+/* on a desk */
+static void
+desk(void)
+{
+	for (unsigned i = 0; i < SAMPLES; i++)
+		sample(&in[i], (double[3]){0.01, -0.02, 1}, (double[3]){0.4, -0.2, 0.7});
+}
+
+/* turned about by hand, up to about 100 dps */
+static void
+handheld(void)
+{
+	for (unsigned i = 0; i < SAMPLES; i++) {
+		double s = (double)i / RATE;
+		double pitch = 0.6 * sin(2 * M_PI * s / 7.3), roll = 0.5 * sin(2 * M_PI * s / 5.1 + 1);
+
+		sample(&in[i], (double[3]){-sin(pitch), sin(roll) * cos(pitch), cos(roll) * cos(pitch)},
+		    (double[3]){
+			0.5 * 2 * M_PI / 5.1 * cos(2 * M_PI * s / 5.1 + 1) * 180 / M_PI,
+			0.6 * 2 * M_PI / 7.3 * cos(2 * M_PI * s / 7.3) * 180 / M_PI,
+			70 * sin(2 * M_PI * s / 11.7)});
+	}
+}
+
+/* in a pocket at 1.8 steps/s */
+static void
+walking(void)
+{
+	for (unsigned i = 0; i < SAMPLES; i++) {
+		double p = 2 * M_PI * 1.8 * i / RATE;
+
+		sample(&in[i], (double[3]){0.1 * sin(p / 2), 0.05 * sin(p + 1),
+		    1 + 0.25 * sin(p) + 0.08 * sin(2 * p + 1)},
+		    (double[3]){20 * sin(p / 2), 8 * sin(p + 2), 5 * sin(p / 2 + 1)});
+	}
+}
+
+/* on a pump housing, 24.7 Hz and harmonics, hardly predictable at 100 Hz */
+static void
+pump(void)
+{
+	for (unsigned i = 0; i < SAMPLES; i++) {
+		double p = 2 * M_PI * 24.7 * i / RATE;
+
+		sample(&in[i], (double[3]){0.2 * sin(p), 0.08 * sin(2 * p), 1 + 0.03 * sin(6 * p)},
+		    (double[3]){2 * sin(p + 1), 1 * sin(2 * p), 0.5 * sin(p)});
+	}
+}
+
+/* the worst case: every bit random */
+static void
+noise(void)
+{
+	for (unsigned i = 0; i < SAMPLES; i++) {
+		uint16_t *v = (uint16_t *)&in[i];
+
+		for (int c = 0; c < CODEC_CHANNELS; c++)
+			v[c] = uniform() * 65536;
+	}
+}
+
+static void
+capture(const void *packet, uint8_t len)
+{
+	if (len > CODEC_PAYLOAD)
+		oversize = true;
+	if (npackets < MAX_PACKETS) {
+		memcpy(packets[npackets], packet, len);
+		lens[npackets] = len;
+	}
+	npackets++;
+}
+
+static bool
+raw(unsigned p)
+{
+	return lens[p] == CODEC_RAW;
+}
+
+/* where a decoder picks up again */
+static bool
+key(unsigned p)
+{
+	return raw(p) || packets[p][1] & CODEC_KEY;
+}
+
+static unsigned
+samples(unsigned p)
+{
+	return raw(p) ? 1 : packets[p][1] & 0x7f;
+}
+
+/* decodes the captured packets, skipping `lost'; returns samples out */
+static unsigned
+decode(int lost, unsigned *first_after)
+{
+	struct codec_decoder dec;
+	unsigned n = 0;
+
+	memset(&dec, 0, sizeof(dec));
+	*first_after = 0;
+	for (unsigned p = 0; p < npackets; p++) {
+		int got;
+
+		if ((int)p == lost)
+			continue;
+		got = codec_decode(&dec, packets[p], lens[p], &out[n], SAMPLES - n);
+		if (got > 0) {
+			if (lost >= 0 && (int)p > lost && *first_after == 0)
+				*first_after = p;
+			n += got;
+		}
+	}
+	return n;
+}
+
+static void
+trace(const char *name, void (*make)(void))
+{
+	struct codec c;
+	unsigned n, bytes = 0, keys = 0, raws = 0, since = 0, longest = 0, first_after;
+	uint64_t ns;
+
+	make();
+	npackets = 0;
+	oversize = false;
+	codec_init(&c, capture);
+	ns = host_ns();
+	for (unsigned i = 0; i < SAMPLES; i++)
+		codec_add(&c, &in[i]);
+	codec_flush(&c);
+	ns = host_ns() - ns;
+
+	for (unsigned p = 0; p < npackets; p++) {
+		bytes += lens[p];
+		raws += raw(p);
+		if (key(p)) {
+			keys += !raw(p);
+			since = 0;
+		} else if (++since > longest) {
+			longest = since;
+		}
+	}
+	CHECKF(!oversize, "%s: a packet over %u bytes", name, CODEC_PAYLOAD);
+	CHECKF(key(0), "%s: starts without a keyframe", name);
+	CHECKF(bytes <= 12 * SAMPLES, "%s: %u bytes for %u samples", name, bytes, SAMPLES);
+	CHECKF(longest < CODEC_KEYFRAME, "%s: %u packets between keyframes", name, longest);
+
+	/* lossless */
+	n = decode(-1, &first_after);
+	CHECKF(n == SAMPLES, "%s: %u samples back of %u", name, n, SAMPLES);
+	CHECKF(memcmp(in, out, sizeof(in)) == 0, "%s: samples differ", name);
+
+	/* a packet lost mid-stream: what follows up to the keyframe goes with it */
+	unsigned lost = npackets / 2;
+	unsigned before = 0;
+	for (unsigned p = 0; p < lost; p++)
+		before += samples(p);
+	n = decode(lost, &first_after);
+	unsigned skipped = 0;
+	for (unsigned p = lost; p < first_after; p++)
+		skipped += samples(p);
+	CHECKF(first_after != 0 && key(first_after) &&
+	    first_after - lost <= CODEC_KEYFRAME, "%s: resynchronised %u packets on", name,
+	    first_after - lost);
+	CHECKF(n == SAMPLES - skipped && memcmp(&in[before + skipped], &out[before],
+	    (SAMPLES - before - skipped) * sizeof(in[0])) == 0,
+	    "%s: wrong samples after the keyframe", name);
+
+	check_note("%-8s %5.2f times smaller than 12 bytes a sample, %4.1f samples a notification, "
+	    "%u keyframes, %u raw; %.0f ns a sample on the host", name,
+	    12.0 * SAMPLES / bytes, (double)SAMPLES / npackets, keys, raws, (double)ns / SAMPLES);
+}
+
+void
+scenario(void)
+{
+	trace("desk", desk);
+	trace("handheld", handheld);
+	trace("walking", walking);
+	trace("pump", pump);
+	trace("noise", noise);
+}
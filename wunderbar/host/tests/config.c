@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "config.h"
+#include "flash.h"
+#include "task.h"
+#include "vtimer.h"
+
+/*
+ * config: the settings log against the simulated flash, with the power
+ * cut at every flash step of an update in turn, each in a child that
+ * boots from what the cut left (sim_boot()): the first store, an
+ * append and a page switch.  After the cut every setting reads back as
+ * its old or its new value, a switch is all or nothing, and the next
+ * update goes through.  Also failed operations retried, a burst of
+ * changes written once, and the erases a long run of updates costs.
+ */
+
+#define RTC_ID		0
+#define SETTINGS	3
+/* the three records, in words */
+#define RECORD_WORDS	(1 + 1 + 1 + 2 + 1 + 4)
+#define HEADER_WORDS	2
+#define CONFIG_MAGIC	0x4346	/* as config.c has them */
+#define PAGE_MAX	1024	/* bytes, the nRF51's */
+#define RUN		(CONFIG_DELAY + 500)	/* ms, time enough for an update */
+#define WEAR_UPDATES	1000
+
+struct settings {
+	uint32_t a;
+	uint8_t b[6];
+	uint8_t c[16];
+};
+
+/* what a child saw, shared with the parent */
+struct seen {
+	bool found[SETTINGS];
+	struct settings s;
+	unsigned long words;
+	unsigned long erases;
+};
+
+static struct rtc_ctx rtc_ctx = {
+	.rtc_x[RTC_ID] = VTIMER_RTC_SLOT,
+};
+
+static struct seen *seen;
+static unsigned fails;
+static struct settings cur;
+static struct config_item items[SETTINGS];
+static uint32_t saved[2][PAGE_MAX / sizeof(uint32_t)];
+
+static void
+make(struct settings *s, uint32_t n)
+{
+	s->a = n * 2654435761u;
+	for (unsigned i = 0; i < sizeof(s->b); i++)
+		s->b[i] = n + i;
+	for (unsigned i = 0; i < sizeof(s->c); i++)
+		s->c[i] = n * 7 + i;
+}
+
+static const void *
+field(const struct settings *s, int i)
+{
+	return i == 0 ? (const void *)&s->a : i == 1 ? (const void *)s->b : (const void *)s->c;
+}
+
+static const size_t sizes[SETTINGS] = {
+	sizeof(((struct settings *)0)->a),
+	sizeof(((struct settings *)0)->b),
+	sizeof(((struct settings *)0)->c),
+};
+
+static bool
+same(const struct settings *s, const struct settings *t, int i)
+{
+	return memcmp(field(s, i), field(t, i), sizes[i]) == 0;
+}
+
+static bool
+all(const struct settings *s, const struct settings *t)
+{
+	return same(s, t, 0) && same(s, t, 1) && same(s, t, 2);
+}
+
+/* in a child: what a module does while it builds its services */
+static void
+attach(void)
+{
+	memset(&cur, 0, sizeof(cur));
+	for (int i = 0; i < SETTINGS; i++)
+		seen->found[i] = config_add(&items[i], CONFIG_KEY(0x10, i), (void *)field(&cur, i),
+		    sizes[i]);
+	seen->s = cur;
+}
+
+/* in a child: a GATT write of every setting, then time for the task */
+static void
+update(uint32_t n)
+{
+	unsigned long words = sim_flash_words(), erases = sim_flash_erases();
+
+	attach();
+	make(&cur, n);
+	config_changed();
+	CHECK(sim_flash_words() == words && sim_flash_erases() == erases);
+	sim_run(SIM_MS(RUN));
+	seen->words = sim_flash_words() - words;
+	seen->erases = sim_flash_erases() - erases;
+}
+
+/*
+ * Runs `fn' in a child booted with the flash as it is, the power cut
+ * on flash step `cut' if not 0; the child's status.
+ */
+static int
+boot(void (*fn)(uint32_t), uint32_t n, unsigned long cut)
+{
+	int status;
+
+	memset(seen, 0, sizeof(*seen));
+	if (sim_boot(&status)) {
+		sim_flash_cut(cut);
+		fn(n);
+		fflush(stdout);
+		_exit(check_failures() != 0);
+	}
+	return status;
+}
+
+static void
+load(uint32_t n)
+{
+	attach();
+}
+
+/* the words free on the page that is in charge, as config.c picks it */
+static unsigned
+room(void)
+{
+	const uint32_t *a = flash_page(FLASH_CONFIG_FIRST), *b = flash_page(FLASH_CONFIG_FIRST + 1);
+	const uint32_t *p;
+	unsigned words = flash_page_size() / sizeof(uint32_t), end = words;
+	bool va = a[0] >> 16 == CONFIG_MAGIC && a[1] == ~a[0];
+	bool vb = b[0] >> 16 == CONFIG_MAGIC && b[1] == ~b[0];
+
+	if (va && (!vb || (int16_t)(a[0] - b[0]) > 0))
+		p = a;
+	else if (vb)
+		p = b;
+	else
+		return 0;
+	while (end > HEADER_WORDS && p[end - 1] == 0xffffffff)
+		end--;
+	return words - end;
+}
+
+static void
+save(void)
+{
+	memcpy(saved[0], flash_page(FLASH_CONFIG_FIRST), flash_page_size());
+	memcpy(saved[1], flash_page(FLASH_CONFIG_FIRST + 1), flash_page_size());
+}
+
+static void
+restore(void)
+{
+	memcpy(flash_page(FLASH_CONFIG_FIRST), saved[0], flash_page_size());
+	memcpy(flash_page(FLASH_CONFIG_FIRST + 1), saved[1], flash_page_size());
+}
+
+/*
+ * Update to the settings made from `n' with the power cut at every
+ * step in turn; leaves the flash as the update without a cut does.
+ */
+static void
+sweep(const char *name, uint32_t n)
+{
+	struct seen before;
+	struct settings next, again;
+	bool switching = room() < RECORD_WORDS;
+	unsigned cuts = 0, old = 0, mixed = 0, new = 0;
+	unsigned long cut;
+	int status;
+
+	CHECK(boot(load, 0, 0) == 0);
+	before = *seen;
+	make(&next, n);
+	make(&again, n + 1000);
+	save();
+	for (cut = 1;; cut++) {
+		restore();
+		status = boot(update, n, cut);
+		if (status != SIM_CUT_STATUS)
+			break;
+		cuts++;
+
+		CHECK(boot(load, 0, 0) == 0);
+		unsigned was = 0, now = 0;
+		for (int i = 0; i < SETTINGS; i++) {
+			bool is_old = before.found[i] ? seen->found[i] && same(&seen->s, &before.s, i) :
+			    !seen->found[i];
+			bool is_new = seen->found[i] && same(&seen->s, &next, i);
+
+			CHECKF(is_old || is_new, "%s, cut at step %lu: setting %d neither old nor new",
+			    name, cut, i);
+			was += is_old && !is_new;
+			now += is_new;
+		}
+		old += was == SETTINGS;
+		mixed += was != SETTINGS && now != SETTINGS;
+		new += now == SETTINGS;
+		if (switching)
+			CHECKF(was == SETTINGS || now == SETTINGS, "%s, cut at step %lu: %u old, %u new",
+			    name, cut, was, now);
+
+		/* what the cut left takes the next update */
+		CHECK(boot(update, n + 1000, 0) == 0);
+		CHECK(boot(load, 0, 0) == 0);
+		for (int i = 0; i < SETTINGS; i++)
+			CHECKF(seen->found[i] && same(&seen->s, &again, i),
+			    "%s, cut at step %lu: setting %d lost after the next update", name, cut, i);
+	}
+	CHECKF(status == 0, "%s: status %d", name, status);
+	CHECKF(cut == seen->words + seen->erases + 1, "%s: %lu steps cut, %lu words and %lu erases",
+	    name, cut - 1, seen->words, seen->erases);
+	CHECK(boot(load, 0, 0) == 0);
+	for (int i = 0; i < SETTINGS; i++)
+		CHECKF(seen->found[i] && same(&seen->s, &next, i), "%s: setting %d not stored", name, i);
+	check_note("%-11s cut at each of %u flash steps: all old after %u, old and new after %u, "
+	    "all new after %u", name, cuts, old, mixed, new);
+}
+
+/* in a child: a setting changing now and again, as a gateway might */
+static void
+wear(uint32_t n)
+{
+	unsigned long words = sim_flash_words(), erases = sim_flash_erases();
+
+	attach();
+	for (uint32_t i = 0; i < WEAR_UPDATES; i++) {
+		cur.a = n + i;
+		config_changed();
+		sim_run(SIM_MS(RUN));
+	}
+	seen->words = sim_flash_words() - words;
+	seen->erases = sim_flash_erases() - erases;
+	seen->s = cur;
+}
+
+/* in a child: five writes 100 ms apart */
+static void
+burst(uint32_t n)
+{
+	unsigned long words = sim_flash_words(), erases = sim_flash_erases();
+
+	attach();
+	for (uint32_t i = 0; i < 5; i++) {
+		make(&cur, n + i);
+		config_changed();
+		sim_run(SIM_MS(100));
+	}
+	sim_run(SIM_MS(RUN));
+	seen->words = sim_flash_words() - words;
+	seen->erases = sim_flash_erases() - erases;
+}
+
+/* in a child: an update whose first `fails' flash operations fail */
+static void
+failing(uint32_t n)
+{
+	sim_flash_fail(fails);
+	update(n);
+}
+
+void
+scenario(void)
+{
+	struct settings want;
+
+	vtimer_init(RTC_ID);
+	rtc_init(&rtc_ctx);
+	task_init();
+	seen = mmap(NULL, sizeof(*seen), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (!CHECK(seen != MAP_FAILED) || !CHECK(flash_page_size() <= PAGE_MAX))
+		return;
+
+	/* nothing stored, nothing found */
+	CHECK(boot(load, 0, 0) == 0);
+	CHECK(!seen->found[0] && !seen->found[1] && !seen->found[2]);
+
+	sweep("first store", 1);
+	CHECK(room() >= RECORD_WORDS);
+	sweep("append", 2);
+
+	/* updates until the next no longer fits */
+	for (uint32_t i = 0; room() >= RECORD_WORDS && i < 100; i++)
+		CHECK(boot(update, 3 + i, 0) == 0);
+	CHECK(room() < RECORD_WORDS);
+	sweep("page switch", 500);
+
+	/* failed operations are retried */
+	fails = 1;
+	CHECK(boot(failing, 600, 0) == 0);
+	CHECK(boot(load, 0, 0) == 0);
+	make(&want, 600);
+	CHECK(all(&seen->s, &want));
+	/* and when they keep failing the old values stand */
+	fails = 100;
+	CHECK(boot(failing, 700, 0) == 0);
+	CHECK(boot(load, 0, 0) == 0);
+	CHECK(all(&seen->s, &want));
+
+	/* a burst of writes is one update */
+	CHECK(boot(burst, 800, 0) == 0);
+	CHECKF(seen->erases <= 1 && seen->words <= RECORD_WORDS + SETTINGS + HEADER_WORDS,
+	    "a burst of 5 writes: %lu words, %lu erases", seen->words, seen->erases);
+	check_note("5 writes 100 ms apart: one update, %lu words and %lu erases", seen->words,
+	    seen->erases);
+	CHECK(boot(load, 0, 0) == 0);
+	make(&want, 804);
+	CHECK(all(&seen->s, &want));
+
+	/* one erase a page of appends */
+	CHECK(boot(wear, 900, 0) == 0);
+	unsigned long per_page = (flash_page_size() / sizeof(uint32_t) - HEADER_WORDS - RECORD_WORDS) / 2;
+	CHECKF(seen->erases <= WEAR_UPDATES / per_page + 1, "%u updates: %lu erases", WEAR_UPDATES,
+	    seen->erases);
+	check_note("%u updates of one setting: %lu erases, %.1f words written an update; a page "
+	    "takes %lu such updates", WEAR_UPDATES, seen->erases, (double)seen->words / WEAR_UPDATES,
+	    per_page);
+	uint32_t last = seen->s.a;
+	CHECK(boot(load, 0, 0) == 0);
+	CHECK(seen->s.a == last);
+}
@@ -0,0 +1,166 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "sim.h"
+#include "deadband.h"
+#include "vtimer.h"
+
+/*
+ * deadband: the absolute and relative bands, signed and multi channel
+ * samples and the heartbeat, then the notifications a dead band saves
+ * on a slowly drifting bridge-ADC trace, with every held sample within
+ * the band of what the gateway last got.
+ */
+
+#define RTC_ID		0
+#define PERIOD		1000	/* ms */
+#define HOURS		6
+
+static struct rtc_ctx rtc_ctx = {
+	.rtc_x[RTC_ID] = VTIMER_RTC_SLOT,
+};
+
+static struct deadband d;
+
+static void
+setup(uint8_t size, uint8_t width, bool is_signed, uint16_t absolute, uint16_t relative,
+    uint32_t heartbeat)
+{
+	deadband_init(&d, size, width, is_signed);
+	d.config.absolute = absolute;
+	d.config.relative = relative;
+	d.config.heartbeat = heartbeat;
+	deadband_reset(&d);
+}
+
+static bool
+pass16(uint16_t v)
+{
+	return deadband_pass(&d, &v);
+}
+
+/* 0..1, the same sequence every run */
+static double
+uniform(void)
+{
+	static uint32_t x = 2463534242u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x / 4294967296.0;
+}
+
+static double
+gauss(void)
+{
+	return sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+}
+
+/* a strain bridge warming up and settling, 12 bit counts with 2 counts of noise */
+static uint16_t
+bridge(double h)
+{
+	double v = 2000 + 600 * (1 - exp(-h / 1.5)) + 40 * sin(2 * M_PI * h / 4) + 2 * gauss();
+
+	return v < 0 ? 0 : v > 4095 ? 4095 : lround(v);
+}
+
+static void
+trace(uint16_t absolute, uint32_t heartbeat)
+{
+	unsigned n = HOURS * 3600 * 1000 / PERIOD, passed = 0, worst = 0;
+	uint32_t last = vtimer_now(), gap = 0;
+	uint16_t got = 0;
+
+	setup(2, 2, false, absolute, 0, heartbeat);
+	for (unsigned i = 0; i < n; i++) {
+		uint16_t v = bridge((double)i * PERIOD / 3600000);
+
+		sim_run(SIM_MS(PERIOD));
+		if (pass16(v)) {
+			if (vtimer_now() - last > gap)
+				gap = vtimer_now() - last;
+			last = vtimer_now();
+			got = v;
+			passed++;
+		} else if ((unsigned)abs(v - got) > worst) {
+			worst = abs(v - got);
+		}
+	}
+	CHECKF(worst <= absolute, "band %u: a held sample %u away", absolute, worst);
+	if (heartbeat != 0)
+		CHECKF(gap <= heartbeat + PERIOD + VTIMER_GUARD, "heartbeat %u: %u ms without a notification",
+		    heartbeat, gap);
+	check_note("band %2u counts, heartbeat %5u ms: %5u of %u samples notified (%.1f%%)",
+	    absolute, heartbeat, passed, n, 100.0 * passed / n);
+}
+
+void
+scenario(void)
+{
+	vtimer_init(RTC_ID);
+	rtc_init(&rtc_ctx);
+
+	/* off: everything passes */
+	setup(2, 2, false, 0, 0, 0);
+	CHECK(pass16(100) && pass16(100) && pass16(101));
+
+	/* absolute, measured from the value that passed last */
+	setup(2, 2, false, 10, 0, 0);
+	CHECK(pass16(100));
+	CHECK(!pass16(105) && !pass16(110) && !pass16(90));
+	CHECK(pass16(111));
+	CHECK(!pass16(105) && !pass16(120));
+	CHECK(pass16(100));
+
+	/* relative, per mille of the last value, the larger band wins */
+	setup(2, 2, false, 10, 50, 0);
+	CHECK(pass16(1000));
+	CHECK(!pass16(1050) && !pass16(950));
+	CHECK(pass16(1051));
+	CHECK(pass16(100));
+	CHECK(!pass16(110) && pass16(111));
+
+	/* signed bytes, a temperature below zero */
+	setup(1, 1, true, 2, 0, 0);
+	int8_t t = -10;
+	CHECK(deadband_pass(&d, &t));
+	t = -12;
+	CHECK(!deadband_pass(&d, &t));
+	t = -13;
+	CHECK(deadband_pass(&d, &t));
+	t = 1;
+	CHECK(deadband_pass(&d, &t));
+
+	/* one channel of four moving is enough */
+	setup(8, 2, false, 20, 0, 0);
+	uint16_t rgb[4] = {500, 400, 300, 200};
+	CHECK(deadband_pass(&d, rgb));
+	rgb[0] += 20;
+	rgb[1] -= 20;
+	CHECK(!deadband_pass(&d, rgb));
+	rgb[3] += 21;
+	CHECK(deadband_pass(&d, rgb));
+
+	/* the heartbeat lets a held value through, at the next sample */
+	setup(2, 2, false, 10, 0, 4500);
+	CHECK(pass16(100));
+	for (unsigned i = 1; i < 5; i++) {
+		sim_run(SIM_MS(1000));
+		CHECKF(!pass16(100), "passed after %u s", i);
+	}
+	sim_run(SIM_MS(1000));
+	CHECK(pass16(100));
+	CHECK(!pass16(100));
+
+	/* a reset, for a new subscriber, lets the next one through */
+	deadband_reset(&d);
+	CHECK(pass16(100));
+
+	trace(0, 0);
+	trace(4, 0);
+	trace(8, 0);
+	trace(8, 60000);
+	trace(16, 0);
+}
@@ -0,0 +1,240 @@
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "motion/fft.h"
+#include "motion/vibration.h"
+
+/*
+ * fft: the fixed point transform and Hann window against double
+ * precision, as SNR over all bins for full scale and quiet blocks, then
+ * the vibration report of a synthetic pump against the tones it was
+ * made of.  Time is host time; RAM is what the caller hands in, the
+ * transform itself keeps a few words on the stack.
+ */
+
+#define RATE		1000	/* Hz, the FIFO at rate_shift 0 */
+#define ACCEL_SCALE	8192	/* LSB per g, +-4 g */
+#define G		9806.65	/* mm/s^2 */
+#define MAX		(1 << FFT_MAX_LOG2)
+
+static int16_t re[MAX], im[MAX], block[MAX];
+static double ref_re[MAX], ref_im[MAX];
+
+/* 0..1, the same sequence every run */
+static double
+uniform(void)
+{
+	static uint32_t x = 2463534242u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x / 4294967296.0;
+}
+
+static double
+gauss(void)
+{
+	return sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+}
+
+static uint64_t
+host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* the transform fft() computes, 1 / n and all, of what re holds */
+static void
+dft(unsigned n)
+{
+	for (unsigned k = 0; k < n; k++) {
+		double sr = 0, si = 0;
+
+		for (unsigned i = 0; i < n; i++) {
+			double a = 2 * M_PI * ((uint64_t)i * k % n) / n;
+
+			sr += re[i] * cos(a);
+			si -= re[i] * sin(a);
+		}
+		ref_re[k] = sr / n;
+		ref_im[k] = si / n;
+	}
+}
+
+/* signal over error, dB, of fft() on the block in re */
+static double
+snr(uint8_t log2n)
+{
+	unsigned n = 1U << log2n;
+	double signal = 0, noise = 0;
+
+	dft(n);
+	memset(im, 0, sizeof(im));
+	fft(re, im, log2n);
+	for (unsigned k = 0; k < n; k++) {
+		signal += ref_re[k] * ref_re[k] + ref_im[k] * ref_im[k];
+		noise += (re[k] - ref_re[k]) * (re[k] - ref_re[k]) +
+		    (im[k] - ref_im[k]) * (im[k] - ref_im[k]);
+	}
+	return 10 * log10(signal / noise);
+}
+
+static void
+white(unsigned n, double amplitude)
+{
+	for (unsigned i = 0; i < n; i++)
+		re[i] = lround((2 * uniform() - 1) * amplitude);
+}
+
+/* a tone between bins */
+static void
+tone(unsigned n, double amplitude)
+{
+	for (unsigned i = 0; i < n; i++)
+		re[i] = lround(amplitude * sin(2 * M_PI * 37.3 * i / n));
+}
+
+static void
+accuracy(uint8_t log2n)
+{
+	unsigned n = 1U << log2n;
+	double full, sine, quiet;
+	uint64_t ns;
+
+	white(n, 16384);
+	full = snr(log2n);
+	tone(n, 16000);
+	sine = snr(log2n);
+	white(n, 256);
+	quiet = snr(log2n);
+
+	white(n, 16384);
+	memcpy(block, re, n * sizeof(re[0]));
+	ns = host_ns();
+	for (int i = 0; i < 1000; i++) {
+		memcpy(re, block, n * sizeof(re[0]));
+		memset(im, 0, n * sizeof(im[0]));
+		fft(re, im, log2n);
+	}
+	ns = host_ns() - ns;
+
+	/*
+	 * Scaled by 1 / n, full scale noise leaves 2^28 / 3n LSB^2 a bin;
+	 * the rounding of the stages should stay within 2 LSB^2 of that.
+	 */
+	double least = 10 * log10((1 << 28) / 3.0 / n / 2);
+	CHECKF(full > least, "%u points: %.1f dB on full scale noise", n, full);
+	CHECKF(sine > least, "%u points: %.1f dB on a full scale tone", n, sine);
+	check_note("%3u points: SNR %.1f dB full scale noise, %.1f dB tone, %.1f dB at 1/64 scale; "
+	    "%.0f ns a transform on the host, %zu bytes of buffers",
+	    n, full, sine, quiet, ns / 1000.0, 2 * n * sizeof(int16_t));
+}
+
+static void
+window(uint8_t log2n)
+{
+	unsigned n = 1U << log2n;
+	double worst = 0;
+
+	for (unsigned i = 0; i < n; i++)
+		re[i] = 16384;
+	fft_window(re, log2n);
+	for (unsigned i = 0; i < n; i++) {
+		double e = fabs(re[i] - 16384 * (0.5 - 0.5 * cos(2 * M_PI * i / n)));
+
+		if (e > worst)
+			worst = e;
+	}
+	CHECKF(worst <= 1, "%u point window: %.2f LSB off", n, worst);
+}
+
+static const struct {
+	double freq;	/* Hz */
+	double mg;	/* peak */
+} pump[] = {
+	/* running speed, twice it for misalignment, a vane pass */
+	{24.7, 200}, {49.4, 80}, {148.2, 30},
+};
+
+#define TONES	(sizeof(pump) / sizeof(pump[0]))
+
+static void
+spectrum(uint8_t log2n)
+{
+	unsigned n = 1U << log2n;
+	struct vibration_report r;
+	double velocity = 0, bin = (double)RATE / n, worst_freq = 0, worst_amp = 0;
+	uint64_t ns;
+
+	for (unsigned t = 0; t < TONES; t++) {
+		double v = pump[t].mg / 1000 * G / (2 * M_PI * pump[t].freq);	/* mm/s peak */
+
+		velocity += v * v / 2;
+	}
+	velocity = sqrt(velocity) * 1000;	/* um/s RMS */
+
+	for (unsigned i = 0; i < n; i++) {
+		double g = 1 + 0.002 * gauss();
+
+		for (unsigned t = 0; t < TONES; t++)
+			g += pump[t].mg / 1000 * sin(2 * M_PI * pump[t].freq * i / RATE + t);
+		re[i] = lround(g * ACCEL_SCALE);
+	}
+	ns = host_ns();
+	vibration_analyse(re, im, log2n, RATE, ACCEL_SCALE, &r);
+	ns = host_ns() - ns;
+
+	CHECK(r.rate == RATE && r.points == n);
+	for (unsigned t = 0; t < TONES; t++) {
+		double f = r.peak[t].freq / 10.0, a = r.peak[t].amplitude;
+
+		if (fabs(f - pump[t].freq) > worst_freq)
+			worst_freq = fabs(f - pump[t].freq);
+		if (fabs(a / pump[t].mg - 1) > worst_amp)
+			worst_amp = fabs(a / pump[t].mg - 1);
+		/* strongest first; the tallest bin, so Hann scalloping takes up to 15% */
+		CHECKF(fabs(f - pump[t].freq) < bin / 4, "%u points, peak %u: %.1f Hz for %.1f Hz",
+		    n, t, f, pump[t].freq);
+		CHECKF(a <= pump[t].mg * 1.02 && a >= pump[t].mg * 0.84,
+		    "%u points, peak %u: %.0f mg for %.0f mg", n, t, a, pump[t].mg);
+	}
+	CHECKF(fabs(r.velocity / velocity - 1) < 0.1, "%u points: %u um/s for %.0f um/s", n,
+	    r.velocity, velocity);
+	check_note("%3u points: peaks within %.2f Hz (%.2f bin) and %.0f%%, velocity %u um/s "
+	    "for %.0f um/s; %.0f ns an analysis on the host", n, worst_freq, worst_freq / bin,
+	    100 * worst_amp, r.velocity, velocity, (double)ns);
+}
+
+void
+scenario(void)
+{
+	/* an impulse is flat at 1 / n, a constant all in bin 0 */
+	memset(re, 0, sizeof(re));
+	memset(im, 0, sizeof(im));
+	re[0] = 16384;
+	fft(re, im, 8);
+	for (unsigned k = 0; k < 256; k++)
+		if (!CHECKF(re[k] == 64 && im[k] == 0, "impulse, bin %u: %d%+dj", k, re[k], im[k]))
+			break;
+	for (unsigned i = 0; i < 256; i++)
+		re[i] = 16384;
+	memset(im, 0, sizeof(im));
+	fft(re, im, 8);
+	CHECK(re[0] == 16384);
+	for (unsigned k = 1; k < 256; k++)
+		if (!CHECKF(re[k] == 0 && im[k] == 0, "constant, bin %u: %d%+dj", k, re[k], im[k]))
+			break;
+
+	for (uint8_t log2n = 6; log2n <= FFT_MAX_LOG2; log2n++) {
+		window(log2n);
+		accuracy(log2n);
+	}
+	spectrum(8);
+	spectrum(9);
+}
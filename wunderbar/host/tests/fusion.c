@@ -0,0 +1,301 @@
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sim.h"
+#include "motion/fusion.h"
+
+/*
+ * fusion: the fixed point Mahony filter against the same filter in
+ * double precision and against the true orientation, on synthetic
+ * 100 Hz IMU traces with gyro bias and noise, quantised as the chip
+ * does at +-4 g and +-500 dps.  Tilt is held by gravity; heading has
+ * nothing to hold it but a well trimmed bias, so it may drift a few
+ * degrees over the run.  The time per update is host time, the M0
+ * takes far longer.
+ */
+
+#define MINUTES		10
+#define UPDATES		(MINUTES * 60 * 1000 / FUSION_PERIOD)
+#define ACCEL_SCALE	8192	/* LSB per g, +-4 g */
+#define GYRO_SCALE	655	/* LSB per dps times 10, +-500 dps */
+#define DEG		(M_PI / 180)
+
+struct quat {
+	double w, x, y, z;
+};
+
+/* the filter of fusion.c in double precision */
+struct reference {
+	struct quat q;
+	double bias[3];
+	double rest[3];
+	unsigned still;
+};
+
+struct motion {
+	const char *name;
+	struct quat start;
+	void (*rate)(double s, double w[3]);	/* rad/s in the body frame */
+	double linear;	/* g of linear acceleration, noise-like */
+	double tilt;	/* deg the estimate may be off in tilt once settled */
+	double late;	/* and in the last minute, with the bias trimmed */
+	double drift;	/* deg heading may drift over the run */
+};
+
+static const double bias[3] = {0.5 * DEG, -0.3 * DEG, 0.8 * DEG};
+
+/* 0..1, the same sequence every run */
+static double
+uniform(void)
+{
+	static uint32_t x = 2463534242u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x / 4294967296.0;
+}
+
+static double
+gauss(void)
+{
+	return sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+}
+
+static uint64_t
+host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct quat
+mul(struct quat a, struct quat b)
+{
+	return (struct quat){
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+	};
+}
+
+static struct quat
+normalise(struct quat q)
+{
+	double n = sqrt(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+
+	return (struct quat){q.w / n, q.x / n, q.y / n, q.z / n};
+}
+
+/* earth up in the body frame */
+static void
+up(struct quat q, double v[3])
+{
+	v[0] = 2 * (q.x * q.z - q.w * q.y);
+	v[1] = 2 * (q.w * q.x + q.y * q.z);
+	v[2] = q.w * q.w - q.x * q.x - q.y * q.y + q.z * q.z;
+}
+
+/* rotates by w over dt exactly */
+static struct quat
+turn(struct quat q, const double w[3], double dt)
+{
+	double n = sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+	double s = n == 0 ? 0 : sin(n * dt / 2) / n;
+
+	return normalise(mul(q, (struct quat){cos(n * dt / 2), w[0] * s, w[1] * s, w[2] * s}));
+}
+
+static double
+tilt(struct quat a, struct quat b)
+{
+	double u[3], v[3], d;
+
+	up(a, u);
+	up(b, v);
+	d = u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+	return acos(d > 1 ? 1 : d) / DEG;
+}
+
+/* the estimate's error about earth up, deg */
+static double
+heading(struct quat est, struct quat truth)
+{
+	struct quat e = mul(est, (struct quat){truth.w, -truth.x, -truth.y, -truth.z});
+
+	return 2 * atan2(e.z, e.w) / DEG;
+}
+
+static void
+reference_update(struct reference *r, const struct mpu6500_data *d, double dt)
+{
+	double a[3] = {(int16_t)d->accel_x, (int16_t)d->accel_y, (int16_t)d->accel_z};
+	double g[3] = {(int16_t)d->gyro_x, (int16_t)d->gyro_y, (int16_t)d->gyro_z};
+	double n = sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+	double w[3], v[3], e[3];
+
+	bool steady = true;
+
+	for (int i = 0; i < 3; i++) {
+		w[i] = g[i] * 10 / GYRO_SCALE * DEG;
+		r->rest[i] += (w[i] - r->rest[i]) / 32;
+		if (fabs(w[i] - r->rest[i]) > 1 * DEG || fabs(r->rest[i]) > 5 * DEG)
+			steady = false;
+	}
+	if (!steady)
+		r->still = 0;
+	else if (r->still < FUSION_STILL)
+		r->still++;
+	else
+		for (int i = 0; i < 3; i++)
+			r->bias[i] = -r->rest[i];
+	if (n != 0) {
+		for (int i = 0; i < 3; i++)
+			a[i] /= n;
+		up(r->q, v);
+		e[0] = a[1] * v[2] - a[2] * v[1];
+		e[1] = a[2] * v[0] - a[0] * v[2];
+		e[2] = a[0] * v[1] - a[1] * v[0];
+		for (int i = 0; i < 3; i++) {
+			r->bias[i] += e[i] * FUSION_KI / 65536.0 * dt;
+			w[i] += e[i] * FUSION_KP / 256.0 + r->bias[i];
+		}
+	}
+	r->q = normalise(mul(r->q, (struct quat){1, w[0] * dt / 2, w[1] * dt / 2, w[2] * dt / 2}));
+}
+
+static uint16_t
+lsb(double v)
+{
+	v = round(v);
+	return (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+}
+
+static void
+still(double s, double w[3])
+{
+	w[0] = w[1] = w[2] = 0;
+}
+
+/* a hand turning the board about every axis, up to about 100 dps */
+static void
+handheld(double s, double w[3])
+{
+	w[0] = 60 * DEG * sin(2 * M_PI * s / 7.3) + 20 * DEG * sin(2 * M_PI * s / 1.9);
+	w[1] = 45 * DEG * sin(2 * M_PI * s / 5.1 + 1) + 15 * DEG * sin(2 * M_PI * s / 2.3);
+	w[2] = 70 * DEG * sin(2 * M_PI * s / 11.7 + 2);
+}
+
+static const struct motion motions[] = {
+	/* 1 dps of bias over a gain of 1 is a degree until the integral takes it */
+	{"flat", {1, 0, 0, 0}, still, 0, 1.5, 0.2, 5},
+	/* 40 deg over, the estimate starts flat */
+	{"tilted", {0.9397, 0.3420, 0, 0}, still, 0, 1.5, 0.2, 5},
+	/* never at rest, gravity in ever changing directions trims the bias */
+	{"handheld", {1, 0, 0, 0}, handheld, 0.05, 3, 2, 10},
+};
+
+static void
+run(const struct motion *m)
+{
+	struct quat truth = normalise(m->start), est;
+	struct reference r = {{1, 0, 0, 0}};
+	struct fusion f;
+	struct mpu6500_data d;
+	double dt = FUSION_PERIOD / 1000.0, fixed = 0, worst = 0, ref_worst = 0;
+	double settled = -1, drift = 0, last = 0, apart = 0, late = 0;
+	uint64_t ns = 0;
+
+	fusion_reset(&f);
+	for (unsigned i = 0; i < UPDATES; i++) {
+		double w[3], v[3], s = i * dt;
+		uint64_t t0;
+
+		m->rate(s, w);
+		truth = turn(truth, w, dt);
+		up(truth, v);
+		d.accel_x = lsb((v[0] + m->linear * gauss() + 0.004 * gauss()) * ACCEL_SCALE);
+		d.accel_y = lsb((v[1] + m->linear * gauss() + 0.004 * gauss()) * ACCEL_SCALE);
+		d.accel_z = lsb((v[2] + m->linear * gauss() + 0.004 * gauss()) * ACCEL_SCALE);
+		d.gyro_x = lsb((w[0] + bias[0] + 0.05 * DEG * gauss()) / DEG * GYRO_SCALE / 10);
+		d.gyro_y = lsb((w[1] + bias[1] + 0.05 * DEG * gauss()) / DEG * GYRO_SCALE / 10);
+		d.gyro_z = lsb((w[2] + bias[2] + 0.05 * DEG * gauss()) / DEG * GYRO_SCALE / 10);
+
+		t0 = host_ns();
+		fusion_update(&f, &d, GYRO_SCALE, FUSION_PERIOD);
+		ns += host_ns() - t0;
+		reference_update(&r, &d, dt);
+
+		est = (struct quat){f.q[0] / 1073741824.0, f.q[1] / 1073741824.0,
+			f.q[2] / 1073741824.0, f.q[3] / 1073741824.0};
+		if (tilt(est, r.q) > fixed)
+			fixed = tilt(est, r.q);
+		if (fabs(heading(est, r.q)) > apart)
+			apart = fabs(heading(est, r.q));
+		/* unwrapped, heading runs away for good when flat */
+		drift += remainder(heading(est, truth) - last, 360);
+		last = heading(est, truth);
+		if (settled < 0 && tilt(est, truth) < 1)
+			settled = s;
+		if (settled >= 0 && s - settled > 10) {
+			if (tilt(est, truth) > worst)
+				worst = tilt(est, truth);
+			if (tilt(r.q, truth) > ref_worst)
+				ref_worst = tilt(r.q, truth);
+		}
+		if (i >= UPDATES - 60000 / FUSION_PERIOD && tilt(est, truth) > late)
+			late = tilt(est, truth);
+	}
+
+	CHECKF(settled >= 0 && settled < 10, "%s: tilt within 1 deg after %.2f s", m->name, settled);
+	CHECKF(fixed < 0.1, "%s: tilt %.3f deg from the double filter", m->name, fixed);
+	CHECKF(apart < 2, "%s: heading %.3f deg from the double filter", m->name, apart);
+	CHECKF(worst < m->tilt, "%s: tilt off by %.2f deg", m->name, worst);
+	CHECKF(late < m->late, "%s: tilt off by %.2f deg in the last minute", m->name, late);
+	CHECKF(fabs(drift) < m->drift, "%s: heading off %+.1f deg after %u min",
+	    m->name, drift, MINUTES);
+	check_note("%-8s tilt within 1 deg after %.2f s, then within %.2f deg (double %.2f), "
+	    "%.2f deg in the last minute", m->name, settled, worst, ref_worst, late);
+	check_note("%-8s tilt within %.3f deg and heading within %.3f deg of the double filter; "
+	    "heading off %+.1f deg after %u min", m->name, fixed, apart, drift, MINUTES);
+	check_note("%-8s %.0f ns an update on the host", m->name, (double)ns / UPDATES);
+}
+
+void
+scenario(void)
+{
+	struct fusion f;
+	struct mpu6500_data d = {0, 0, ACCEL_SCALE, 0, 0, 0};
+	int16_t q[4];
+
+	/* flat and still stays put */
+	fusion_reset(&f);
+	for (int i = 0; i < 100; i++)
+		fusion_update(&f, &d, GYRO_SCALE, FUSION_PERIOD);
+	fusion_quaternion(&f, q);
+	CHECKF(q[0] == 16384 && q[1] == 0 && q[2] == 0 && q[3] == 0, "%d %d %d %d",
+	    q[0], q[1], q[2], q[3]);
+
+	/* 90 dps about z for a second, with nothing to correct heading */
+	fusion_reset(&f);
+	d.gyro_z = lsb(90.0 * GYRO_SCALE / 10);
+	for (int i = 0; i < 1000 / FUSION_PERIOD; i++)
+		fusion_update(&f, &d, GYRO_SCALE, FUSION_PERIOD);
+	fusion_quaternion(&f, q);
+	CHECKF(abs(q[0] - 11585) < 40 && abs(q[3] - 11585) < 40 && q[1] == 0 && q[2] == 0,
+	    "%d %d %d %d after 90 deg", q[0], q[1], q[2], q[3]);
+
+	/* a gap is taken as FUSION_MAX_DT */
+	fusion_reset(&f);
+	fusion_update(&f, &d, GYRO_SCALE, 1000);
+	fusion_quaternion(&f, q);
+	CHECKF(fabs(2 * atan2(q[3], q[0]) / DEG - 90.0 * FUSION_MAX_DT / 1000) < 0.2,
+	    "%.2f deg over a 1 s gap", 2 * atan2(q[3], q[0]) / DEG);
+
+	for (unsigned i = 0; i < sizeof(motions) / sizeof(motions[0]); i++)
+		run(&motions[i]);
+}
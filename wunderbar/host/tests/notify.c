@@ -0,0 +1,160 @@
+#include <string.h>
+
+#include "sim.h"
+#include "notify.h"
+#include "wunderbar_uuid.h"
+
+/*
+ * notify: values queued from any context go out from simble's event loop,
+ * in order as the connection events free the softdevice's TX buffers,
+ * asking the softdevice again only after BLE_EVT_TX_COMPLETE; a full
+ * queue drops its oldest values, a NOTIFY_NEWEST queue keeps the last
+ * one, and a disconnect leaves nothing stuck behind buffers the link
+ * took along.
+ */
+
+#define DEPTH		16
+
+static struct {
+	struct service_desc;
+	struct char_desc burst_char;
+	struct char_desc latest_char;
+	struct notify_queue burst;
+	struct notify_queue latest;
+	uint8_t burst_tx[NOTIFY_SLOTS(DEPTH, sizeof(uint32_t))];
+	uint8_t latest_tx[NOTIFY_SLOTS(1, sizeof(uint32_t))];
+} srv;
+
+struct send {
+	struct notify_queue *q;
+	uint32_t first;
+	unsigned count;
+};
+
+static void
+send_op(void *arg)
+{
+	struct send *s = arg;
+
+	for (uint32_t v = s->first; v < s->first + s->count; v++)
+		notify_send(s->q, &v, sizeof(v));
+}
+
+static void
+send(struct notify_queue *q, uint32_t first, unsigned count)
+{
+	struct send s = {q, first, count};
+
+	sim_thread(send_op, &s);
+}
+
+static uint32_t
+value(struct char_desc *c, unsigned n)
+{
+	const struct sim_notification *p = sim_notification(c, n);
+	uint32_t v = UINT32_MAX;
+
+	if (p != NULL)
+		memcpy(&v, p->data, sizeof(v));
+	return v;
+}
+
+static struct notify_stats
+stats(void)
+{
+	struct notify_stats st;
+
+	sim_read(sim_char("burst", "tx stats"), &st, sizeof(st));
+	return st;
+}
+
+void
+scenario(void)
+{
+	simble_init("notify");
+	simble_srv_init(&srv, simble_get_vendor_uuid_class(), VENDOR_UUID_SENSOR_SERVICE);
+	simble_srv_char_add(&srv, &srv.burst_char, simble_get_vendor_uuid_class(),
+		VENDOR_UUID_RAW_CHAR, u8"burst", sizeof(uint32_t));
+	srv.burst_char.notify = 1;
+	notify_init(&srv.burst, &srv.burst_char, srv.burst_tx, DEPTH, sizeof(uint32_t), NOTIFY_ALL);
+	notify_char_add(&srv, &srv.burst);
+	simble_srv_char_add(&srv, &srv.latest_char, simble_get_vendor_uuid_class(),
+		VENDOR_UUID_RAW_CHAR, u8"latest", sizeof(uint32_t));
+	srv.latest_char.notify = 1;
+	notify_init(&srv.latest, &srv.latest_char, srv.latest_tx, DEPTH, sizeof(uint32_t),
+		NOTIFY_NEWEST);
+	simble_srv_register(&srv);
+	simble_adv_start();
+	sim_connect();
+
+	struct char_desc *burst = sim_char("burst", "burst");
+	struct char_desc *latest = sim_char("burst", "latest");
+	struct notify_stats st;
+	unsigned long refused;
+	unsigned n;
+
+	sim_subscribe(burst);
+	sim_subscribe(latest);
+
+	/* a queue's worth at once: the buffers take seven, one call finds them full */
+	send(&srv.burst, 0, DEPTH);
+	CHECKF(sim_notifications(burst) == SIM_TX_BUFFERS, "%u handed over at once",
+	    sim_notifications(burst));
+	CHECKF(notify_queued(&srv.burst) == DEPTH - SIM_TX_BUFFERS, "%u queued",
+	    notify_queued(&srv.burst));
+	CHECKF(sim_tx_refused() == 1, "%lu refusals", sim_tx_refused());
+
+	/* out in order as connection events free the buffers */
+	sim_run(5 * sim_conn_interval());
+	CHECKF(sim_notifications(burst) == DEPTH, "%u of %u sent", sim_notifications(burst),
+	    DEPTH);
+	for (unsigned i = 0; i < DEPTH; i++)
+		CHECKF(value(burst, i) == i, "notification %u: %u", i, value(burst, i));
+	CHECK(notify_queued(&srv.burst) == 0);
+	/* once per connection event that left some waiting, not per radio event */
+	CHECKF(sim_tx_refused() <= 3, "%lu refusals", sim_tx_refused());
+	st = stats();
+	CHECKF(st.dropped == 0 && st.high_water == DEPTH && st.depth == DEPTH,
+	    "dropped %u, high water %u, depth %u", st.dropped, st.high_water, st.depth);
+	CHECKF(st.retries == sim_tx_refused(), "%u retries, %lu refusals", st.retries,
+	    sim_tx_refused());
+
+	/* idle, nothing asks the softdevice */
+	refused = sim_tx_refused();
+	sim_run(SIM_S(1));
+	CHECK(sim_tx_refused() == refused && sim_notifications(burst) == DEPTH);
+
+	/* beyond the queue the oldest values go before the event loop sends any */
+	n = sim_notifications(burst);
+	send(&srv.burst, 100, DEPTH + 4);
+	sim_run(10 * sim_conn_interval());
+	CHECKF(sim_notifications(burst) == n + DEPTH, "%u sent", sim_notifications(burst) - n);
+	for (unsigned i = 0; i < DEPTH; i++)
+		CHECKF(value(burst, n + i) == 104 + i, "notification %u: %u", n + i,
+		    value(burst, n + i));
+	st = stats();
+	CHECKF(st.dropped == 4 && st.high_water == DEPTH, "dropped %u, high water %u",
+	    st.dropped, st.high_water);
+
+	/* behind full buffers, only the newest of "latest" waits */
+	n = sim_notifications(latest);
+	send(&srv.burst, 200, SIM_TX_BUFFERS);
+	send(&srv.latest, 300, 5);
+	sim_run(2 * sim_conn_interval());
+	CHECKF(sim_notifications(latest) == n + 1 && value(latest, n) == 304,
+	    "%u sent, the last %u", sim_notifications(latest) - n, value(latest, n));
+
+	/* buffers full as the link drops: the next connection starts afresh */
+	send(&srv.burst, 400, SIM_TX_BUFFERS + 1);
+	sim_disconnect();
+	notify_reset(&srv.burst);
+	sim_run(SIM_MS(100));
+	sim_connect();
+	sim_subscribe(burst);
+	n = sim_notifications(burst);
+	send(&srv.burst, 500, 1);
+	CHECKF(sim_notifications(burst) == n + 1 && value(burst, n) == 500,
+	    "%u sent after reconnecting", sim_notifications(burst) - n);
+	sim_disconnect();
+	CHECK(sim_gap_errors() == 0);
+}
@@ -0,0 +1,175 @@
+#include <math.h>
+#include <time.h>
+
+#include "sim.h"
+#include "motion/pedometer.h"
+
+/*
+ * pedometer: a labelled synthetic day in a pocket, sampled as the
+ * motion module does, against the steps and activity it was made of.
+ * Walking and running put a step harmonic and its second on the
+ * vertical with cadence and swing jitter and sway; still has bumps,
+ * shaking is a phone shaken at 6 Hz and neither may count, bar the
+ * first shake straight after a walk.  Time is host time.
+ */
+
+#define ACCEL_SCALE	8192	/* LSB per g, +-4 g */
+#define MS		PEDOMETER_PERIOD
+/* the activity of a segment is judged after two windows of it */
+#define SETTLE		(2 * PEDOMETER_WINDOW)
+
+#define SHAKING		3	/* a label of its own, still to the pedometer */
+
+struct segment {
+	uint8_t label;
+	uint32_t seconds;
+	double cadence;	/* steps/s */
+	double swing;	/* g, vertical peak */
+};
+
+static const struct segment day[] = {
+	{ACTIVITY_STILL, 60},
+	{ACTIVITY_WALKING, 120, 1.8, 0.25},
+	{ACTIVITY_STILL, 20},
+	{ACTIVITY_RUNNING, 90, 2.8, 0.9},
+	{ACTIVITY_WALKING, 60, 1.5, 0.15},
+	{SHAKING, 10, 6, 1},
+	{ACTIVITY_STILL, 30},
+	{ACTIVITY_RUNNING, 60, 2.6, 0.7},
+	{ACTIVITY_WALKING, 180, 2.0, 0.3},
+	{ACTIVITY_STILL, 60},
+	/* shuffling along, close to the threshold */
+	{ACTIVITY_WALKING, 120, 1.2, 0.12},
+	{ACTIVITY_STILL, 30},
+};
+
+#define SEGMENTS	(sizeof(day) / sizeof(day[0]))
+
+static const char *const names[] = {"still", "walking", "running", "shaking"};
+
+/* 0..1, the same sequence every run */
+static double
+uniform(void)
+{
+	static uint32_t x = 2463534242u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x / 4294967296.0;
+}
+
+static double
+gauss(void)
+{
+	return sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+}
+
+static uint64_t
+host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int16_t
+lsb(double g)
+{
+	g = round(g * ACCEL_SCALE);
+	return g > 32767 ? 32767 : g < -32768 ? -32768 : g;
+}
+
+void
+scenario(void)
+{
+	struct pedometer p;
+	uint32_t now = 0, counted[SEGMENTS] = {0}, made[SEGMENTS] = {0};
+	uint32_t judged = 0, right = 0, confused[4][3] = {{0}};
+	uint32_t total = 0, steps = 0, samples = 0;
+	uint64_t ns = 0;
+	double phase = 0;
+
+	pedometer_reset(&p, now);
+	for (unsigned s = 0; s < SEGMENTS; s++) {
+		const struct segment *seg = &day[s];
+		uint32_t start = now, before = p.steps;
+		double period = seg->cadence != 0 ? 1 / seg->cadence : 0, step = period, swing = seg->swing;
+		/* the phone sits differently in the pocket each time */
+		double tilt = 0.5 * uniform(), turn = 2 * M_PI * uniform();
+		double up[3] = {sin(tilt) * cos(turn), sin(tilt) * sin(turn), cos(tilt)};
+		double side[3] = {cos(turn), -sin(turn), 0};
+
+		while (now - start < seg->seconds * 1000) {
+			double v = 0, l = 0, a[3];
+			int16_t accel[3];
+			uint64_t t0;
+
+			if (seg->label == SHAKING) {
+				v = seg->swing * sin(2 * M_PI * seg->cadence * (now - start) / 1000.0);
+			} else if (seg->cadence != 0) {
+				/* each step a little longer or shorter than the last */
+				phase += MS / 1000.0 / step;
+				if (phase >= 1) {
+					phase -= 1;
+					step = period * (1 + 0.05 * gauss());
+					swing = seg->swing * (1 + 0.15 * gauss());
+					made[s]++;
+				}
+				v = swing * (sin(2 * M_PI * phase) + 0.3 * sin(4 * M_PI * phase + 1));
+				l = 0.1 * swing * sin(M_PI * phase + M_PI * (made[s] & 1));
+			} else if ((now - start) % 17000 == 5000) {
+				/* set down, picked up */
+				v = 0.6;
+			}
+			for (int i = 0; i < 3; i++) {
+				a[i] = (1 + v) * up[i] + l * side[i] + 0.05 * gauss();
+				accel[i] = lsb(a[i]);
+			}
+
+			t0 = host_ns();
+			pedometer_add(&p, accel, ACCEL_SCALE, now);
+			ns += host_ns() - t0;
+			samples++;
+			now += MS;
+
+			if (now - start >= SETTLE) {
+				uint8_t want = seg->label == SHAKING ? ACTIVITY_STILL : seg->label;
+
+				judged++;
+				right += p.activity == want;
+				confused[seg->label][p.activity]++;
+			}
+		}
+		counted[s] = p.steps - before;
+		total += made[s];
+		steps += counted[s];
+	}
+
+	for (unsigned s = 0; s < SEGMENTS; s++) {
+		if (day[s].cadence == 0)
+			CHECKF(counted[s] == 0, "%s for %u s: %u steps", names[day[s].label],
+			    day[s].seconds, counted[s]);
+		else if (day[s].label == SHAKING)
+			/* straight after a walk, the first swing still passes for a step */
+			CHECKF(counted[s] <= (s > 0 && day[s - 1].cadence != 0),
+			    "shaking for %u s: %u steps", day[s].seconds, counted[s]);
+		else
+			CHECKF(fabs((double)counted[s] - made[s]) <= 0.05 * made[s] + PEDOMETER_CONFIRM,
+			    "%s at %.1f steps/s: %u steps of %u", names[day[s].label], day[s].cadence,
+			    counted[s], made[s]);
+		check_note("%-7s %3u s at %.1f steps/s: %4u steps counted of %4u", names[day[s].label],
+		    day[s].seconds, day[s].cadence, counted[s], made[s]);
+	}
+	CHECKF(fabs((double)steps - total) <= 0.03 * total, "%u steps of %u", steps, total);
+	CHECKF(right >= 0.9 * judged, "activity right %.1f%% of the time", 100.0 * right / judged);
+	check_note("%u steps counted of %u (%+.1f%%); activity right %.1f%% of the time once "
+	    "settled", steps, total, 100.0 * ((double)steps - total) / total, 100.0 * right / judged);
+	for (unsigned l = 0; l < 4; l++)
+		check_note("%-7s taken for still %4.1f%%, walking %4.1f%%, running %4.1f%%", names[l],
+		    100.0 * confused[l][0] / (confused[l][0] + confused[l][1] + confused[l][2]),
+		    100.0 * confused[l][1] / (confused[l][0] + confused[l][1] + confused[l][2]),
+		    100.0 * confused[l][2] / (confused[l][0] + confused[l][1] + confused[l][2]));
+	check_note("%.0f ns a sample on the host", (double)ns / samples);
+}
@@ -0,0 +1,181 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "predict.h"
+#include "vtimer.h"
+#include "wunderbar_uuid.h"
+
+/*
+ * predict: the models a subscribed gateway gets for synthetic 1 Hz
+ * traces.  Evaluating them as predict.h tells, the gateway has every
+ * sample within the bound; the ratio of samples to models is what dual
+ * prediction saves over notifying every sample.
+ */
+
+#define RTC_ID		0
+#define PERIOD		1000	/* ms */
+#define HOURS		6
+#define SAMPLES		(HOURS * 3600 * 1000 / PERIOD)
+
+static struct rtc_ctx rtc_ctx = {
+	.rtc_x[RTC_ID] = VTIMER_RTC_SLOT,
+};
+
+static struct {
+	struct service_desc;
+	struct predict predict;
+} srv;
+
+static struct {
+	uint32_t time;
+	int32_t value;
+} samples[SAMPLES];
+
+/* 0..1, the same sequence every run */
+static double
+uniform(void)
+{
+	static uint32_t x = 2463534242u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x / 4294967296.0;
+}
+
+static double
+gauss(void)
+{
+	return sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+}
+
+/* a strain bridge warming up and settling, 12 bit counts with 2 counts of noise */
+static int32_t
+bridge(double h)
+{
+	double v = 2000 + 600 * (1 - exp(-h / 1.5)) + 40 * sin(2 * M_PI * h / 4) + 2 * gauss();
+
+	return v < 0 ? 0 : v > 4095 ? 4095 : lround(v);
+}
+
+/* a room through the morning, whole degrees as temp_rh reports them */
+static int32_t
+room(double h)
+{
+	return lround(18 + 6 * (1 - cos(M_PI * h / HOURS)) / 2 + 0.2 * gauss());
+}
+
+static int32_t
+model_at(const struct predict_model *m, uint32_t t)
+{
+	return m->value + (int64_t)m->slope * (int32_t)(t - m->time) / PREDICT_ONE;
+}
+
+static void
+trace(const char *name, int32_t (*fn)(double h), uint16_t bound)
+{
+	struct char_desc *model = sim_char("prediction", "prediction");
+	struct char_desc *bound_char = sim_char("prediction", "prediction bound");
+	unsigned first, models = 0, worst = 0;
+	struct predict_model m;
+
+	sim_write(bound_char, &bound, sizeof(bound));
+	sim_subscribe(model);
+	first = sim_notifications(model);
+	for (unsigned i = 0; i < SAMPLES; i++) {
+		sim_run(SIM_MS(PERIOD));
+		samples[i].value = fn((double)i * PERIOD / 3600000);
+		samples[i].time = vtimer_now();
+		predict_add(&srv.predict, samples[i].value);
+	}
+	sim_run(SIM_MS(100));
+	sim_unsubscribe(model);
+
+	/* the gateway's view: each sample against the last model sent by then */
+	const struct sim_notification *n = sim_notification(model, first);
+	if (!CHECKF(n != NULL, "%s: no model", name))
+		return;
+	memcpy(&m, n->data, sizeof(m));
+	models = 1;
+	for (unsigned i = 0; i < SAMPLES; i++) {
+		while ((n = sim_notification(model, first + models)) != NULL) {
+			struct predict_model next;
+
+			memcpy(&next, n->data, sizeof(next));
+			if (next.time > samples[i].time)
+				break;
+			m = next;
+			models++;
+		}
+		unsigned error = abs(samples[i].value - model_at(&m, samples[i].time));
+		if (error > worst)
+			worst = error;
+	}
+	CHECKF(sim_notifications(model) - first == models, "%s: %u models sent, %u used",
+	    name, sim_notifications(model) - first, models);
+	CHECKF(worst <= bound, "%s, bound %u: a sample %u away from the model", name, bound, worst);
+	check_note("%-7s bound %2u: %5u models for %u samples, %5.1f times fewer", name,
+	    bound, models, SAMPLES, (double)SAMPLES / models);
+}
+
+void
+scenario(void)
+{
+	struct predict_model m;
+
+	vtimer_init(RTC_ID);
+	rtc_init(&rtc_ctx);
+	simble_init("predict");
+	simble_srv_init(&srv, simble_get_vendor_uuid_class(), VENDOR_UUID_SENSOR_SERVICE);
+	predict_init(&srv.predict, NULL);
+	predict_char_add(&srv, &srv.predict);
+	simble_srv_register(&srv);
+	simble_adv_start();
+	sim_connect();
+
+	struct char_desc *model = sim_char("prediction", "prediction");
+	uint16_t bound = 2;
+
+	/* off until a bound is set and a client listens */
+	CHECK(!predict_enabled(&srv.predict));
+	sim_subscribe(model);
+	CHECK(!predict_enabled(&srv.predict));
+	sim_write(sim_char("prediction", "prediction bound"), &bound, sizeof(bound));
+	CHECK(predict_enabled(&srv.predict));
+
+	/* the first sample goes out flat, a ramp within the bound is quiet */
+	predict_add(&srv.predict, 100);
+	sim_run(SIM_MS(100));
+	if (CHECK(sim_notifications(model) == 1)) {
+		memcpy(&m, sim_notification(model, 0)->data, sizeof(m));
+		CHECK(m.value == 100 && m.slope == 0);
+	}
+	sim_run(SIM_MS(900));
+	predict_add(&srv.predict, 102);
+	sim_run(SIM_MS(1000));
+	CHECK(sim_notifications(model) == 1);
+	/* then the slope is refit through the old anchor: 1.5 units a second */
+	predict_add(&srv.predict, 103);
+	sim_run(SIM_MS(1000));
+	if (CHECK(sim_notifications(model) == 2)) {
+		memcpy(&m, sim_notification(model, 1)->data, sizeof(m));
+		CHECKF(m.value == 103 && abs(m.slope - 3 * 65536 / 2) < 65536 / 20,
+		    "model %d, slope %.3f a second", m.value, m.slope / 65536.0);
+	}
+	/* and followed without a word */
+	for (int i = 1; i <= 10; i++) {
+		predict_add(&srv.predict, 103 + 3 * i / 2);
+		sim_run(SIM_MS(1000));
+	}
+	CHECK(sim_notifications(model) == 2);
+	sim_unsubscribe(model);
+	CHECK(!predict_enabled(&srv.predict));
+
+	trace("bridge", bridge, 4);
+	trace("bridge", bridge, 8);
+	trace("bridge", bridge, 16);
+	trace("room", room, 1);
+	trace("room", room, 2);
+}
@@ -0,0 +1,192 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "stats.h"
+#include "vtimer.h"
+#include "wunderbar_uuid.h"
+
+/*
+ * stats: the windows a subscribed gateway gets, at the window period,
+ * against a two pass double computation over the same samples, for
+ * small, negative and large offset signals; the window bounds and a
+ * saturated count.
+ */
+
+#define RTC_ID		0
+#define PERIOD		100	/* ms between samples */
+#define WINDOW		10000	/* ms */
+#define WINDOWS		30
+#define SAMPLES		(WINDOWS * WINDOW / PERIOD)
+#define ONE		(1 << STATS_FRAC)
+
+static struct rtc_ctx rtc_ctx = {
+	.rtc_x[RTC_ID] = VTIMER_RTC_SLOT,
+};
+
+static struct {
+	struct service_desc;
+	struct stats stats;
+} srv;
+
+static struct {
+	sim_time_t at;
+	int32_t value;
+} samples[SAMPLES];
+
+/* 0..1, the same sequence every run */
+static double
+uniform(void)
+{
+	static uint32_t x = 2463534242u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x / 4294967296.0;
+}
+
+static double
+gauss(void)
+{
+	return sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+}
+
+static int32_t
+bridge(double s)
+{
+	return lround(2000 + 300 * sin(2 * M_PI * s / 120) + 5 * gauss());
+}
+
+/* whole degrees below zero */
+static int32_t
+freezer(double s)
+{
+	return lround(-18 + 2 * sin(2 * M_PI * s / 600) + 0.7 * gauss());
+}
+
+/* a large reading with little spread, where a sum of squares would cancel */
+static int32_t
+proximity(double s)
+{
+	return lround(60000 + 1.5 * gauss());
+}
+
+static void
+trace(const char *name, int32_t (*fn)(double s))
+{
+	struct char_desc *report = sim_char("statistics", "statistics");
+	double worst_mean = 0, worst_dev = 0;
+	unsigned first, windows, s = 0;
+
+	sim_subscribe(report);
+	first = sim_notifications(report);
+	for (unsigned i = 0; i < SAMPLES; i++) {
+		sim_run(SIM_MS(PERIOD));
+		samples[i].value = fn(sim_now() / 1e9);
+		samples[i].at = sim_now();
+		stats_add(&srv.stats, samples[i].value);
+	}
+	sim_run(SIM_MS(WINDOW));
+	sim_unsubscribe(report);
+	windows = sim_notifications(report) - first;
+	CHECKF(windows >= WINDOWS, "%s: %u windows", name, windows);
+
+	for (unsigned w = 0; w < windows; w++) {
+		const struct sim_notification *n = sim_notification(report, first + w);
+		struct stats_report r;
+		double sum = 0, m2 = 0, mean;
+		int32_t min = INT32_MAX, max = INT32_MIN;
+		unsigned count = 0;
+
+		memcpy(&r, n->data, sizeof(r));
+		if (w > 0)
+			CHECKF(llabs((long long)(n->queued - sim_notification(report, first + w - 1)->queued) -
+			    SIM_MS(WINDOW)) <= SIM_MS(VTIMER_GUARD + 1),
+			    "%s window %u: %.3f ms after the last", name, w,
+			    (n->queued - sim_notification(report, first + w - 1)->queued) / 1e6);
+		for (unsigned i = s; i < SAMPLES && samples[i].at < n->queued; i++, count++) {
+			sum += samples[i].value;
+			if (samples[i].value < min)
+				min = samples[i].value;
+			if (samples[i].value > max)
+				max = samples[i].value;
+		}
+		mean = sum / count;
+		for (unsigned i = s; i < s + count; i++)
+			m2 += (samples[i].value - mean) * (samples[i].value - mean);
+		s += count;
+		if (!CHECKF(r.count == count, "%s window %u: %u samples, not %u", name, w, r.count, count))
+			continue;
+		if (count == 0)
+			continue;
+		CHECKF(r.min == min && r.max == max, "%s window %u: %d .. %d, not %d .. %d", name, w,
+		    r.min, r.max, min, max);
+		double dmean = fabs((double)r.mean / ONE - mean);
+		double ddev = count < 2 ? 0 : fabs((double)r.stddev / ONE - sqrt(m2 / (count - 1)));
+		if (dmean > worst_mean)
+			worst_mean = dmean;
+		if (ddev > worst_dev)
+			worst_dev = ddev;
+	}
+	CHECK(s == SAMPLES);
+	/* within the rounding of the 24.8 report */
+	CHECKF(worst_mean <= 2.0 / ONE, "%s: mean off by %.4f", name, worst_mean);
+	CHECKF(worst_dev <= 2.0 / ONE, "%s: deviation off by %.4f", name, worst_dev);
+	check_note("%-9s %u windows, mean within %.4f, deviation within %.4f raw units",
+	    name, windows, worst_mean, worst_dev);
+}
+
+void
+scenario(void)
+{
+	vtimer_init(RTC_ID);
+	rtc_init(&rtc_ctx);
+	simble_init("stats");
+	simble_srv_init(&srv, simble_get_vendor_uuid_class(), VENDOR_UUID_SENSOR_SERVICE);
+	stats_init(&srv.stats, NULL);
+	stats_char_add(&srv, &srv.stats);
+	simble_srv_register(&srv);
+	simble_adv_start();
+	sim_connect();
+
+	struct char_desc *report = sim_char("statistics", "statistics");
+	struct char_desc *window = sim_char("statistics", "statistics window");
+	uint32_t ms;
+
+	/* no shorter than the minimum */
+	ms = 10;
+	sim_write(window, &ms, sizeof(ms));
+	CHECK(sim_read(window, &ms, sizeof(ms)) == 4 && ms == STATS_MIN_WINDOW);
+	ms = WINDOW;
+	sim_write(window, &ms, sizeof(ms));
+
+	/* nothing without samples, nothing without a subscriber */
+	sim_subscribe(report);
+	sim_run(SIM_MS(2 * WINDOW));
+	CHECK(sim_notifications(report) == 0);
+	sim_unsubscribe(report);
+	stats_add(&srv.stats, 1);
+	sim_run(SIM_MS(2 * WINDOW));
+	CHECK(sim_notifications(report) == 0);
+
+	trace("bridge", bridge);
+	trace("freezer", freezer);
+	trace("proximity", proximity);
+
+	/* the count saturates, min and max still follow */
+	struct stats_report r;
+	unsigned n = sim_notifications(report);
+	sim_subscribe(report);
+	for (unsigned i = 0; i < 70000; i++)
+		stats_add(&srv.stats, i < 69999 ? 7 : 9);
+	sim_run(SIM_MS(WINDOW + 100));
+	sim_unsubscribe(report);
+	if (CHECK(sim_notifications(report) == n + 1)) {
+		memcpy(&r, sim_notification(report, n)->data, sizeof(r));
+		CHECKF(r.count == UINT16_MAX && r.min == 7 && r.max == 7 && r.mean == 7 * ONE &&
+		    r.stddev == 0, "%u samples, %d .. %d, mean %d, deviation %u", r.count, r.min, r.max,
+		    r.mean, r.stddev);
+	}
+}
@@ -0,0 +1,164 @@
+#include <math.h>
+
+#include "sim.h"
+#include "models.h"
+#include "i2c.h"
+#include "task.h"
+#include "twi_async.h"
+#include "vtimer.h"
+
+/*
+ * task: sleeps, events signalled from an interrupt, timeouts, a signal
+ * kept for the next await and TWI transfers awaited from a task, each
+ * resuming once when it is done instead of polling.  A kick while the
+ * task runs makes it run once more.
+ */
+
+#define RTC_ID		0
+#define HTU21		(0x40 << 1)
+#define TEMP		0xf3	/* no hold */
+#define CONVERSION	50	/* ms, 14 bit */
+
+static struct sim_htu21 htu21 = {
+	.temp = {.value = 21.5},
+};
+
+void
+scenario_init(void)
+{
+	sim_htu21_attach(&htu21);
+}
+
+static struct rtc_ctx rtc_ctx = {
+	.rtc_x[RTC_ID] = VTIMER_RTC_SLOT,
+};
+
+static struct {
+	struct task task;
+	struct task_event ev;
+	struct task_event twi;
+	struct vtimer irq;
+	uint32_t t0;
+	uint32_t slept;
+	uint32_t signalled;
+	uint32_t waited;
+	uint32_t kept;
+	bool signal_timed_out;
+	bool wait_timed_out;
+	bool kept_timed_out;
+	bool started;
+	bool early;
+	bool read;
+	uint8_t buf[3];
+	bool done;
+} ctx;
+
+/* an interrupt handler, the RTC one here */
+static void
+irq_cb(struct vtimer *t)
+{
+	task_event_signal(&ctx.ev);
+}
+
+static enum task_status
+body(struct task *t)
+{
+	TASK_BEGIN(t);
+
+	ctx.t0 = vtimer_now();
+	TASK_SLEEP(t, 50);
+	ctx.slept = vtimer_now() - ctx.t0;
+
+	ctx.t0 = vtimer_now();
+	vtimer_start(&ctx.irq, 30, 0);
+	TASK_AWAIT(t, &ctx.ev, 100);
+	ctx.signalled = vtimer_now() - ctx.t0;
+	ctx.signal_timed_out = task_timed_out(t);
+
+	ctx.t0 = vtimer_now();
+	TASK_AWAIT(t, &ctx.ev, 20);
+	ctx.waited = vtimer_now() - ctx.t0;
+	ctx.wait_timed_out = task_timed_out(t);
+
+	task_event_signal(&ctx.ev);
+	ctx.t0 = vtimer_now();
+	TASK_AWAIT(t, &ctx.ev, 20);
+	ctx.kept = vtimer_now() - ctx.t0;
+	ctx.kept_timed_out = task_timed_out(t);
+
+	/* a conversion: the early read NACKs, the one after the wait gets it */
+	ctx.buf[0] = TEMP;
+	TASK_AWAIT_TWI(t, &ctx.twi, HTU21, ctx.buf, 1, true);
+	ctx.started = twi_async_result();
+	TASK_AWAIT_TWI(t, &ctx.twi, HTU21 | TWI_READ_BIT, ctx.buf, 3, true);
+	ctx.early = twi_async_result();
+	TASK_SLEEP(t, CONVERSION);
+	TASK_AWAIT_TWI(t, &ctx.twi, HTU21 | TWI_READ_BIT, ctx.buf, 3, true);
+	ctx.read = twi_async_result();
+	ctx.done = true;
+
+	TASK_END(t);
+}
+
+static struct task kicked;
+static unsigned kicks;
+
+static enum task_status
+kick_body(struct task *t)
+{
+	TASK_BEGIN(t);
+	kicks++;
+	TASK_SLEEP(t, 10);
+	TASK_END(t);
+}
+
+void
+scenario(void)
+{
+	unsigned long runs;
+
+	twi_master_init();
+	vtimer_init(RTC_ID);
+	rtc_init(&rtc_ctx);
+	task_init();
+	enable_i2c();
+	sim_run(SIM_HTU21_STARTUP);
+
+	ctx.irq.cb = irq_cb;
+	runs = sim_irq_count(SWI3_IRQn);
+	task_start(&ctx.task, body);
+	sim_run(SIM_MS(500));
+	runs = sim_irq_count(SWI3_IRQn) - runs;
+
+	CHECK(ctx.done);
+	CHECK(!task_running(&ctx.task));
+	CHECKF(ctx.slept >= 50 && ctx.slept <= 50 + VTIMER_GUARD + 1, "slept %u ms", ctx.slept);
+	CHECKF(!ctx.signal_timed_out && ctx.signalled >= 30 && ctx.signalled <= 30 + VTIMER_GUARD + 1,
+	    "signalled after %u ms", ctx.signalled);
+	CHECKF(ctx.wait_timed_out && ctx.waited >= 20 && ctx.waited <= 20 + VTIMER_GUARD + 1,
+	    "timed out after %u ms", ctx.waited);
+	CHECKF(!ctx.kept_timed_out && ctx.kept == 0, "kept signal after %u ms", ctx.kept);
+	CHECK(ctx.started);
+	CHECK(!ctx.early);
+	CHECK(htu21.early_reads == 1);
+	if (CHECK(ctx.read)) {
+		uint16_t raw = (ctx.buf[0] << 8 | ctx.buf[1]) & ~3;
+		double t = -46.85 + 175.72 * raw / 65536;
+
+		CHECKF(fabs(t - 21.5) < 0.05, "read %.2f deg C", t);
+	}
+	/* one run to start, then one per await */
+	CHECKF(runs == 9, "task ran %lu times", runs);
+
+	task_kick(&kicked, kick_body);
+	sim_run(SIM_MS(2));
+	task_kick(&kicked, kick_body);
+	sim_run(SIM_MS(50));
+	CHECKF(kicks == 2, "%u runs for a kick while running", kicks);
+	task_kick(&kicked, kick_body);
+	sim_run(SIM_MS(50));
+	CHECK(kicks == 3);
+
+	check_note("struct task %zu bytes, struct task_event %zu bytes (host pointers)",
+	    sizeof(struct task), sizeof(struct task_event));
+}
@@ -0,0 +1,170 @@
+#include "sim.h"
+#include "vtimer.h"
+#include "sampler.h"
+
+#include "temp_rh/htu21.h"
+#include "proximity/tcs3771.h"
+#include "motion/mpu6500.h"
+#include "motion/fusion.h"
+#include "motion/pedometer.h"
+
+/*
+ * vtimer: timers never fire before their delay, timers within their
+ * slack share a wakeup, and the RTC wakeups an hour of the modules'
+ * timer sets.  "Before" counts one interrupt per expiry, as a compare
+ * channel per timer gave; "after" the wakeups of the one vtimer slot.
+ */
+
+#define RTC_ID		0
+#define HOUR		SIM_S(3600)
+
+/* the timers of a module with everything subscribed */
+struct module {
+	const char *name;
+	struct {
+		uint32_t period;
+		uint16_t latency;
+		uint32_t start;	/* ms after the first */
+	} samplers[2];
+	struct {
+		uint32_t period;
+		uint32_t start;
+	} timers[3];
+};
+
+static const struct module modules[] = {
+	{"temp_rh",
+		{{1000, HTU21_TEMPERATURE_LATENCY, 0}, {1000, HTU21_HUMIDITY_LATENCY, 0}},
+		/* the statistics windows */
+		{{60000, 0}, {60000, 0}}},
+	{"proximity",
+		{{1000, TCS3771_LATENCY, 0}, {1000, TCS3771_LATENCY, 400}}},
+	{"noiselvl",
+		/* NOISELVL_LATENCY */
+		{{1000, 76, 0}}},
+	{"motion",
+		{{250, MPU6500_LATENCY, 0}},
+		/* fusion, the orientation notifications, the pedometer */
+		{{FUSION_PERIOD, 0}, {250, 0}, {PEDOMETER_PERIOD, 1500}}},
+};
+
+static struct rtc_ctx rtc_ctx = {
+	.rtc_x[RTC_ID] = VTIMER_RTC_SLOT,
+};
+
+static struct sampler samplers[2];
+static struct vtimer timers[3];
+
+static void
+acquire(struct sampler *s)
+{
+	sampler_ready(s);
+}
+
+static void
+deliver(struct sampler *s)
+{
+}
+
+static void
+tick(struct vtimer *t)
+{
+}
+
+static void
+wakeups(const struct module *m)
+{
+	sim_time_t start = sim_now();
+	uint32_t wakeups, fired;
+	unsigned i;
+
+	for (i = 0; i < 2 && m->samplers[i].period != 0; i++) {
+		sampler_init(&samplers[i], m->samplers[i].latency, acquire, deliver);
+		sim_run_until(start + SIM_MS(m->samplers[i].start));
+		sampler_start(&samplers[i], m->samplers[i].period);
+	}
+	for (i = 0; i < 3 && m->timers[i].period != 0; i++) {
+		timers[i].cb = tick;
+		sim_run_until(start + SIM_MS(m->timers[i].start));
+		vtimer_start(&timers[i], m->timers[i].period, m->timers[i].period);
+	}
+	wakeups = vtimer_stats.wakeups;
+	fired = vtimer_stats.fired;
+	sim_run(HOUR);
+	wakeups = vtimer_stats.wakeups - wakeups;
+	fired = vtimer_stats.fired - fired;
+
+	for (i = 0; i < 2 && m->samplers[i].period != 0; i++) {
+		/* pre-warmed: on the tick, up to the guard and a tick late */
+		CHECKF(samplers[i].stats.max_error <= VTIMER_GUARD + 1,
+		    "%s sampler %u: %u late, by up to %u ms", m->name, i,
+		    samplers[i].stats.late, samplers[i].stats.max_error);
+		sampler_stop(&samplers[i]);
+	}
+	for (i = 0; i < 3; i++)
+		vtimer_stop(&timers[i]);
+	CHECKF(wakeups <= fired, "%s: %u wakeups for %u expiries", m->name, wakeups, fired);
+	check_note("%-10s %6u expiries, %6u wakeups an hour (%.0f%%)", m->name,
+	    fired, wakeups, 100.0 * wakeups / fired);
+}
+
+static struct {
+	struct vtimer t;
+	uint32_t started;
+	uint32_t delay;
+	uint32_t fired;
+	uint32_t wakeup;
+} one[2];
+
+static void
+one_cb(struct vtimer *t)
+{
+	for (unsigned i = 0; i < 2; i++) {
+		if (t != &one[i].t)
+			continue;
+		one[i].fired = vtimer_now();
+		one[i].wakeup = vtimer_stats.wakeups;
+	}
+}
+
+/* `delay' ms with `slack', then a timer due `gap' ms later */
+static void
+pair(uint32_t delay, uint16_t slack, uint32_t gap)
+{
+	for (unsigned i = 0; i < 2; i++) {
+		one[i].t.cb = one_cb;
+		one[i].t.slack = i == 0 ? slack : 0;
+		one[i].delay = delay + i * gap;
+		one[i].fired = 0;
+		one[i].started = vtimer_now();
+		vtimer_start(&one[i].t, one[i].delay, 0);
+	}
+	sim_run(SIM_MS(delay + gap + slack + 10));
+	for (unsigned i = 0; i < 2; i++) {
+		CHECKF(one[i].fired - one[i].started >= one[i].delay,
+		    "timer %u: %u ms for a %u ms delay", i, one[i].fired - one[i].started, one[i].delay);
+		CHECKF(one[i].fired - one[i].started <= one[i].delay + one[i].t.slack + VTIMER_GUARD + 1,
+		    "timer %u: %u ms for a %u ms delay, %u slack", i,
+		    one[i].fired - one[i].started, one[i].delay, one[i].t.slack);
+	}
+}
+
+void
+scenario(void)
+{
+	vtimer_init(RTC_ID);
+	rtc_init(&rtc_ctx);
+
+	/* apart by less than the slack: one wakeup */
+	pair(100, 10, 5);
+	CHECK(one[0].wakeup == one[1].wakeup);
+	/* apart by more: two */
+	pair(100, 10, 30);
+	CHECK(one[0].wakeup != one[1].wakeup);
+	/* short delays, never early whatever the phase of the tick */
+	for (uint32_t d = 1; d < 40; d++)
+		pair(d, 0, 1);
+
+	for (unsigned i = 0; i < sizeof(modules) / sizeof(modules[0]); i++)
+		wakeups(&modules[i]);
+}
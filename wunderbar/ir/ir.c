@@ -1,6 +1,5 @@
 #include <stdlib.h>
 #include <string.h>
-#include <nrf_delay.h>
 
 #include "simble.h"
 #include "indicator.h"
@@ -53,11 +52,19 @@ static struct ir_ctx ir_ctx;
 
 static struct rtc_ctx rtc_ctx;
 
+/*
+ * The write arrives right after the connection event that carried it, so
+ * a frame started now has the whole connection interval to itself before
+ * the softdevice can delay the RTC1 interrupt again.  The only wait is
+ * the crystal start, which protocol_send() adds when the HFCLK is off.
+ */
 static void
 ir_write_cb(struct service_desc *s, struct char_desc *c, const void *val, const uint16_t len)
 {
 	struct ir_payload *payload = (struct ir_payload*) val;
-	nrf_delay_us(50 * 999); // XXX delay ~50ms to avoid interrupt screw up
+
+	if (len < sizeof(*payload))
+		return;
 	protocol_send(payload->address, payload->command, NULL);
 }
 
@@ -7,17 +7,36 @@
 #include "protocol.h"
 #include "util.h"
 #include "rtc.h"
+#include "evq.h"
+#include "simble.h"
 
 #define RTC_TASK_JITTER		(30u)
 #define LFCLK_FREQUENCY		(32768ul)
+/* ms for the 16 MHz crystal to start, the frame waits at least this long */
+#define HFCLK_STARTUP		(2u)
+
+/*
+ * RTC1_IRQHandler() only keeps the bit timing going; the battery tick and
+ * the sent callback are posted to `deferred' and run in thread mode from
+ * simble's event loop, which wakes up as the handler returns.
+ */
+enum {
+	PROTOCOL_EVENT_TICK,
+	PROTOCOL_EVENT_SENT,
+};
+
+static void deferred_work(void);
 
 static struct rtc_ctx *ctx;
+static struct evq deferred;
+static struct simble_hook hook = {.idle = deferred_work};
 
 static struct {
 	uint8_t led_pin;
 	struct ir_protocol *protocol;
 	enum {
 		PROTOCOL_STATE_IDLE = 0x0,
+		PROTOCOL_STATE_DELAY,
 		PROTOCOL_STATE_PREAMBLE_DONE,
 		PROTOCOL_STATE_ADDRESS,
 		PROTOCOL_STATE_COMMAND,
@@ -37,6 +56,56 @@ static struct {
 	.command = 0,
 };
 
+static void start_frame(void);
+
+/*
+ * The crystal and the carrier blocks only run from protocol_send() to
+ * the end of the last frame; powering a block down clears its
+ * registers, so they are set up again for every burst.
+ */
+static void
+carrier_on(void)
+{
+	sd_clock_hfclk_request();
+
+	// gpiote0 (toggles gpio)
+	NRF_GPIOTE->POWER = GPIOTE_POWER_POWER_Enabled << GPIOTE_POWER_POWER_Pos;
+	nrf_gpiote_task_config(0, context.led_pin, NRF_GPIOTE_POLARITY_TOGGLE, NRF_GPIOTE_INITIAL_VALUE_LOW);
+
+	// timer1
+	NRF_TIMER1->POWER = 1;
+	NRF_TIMER1->TASKS_STOP = 1;
+	NRF_TIMER1->TASKS_CLEAR = 1;
+	NRF_TIMER1->PRESCALER = 4;
+	NRF_TIMER1->MODE = TIMER_MODE_MODE_Timer;
+	NRF_TIMER1->BITMODE = TIMER_BITMODE_BITMODE_16Bit;
+	NRF_TIMER1->SHORTS = TIMER_SHORTS_COMPARE2_CLEAR_Msk;
+	NRF_TIMER1->CC[0] = 1;
+	NRF_TIMER1->CC[1] = ROUNDED_DIV(context.protocol->pulse_width, 3);
+	NRF_TIMER1->CC[2] = context.protocol->pulse_width;
+
+	// timer2 (counter)
+	NRF_TIMER2->POWER = 1;
+	NRF_TIMER2->TASKS_STOP = 1;
+	NRF_TIMER2->TASKS_CLEAR = 1;
+	NRF_TIMER2->MODE = TIMER_MODE_MODE_Counter;
+	NRF_TIMER2->BITMODE = TIMER_BITMODE_BITMODE_16Bit;
+	NRF_TIMER2->TASKS_START = 1;
+	NRF_TIMER2->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+}
+
+static void
+carrier_off(void)
+{
+	NRF_TIMER1->TASKS_STOP = 1;
+	NRF_TIMER2->TASKS_STOP = 1;
+	NRF_TIMER1->POWER = 0;
+	NRF_TIMER2->POWER = 0;
+	// turn off GPIOTE to avoid overconsumption bug (PAN39)
+	NRF_GPIOTE->POWER = GPIOTE_POWER_POWER_Disabled << GPIOTE_POWER_POWER_Pos;
+	sd_clock_hfclk_release();
+}
+
 static inline void
 pulse(uint32_t num)
 {
@@ -65,8 +134,7 @@ RTC1_IRQHandler(void)
 		// clear the event CC_x
 		NRF_RTC1->EVENTS_COMPARE[3] = 0;
 
-		//call the registered callback
-		ctx->rtc_x[3].cb(ctx);
+		evq_post(&deferred, PROTOCOL_EVENT_TICK, 0, 0);
 	}
 	if (NRF_RTC1->EVENTS_COMPARE[0] == 0)
 		return;
@@ -75,6 +143,9 @@ RTC1_IRQHandler(void)
 	case PROTOCOL_STATE_IDLE:
 		/* should not happen */
 		break;
+	case PROTOCOL_STATE_DELAY:
+		start_frame();
+		break;
 	case PROTOCOL_STATE_PREAMBLE_DONE:
 		NRF_RTC1->TASKS_STOP = 1;
 		NRF_RTC1->PRESCALER = ROUNDED_DIV(LFCLK_FREQUENCY, context.protocol->tick_freq) - 1;
@@ -119,19 +190,40 @@ RTC1_IRQHandler(void)
 		context.state = PROTOCOL_STATE_END;
 		break;
 	case PROTOCOL_STATE_END:
-		// turn off GPIOTE to avoid overconsumption bug (PAN39)
-		NRF_GPIOTE->POWER = GPIOTE_POWER_POWER_Disabled << GPIOTE_POWER_POWER_Pos;
 		NRF_RTC1->TASKS_STOP = 1;
 		NRF_RTC1->TASKS_CLEAR = 1;
 		NRF_POWER->TASKS_LOWPWR = 1; // PAN 11 "HFCLK: Base current with HFCLK running is too high"
 		context.state = PROTOCOL_STATE_IDLE;
-		if (context.cb) {
-			context.cb(context.address, context.command);
-		}
+		evq_post(&deferred, PROTOCOL_EVENT_SENT, context.address, context.command);
 		break;
 	}
 }
 
+static void
+deferred_work(void)
+{
+	struct evq_event e;
+	bool sent = false;
+
+	while (evq_get(&deferred, &e)) {
+		switch (e.type) {
+		case PROTOCOL_EVENT_TICK:
+			//call the registered callback
+			ctx->rtc_x[3].cb(ctx);
+			break;
+		case PROTOCOL_EVENT_SENT:
+			if (context.cb) {
+				context.cb(e.a, e.b);
+			}
+			sent = true;
+			break;
+		}
+	}
+	/* unless the callback queued the next frame of a burst */
+	if (sent && context.state == PROTOCOL_STATE_IDLE)
+		carrier_off();
+}
+
 void
 protocol_init(struct ir_protocol *protocol, uint8_t led_pin, struct rtc_ctx *c)
 {
@@ -154,27 +246,12 @@ protocol_init(struct ir_protocol *protocol, uint8_t led_pin, struct rtc_ctx *c)
 	NRF_RTC1->EVTENSET = RTC_EVTENSET_COMPARE0_Msk;
 	NRF_RTC1->INTENSET = RTC_INTENSET_COMPARE0_Msk;
 
-	// high freq clock
-	sd_clock_hfclk_request();
-
-	// timer1
-	NRF_TIMER1->TASKS_STOP = 1;
-	NRF_TIMER1->TASKS_CLEAR = 1;
-	NRF_TIMER1->PRESCALER = 4;
-	NRF_TIMER1->MODE = TIMER_MODE_MODE_Timer;
-	NRF_TIMER1->BITMODE = TIMER_BITMODE_BITMODE_16Bit;
-	NRF_TIMER1->SHORTS = TIMER_SHORTS_COMPARE2_CLEAR_Msk;
-	NRF_TIMER1->CC[0] = 1;
-	NRF_TIMER1->CC[1] = ROUNDED_DIV(context.protocol->pulse_width, 3);
-	NRF_TIMER1->CC[2] = context.protocol->pulse_width;
+	// deferred work, see deferred_work()
+	simble_hook_add(&hook);
 
-	// timer2 (counter)
-	NRF_TIMER2->TASKS_STOP = 1;
-	NRF_TIMER2->TASKS_CLEAR = 1;
-	NRF_TIMER2->MODE = TIMER_MODE_MODE_Counter;
-	NRF_TIMER2->BITMODE = TIMER_BITMODE_BITMODE_16Bit;
-	NRF_TIMER2->TASKS_START = 1;
-	NRF_TIMER2->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+	// the crystal and the timers only run for a burst, see carrier_on()
+	NRF_TIMER1->POWER = 0;
+	NRF_TIMER2->POWER = 0;
 
 	// gpio (led)
 	nrf_gpio_cfg_output(led_pin);
@@ -190,29 +267,58 @@ protocol_init(struct ir_protocol *protocol, uint8_t led_pin, struct rtc_ctx *c)
 		PPI_CHEN_CH3_Msk);
 }
 
+static void
+start_frame(void)
+{
+	context.state = PROTOCOL_STATE_PREAMBLE_DONE;
+	NRF_POWER->TASKS_CONSTLAT = 1; // PAN 11 "HFCLK: Base current with HFCLK running is too high"
+	NRF_RTC1->TASKS_STOP = 1;
+	NRF_RTC1->TASKS_CLEAR = 1;
+	NRF_RTC1->PRESCALER = ROUNDED_DIV(LFCLK_FREQUENCY,
+		ROUNDED_DIV(1000000,
+			context.protocol->preamble.leader + context.protocol->preamble.pause - RTC_TASK_JITTER
+			)) - 1;
+	NRF_RTC1->CC[0] = 1;
+	NRF_RTC1->TASKS_START = 1;
+	pulse(ROUNDED_DIV(context.protocol->preamble.leader, context.protocol->pulse_width));
+}
+
 bool
 protocol_send(uint16_t address, uint16_t command, sent_cb_t* cb)
 {
-	// gpiote0 (toggles gpio)
-	NRF_GPIOTE->POWER = GPIOTE_POWER_POWER_Enabled << GPIOTE_POWER_POWER_Pos;
-	nrf_gpiote_task_config(0, context.led_pin, NRF_GPIOTE_POLARITY_TOGGLE, NRF_GPIOTE_INITIAL_VALUE_LOW);
+	return protocol_send_delayed(address, command, 0, cb);
+}
+
+/*
+ * Like protocol_send(), the frame starts `delay' ms later.  The wait runs
+ * on RTC1 compare 0 so the caller returns immediately.  A crystal that
+ * is not running yet starts during the wait, which is stretched to
+ * HFCLK_STARTUP if need be.
+ */
+bool
+protocol_send_delayed(uint16_t address, uint16_t command, uint16_t delay, sent_cb_t* cb)
+{
+	uint32_t running = 0;
 
 	if (context.state != PROTOCOL_STATE_IDLE) {
 		return false;
 	}
-	context.state = PROTOCOL_STATE_PREAMBLE_DONE;
+	sd_clock_hfclk_is_running(&running);
+	if (!running && delay < HFCLK_STARTUP)
+		delay = HFCLK_STARTUP;
+	carrier_on();
 	context.address = address;
 	context.command = command;
 	context.cb = cb;
-	NRF_POWER->TASKS_CONSTLAT = 1; // PAN 11 "HFCLK: Base current with HFCLK running is too high"
+	if (delay == 0) {
+		start_frame();
+		return true;
+	}
+	context.state = PROTOCOL_STATE_DELAY;
 	NRF_RTC1->TASKS_STOP = 1;
 	NRF_RTC1->TASKS_CLEAR = 1;
-	NRF_RTC1->PRESCALER = ROUNDED_DIV(LFCLK_FREQUENCY,
-		ROUNDED_DIV(1000000,
-			context.protocol->preamble.leader + context.protocol->preamble.pause - RTC_TASK_JITTER
-			)) - 1;
-	NRF_RTC1->CC[0] = 1;
+	NRF_RTC1->PRESCALER = ROUNDED_DIV(LFCLK_FREQUENCY, 1000) - 1;
+	NRF_RTC1->CC[0] = delay;
 	NRF_RTC1->TASKS_START = 1;
-	pulse(ROUNDED_DIV(context.protocol->preamble.leader, context.protocol->pulse_width));
 	return true;
 }
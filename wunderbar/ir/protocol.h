@@ -35,5 +35,6 @@ typedef void (sent_cb_t)(uint16_t address, uint16_t command);
 
 void protocol_init(struct ir_protocol *protocol, uint8_t led_pin, struct rtc_ctx *c);
 bool protocol_send(uint16_t address, uint16_t command, sent_cb_t* cb);
+bool protocol_send_delayed(uint16_t address, uint16_t command, uint16_t delay, sent_cb_t* cb);
 
 #endif /* PROTOCOL_H */
@@ -0,0 +1,310 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "codec.h"
+
+static void
+unpack(const struct mpu6500_data *d, uint16_t v[CODEC_CHANNELS])
+{
+        v[0] = d->accel_x;
+        v[1] = d->accel_y;
+        v[2] = d->accel_z;
+        v[3] = d->gyro_x;
+        v[4] = d->gyro_y;
+        v[5] = d->gyro_z;
+}
+
+static void
+restart(struct codec_channel *ch, uint16_t v)
+{
+        ch->last[0] = ch->last[1] = v;
+        /*
+         * Rice parameter 7 to begin with: start lower and a noisy
+         * channel escapes until it adapts, so the sample after a restart
+         * goes out raw again.
+         */
+        ch->sum = 128;
+        ch->count = 1;
+        ch->error[0] = ch->error[1] = 0;
+}
+
+/* the order that did better lately; the decoder picks the same */
+static uint16_t
+predict(const struct codec_channel *ch, uint8_t *order)
+{
+        *order = ch->error[1] < ch->error[0];
+        if (*order)
+                return 2 * ch->last[0] - ch->last[1];
+        return ch->last[0];
+}
+
+static uint8_t
+rice_k(const struct codec_channel *ch)
+{
+        uint8_t k = 0;
+
+        while (k < 15 && ((uint32_t)ch->count << k) < ch->sum)
+                k++;
+        return k;
+}
+
+static uint16_t
+zigzag(uint16_t r)
+{
+        return (uint16_t)(r << 1) ^ (uint16_t)-(r >> 15);
+}
+
+/* |r|, capped so the sums below stay in 16 bits */
+static uint16_t
+magnitude(uint16_t r)
+{
+        int32_t v = (int16_t)r;
+
+        if (v < 0)
+                v = -v;
+        return v > 2047 ? 2047 : v;
+}
+
+/* learn from value v, once it is coded */
+static void
+update(struct codec_channel *ch, uint16_t v, uint16_t u)
+{
+        uint16_t p1 = ch->last[0], p2 = 2 * ch->last[0] - ch->last[1];
+
+        for (int i = 0; i < 2; i++)
+                ch->error[i] -= ch->error[i] >> 4;
+        ch->error[0] += magnitude(v - p1);
+        ch->error[1] += magnitude(v - p2);
+        ch->sum += u > 2047 ? 2047 : u;
+        if (++ch->count == 32) {
+                ch->sum >>= 1;
+                ch->count >>= 1;
+        }
+        ch->last[1] = ch->last[0];
+        ch->last[0] = v;
+}
+
+static void
+put_bits(uint8_t *buf, uint16_t *pos, uint16_t v, uint8_t n)
+{
+        while (n-- != 0) {
+                if (v >> n & 1)
+                        buf[*pos >> 3] |= 0x80 >> (*pos & 7);
+                else
+                        buf[*pos >> 3] &= ~(0x80 >> (*pos & 7));
+                (*pos)++;
+        }
+}
+
+static uint8_t
+code_bits(uint16_t u, uint8_t k)
+{
+        uint16_t q = u >> k;
+
+        return q < CODEC_ESCAPE ? q + 1 + k : CODEC_ESCAPE + 16;
+}
+
+static void
+put_code(uint8_t *buf, uint16_t *pos, uint16_t u, uint8_t k)
+{
+        uint16_t q = u >> k;
+
+        if (q >= CODEC_ESCAPE) {
+                put_bits(buf, pos, (1 << CODEC_ESCAPE) - 1, CODEC_ESCAPE);
+                put_bits(buf, pos, u, 16);
+                return;
+        }
+        put_bits(buf, pos, ((1 << q) - 1) << 1, q + 1);
+        put_bits(buf, pos, u & ((1 << k) - 1), k);
+}
+
+/* the sequence number after a raw packet, from its sample */
+static uint8_t
+raw_seq(const uint8_t *raw)
+{
+        uint8_t seq = 0;
+
+        for (int i = 0; i < CODEC_RAW; i++)
+                seq ^= raw[i];
+        return seq;
+}
+
+void
+codec_flush(struct codec *c)
+{
+        uint8_t len = (c->bits + 7) / 8;
+
+        if (c->count == 0)
+                return;
+        if (c->count == 1 && len >= CODEC_RAW) {
+                /* the header would make it larger than the sample */
+                for (int i = 0; i < CODEC_CHANNELS; i++) {
+                        uint16_t v = c->ch[i].last[0];
+
+                        c->packet[2 * i] = v;
+                        c->packet[2 * i + 1] = v >> 8;
+                        restart(&c->ch[i], v);
+                }
+                c->send(c->packet, CODEC_RAW);
+                c->seq = raw_seq(c->packet);
+        } else {
+                if (len == CODEC_RAW)
+                        c->packet[len++] = 0;
+                c->packet[1] |= c->count;
+                c->send(c->packet, len);
+                c->seq++;
+        }
+        c->since_key++;
+        c->count = 0;
+}
+
+static void
+keyframe(struct codec *c, const uint16_t v[CODEC_CHANNELS])
+{
+        c->packet[0] = c->seq;
+        c->packet[1] = CODEC_KEY;
+        for (int i = 0; i < CODEC_CHANNELS; i++) {
+                c->packet[CODEC_HEADER + 2 * i] = v[i];
+                c->packet[CODEC_HEADER + 2 * i + 1] = v[i] >> 8;
+                restart(&c->ch[i], v[i]);
+        }
+        c->bits = 8 * (CODEC_HEADER + 2 * CODEC_CHANNELS);
+        c->count = 1;
+        c->since_key = 0;
+}
+
+/* true if the sample went into the packet */
+static bool
+code(struct codec *c, const uint16_t v[CODEC_CHANNELS])
+{
+        uint16_t u[CODEC_CHANNELS];
+        uint8_t k[CODEC_CHANNELS], order;
+        uint16_t bits = 0;
+
+        for (int i = 0; i < CODEC_CHANNELS; i++) {
+                u[i] = zigzag(v[i] - predict(&c->ch[i], &order));
+                k[i] = rice_k(&c->ch[i]);
+                bits += code_bits(u[i], k[i]);
+        }
+        if (c->bits + bits > 8 * CODEC_PAYLOAD)
+                return false;
+        for (int i = 0; i < CODEC_CHANNELS; i++) {
+                put_code(c->packet, &c->bits, u[i], k[i]);
+                update(&c->ch[i], v[i], u[i]);
+        }
+        c->count++;
+        return true;
+}
+
+void
+codec_add(struct codec *c, const struct mpu6500_data *d)
+{
+        uint16_t v[CODEC_CHANNELS];
+
+        unpack(d, v);
+        if (c->count != 0 && c->count < 0x7f && code(c, v))
+                return;
+        codec_flush(c);
+        if (c->since_key >= CODEC_KEYFRAME) {
+                keyframe(c, v);
+                return;
+        }
+        c->packet[0] = c->seq;
+        c->packet[1] = 0;
+        c->bits = 8 * CODEC_HEADER;
+        if (!code(c, v))
+                keyframe(c, v);
+}
+
+void
+codec_init(struct codec *c, codec_send_t *send)
+{
+        memset(c, 0, sizeof(*c));
+        c->send = send;
+        /* the first packet is a keyframe */
+        c->since_key = CODEC_KEYFRAME;
+}
+
+#ifdef CODEC_DECODER
+static uint16_t
+unzigzag(uint16_t u)
+{
+        return (u >> 1) ^ (uint16_t)-(u & 1);
+}
+
+static uint16_t
+get_bits(const uint8_t *buf, uint16_t *pos, uint8_t n)
+{
+        uint16_t v = 0;
+
+        while (n-- != 0) {
+                v = v << 1 | (buf[*pos >> 3] >> (7 - (*pos & 7)) & 1);
+                (*pos)++;
+        }
+        return v;
+}
+
+int
+codec_decode(struct codec_decoder *dec, const uint8_t *packet, uint8_t len,
+        struct mpu6500_data *out, int max)
+{
+        uint16_t pos = 8 * CODEC_HEADER, v[CODEC_CHANNELS];
+        const uint8_t *first = NULL;    /* a sample verbatim */
+        uint8_t count;
+        int n = 0;
+
+        if (len == CODEC_RAW) {
+                first = packet;
+                count = 1;
+                dec->valid = 1;
+                dec->seq = raw_seq(packet);
+        } else {
+                if (len < CODEC_HEADER)
+                        return -1;
+                count = packet[1] & 0x7f;
+                if (packet[1] & CODEC_KEY) {
+                        if (len < CODEC_HEADER + 2 * CODEC_CHANNELS)
+                                return -1;
+                        first = &packet[CODEC_HEADER];
+                        pos += 16 * CODEC_CHANNELS;
+                        dec->valid = 1;
+                } else if (!dec->valid || packet[0] != dec->seq) {
+                        dec->valid = 0;
+                        return -1;
+                }
+                dec->seq = packet[0] + 1;
+        }
+        if (first != NULL) {
+                for (int i = 0; i < CODEC_CHANNELS; i++) {
+                        v[i] = first[2 * i] | first[2 * i + 1] << 8;
+                        restart(&dec->ch[i], v[i]);
+                }
+        }
+
+        for (; n < count && n < max; n++) {
+                if (n != 0 || first == NULL) {
+                        for (int i = 0; i < CODEC_CHANNELS; i++) {
+                                struct codec_channel *ch = &dec->ch[i];
+                                uint8_t k = rice_k(ch), order;
+                                uint16_t q = 0, u;
+
+                                while (q < CODEC_ESCAPE && get_bits(packet, &pos, 1))
+                                        q++;
+                                if (q == CODEC_ESCAPE)
+                                        u = get_bits(packet, &pos, 16);
+                                else
+                                        u = q << k | get_bits(packet, &pos, k);
+                                v[i] = predict(ch, &order) + unzigzag(u);
+                                update(ch, v[i], u);
+                        }
+                }
+                out[n].accel_x = v[0];
+                out[n].accel_y = v[1];
+                out[n].accel_z = v[2];
+                out[n].gyro_x = v[3];
+                out[n].gyro_y = v[4];
+                out[n].gyro_z = v[5];
+        }
+        return n;
+}
+#endif /* CODEC_DECODER */
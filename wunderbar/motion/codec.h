@@ -0,0 +1,88 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mpu6500.h"
+
+/*
+ * Lossless packing of struct mpu6500_data streams into notifications.
+ *
+ * Each of the six channels is predicted from its past, either by the
+ * last value or by extending the line through the last two, whichever
+ * did better lately.  The residual is zigzag mapped and Rice coded
+ * with a parameter that follows the residual magnitude, LOCO-I style;
+ * a residual too large for CODEC_ESCAPE ones goes out verbatim.  The
+ * decoder makes the same choices from the same past, so none of them
+ * is sent.
+ *
+ * Packets are CODEC_PAYLOAD bytes at most:
+ *
+ *	u8 seq		increments per packet
+ *	u8 info		bit 7 keyframe, bits 0..6 samples in the packet
+ *	keyframe only:	the first sample verbatim, 6 x i16 little endian
+ *	bits		the codes of the remaining samples, msb first
+ *
+ * A keyframe restarts the prediction, every CODEC_KEYFRAME packets and
+ * whenever a sample would not fit into a packet of its own.  A decoder
+ * that sees the sequence jump waits for the next keyframe.
+ *
+ * A packet that would carry one sample in CODEC_RAW bytes or more goes
+ * out raw instead: the sample verbatim without a header, as the
+ * uncompressed characteristic sends it, and the prediction restarts
+ * from it.  Coded packets are never
+ * CODEC_RAW bytes long, so the length tells the two apart.  A decoder
+ * picks up at a raw packet as at a keyframe.  The packet after it
+ * carries the xor of the raw sample's bytes as its sequence number,
+ * which catches a lost raw packet but one time in 256.  A stream that
+ * does not compress, such as noise, is then never larger than the
+ * samples themselves.
+ *
+ * Build with CODEC_DECODER for the reference decoder, on a gateway.
+ */
+
+#define CODEC_PAYLOAD           20
+#define CODEC_HEADER            2
+#define CODEC_KEYFRAME          16      /* packets */
+#define CODEC_ESCAPE            12
+#define CODEC_CHANNELS          6
+#define CODEC_KEY               0x80
+#define CODEC_RAW               12      /* bytes, one sample verbatim */
+
+struct codec_channel {
+        uint16_t last[2];       /* the previous value and the one before */
+        uint16_t sum;           /* residual magnitudes for the Rice parameter */
+        uint8_t count;          /* in sum */
+        uint16_t error[2];      /* recent errors of the two predictors */
+};
+
+typedef void (codec_send_t)(const void *packet, uint8_t len);
+
+struct codec {
+        struct codec_channel ch[CODEC_CHANNELS];
+        codec_send_t *send;
+        uint8_t seq;
+        uint8_t since_key;      /* packets since the last keyframe */
+        uint8_t count;          /* samples in the packet */
+        uint16_t bits;          /* used in the packet */
+        uint8_t packet[CODEC_PAYLOAD];
+};
+
+void codec_init(struct codec *c, codec_send_t *send);
+void codec_add(struct codec *c, const struct mpu6500_data *d);
+void codec_flush(struct codec *c);
+
+#ifdef CODEC_DECODER
+struct codec_decoder {
+        struct codec_channel ch[CODEC_CHANNELS];
+        uint8_t seq;
+        uint8_t valid;
+};
+
+/* samples decoded into out, -1 while waiting for a keyframe */
+int codec_decode(struct codec_decoder *dec, const uint8_t *packet, uint8_t len,
+        struct mpu6500_data *out, int max);
+#endif
+
+#endif /* CODEC_H */
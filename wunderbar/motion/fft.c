@@ -0,0 +1,98 @@
+#include <stdint.h>
+
+#include "fft.h"
+
+#define QUARTER (1 << (FFT_MAX_LOG2 - 2))
+
+/* sin(2 pi i / 2^FFT_MAX_LOG2) for a quarter wave, Q15 */
+static const int16_t sine[QUARTER + 1] = {
+        0, 402, 804, 1206, 1608, 2009, 2411, 2811,
+        3212, 3612, 4011, 4410, 4808, 5205, 5602, 5998,
+        6393, 6787, 7180, 7571, 7962, 8351, 8740, 9127,
+        9512, 9896, 10279, 10660, 11039, 11417, 11793, 12167,
+        12540, 12910, 13279, 13646, 14010, 14373, 14733, 15091,
+        15447, 15800, 16151, 16500, 16846, 17190, 17531, 17869,
+        18205, 18538, 18868, 19195, 19520, 19841, 20160, 20475,
+        20788, 21097, 21403, 21706, 22006, 22302, 22595, 22884,
+        23170, 23453, 23732, 24008, 24279, 24548, 24812, 25073,
+        25330, 25583, 25833, 26078, 26320, 26557, 26791, 27020,
+        27246, 27467, 27684, 27897, 28106, 28311, 28511, 28707,
+        28899, 29086, 29269, 29448, 29622, 29792, 29957, 30118,
+        30274, 30425, 30572, 30715, 30853, 30986, 31114, 31238,
+        31357, 31471, 31581, 31686, 31786, 31881, 31972, 32058,
+        32138, 32214, 32286, 32352, 32413, 32470, 32522, 32568,
+        32610, 32647, 32679, 32706, 32729, 32746, 32758, 32766,
+        32767,
+};
+
+/* over half a turn, i < 2 * QUARTER */
+static int16_t
+sin_half(unsigned i)
+{
+        return i <= QUARTER ? sine[i] : sine[2 * QUARTER - i];
+}
+
+static int16_t
+cos_half(unsigned i)
+{
+        return i <= QUARTER ? sine[QUARTER - i] : -sine[i - QUARTER];
+}
+
+void
+fft_window(int16_t *x, uint8_t log2n)
+{
+        unsigned n = 1U << log2n;
+        unsigned step = 1U << (FFT_MAX_LOG2 - log2n);
+
+        /* 0.5 - 0.5 cos(2 pi i / n), the second half mirrors the first */
+        for (unsigned i = 0; i <= n / 2; i++) {
+                int32_t w = (32768 - cos_half(i * step)) / 2;
+
+                x[i] = (int32_t)x[i] * w >> 15;
+                if (i != 0 && i != n / 2)
+                        x[n - i] = (int32_t)x[n - i] * w >> 15;
+        }
+}
+
+void
+fft(int16_t *re, int16_t *im, uint8_t log2n)
+{
+        unsigned n = 1U << log2n;
+
+        /* bit reversed order, so the butterflies can run in place */
+        for (unsigned i = 1, j = 0; i < n; i++) {
+                unsigned bit = n >> 1;
+
+                for (; j & bit; bit >>= 1)
+                        j ^= bit;
+                j |= bit;
+                if (i < j) {
+                        int16_t t;
+
+                        t = re[i]; re[i] = re[j]; re[j] = t;
+                        t = im[i]; im[i] = im[j]; im[j] = t;
+                }
+        }
+
+        for (unsigned half = 1; half < n; half <<= 1) {
+                /* twiddle k of this stage is e^(-j pi k / half) */
+                unsigned step = (2 * QUARTER) / half;
+
+                for (unsigned k = 0; k < half; k++) {
+                        int32_t c = cos_half(k * step);
+                        int32_t s = sin_half(k * step);
+
+                        for (unsigned p = k; p < n; p += 2 * half) {
+                                unsigned q = p + half;
+                                /* rounded, truncating biases every bin and costs 2 dB */
+                                int32_t tr = (c * re[q] + s * im[q] + (1 << 14)) >> 15;
+                                int32_t ti = (c * im[q] - s * re[q] + (1 << 14)) >> 15;
+
+                                re[q] = (re[p] - tr + 1) >> 1;
+                                im[q] = (im[p] - ti + 1) >> 1;
+                                re[p] = (re[p] + tr + 1) >> 1;
+                                im[p] = (im[p] + ti + 1) >> 1;
+                        }
+                }
+        }
+}
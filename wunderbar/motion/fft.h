@@ -0,0 +1,23 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <stdint.h>
+
+/*
+ * In place radix 2 FFT on 16 bit fixed point data.
+ *
+ * Every stage halves its outputs, so the result is the transform
+ * divided by the number of points and can not overflow as long as the
+ * input stays within +-2^14.  Twiddles come from a quarter wave sine
+ * table in flash sized for FFT_MAX_LOG2; smaller transforms step
+ * through it.
+ */
+
+#define FFT_MAX_LOG2    9       /* 512 points */
+
+/* multiply by a Hann window; its coherent gain is 1/2 */
+void fft_window(int16_t *x, uint8_t log2n);
+/* forward transform of re + j im, scaled by 1 / 2^log2n */
+void fft(int16_t *re, int16_t *im, uint8_t log2n);
+
+#endif /* FFT_H */
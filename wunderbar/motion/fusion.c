@@ -0,0 +1,133 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fusion.h"
+
+#define ONE             (1L << 30)
+/* 10 * pi / 180 * 2^24: LSB * 10 / gyro_scale to rad/s in Q24 */
+#define DPS10_TO_RAD    2928181LL
+
+static int32_t
+mul(int32_t a, int32_t b)
+{
+        return (int64_t)a * b >> 30;
+}
+
+static uint32_t
+isqrt(uint64_t v)
+{
+        uint64_t r = 0, bit = 1ULL << 62;
+
+        while (bit > v)
+                bit >>= 2;
+        while (bit != 0) {
+                if (v >= r + bit) {
+                        v -= r + bit;
+                        r = (r >> 1) + bit;
+                } else {
+                        r >>= 1;
+                }
+                bit >>= 2;
+        }
+        return r;
+}
+
+void
+fusion_reset(struct fusion *f)
+{
+        f->q[0] = ONE;
+        f->q[1] = f->q[2] = f->q[3] = 0;
+        for (int i = 0; i < 3; i++)
+                f->bias[i] = f->rest[i] = 0;
+        f->still = 0;
+}
+
+/* at rest the gyro reads its bias; steady and small enough is rest */
+static void
+rest(struct fusion *f, const int32_t w[3])
+{
+        bool steady = true;
+
+        for (int i = 0; i < 3; i++) {
+                int32_t d = w[i] - f->rest[i];
+
+                f->rest[i] += d >> 5;
+                if (d > FUSION_STEADY || d < -FUSION_STEADY ||
+                    f->rest[i] > FUSION_MAX_BIAS || f->rest[i] < -FUSION_MAX_BIAS)
+                        steady = false;
+        }
+        if (!steady) {
+                f->still = 0;
+                return;
+        }
+        if (f->still < FUSION_STILL) {
+                f->still++;
+                return;
+        }
+        for (int i = 0; i < 3; i++)
+                f->bias[i] = -f->rest[i];
+}
+
+void
+fusion_update(struct fusion *f, const struct mpu6500_data *d,
+        uint16_t gyro_scale, uint32_t dt)
+{
+        int32_t a[3] = {(int16_t)d->accel_x, (int16_t)d->accel_y, (int16_t)d->accel_z};
+        int32_t g[3] = {(int16_t)d->gyro_x, (int16_t)d->gyro_y, (int16_t)d->gyro_z};
+        int32_t *q = f->q;
+        int32_t w[3], h[3], dq[4];
+        uint64_t norm2;
+        int64_t inv;
+
+        if (dt > FUSION_MAX_DT)
+                dt = FUSION_MAX_DT;
+        for (int i = 0; i < 3; i++)
+                w[i] = g[i] * DPS10_TO_RAD / gyro_scale;
+        rest(f, w);
+
+        norm2 = (uint64_t)(a[0] * a[0]) + a[1] * a[1] + a[2] * a[2];
+        if (norm2 != 0) {
+                int32_t v[3], e[3];
+
+                /* accel to a unit vector, Q30 */
+                inv = ((int64_t)1 << 45) / isqrt(norm2 << 30);
+                for (int i = 0; i < 3; i++)
+                        a[i] = a[i] * inv;
+                /* gravity as the quaternion sees it */
+                v[0] = 2 * (mul(q[1], q[3]) - mul(q[0], q[2]));
+                v[1] = 2 * (mul(q[0], q[1]) + mul(q[2], q[3]));
+                v[2] = mul(q[0], q[0]) - mul(q[1], q[1]) - mul(q[2], q[2]) + mul(q[3], q[3]);
+                e[0] = mul(a[1], v[2]) - mul(a[2], v[1]);
+                e[1] = mul(a[2], v[0]) - mul(a[0], v[2]);
+                e[2] = mul(a[0], v[1]) - mul(a[1], v[0]);
+                for (int i = 0; i < 3; i++) {
+                        /* Q30 * Q16 >> 22 and Q30 * Q8 >> 14 give Q24 */
+                        f->bias[i] += ((int64_t)e[i] * FUSION_KI >> 22) * (int32_t)dt / 1000;
+                        w[i] += ((int64_t)e[i] * FUSION_KP >> 14) + f->bias[i];
+                }
+        }
+
+        /* half the rotation over dt, rad in Q30 */
+        for (int i = 0; i < 3; i++)
+                h[i] = (int64_t)w[i] * (int32_t)dt * 64 / 2000;
+        dq[0] = -mul(q[1], h[0]) - mul(q[2], h[1]) - mul(q[3], h[2]);
+        dq[1] = mul(q[0], h[0]) + mul(q[2], h[2]) - mul(q[3], h[1]);
+        dq[2] = mul(q[0], h[1]) - mul(q[1], h[2]) + mul(q[3], h[0]);
+        dq[3] = mul(q[0], h[2]) + mul(q[1], h[1]) - mul(q[2], h[0]);
+        norm2 = 0;
+        for (int i = 0; i < 4; i++) {
+                q[i] += dq[i];
+                norm2 += (int64_t)q[i] * q[i];
+        }
+        inv = ((int64_t)1 << 60) / isqrt(norm2);
+        for (int i = 0; i < 4; i++)
+                q[i] = mul(q[i], inv);
+}
+
+/* Q14, what the "orientation" characteristic carries */
+void
+fusion_quaternion(const struct fusion *f, int16_t q[4])
+{
+        for (int i = 0; i < 4; i++)
+                q[i] = f->q[i] >> 16;
+}
@@ -0,0 +1,45 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include <stdint.h>
+
+#include "mpu6500.h"
+
+/*
+ * Mahony orientation filter in fixed point.
+ *
+ * The quaternion is kept in Q30; the accelerometer pulls the estimated
+ * gravity towards the measured one with a proportional and an integral
+ * term, so gyro bias is trimmed out over time.  Gravity says nothing
+ * about the bias around the vertical, so whenever the gyro has held
+ * steady for FUSION_STILL samples the board is taken to be at rest and
+ * its average reading becomes the bias on all three axes.  Heading
+ * still drifts while the board moves, there is no magnetometer, and a
+ * steady turn slower than FUSION_MAX_BIAS is taken for bias.  An update
+ * costs a handful of 64 bit multiplies and two 64 bit divisions.  Feed
+ * it every sample the chip takes, with the chip set to one per
+ * FUSION_PERIOD.
+ */
+
+#define FUSION_PERIOD   10      /* ms between samples, 100 Hz */
+#define FUSION_DLPF     3       /* mpu6500 filter, 41 Hz below the 50 Hz Nyquist */
+#define FUSION_MAX_DT   50      /* ms, longer gaps are taken as this */
+#define FUSION_KP       256     /* proportional gain 1.0, Q8 */
+#define FUSION_KI       655     /* integral gain 0.01, Q16 */
+#define FUSION_STILL    100     /* steady samples before the board is at rest */
+#define FUSION_STEADY   292818  /* rad/s Q24, 1 dps off the average is steady */
+#define FUSION_MAX_BIAS 1464090 /* rad/s Q24, 5 dps, the mpu6500's worst offset */
+
+struct fusion {
+        int32_t q[4];           /* w, x, y, z; Q30 */
+        int32_t bias[3];        /* rad/s, Q24 */
+        int32_t rest[3];        /* the gyro averaged over 32 samples, Q24 */
+        uint16_t still;         /* samples the gyro held steady */
+};
+
+void fusion_reset(struct fusion *f);
+void fusion_update(struct fusion *f, const struct mpu6500_data *d,
+        uint16_t gyro_scale, uint32_t dt);
+void fusion_quaternion(const struct fusion *f, int16_t q[4]);
+
+#endif /* FUSION_H */
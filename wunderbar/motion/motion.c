@@ -1,158 +1,868 @@
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <twi_master.h>
-#include <nrf_delay.h>
 
 #include "simble.h"
 #include "indicator.h"
 #include "batt_serv.h"
 #include "i2c.h"
 #include "rtc.h"
+#include "twi_trace.h"
+#include "sensor.h"
+#include "broadcast.h"
+#include "task.h"
+#include "twi_async.h"
+#include "power.h"
+#include "wunderbar_uuid.h"
 
 #include "mpu6500.h"
+#include "fusion.h"
+#include "fft.h"
+#include "vibration.h"
+#include "shock.h"
+#include "pedometer.h"
+#include "codec.h"
 
-#define DEFAULT_SAMPLING_PERIOD 1000UL
-#define MIN_SAMPLING_PERIOD 250UL
+/* keep every sample at short periods, see notify.h */
+#define MOTION_TX_DEPTH 8
 
-#define NOTIF_TIMER_ID  0
+#define VTIMER_RTC_ID 0
 
+#define MOTION_REQ_INIT   0x1
+#define MOTION_REQ_SAMPLE 0x2
+#define MOTION_REQ_CONFIG 0x4
+#define MOTION_REQ_SLEEP  0x8
+#define MOTION_REQ_FUSE   0x10
+#define MOTION_REQ_VIBRATION 0x20
+#define MOTION_REQ_SHOCK  0x40
+#define MOTION_REQ_STEP   0x80
+/* served by one read of the data registers */
+#define MOTION_REQ_READ   (MOTION_REQ_SAMPLE | MOTION_REQ_FUSE | MOTION_REQ_STEP)
 
-struct motion_ctx {
-        struct service_desc;
-        struct char_desc motion;
-        struct char_desc sampling_period_motion;
-        struct mpu6500_data motion_value;
-        uint32_t sampling_period;
+/* shortest period while "compressed" is on, leaves room for the TWI read */
+#define MOTION_BATCH_MIN_PERIOD 5
+/* below this period the chip stays awake between samples */
+#define MOTION_AWAKE_PERIOD (2 * MPU6500_LATENCY)
+/* ms without a sample before an awake chip goes to sleep */
+#define MOTION_IDLE_TIME (2 * MOTION_AWAKE_PERIOD)
+
+/* vibration blocks of 2^VIBRATION_LOG2 samples, up to FFT_MAX_LOG2 */
+#ifndef VIBRATION_LOG2
+#define VIBRATION_LOG2 8
+#endif
+#define VIBRATION_POINTS (1U << VIBRATION_LOG2)
+#define VIBRATION_RATE_SHIFT_MAX 3
+/* ms between FIFO polls, well before 1 kHz fills it */
+#define VIBRATION_POLL 20
+/* FIFO records per TWI read, 97 bytes at 100 kHz stay inside TWI_ASYNC_TIMEOUT */
+#define VIBRATION_CHUNK 16
+/* ms the bus stays up after a transfer, a fusion period */
+#define MOTION_I2C_LINGER 10
+
+/* "compressed" packets in flight, see notify.h */
+#define CODEC_TX_DEPTH 8
+/* ms between FIFO polls while the shock trigger is armed */
+#define SHOCK_POLL VIBRATION_POLL
+
+/* "motion config", the setup and the scale factors it results in */
+struct motion_config {
+        struct mpu6500_config;
+        uint16_t accel_scale;   /* LSB per g */
+        uint16_t gyro_scale;    /* LSB per dps, times 10 */
+} __attribute__((__packed__));
+
+
+static struct sensor motion_sensor;
+static struct power_domain i2c_power;
+static struct mpu6500_data motion_reading;
+static struct history_block motion_log[HISTORY_RAM_BLOCKS];
+static uint8_t motion_tx[NOTIFY_SLOTS(MOTION_TX_DEPTH, sizeof(motion_reading))];
+
+static struct char_desc motion_config_char;
+static struct motion_config motion_config;
+
+/* "orientation", the fused attitude as a Q14 quaternion w, x, y, z */
+static struct char_desc orientation_char;
+static struct notify_queue orientation_txq;
+static uint8_t orientation_tx[NOTIFY_SLOTS(1, 4 * sizeof(int16_t))];
+static int16_t orientation[4];
+static struct fusion fusion;
+static struct vtimer orientation_timer;
+
+/* "vibration config": axis 0..2 for x, y, z; rate 1 kHz >> rate_shift */
+struct vibration_config {
+        uint8_t axis;
+        uint8_t rate_shift;
+} __attribute__((__packed__));
+
+static struct char_desc vibration_char;
+static struct char_desc vibration_config_char;
+static struct notify_queue vibration_txq;
+static uint8_t vibration_tx[NOTIFY_SLOTS(1, sizeof(struct vibration_report))];
+static struct vibration_config vibration_config = {.axis = 2};
+static struct vibration_report vibration_report;
+static struct vtimer vibration_timer;
+static int16_t vibration_re[VIBRATION_POINTS];
+static int16_t vibration_im[VIBRATION_POINTS];
+
+/* "shock config": threshold in mg, rate 1 kHz >> rate_shift */
+struct shock_config {
+        uint8_t armed;
+        uint8_t rate_shift;
+        uint16_t threshold;
+} __attribute__((__packed__));
+
+static struct char_desc shock_char;
+static struct char_desc shock_config_char;
+static struct char_desc shock_data_char;
+static struct notify_queue shock_txq;
+static uint8_t shock_tx[NOTIFY_SLOTS(1, sizeof(struct shock_event))];
+static struct shock_config shock_config = {.threshold = 2000};
+/* what survives a reset: rate_shift and threshold, not the arming */
+#define SHOCK_CONFIG_SAVED (sizeof(shock_config) - offsetof(struct shock_config, rate_shift))
+static struct shock shock;
+static struct shock_chunk shock_chunk;
+static struct vtimer shock_timer;
+
+/* "steps" and "activity", notified when they change */
+static struct char_desc steps_char;
+static struct char_desc activity_char;
+static struct notify_queue steps_txq;
+static struct notify_queue activity_txq;
+static uint8_t steps_tx[NOTIFY_SLOTS(1, sizeof(uint32_t))];
+static uint8_t activity_tx[NOTIFY_SLOTS(1, sizeof(uint8_t))];
+static struct pedometer pedometer;
+static struct vtimer pedometer_timer;
+static uint8_t pedometer_clients;       /* bit per subscribed characteristic */
+
+/* module settings kept in flash, see sensor_config_add() */
+enum motion_setting {
+        MOTION_CONFIG_VIBRATION,
+        MOTION_CONFIG_SHOCK,
+        MOTION_CONFIG_SETUP,
+        MOTION_CONFIG_ITEMS
 };
 
-static struct motion_ctx motion_ctx;
+static struct config_item motion_saved[MOTION_CONFIG_ITEMS];
+
+/* "compressed", the samples packed by codec.h */
+static struct char_desc compressed_char;
+static struct notify_queue compressed_txq;
+static uint8_t compressed_tx[NOTIFY_SLOTS(CODEC_TX_DEPTH, CODEC_PAYLOAD)];
+static struct codec motion_codec;
+
+static struct motion_job {
+        struct task task;
+        struct task_event twi_done;
+        struct task_event wake; /* a request came in during a capture */
+        struct vtimer idle;
+        struct vtimer fuse;     /* FUSION_PERIOD while "orientation" is on */
+        uint32_t fused;         /* vtimer_now() of the last fusion update */
+        uint8_t fresh;          /* job->data holds a sample not fused yet */
+        uint8_t pending;
+        uint8_t current;        /* requests served by the read in flight */
+        uint8_t raw[MPU6500_STATUS_SIZE];
+        struct mpu6500_data data;
+        uint32_t poll;          /* vtimer_now() of the next FIFO poll */
+        uint16_t count;         /* vibration samples so far */
+        uint8_t avail;          /* FIFO records not read yet */
+        uint8_t chunk;
+        uint8_t ok;
+        uint8_t capturing;      /* the FIFO runs for a vibration block */
+        uint8_t streaming;      /* the FIFO runs for the shock trigger */
+        int16_t accel[3];
+        uint8_t fifo[VIBRATION_CHUNK * MPU6500_FIFO_SAMPLE];
+} motion_job;
+
+/* sleep after a read unless more reads follow soon */
+static void
+motion_rest(struct motion_job *job)
+{
+        if (job->streaming || job->capturing)
+                return;
+        if (orientation_timer.armed || pedometer_timer.armed ||
+            sensor_period(&motion_sensor) < MOTION_AWAKE_PERIOD) {
+                job->pending &= ~MOTION_REQ_SLEEP;
+                vtimer_start(&job->idle, MOTION_IDLE_TIME, 0);
+        } else {
+                mpu6500_stop();
+        }
+}
+
+/* the client's setup, at the fusion rate while "orientation" is on */
+static void
+motion_setup(void)
+{
+        struct mpu6500_config config;
+
+        memcpy(&config, &motion_config, sizeof(config));
+        if (motion_job.fuse.armed) {
+                config.rate_div = FUSION_PERIOD - 1;
+                config.dlpf = FUSION_DLPF;
+        }
+        mpu6500_set_config(&config);
+}
+
+static uint16_t
+vibration_rate(void)
+{
+        return 1000 >> vibration_config.rate_shift;
+}
+
+/* FIFO at 1 kHz >> rate_shift, filtered below the Nyquist frequency */
+static void
+motion_fifo_setup(uint8_t rate_shift)
+{
+        struct mpu6500_config config;
+
+        memcpy(&config, &motion_config, sizeof(config));
+        config.rate_div = (1 << rate_shift) - 1;
+        config.dlpf = 1 + rate_shift;
+        mpu6500_set_config(&config);
+        mpu6500_fifo_start();
+}
+
+static enum task_status
+motion_task(struct task *t)
+{
+        struct motion_job *job = &motion_job;
+        int32_t remaining;
+        bool ok;
+
+        TASK_BEGIN(t);
+        TASK_POWER_GET(t, &i2c_power);
+        if (job->pending & MOTION_REQ_INIT) {
+                job->pending &= ~MOTION_REQ_INIT;
+                mpu6500_reset();
+                do {
+                        TASK_SLEEP(t, MPU6500_RESET_POLL);
+                } while (!mpu6500_reset_done());
+                mpu6500_configure();
+                motion_setup();
+                mpu6500_stop();
+        }
+        /*
+         * One pass per request, reads first.  A vibration capture waits
+         * for its FIFO polls on job->wake, so samples, fusion updates and
+         * steps due in between are still read on time.
+         */
+        for (;;) {
+                if (job->pending & MOTION_REQ_CONFIG) {
+                        job->pending &= ~MOTION_REQ_CONFIG;
+                        /* a running capture keeps its rate until it ends */
+                        if (!job->streaming && !job->capturing)
+                                motion_setup();
+                }
+                /* a sample, a fusion update and a step due together share one read */
+                if (job->pending & MOTION_REQ_READ) {
+                        job->current = job->pending & MOTION_REQ_READ;
+                        job->pending &= ~job->current;
+                        if (mpu6500_start())
+                                TASK_SLEEP(t, MPU6500_WAKEUP_TIME / 1000);
+                        mpu6500_select_status();
+                        TASK_AWAIT_TWI(t, &job->twi_done, MPU6500_ADDRESS | TWI_READ_BIT,
+                                job->raw, sizeof(job->raw), TWI_ISSUE_STOP);
+                        ok = twi_async_result();
+                        if (ok) {
+                                mpu6500_decode_data(&job->raw[1], &job->data);
+                                if (job->raw[0] & MPU6500_DATA_READY)
+                                        job->fresh = 1;
+                        }
+                        /*
+                         * Fuse each sample of the chip once, over the whole
+                         * sample periods since the last one; a poll that
+                         * finds no new sample leaves the filter alone.
+                         */
+                        if (ok && (job->current & MOTION_REQ_FUSE) && job->fresh) {
+                                uint32_t now = vtimer_now();
+                                uint32_t n = (now - job->fused + FUSION_PERIOD / 2) / FUSION_PERIOD;
+
+                                fusion_update(&fusion, &job->data,
+                                        mpu6500_gyro_scale(motion_config.gyro_fs),
+                                        (n != 0 ? n : 1) * FUSION_PERIOD);
+                                job->fused = now;
+                                job->fresh = 0;
+                        }
+                        if (ok && (job->current & MOTION_REQ_STEP)) {
+                                int16_t accel[3] = {job->data.accel_x, job->data.accel_y, job->data.accel_z};
+                                uint8_t changed;
 
+                                changed = pedometer_add(&pedometer, accel,
+                                        mpu6500_accel_scale(motion_config.accel_fs), vtimer_now());
+                                if (changed & PEDOMETER_STEPS)
+                                        notify_send(&steps_txq, &pedometer.steps, sizeof(pedometer.steps));
+                                if (changed & PEDOMETER_ACTIVITY)
+                                        notify_send(&activity_txq, &pedometer.activity,
+                                                sizeof(pedometer.activity));
+                        }
+                        motion_rest(job);
+                        if (job->current & MOTION_REQ_SAMPLE) {
+                                if (ok)
+                                        motion_reading = job->data;
+                                sensor_ready(&motion_sensor, ok);
+                        }
+                        continue;
+                }
+                if (job->capturing) {
+                        remaining = job->poll - vtimer_now();
+                        if (remaining > 0) {
+                                TASK_AWAIT(t, &job->wake, remaining);
+                                continue;
+                        }
+                        job->poll += VIBRATION_POLL;
+                        job->avail = mpu6500_fifo_count() / MPU6500_FIFO_SAMPLE;
+                        if (job->avail >= MPU6500_FIFO_SIZE / MPU6500_FIFO_SAMPLE) {
+                                /* overrun, the block would have a gap */
+                                mpu6500_fifo_start();
+                                job->poll = vtimer_now() + VIBRATION_POLL;
+                                job->count = 0;
+                                continue;
+                        }
+                        while (job->ok && job->avail != 0 && job->count < VIBRATION_POINTS) {
+                                job->chunk = job->avail < VIBRATION_CHUNK ? job->avail : VIBRATION_CHUNK;
+                                if (job->chunk > VIBRATION_POINTS - job->count)
+                                        job->chunk = VIBRATION_POINTS - job->count;
+                                mpu6500_select_fifo();
+                                TASK_AWAIT_TWI(t, &job->twi_done, MPU6500_ADDRESS | TWI_READ_BIT,
+                                        job->fifo, job->chunk * MPU6500_FIFO_SAMPLE, TWI_ISSUE_STOP);
+                                job->ok = twi_async_result();
+                                mpu6500_decode_fifo(job->fifo, job->chunk,
+                                        vibration_config.axis, &vibration_re[job->count]);
+                                job->count += job->chunk;
+                                job->avail -= job->chunk;
+                        }
+                        if (job->ok && job->count < VIBRATION_POINTS)
+                                continue;
+                        job->capturing = 0;
+                        mpu6500_fifo_stop();
+                        motion_setup();
+                        motion_rest(job);
+                        if (job->ok) {
+                                vibration_analyse(vibration_re, vibration_im, VIBRATION_LOG2,
+                                        vibration_rate(), mpu6500_accel_scale(motion_config.accel_fs),
+                                        &vibration_report);
+                                notify_send(&vibration_txq, &vibration_report, sizeof(vibration_report));
+                        }
+                        continue;
+                }
+                /* the FIFO serves one of them; an armed shock trigger wins */
+                if (job->streaming)
+                        job->pending &= ~MOTION_REQ_VIBRATION;
+                if (job->pending & MOTION_REQ_VIBRATION) {
+                        job->pending &= ~MOTION_REQ_VIBRATION;
+                        if (mpu6500_start())
+                                TASK_SLEEP(t, MPU6500_WAKEUP_TIME / 1000);
+                        motion_fifo_setup(vibration_config.rate_shift);
+                        task_event_clear(&job->wake);
+                        job->poll = vtimer_now() + VIBRATION_POLL;
+                        job->count = 0;
+                        job->ok = 1;
+                        job->capturing = 1;
+                        continue;
+                }
+                if (job->pending & MOTION_REQ_SHOCK) {
+                        job->pending &= ~MOTION_REQ_SHOCK;
+                        if (shock_recording(&shock) && !job->streaming) {
+                                if (mpu6500_start())
+                                        TASK_SLEEP(t, MPU6500_WAKEUP_TIME / 1000);
+                                motion_fifo_setup(shock_config.rate_shift);
+                                job->streaming = 1;
+                        }
+                        job->avail = 0;
+                        if (job->streaming)
+                                job->avail = mpu6500_fifo_count() / MPU6500_FIFO_SAMPLE;
+                        if (job->avail >= MPU6500_FIFO_SIZE / MPU6500_FIFO_SAMPLE) {
+                                /* overrun, samples were lost */
+                                mpu6500_fifo_start();
+                                shock_gap(&shock);
+                                job->avail = 0;
+                        }
+                        while (job->avail != 0 && shock_recording(&shock)) {
+                                job->chunk = job->avail < VIBRATION_CHUNK ? job->avail : VIBRATION_CHUNK;
+                                mpu6500_select_fifo();
+                                TASK_AWAIT_TWI(t, &job->twi_done, MPU6500_ADDRESS | TWI_READ_BIT,
+                                        job->fifo, job->chunk * MPU6500_FIFO_SAMPLE, TWI_ISSUE_STOP);
+                                if (!twi_async_result())
+                                        break;
+                                for (uint8_t i = 0; i < job->chunk; i++) {
+                                        const uint8_t *rec = &job->fifo[i * MPU6500_FIFO_SAMPLE];
+
+                                        for (uint8_t axis = 0; axis < 3; axis++)
+                                                mpu6500_decode_fifo(rec, 1, axis, &job->accel[axis]);
+                                        if (!shock_add(&shock, job->accel, vtimer_now()))
+                                                continue;
+                                        if (shock.event.state == SHOCK_CAPTURED)
+                                                shock_finish(&shock,
+                                                        mpu6500_accel_scale(motion_config.accel_fs));
+                                        notify_send(&shock_txq, &shock.event, sizeof(shock.event));
+                                }
+                                job->avail -= job->chunk;
+                        }
+                        if (!shock_recording(&shock) && job->streaming) {
+                                vtimer_stop(&shock_timer);
+                                mpu6500_fifo_stop();
+                                motion_setup();
+                                job->streaming = 0;
+                                motion_rest(job);
+                        }
+                        continue;
+                }
+                break;
+        }
+        if (job->pending & MOTION_REQ_SLEEP) {
+                job->pending &= ~MOTION_REQ_SLEEP;
+                if (!job->streaming)
+                        mpu6500_stop();
+        }
+        power_put(&i2c_power);
+        TASK_END(t);
+}
 
 static void
-motion_update(struct motion_ctx *ctx, struct mpu6500_data *val)
+i2c_power_set(bool on)
 {
-        simble_srv_char_update(&ctx->motion, val);
+        if (on)
+                enable_i2c();
+        else
+                disable_i2c();
 }
 
 static void
-motion_disconnected(struct service_desc *s)
+motion_request(uint8_t req)
 {
-        rtc_update_cfg(motion_ctx.sampling_period, (uint8_t)NOTIF_TIMER_ID, false);
+        uint8_t nested;
+
+        sd_nvic_critical_region_enter(&nested);
+        motion_job.pending |= req;
+        sd_nvic_critical_region_exit(nested);
+        task_event_signal(&motion_job.wake);
+        task_kick(&motion_job.task, motion_task);
 }
 
 static void
-motion_read(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+motion_idle_cb(struct vtimer *t)
 {
-        struct motion_ctx *ctx = (void *)s;
+        motion_request(MOTION_REQ_SLEEP);
+}
 
-        enable_i2c();
-        mpu6500_start();
-        nrf_delay_us(MPU6500_WAKEUP_TIME);
-        mpu6500_read_data(&ctx->motion_value);
-        mpu6500_stop();
-        disable_i2c();
-        *lenp = sizeof(ctx->motion_value);
-        *valp = &ctx->motion_value;
+static void
+motion_acquire(struct sensor *s)
+{
+        motion_request(MOTION_REQ_SAMPLE);
+}
+
+static void
+motion_deliver(struct sensor *s)
+{
+        broadcast_update(&motion_reading, sizeof(motion_reading));
+        if (s->bulk)
+                codec_add(&motion_codec, &motion_reading);
+}
+
+static void
+compressed_send(const void *packet, uint8_t len)
+{
+        notify_send(&compressed_txq, packet, len);
 }
 
+/* samples at MOTION_BATCH_MIN_PERIOD, packed instead of one per value */
 static void
-sampling_period_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+compressed_status_cb(struct service_desc *s, struct char_desc *c, const int8_t status)
 {
-	struct motion_ctx *ctx = (struct motion_ctx *)s;
-	*valp = &ctx->sampling_period;
-	*lenp = sizeof(ctx->sampling_period);
+        if (status & BLE_GATT_HVX_NOTIFICATION) {
+                codec_init(&motion_codec, compressed_send);
+                motion_sensor.bulk = 1;
+        } else {
+                motion_sensor.bulk = 0;
+                notify_reset(&compressed_txq);
+        }
+        sensor_status_cb(s, c, status);
 }
 
 static void
-sampling_period_write_cb(struct service_desc *s, struct char_desc *c,
+motion_fuse_cb(struct vtimer *t)
+{
+        motion_request(MOTION_REQ_FUSE);
+}
+
+static void
+orientation_publish_cb(struct vtimer *t)
+{
+        fusion_quaternion(&fusion, orientation);
+        notify_send(&orientation_txq, orientation, sizeof(orientation));
+}
+
+static void
+orientation_stop(void)
+{
+        vtimer_stop(&orientation_timer);
+        if (motion_job.fuse.armed) {
+                vtimer_stop(&motion_job.fuse);
+                motion_request(MOTION_REQ_CONFIG);
+        }
+        notify_reset(&orientation_txq);
+}
+
+static void
+orientation_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+        fusion_quaternion(&fusion, orientation);
+        *valp = orientation;
+        *lenp = sizeof(orientation);
+}
+
+/*
+ * The chip samples at FUSION_PERIOD and the filter takes every sample;
+ * the attitude goes out at the client's "sampling period".
+ */
+static void
+orientation_status_cb(struct service_desc *s, struct char_desc *c, const int8_t status)
+{
+        if (status & BLE_GATT_HVX_NOTIFICATION) {
+                fusion_reset(&fusion);
+                motion_job.fused = vtimer_now();
+                motion_job.fresh = 0;
+                vtimer_start(&motion_job.fuse, FUSION_PERIOD, FUSION_PERIOD);
+                motion_request(MOTION_REQ_CONFIG);
+                vtimer_start(&orientation_timer, sensor_period(&motion_sensor),
+                        sensor_period(&motion_sensor));
+        } else {
+                orientation_stop();
+        }
+}
+
+static void
+vibration_cb(struct vtimer *t)
+{
+        motion_request(MOTION_REQ_VIBRATION);
+}
+
+static void
+vibration_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+        *valp = &vibration_report;
+        *lenp = sizeof(vibration_report);
+}
+
+/* a block every sampling period, or back to back if it takes longer */
+static void
+vibration_status_cb(struct service_desc *s, struct char_desc *c, const int8_t status)
+{
+        if (status & BLE_GATT_HVX_NOTIFICATION) {
+                vtimer_start(&vibration_timer, 0, sensor_period(&motion_sensor));
+        } else {
+                vtimer_stop(&vibration_timer);
+                notify_reset(&vibration_txq);
+        }
+}
+
+static void
+vibration_config_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+        *valp = &vibration_config;
+        *lenp = sizeof(vibration_config);
+}
+
+static void
+vibration_config_write_cb(struct service_desc *s, struct char_desc *c,
         const void *val, const uint16_t len)
 {
-	struct motion_ctx *ctx = (struct motion_ctx *)s;
+        struct vibration_config config;
 
-        if (*(uint32_t*)val > MIN_SAMPLING_PERIOD)
-                ctx->sampling_period = *(uint32_t*)val;
-        else
-                ctx->sampling_period = MIN_SAMPLING_PERIOD;
-        rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID, true);
+        if (len < sizeof(config))
+                return;
+        memcpy(&config, val, sizeof(config));
+        if (config.axis > 2 || config.rate_shift > VIBRATION_RATE_SHIFT_MAX)
+                return;
+        vibration_config = config;
+        config_changed();
 }
 
-void
-motion_notify_status_cb(struct service_desc *s, struct char_desc *c, const int8_t status)
+static void
+shock_poll_cb(struct vtimer *t)
+{
+        motion_request(MOTION_REQ_SHOCK);
+}
+
+static void
+shock_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+        *valp = &shock.event;
+        *lenp = sizeof(shock.event);
+}
+
+static void
+shock_status_cb(struct service_desc *s, struct char_desc *c, const int8_t status)
 {
-        struct motion_ctx *ctx = (struct motion_ctx *)s;
+        if (!(status & BLE_GATT_HVX_NOTIFICATION))
+                notify_reset(&shock_txq);
+}
 
-        if (status & BLE_GATT_HVX_NOTIFICATION)
-                rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID, true);
-        else     //disable NOTIFICATION_TIMER
-                rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID, false);
+static void
+shock_data_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+        shock_read(&shock, &shock_chunk);
+        *valp = &shock_chunk;
+        *lenp = sizeof(shock_chunk);
 }
 
 static void
-motion_init(struct motion_ctx *ctx)
+shock_config_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
 {
-        simble_srv_init(ctx, simble_get_vendor_uuid_class(), VENDOR_UUID_SENSOR_SERVICE);
-        simble_srv_char_add(ctx, &ctx->motion,
-                     simble_get_vendor_uuid_class(), VENDOR_UUID_MOTION_CHAR,
-                     u8"Motion",
-                     sizeof(ctx->motion_value));
-        simble_srv_char_add(ctx, &ctx->sampling_period_motion,
-                     simble_get_vendor_uuid_class(), VENDOR_UUID_SAMPLING_PERIOD_CHAR,
-                     u8"sampling period",
-                     sizeof(ctx->sampling_period)); // size in bytes
-        // Resolution: 1ms, max value: 16777216 (4 hours)
-        // A value of 0 will disable periodic notifications
-        simble_srv_char_attach_format(&ctx->sampling_period_motion,
-	             BLE_GATT_CPF_FORMAT_UINT24, 0, ORG_BLUETOOTH_UNIT_UNITLESS);
-        /* srv_char_attach_format(&ctx->motion, */
-        /*                        BLE_GATT_CPF_FORMAT_UINT16, */
-        /*                        0, */
-        /*                        0); */
-        ctx->disconnect_cb = motion_disconnected;
-        ctx->motion.read_cb = motion_read;
-        ctx->motion.notify = 1;
-        ctx->motion.notify_status_cb = motion_notify_status_cb;
-        ctx->sampling_period_motion.read_cb = sampling_period_read_cb;
-	ctx->sampling_period_motion.write_cb = sampling_period_write_cb;
-        simble_srv_register(ctx);
+        shock_config.armed = shock_recording(&shock);
+        *valp = &shock_config;
+        *lenp = sizeof(shock_config);
 }
 
+/* arming starts a new capture and drops the last window */
 static void
-notif_timer_cb(struct rtc_ctx *ctx)
+shock_config_write_cb(struct service_desc *s, struct char_desc *c,
+        const void *val, const uint16_t len)
 {
-        void *val = &motion_ctx.motion_value;
-	uint16_t len = sizeof(motion_ctx.motion_value);
-        motion_read(&motion_ctx, &motion_ctx.motion, &val, &len);
-        simble_srv_char_notify(&motion_ctx.motion, false, len,
-                &motion_ctx.motion_value);
+        struct shock_config config;
+
+        if (len < sizeof(config))
+                return;
+        memcpy(&config, val, sizeof(config));
+        if (config.rate_shift > VIBRATION_RATE_SHIFT_MAX)
+                return;
+        shock_config = config;
+        config_changed();
+        if (config.armed) {
+                shock_arm(&shock, (uint32_t)config.threshold *
+                        mpu6500_accel_scale(motion_config.accel_fs) / 1000,
+                        1000 >> config.rate_shift);
+                vtimer_start(&shock_timer, 0, SHOCK_POLL);
+        } else {
+                shock_disarm(&shock);
+        }
+        motion_request(MOTION_REQ_SHOCK);
 }
 
+static void
+pedometer_cb(struct vtimer *t)
+{
+        motion_request(MOTION_REQ_STEP);
+}
+
+static void
+steps_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+        *valp = &pedometer.steps;
+        *lenp = sizeof(pedometer.steps);
+}
+
+static void
+activity_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+        *valp = &pedometer.activity;
+        *lenp = sizeof(pedometer.activity);
+}
+
+/* counts while either is subscribed */
+static void
+pedometer_status_cb(struct service_desc *s, struct char_desc *c, const int8_t status)
+{
+        uint8_t bit = c == &steps_char ? 0x1 : 0x2;
+
+        if (status & BLE_GATT_HVX_NOTIFICATION) {
+                if (pedometer_clients == 0) {
+                        pedometer_reset(&pedometer, vtimer_now());
+                        vtimer_start(&pedometer_timer, PEDOMETER_PERIOD, PEDOMETER_PERIOD);
+                }
+                pedometer_clients |= bit;
+        } else {
+                notify_reset(bit == 0x1 ? &steps_txq : &activity_txq);
+                pedometer_clients &= ~bit;
+                if (pedometer_clients == 0)
+                        vtimer_stop(&pedometer_timer);
+        }
+}
+
+/*
+ * An armed trigger stays armed, the window waits for a download; the
+ * pedometer keeps counting for the next connection.
+ */
+static void
+motion_disconnect(struct sensor *s)
+{
+        orientation_stop();
+        motion_sensor.bulk = 0;
+        notify_reset(&compressed_txq);
+        vtimer_stop(&vibration_timer);
+        notify_reset(&vibration_txq);
+}
+
+static void
+motion_config_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
+{
+        motion_config.accel_scale = mpu6500_accel_scale(motion_config.accel_fs);
+        motion_config.gyro_scale = mpu6500_gyro_scale(motion_config.gyro_fs);
+        *valp = &motion_config;
+        *lenp = sizeof(motion_config);
+}
+
+static void
+motion_config_write_cb(struct service_desc *s, struct char_desc *c,
+        const void *val, const uint16_t len)
+{
+        struct mpu6500_config config;
+
+        if (len < sizeof(config))
+                return;
+        memcpy(&config, val, sizeof(config));
+        if (config.dlpf > MPU6500_DLPF_MAX || config.accel_fs > MPU6500_FS_MAX ||
+            config.gyro_fs > MPU6500_FS_MAX)
+                return;
+        memcpy(&motion_config, &config, sizeof(config));
+        motion_request(MOTION_REQ_CONFIG);
+        config_changed();
+}
+
+static void
+motion_char_add(struct sensor *s)
+{
+        simble_srv_char_add(s, &motion_config_char,
+                simble_get_vendor_uuid_class(), VENDOR_UUID_MOTION_CONFIG_CHAR,
+                u8"motion config",
+                sizeof(motion_config));
+        motion_config_char.read_cb = motion_config_read_cb;
+        motion_config_char.write_cb = motion_config_write_cb;
+        simble_srv_char_add(s, &orientation_char,
+                simble_get_vendor_uuid_class(), VENDOR_UUID_ORIENTATION_CHAR,
+                u8"orientation",
+                sizeof(orientation));
+        orientation_char.read_cb = orientation_read_cb;
+        orientation_char.notify = 1;
+        orientation_char.notify_status_cb = orientation_status_cb;
+        notify_init(&orientation_txq, &orientation_char, orientation_tx, 1,
+                sizeof(orientation), NOTIFY_NEWEST);
+        simble_srv_char_add(s, &vibration_char,
+                simble_get_vendor_uuid_class(), VENDOR_UUID_VIBRATION_CHAR,
+                u8"vibration",
+                sizeof(vibration_report));
+        vibration_char.read_cb = vibration_read_cb;
+        vibration_char.notify = 1;
+        vibration_char.notify_status_cb = vibration_status_cb;
+        notify_init(&vibration_txq, &vibration_char, vibration_tx, 1,
+                sizeof(vibration_report), NOTIFY_NEWEST);
+        simble_srv_char_add(s, &vibration_config_char,
+                simble_get_vendor_uuid_class(), VENDOR_UUID_VIBRATION_CONFIG_CHAR,
+                u8"vibration config",
+                sizeof(vibration_config));
+        vibration_config_char.read_cb = vibration_config_read_cb;
+        vibration_config_char.write_cb = vibration_config_write_cb;
+        simble_srv_char_add(s, &shock_char,
+                simble_get_vendor_uuid_class(), VENDOR_UUID_SHOCK_CHAR,
+                u8"shock",
+                sizeof(shock.event));
+        shock_char.read_cb = shock_read_cb;
+        shock_char.notify = 1;
+        shock_char.notify_status_cb = shock_status_cb;
+        notify_init(&shock_txq, &shock_char, shock_tx, 1,
+                sizeof(shock.event), NOTIFY_NEWEST);
+        simble_srv_char_add(s, &shock_config_char,
+                simble_get_vendor_uuid_class(), VENDOR_UUID_SHOCK_CONFIG_CHAR,
+                u8"shock config",
+                sizeof(shock_config));
+        shock_config_char.read_cb = shock_config_read_cb;
+        shock_config_char.write_cb = shock_config_write_cb;
+        simble_srv_char_add(s, &shock_data_char,
+                simble_get_vendor_uuid_class(), VENDOR_UUID_SHOCK_DATA_CHAR,
+                u8"shock data",
+                sizeof(shock_chunk));
+        shock_data_char.read_cb = shock_data_read_cb;
+        simble_srv_char_add(s, &steps_char,
+                simble_get_vendor_uuid_class(), VENDOR_UUID_STEPS_CHAR,
+                u8"steps",
+                sizeof(pedometer.steps));
+        simble_srv_char_attach_format(&steps_char,
+                BLE_GATT_CPF_FORMAT_UINT32, 0, ORG_BLUETOOTH_UNIT_UNITLESS);
+        steps_char.read_cb = steps_read_cb;
+        steps_char.notify = 1;
+        steps_char.notify_status_cb = pedometer_status_cb;
+        notify_init(&steps_txq, &steps_char, steps_tx, 1,
+                sizeof(pedometer.steps), NOTIFY_NEWEST);
+        simble_srv_char_add(s, &activity_char,
+                simble_get_vendor_uuid_class(), VENDOR_UUID_ACTIVITY_CHAR,
+                u8"activity",
+                sizeof(pedometer.activity));
+        activity_char.read_cb = activity_read_cb;
+        activity_char.notify = 1;
+        activity_char.notify_status_cb = pedometer_status_cb;
+        notify_init(&activity_txq, &activity_char, activity_tx, 1,
+                sizeof(pedometer.activity), NOTIFY_NEWEST);
+        simble_srv_char_add(s, &compressed_char,
+                simble_get_vendor_uuid_class(), VENDOR_UUID_COMPRESSED_CHAR,
+                u8"compressed",
+                CODEC_PAYLOAD);
+        compressed_char.notify = 1;
+        compressed_char.notify_status_cb = compressed_status_cb;
+        notify_init(&compressed_txq, &compressed_char, compressed_tx, CODEC_TX_DEPTH,
+                CODEC_PAYLOAD, NOTIFY_ALL);
+        sensor_config_add(s, &motion_saved[MOTION_CONFIG_VIBRATION], MOTION_CONFIG_VIBRATION,
+                &vibration_config, sizeof(vibration_config));
+        sensor_config_add(s, &motion_saved[MOTION_CONFIG_SHOCK], MOTION_CONFIG_SHOCK,
+                &shock_config.rate_shift, SHOCK_CONFIG_SAVED);
+        /* the scale factors follow from it on reads */
+        sensor_config_add(s, &motion_saved[MOTION_CONFIG_SETUP], MOTION_CONFIG_SETUP,
+                &motion_config, sizeof(struct mpu6500_config));
+}
+
+static const struct sensor_desc motion_desc = {
+        .service_uuid = VENDOR_UUID_SENSOR_SERVICE,
+        .char_uuid = VENDOR_UUID_MOTION_CHAR,
+        .name = u8"Motion",
+        .value = &motion_reading,
+        .size = sizeof(motion_reading),
+        .width = 2,
+        .is_signed = 1,
+        .latency = MPU6500_LATENCY,
+        .batch_min_period = MOTION_BATCH_MIN_PERIOD,
+        .flags = SENSOR_BROADCAST_CHAR | SENSOR_POWER_CHAR | SENSOR_CONN_CHAR,
+        .tx_depth = MOTION_TX_DEPTH,
+        .tx_slots = motion_tx,
+        .log = motion_log,
+        .flash_first = 0,
+        .flash_pages = FLASH_HISTORY_PAGES,
+        .acquire = motion_acquire,
+        .deliver = motion_deliver,
+        .char_add = motion_char_add,
+        .disconnect = motion_disconnect,
+};
+
 void
 main(void)
 {
         twi_master_init();
-        mpu6500_init();
-        mpu6500_stop();
-        disable_i2c();
+        power_init(&i2c_power, i2c_power_set, 0, MOTION_I2C_LINGER);
 
         simble_init("Motion");
+        broadcast_init("Motion", BROADCAST_MOTION, sensor_broadcast_cb);
+        task_init();
 
-        motion_ctx.sampling_period = DEFAULT_SAMPLING_PERIOD;
         //Set the timer parameters and initialize it.
         struct rtc_ctx rtc_ctx = {
-                .rtc_x[NOTIF_TIMER_ID] = {
-                        .type = PERIODIC,
-                        .period = motion_ctx.sampling_period,
-                        .enabled = false,
-                        .cb = notif_timer_cb,
-                }
+                .rtc_x[VTIMER_RTC_ID] = VTIMER_RTC_SLOT,
         };
+        vtimer_init(VTIMER_RTC_ID);
         batt_serv_init(&rtc_ctx);
         rtc_init(&rtc_ctx);
 
         ind_init();
-        motion_init(&motion_ctx);
-        simble_adv_start();
+        motion_job.idle.cb = motion_idle_cb;
+        motion_job.fuse.cb = motion_fuse_cb;
+        orientation_timer.cb = orientation_publish_cb;
+        vibration_timer.cb = vibration_cb;
+        shock_timer.cb = shock_poll_cb;
+        pedometer_timer.cb = pedometer_cb;
+        fusion_reset(&fusion);
+        sensor_init(&motion_sensor, &motion_desc);
+        twi_trace_init();
+        motion_request(MOTION_REQ_INIT);
+        broadcast_start();
 
         simble_process_event_loop();
 }
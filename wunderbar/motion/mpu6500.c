@@ -1,21 +1,33 @@
 #include <sys/types.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
 #include <twi_master.h>
+#include "twi_trace.h"
 
 #include "util.h"
 #include "mpu6500.h"
 
 
-#define MPU6500 0xd0
+#define MPU6500 MPU6500_ADDRESS
 
 enum mpu6500_reg_addr {
+        MPU6500_SMPLRT_DIV = 25,
+        MPU6500_CONFIG = 26,
+        MPU6500_GYRO_CONFIG = 27,
+        MPU6500_ACCEL_CONFIG = 28,
+        MPU6500_ACCEL_CONFIG2 = 29,
+        MPU6500_FIFO_EN = 35,
+        MPU6500_INT_ENABLE = 56,
         MPU6500_INT_STATUS = 58,
         MPU6500_ACCEL_XOUT = 59,
+        MPU6500_USER_CTRL = 106,
         MPU6500_PWR_MGMT_1 = 107,
         MPU6500_PWR_MGMT_2 = 108,
         MPU6500_INT_PIN_CFG = 55,
+        MPU6500_FIFO_COUNT = 114,
+        MPU6500_FIFO_R_W = 116,
 };
 
 static void
@@ -27,18 +39,47 @@ mpu6500_write_register(enum mpu6500_reg_addr addr, uint8_t *data, size_t len)
         twi_master_transfer(MPU6500, pkt, sizeof(pkt), TWI_ISSUE_STOP);
 }
 
+/*
+ * What the sampling setup registers hold, so that writing an unchanged
+ * setup costs no TWI transfers.  A reset zeroes them on the chip.
+ */
+static struct {
+        uint8_t valid;
+        uint8_t awake;
+        uint8_t reg[MPU6500_ACCEL_CONFIG2 - MPU6500_SMPLRT_DIV + 1];
+} shadow;
+
+static void
+mpu6500_write_cached(enum mpu6500_reg_addr addr, uint8_t val)
+{
+        uint8_t *cached = &shadow.reg[addr - MPU6500_SMPLRT_DIV];
+
+        if (shadow.valid && *cached == val)
+                return;
+        mpu6500_write_register(addr, &val, sizeof(val));
+        *cached = val;
+}
+
 static void
 mpu6500_read_register(enum mpu6500_reg_addr addr, uint8_t *data, size_t len)
 {
-        twi_master_transfer(MPU6500, &addr, sizeof(addr), TWI_DONT_ISSUE_STOP);
+        uint8_t reg = addr;
+
+        twi_master_transfer(MPU6500, &reg, sizeof(reg), TWI_DONT_ISSUE_STOP);
         twi_master_transfer(MPU6500 | TWI_READ_BIT, data, len, TWI_ISSUE_STOP);
 }
 
-void
+/* true if the chip was asleep and needs MPU6500_WAKEUP_TIME */
+bool
 mpu6500_start(void)
 {
         uint8_t val[] = {0x09};
+
+        if (shadow.awake)
+                return false;
         mpu6500_write_register(MPU6500_PWR_MGMT_1, val, sizeof(val));
+        shadow.awake = 1;
+        return true;
 }
 
 void
@@ -46,30 +87,151 @@ mpu6500_stop(void)
 {
         uint8_t val[] = {0x49};
         mpu6500_write_register(MPU6500_PWR_MGMT_1, val, sizeof(val));
+        shadow.awake = 0;
 }
 
 void
-mpu6500_init(void)
+mpu6500_reset(void)
 {
         uint8_t val[] = {0x80};
+        shadow.valid = 0;
+        shadow.awake = 0;
         mpu6500_write_register(MPU6500_PWR_MGMT_1, val, sizeof(val));
+}
 
-        while (val[0] & 0x80) {
-                mpu6500_read_register(MPU6500_PWR_MGMT_1, val, sizeof(val));
-        }
+bool
+mpu6500_reset_done(void)
+{
+        uint8_t val[] = {0x80};
+        mpu6500_read_register(MPU6500_PWR_MGMT_1, val, sizeof(val));
+        if (val[0] & 0x80)
+                return false;
+        memset(shadow.reg, 0, sizeof(shadow.reg));
+        shadow.valid = 1;
+        return true;
+}
+
+void
+mpu6500_configure(void)
+{
         //Otherwise, int pin drains 300µa
-        mpu6500_write_register(MPU6500_INT_PIN_CFG, 0x80, 1);
+        uint8_t val[] = {0x80};
+        /* raw data ready, for MPU6500_DATA_READY; the pin pulses 50 us */
+        uint8_t ready[] = {0x01};
+        mpu6500_write_register(MPU6500_INT_PIN_CFG, val, sizeof(val));
+        mpu6500_write_register(MPU6500_INT_ENABLE, ready, sizeof(ready));
 }
 
 void
-mpu6500_read_data(struct mpu6500_data *outdata)
+mpu6500_init(void)
+{
+        mpu6500_reset();
+        while (!mpu6500_reset_done())
+                ;
+        mpu6500_configure();
+}
+
+void
+mpu6500_set_config(const struct mpu6500_config *config)
+{
+        mpu6500_write_cached(MPU6500_SMPLRT_DIV, config->rate_div);
+        mpu6500_write_cached(MPU6500_CONFIG, config->dlpf);
+        mpu6500_write_cached(MPU6500_GYRO_CONFIG, config->gyro_fs << 3);
+        mpu6500_write_cached(MPU6500_ACCEL_CONFIG, config->accel_fs << 3);
+        mpu6500_write_cached(MPU6500_ACCEL_CONFIG2, config->dlpf);
+}
+
+/* LSB per g */
+uint16_t
+mpu6500_accel_scale(uint8_t accel_fs)
+{
+        return 16384 >> accel_fs;
+}
+
+/* LSB per dps, times 10 */
+uint16_t
+mpu6500_gyro_scale(uint8_t gyro_fs)
+{
+        static const uint16_t scale[] = {1310, 655, 328, 164};
+        return scale[gyro_fs];
+}
+
+void
+mpu6500_select_data(void)
+{
+        uint8_t addr = MPU6500_ACCEL_XOUT;
+        twi_master_transfer(MPU6500, &addr, sizeof(addr), TWI_DONT_ISSUE_STOP);
+}
+
+/*
+ * The data burst behind INT_STATUS, MPU6500_STATUS_SIZE bytes.  Reading
+ * the status clears it, so MPU6500_DATA_READY tells a new sample from
+ * one read before.
+ */
+void
+mpu6500_select_status(void)
+{
+        uint8_t addr = MPU6500_INT_STATUS;
+        twi_master_transfer(MPU6500, &addr, sizeof(addr), TWI_DONT_ISSUE_STOP);
+}
+
+/* accel samples only, from an empty FIFO */
+void
+mpu6500_fifo_start(void)
+{
+        uint8_t reset[] = {0x04};
+        uint8_t accel[] = {0x08};
+        uint8_t enable[] = {0x40};
+
+        mpu6500_write_register(MPU6500_USER_CTRL, reset, sizeof(reset));
+        mpu6500_write_register(MPU6500_FIFO_EN, accel, sizeof(accel));
+        mpu6500_write_register(MPU6500_USER_CTRL, enable, sizeof(enable));
+}
+
+void
+mpu6500_fifo_stop(void)
+{
+        uint8_t off[] = {0x00};
+        uint8_t reset[] = {0x04};
+
+        mpu6500_write_register(MPU6500_FIFO_EN, off, sizeof(off));
+        mpu6500_write_register(MPU6500_USER_CTRL, reset, sizeof(reset));
+}
+
+/* bytes waiting */
+uint16_t
+mpu6500_fifo_count(void)
+{
+        uint8_t val[2];
+
+        mpu6500_read_register(MPU6500_FIFO_COUNT, val, sizeof(val));
+        return (val[0] & 0x1f) << 8 | val[1];
+}
+
+void
+mpu6500_select_fifo(void)
+{
+        uint8_t addr = MPU6500_FIFO_R_W;
+        twi_master_transfer(MPU6500, &addr, sizeof(addr), TWI_DONT_ISSUE_STOP);
+}
+
+/* one axis out of MPU6500_FIFO_SAMPLE sized FIFO records */
+void
+mpu6500_decode_fifo(const uint8_t *raw, uint8_t count, uint8_t axis, int16_t *out)
+{
+        for (uint8_t i = 0; i < count; i++, raw += MPU6500_FIFO_SAMPLE)
+                out[i] = raw[2 * axis] << 8 | raw[2 * axis + 1];
+}
+
+void
+mpu6500_decode_data(const uint8_t *raw, struct mpu6500_data *outdata)
 {
         struct {
                 uint16_t accel_x, accel_y, accel_z;
                 uint16_t temp;
                 uint16_t gyro_x, gyro_y, gyro_z;
         } data;
-        mpu6500_read_register(MPU6500_ACCEL_XOUT, (void *)&data, sizeof(data));
+        memcpy(&data, raw, sizeof(data));
         outdata->accel_x = be16toh(data.accel_x);
         outdata->accel_y = be16toh(data.accel_y);
         outdata->accel_z = be16toh(data.accel_z);
@@ -78,6 +240,14 @@ mpu6500_read_data(struct mpu6500_data *outdata)
         outdata->gyro_z = be16toh(data.gyro_z);
 }
 
+void
+mpu6500_read_data(struct mpu6500_data *outdata)
+{
+        uint8_t raw[MPU6500_DATA_SIZE];
+        mpu6500_read_register(MPU6500_ACCEL_XOUT, raw, sizeof(raw));
+        mpu6500_decode_data(raw, outdata);
+}
+
 /* uint8_t */
 /* mpu6500_status(void) */
 /* { */
@@ -1,4 +1,42 @@
+#ifndef MPU6500_H
+#define MPU6500_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MPU6500_ADDRESS       0xd0
 #define MPU6500_WAKEUP_TIME   35000
+/* ms from mpu6500_start() to a sample, used to pre-warm periodic samples */
+#define MPU6500_LATENCY       (MPU6500_WAKEUP_TIME / 1000 + 2)
+
+/* accel, temp and gyro burst starting at ACCEL_XOUT */
+#define MPU6500_DATA_SIZE     14
+/* INT_STATUS, then the data burst; see mpu6500_select_status() */
+#define MPU6500_STATUS_SIZE   (1 + MPU6500_DATA_SIZE)
+/* INT_STATUS: a sample came in since the last read of the status */
+#define MPU6500_DATA_READY    0x01
+/* bytes per FIFO record, accel x, y, z */
+#define MPU6500_FIFO_SAMPLE   6
+#define MPU6500_FIFO_SIZE     512
+/* ms between reset polls */
+#define MPU6500_RESET_POLL    1
+
+/*
+ * Sampling setup.  The sample rate is 1 kHz / (1 + rate_div) when dlpf
+ * is 1..6; dlpf 0 bypasses the divider.  dlpf selects the gyro and
+ * accel low pass filter from 250/460 Hz (0) down to 5 Hz (6).  The
+ * full scale ranges are +-2, 4, 8, 16 g and +-250, 500, 1000, 2000 dps
+ * for 0..3.  All zeros is the power-on setup.
+ */
+struct mpu6500_config {
+        uint8_t rate_div;
+        uint8_t dlpf;
+        uint8_t accel_fs;
+        uint8_t gyro_fs;
+} __attribute__((__packed__));
+
+#define MPU6500_DLPF_MAX      6
+#define MPU6500_FS_MAX        3
 
 struct mpu6500_data {
         uint16_t accel_x;
@@ -9,7 +47,28 @@ struct mpu6500_data {
         uint16_t gyro_z;
 };
 
-void mpu6500_start(void);
+bool mpu6500_start(void);
 void mpu6500_stop(void);
 void mpu6500_init(void);
 void mpu6500_read_data(struct mpu6500_data *outdata);
+
+/* split steps, for callers that wait without blocking */
+void mpu6500_reset(void);
+bool mpu6500_reset_done(void);
+void mpu6500_configure(void);
+void mpu6500_select_data(void);
+void mpu6500_select_status(void);
+void mpu6500_decode_data(const uint8_t *raw, struct mpu6500_data *outdata);
+
+/* burst capture through the FIFO, see mpu6500_fifo_start() */
+void mpu6500_fifo_start(void);
+void mpu6500_fifo_stop(void);
+uint16_t mpu6500_fifo_count(void);
+void mpu6500_select_fifo(void);
+void mpu6500_decode_fifo(const uint8_t *raw, uint8_t count, uint8_t axis, int16_t *out);
+
+void mpu6500_set_config(const struct mpu6500_config *config);
+uint16_t mpu6500_accel_scale(uint8_t accel_fs);
+uint16_t mpu6500_gyro_scale(uint8_t gyro_fs);
+
+#endif /* MPU6500_H */
@@ -0,0 +1,121 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "pedometer.h"
+
+static int32_t
+iabs(int32_t v)
+{
+        return v < 0 ? -v : v;
+}
+
+/* |a| within some 8 %, max + 11/32 mid + 1/4 min, no square root */
+static int32_t
+magnitude(const int16_t accel[3])
+{
+        int32_t a = iabs(accel[0]), b = iabs(accel[1]), c = iabs(accel[2]), t;
+
+        if (a < b) { t = a; a = b; b = t; }
+        if (a < c) { t = a; a = c; c = t; }
+        if (b < c) { t = b; b = c; c = t; }
+        return a + (11 * b >> 5) + (c >> 2);
+}
+
+/* the step count survives, everything else starts over */
+void
+pedometer_reset(struct pedometer *p, uint32_t now)
+{
+        uint32_t steps = p->steps;
+
+        memset(p, 0, sizeof(*p));
+        p->steps = steps;
+        p->window = now;
+}
+
+static void
+step(struct pedometer *p, uint32_t now, uint8_t *changed)
+{
+        uint32_t interval = now - p->last;
+
+        /* faster than anyone steps: shaking, start over */
+        if (p->run != 0 && interval < PEDOMETER_MIN_STEP) {
+                p->run = 0;
+                return;
+        }
+        if (p->run == 0 || interval > PEDOMETER_MAX_STEP) {
+                p->run = 1;
+        } else {
+                if (p->run < UINT8_MAX)
+                        p->run++;
+                p->run_steps++;
+                p->run_time += interval;
+        }
+        p->last = now;
+        if (p->run == PEDOMETER_CONFIRM) {
+                p->steps += PEDOMETER_CONFIRM;
+                *changed |= PEDOMETER_STEPS;
+        } else if (p->run > PEDOMETER_CONFIRM) {
+                p->steps++;
+                *changed |= PEDOMETER_STEPS;
+        }
+}
+
+static void
+classify(struct pedometer *p, uint32_t now, uint8_t *changed)
+{
+        uint8_t activity = ACTIVITY_STILL;
+        uint32_t swing = p->samples != 0 ? p->swing / p->samples : 0;
+
+        if (p->run >= PEDOMETER_CONFIRM && now - p->last <= PEDOMETER_MAX_STEP &&
+            p->run_steps != 0) {
+                if (p->run_time / p->run_steps < PEDOMETER_RUN_STEP ||
+                    swing > PEDOMETER_RUN_SWING)
+                        activity = ACTIVITY_RUNNING;
+                else
+                        activity = ACTIVITY_WALKING;
+        }
+        if (activity != p->activity) {
+                p->activity = activity;
+                *changed |= PEDOMETER_ACTIVITY;
+        }
+        p->window = now;
+        p->swing = 0;
+        p->samples = 0;
+        p->run_steps = 0;
+        p->run_time = 0;
+}
+
+uint8_t
+pedometer_add(struct pedometer *p, const int16_t accel[3],
+        uint16_t accel_scale, uint32_t now)
+{
+        uint8_t changed = 0;
+        int32_t mg = magnitude(accel) * 1000 / accel_scale;
+        int32_t smooth = 0, dev;
+
+        p->recent[p->fill++ % 4] = mg;
+        if (p->fill < 4) {
+                p->average = mg << 6;
+                return 0;
+        }
+        for (int i = 0; i < 4; i++)
+                smooth += p->recent[i];
+        smooth /= 4;
+        /* gravity and posture, time constant 64 samples */
+        p->average += smooth - (p->average >> 6);
+        dev = smooth - (p->average >> 6);
+
+        if (dev < -PEDOMETER_THRESHOLD)
+                p->below = 1;
+        if (p->below && dev > PEDOMETER_THRESHOLD) {
+                p->below = 0;
+                step(p, now, &changed);
+        }
+        if (p->fill == 8)
+                p->fill = 4;
+        p->swing += iabs(dev);
+        p->samples++;
+        if (now - p->window >= PEDOMETER_WINDOW)
+                classify(p, now, &changed);
+        return changed;
+}
@@ -0,0 +1,63 @@
+#ifndef PEDOMETER_H
+#define PEDOMETER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Step counter and activity classifier, integer only.
+ *
+ * Feed it the accelerometer at PEDOMETER_PERIOD.  The magnitude is
+ * smoothed and compared against its own slow average; a swing below
+ * and then above it by PEDOMETER_THRESHOLD is a step candidate.
+ * Candidates closer than PEDOMETER_MIN_STEP are shaking and break the
+ * run.  Steps only
+ * count once PEDOMETER_CONFIRM of them came in a row, each within
+ * PEDOMETER_MAX_STEP of the last, so shaking or a bump in the road
+ * does not add up.
+ *
+ * Every PEDOMETER_WINDOW the activity is decided: still without a run
+ * of steps, running at a cadence above 2.5 steps/s or a large mean
+ * swing, walking otherwise.
+ */
+
+#define PEDOMETER_PERIOD        20      /* ms */
+#define PEDOMETER_THRESHOLD     100     /* mg */
+#define PEDOMETER_MIN_STEP      250     /* ms */
+#define PEDOMETER_MAX_STEP      2000    /* ms */
+#define PEDOMETER_CONFIRM       4
+#define PEDOMETER_WINDOW        2000    /* ms */
+#define PEDOMETER_RUN_STEP      400     /* ms, shorter steps are running */
+#define PEDOMETER_RUN_SWING     500     /* mg, mean deviation when running */
+
+/* what pedometer_add() changed */
+#define PEDOMETER_STEPS         0x1
+#define PEDOMETER_ACTIVITY      0x2
+
+enum activity {
+        ACTIVITY_STILL,
+        ACTIVITY_WALKING,
+        ACTIVITY_RUNNING,
+};
+
+struct pedometer {
+        uint32_t steps;
+        uint8_t activity;
+        uint8_t below;          /* swung below the average since the last step */
+        uint8_t run;            /* steps in the current run */
+        uint8_t fill;
+        int16_t recent[4];      /* mg, for the moving average */
+        int32_t average;        /* mg, Q6 */
+        uint32_t last;          /* ms, the last step */
+        uint32_t window;        /* ms, start of the activity window */
+        uint32_t swing;         /* mg, sum of deviations in the window */
+        uint16_t samples;
+        uint16_t run_steps;     /* steps of a run in the window */
+        uint32_t run_time;      /* ms they took */
+};
+
+void pedometer_reset(struct pedometer *p, uint32_t now);
+uint8_t pedometer_add(struct pedometer *p, const int16_t accel[3],
+        uint16_t accel_scale, uint32_t now);
+
+#endif /* PEDOMETER_H */
@@ -0,0 +1,115 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "shock.h"
+
+static uint32_t
+isqrt(uint32_t v)
+{
+        uint32_t r = 0, bit = 1UL << 30;
+
+        while (bit > v)
+                bit >>= 2;
+        while (bit != 0) {
+                if (v >= r + bit) {
+                        v -= r + bit;
+                        r = (r >> 1) + bit;
+                } else {
+                        r >>= 1;
+                }
+                bit >>= 2;
+        }
+        return r;
+}
+
+/* threshold in LSB; the ring starts over */
+void
+shock_arm(struct shock *s, uint16_t threshold, uint16_t rate)
+{
+        s->head = 0;
+        s->count = 0;
+        s->read = 0;
+        s->peak = 0;
+        s->threshold = (uint32_t)threshold * threshold;
+        memset(&s->event, 0, sizeof(s->event));
+        s->event.rate = rate;
+        s->event.state = SHOCK_ARMED;
+}
+
+void
+shock_disarm(struct shock *s)
+{
+        if (s->event.state != SHOCK_CAPTURED)
+                s->event.state = SHOCK_IDLE;
+}
+
+/* samples were lost; before a trigger, forget the ones before the gap */
+void
+shock_gap(struct shock *s)
+{
+        if (s->event.state == SHOCK_ARMED)
+                s->count = 0;
+}
+
+bool
+shock_recording(struct shock *s)
+{
+        return s->event.state == SHOCK_ARMED || s->event.state == SHOCK_TRIGGERED;
+}
+
+/* true when the state changed and is worth a notification */
+bool
+shock_add(struct shock *s, const int16_t accel[3], uint32_t now)
+{
+        uint32_t mag = 0;
+
+        if (!shock_recording(s))
+                return false;
+        for (int i = 0; i < 3; i++)
+                mag += (int32_t)accel[i] * accel[i];
+        memcpy(s->ring[s->head], accel, sizeof(s->ring[0]));
+        s->head = (s->head + 1) % SHOCK_SAMPLES;
+        if (s->count < SHOCK_SAMPLES)
+                s->count++;
+        if (s->event.state == SHOCK_ARMED) {
+                if (mag < s->threshold) {
+                        /* only the last SHOCK_PRE count before a trigger */
+                        if (s->count > SHOCK_PRE)
+                                s->count = SHOCK_PRE;
+                        return false;
+                }
+                s->event.time = now;
+                s->event.state = SHOCK_TRIGGERED;
+                s->post = SHOCK_POST;
+        }
+        if (mag > s->peak)
+                s->peak = mag;
+        if (--s->post != 0)
+                return s->post == SHOCK_POST - 1;
+        s->event.state = SHOCK_CAPTURED;
+        return true;
+}
+
+/* fill in the event once the window is complete */
+void
+shock_finish(struct shock *s, uint16_t accel_scale)
+{
+        s->event.samples = s->count;
+        s->event.peak = isqrt(s->peak) * 1000 / accel_scale;
+}
+
+void
+shock_read(struct shock *s, struct shock_chunk *c)
+{
+        uint16_t first = (s->head + SHOCK_SAMPLES - s->count) % SHOCK_SAMPLES;
+
+        memset(c, 0, sizeof(*c));
+        c->index = s->read;
+        if (s->event.state != SHOCK_CAPTURED) {
+                c->index = SHOCK_SAMPLES;
+                return;
+        }
+        for (int i = 0; i < SHOCK_CHUNK && s->read < s->count; i++, s->read++)
+                memcpy(c->sample[i], s->ring[(first + s->read) % SHOCK_SAMPLES],
+                        sizeof(c->sample[i]));
+}
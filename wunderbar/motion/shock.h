@@ -0,0 +1,66 @@
+#ifndef SHOCK_H
+#define SHOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Pre/post trigger capture of accelerometer samples.
+ *
+ * While armed, every sample goes into a ring of SHOCK_SAMPLES.  The
+ * first sample whose magnitude reaches the threshold triggers: the
+ * ring keeps the SHOCK_PRE samples before it, takes SHOCK_POST more
+ * including the trigger and then freezes until it is armed again.
+ *
+ * "shock" notifies struct shock_event when the trigger fires and again
+ * when the window is complete.  Each read of "shock data" then returns
+ * the next SHOCK_CHUNK samples of the window, oldest first, as
+ * { u16 index; i16 x, y, z ... }, and an index past the window once
+ * all were read.
+ */
+
+#define SHOCK_PRE       64
+#define SHOCK_POST      64
+#define SHOCK_SAMPLES   (SHOCK_PRE + SHOCK_POST)
+#define SHOCK_CHUNK     3       /* samples per read */
+
+enum shock_state {
+        SHOCK_IDLE,
+        SHOCK_ARMED,
+        SHOCK_TRIGGERED,        /* taking the post trigger samples */
+        SHOCK_CAPTURED,
+};
+
+struct shock_event {
+        uint32_t time;          /* ms, vtimer_now() around the trigger */
+        uint16_t peak;          /* mg, largest magnitude in the window */
+        uint16_t rate;          /* Hz */
+        uint16_t samples;       /* in the window */
+        uint8_t state;
+} __attribute__((__packed__));
+
+struct shock_chunk {
+        uint16_t index;
+        int16_t sample[SHOCK_CHUNK][3];
+} __attribute__((__packed__));
+
+struct shock {
+        int16_t ring[SHOCK_SAMPLES][3];
+        uint16_t head;          /* next slot written */
+        uint16_t count;         /* samples in the ring */
+        uint16_t post;          /* post trigger samples still to take */
+        uint16_t read;          /* next sample "shock data" returns */
+        uint32_t threshold;     /* LSB, squared */
+        uint32_t peak;          /* LSB, squared */
+        struct shock_event event;
+};
+
+void shock_arm(struct shock *s, uint16_t threshold, uint16_t rate);
+void shock_disarm(struct shock *s);
+void shock_gap(struct shock *s);
+bool shock_recording(struct shock *s);
+bool shock_add(struct shock *s, const int16_t accel[3], uint32_t now);
+void shock_finish(struct shock *s, uint16_t accel_scale);
+void shock_read(struct shock *s, struct shock_chunk *c);
+
+#endif /* SHOCK_H */
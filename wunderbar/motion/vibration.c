@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "fft.h"
+#include "vibration.h"
+
+/*
+ * sqrt(16/3) * 9806.65 / (2 pi): velocity from the windowed spectrum,
+ * with the Hann power loss of 3/8 put back, in um/s per mm/s^2 ms.
+ */
+#define VELOCITY_SCALE  3604600LL
+
+static uint32_t
+isqrt(uint64_t v)
+{
+        uint64_t r = 0, bit = 1ULL << 62;
+
+        while (bit > v)
+                bit >>= 2;
+        while (bit != 0) {
+                if (v >= r + bit) {
+                        v -= r + bit;
+                        r = (r >> 1) + bit;
+                } else {
+                        r >>= 1;
+                }
+                bit >>= 2;
+        }
+        return r;
+}
+
+/*
+ * Remove the mean and scale the block into +-2^14, the most the FFT
+ * takes; returns the left shift applied, -1 for a halved block.
+ */
+static int8_t
+normalise(int16_t *x, unsigned n)
+{
+        int32_t sum = 0, mean;
+        uint16_t max = 0;
+        int8_t shift = 0;
+
+        for (unsigned i = 0; i < n; i++)
+                sum += x[i];
+        mean = sum / (int32_t)n;
+        for (unsigned i = 0; i < n; i++) {
+                int32_t v = x[i] - mean;
+
+                if (v > INT16_MAX)
+                        v = INT16_MAX;
+                else if (v < -INT16_MAX)
+                        v = -INT16_MAX;
+                x[i] = v;
+                if (v < 0)
+                        v = -v;
+                if (v > max)
+                        max = v;
+        }
+        while (max != 0 && max < (1U << 13)) {
+                max <<= 1;
+                shift++;
+        }
+        if (max >= (1U << 14))
+                shift = -1;
+        for (unsigned i = 0; i < n; i++)
+                x[i] = shift < 0 ? x[i] >> 1 : x[i] << shift;
+        return shift;
+}
+
+/* undo normalise() */
+static uint32_t
+denormalise(uint64_t v, int8_t shift)
+{
+        return shift < 0 ? v << 1 : v >> shift;
+}
+
+void
+vibration_analyse(int16_t *re, int16_t *im, uint8_t log2n,
+        uint16_t rate, uint16_t accel_scale, struct vibration_report *r)
+{
+        unsigned n = 1U << log2n;
+        uint16_t *mag = (uint16_t *)re;
+        int8_t shift;
+        unsigned first;
+        uint64_t energy = 0;
+
+        memset(r, 0, sizeof(*r));
+        r->rate = rate;
+        r->points = n;
+
+        shift = normalise(re, n);
+        memset(im, 0, n * sizeof(*im));
+        fft_window(re, log2n);
+        fft(re, im, log2n);
+
+        /* magnitudes of the positive half, in place */
+        for (unsigned k = 0; k <= n / 2; k++)
+                mag[k] = isqrt((int32_t)re[k] * re[k] + (int32_t)im[k] * im[k]);
+
+        first = ((uint32_t)VIBRATION_MIN_FREQ * n + rate - 1) / rate;
+        if (first == 0)
+                first = 1;
+        for (unsigned k = first; k < n / 2; k++)
+                energy += ((uint64_t)mag[k] * mag[k] << 8) / ((uint32_t)k * k);
+        r->velocity = denormalise(isqrt(energy) * VELOCITY_SCALE * n /
+                ((uint64_t)rate * accel_scale * 16), shift);
+
+        for (unsigned k = 2; k < n / 2 - 1; k++) {
+                struct vibration_peak p;
+                int32_t a = mag[k - 1], b = mag[k], c = mag[k + 1];
+                int32_t d = 0;
+                int i;
+
+                if (b <= a || b < c || b == 0)
+                        continue;
+                /* parabola through the three bins, offset in 1/256 bin */
+                if (2 * b - a - c != 0)
+                        d = 128 * (c - a) / (2 * b - a - c);
+                p.freq = (((int32_t)k << 8) + d) * rate * 10 / ((int32_t)n << 8);
+                /* Hann and the one sided spectrum take 1/4 of the peak */
+                p.amplitude = denormalise((uint64_t)4 * b * 1000 / accel_scale, shift);
+                for (i = VIBRATION_PEAKS - 1; i >= 0; i--) {
+                        if (r->peak[i].amplitude >= p.amplitude)
+                                break;
+                        if (i + 1 < VIBRATION_PEAKS)
+                                r->peak[i + 1] = r->peak[i];
+                }
+                if (i + 1 < VIBRATION_PEAKS)
+                        r->peak[i + 1] = p;
+        }
+}
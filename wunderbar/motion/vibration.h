@@ -0,0 +1,42 @@
+#ifndef VIBRATION_H
+#define VIBRATION_H
+
+#include <stdint.h>
+
+/*
+ * Vibration spectrum of one accelerometer axis.
+ *
+ * A block of 2^log2n samples taken at `rate' Hz is stripped of its mean
+ * (gravity), scaled up to use the FFT's headroom, Hann windowed and
+ * transformed (fft.h).  The report carries the strongest spectral
+ * peaks, their frequency refined between bins, and the RMS velocity
+ * from VIBRATION_MIN_FREQ up to rate / 2, the band ISO 10816 judges
+ * machines by.  It fills one notification:
+ *
+ *	u16 rate	Hz
+ *	u16 points
+ *	u32 velocity	um/s RMS
+ *	peaks		{u16 freq, 0.1 Hz; u16 amplitude, mg peak},
+ *			strongest first, zero when there are fewer
+ */
+
+#define VIBRATION_PEAKS         3
+#define VIBRATION_MIN_FREQ      10      /* Hz */
+
+struct vibration_peak {
+        uint16_t freq;
+        uint16_t amplitude;
+} __attribute__((__packed__));
+
+struct vibration_report {
+        uint16_t rate;
+        uint16_t points;
+        uint32_t velocity;
+        struct vibration_peak peak[VIBRATION_PEAKS];
+} __attribute__((__packed__));
+
+/* re holds the samples, im is scratch; both are overwritten */
+void vibration_analyse(int16_t *re, int16_t *im, uint8_t log2n,
+        uint16_t rate, uint16_t accel_scale, struct vibration_report *r);
+
+#endif /* VIBRATION_H */
@@ -9,228 +9,214 @@
 #include "batt_serv.h"
 #include "i2c.h"
 #include "rtc.h"
+#include "twi_trace.h"
+#include "sensor.h"
+#include "broadcast.h"
+#include "task.h"
+#include "power.h"
 
-#define DEFAULT_SAMPLING_PERIOD 1000UL
-#define MIN_SAMPLING_PERIOD 250UL
-
-#define NOTIF_TIMER_ID_PROX  0
-#define NOTIF_TIMER_ID_RGB  1
+#define VTIMER_RTC_ID 0
 
 #include "tcs3771.h"
 
 #define WLED_CTRL_PIN 21
 #define TCS37717_INT_PIN 25
+#define TCS37717_INT_GPIOTE 0
+
+#define TCS3771_REQ_PROX 0x1
+#define TCS3771_REQ_RGB 0x2
+
+/* ms the bus stays up between back to back measurements */
+#define TCS3771_I2C_LINGER 10
+
+static struct power_domain i2c_power;
+static struct power_domain led_power;
+
+static struct sensor proximity_sensor;
+static uint16_t proximity_reading;
+static struct history_block proximity_log[HISTORY_RAM_BLOCKS];
+static uint8_t proximity_tx[NOTIFY_SLOTS(1, sizeof(proximity_reading))];
+static struct deadband proximity_deadband;
+static struct stats proximity_stats;
+
+static struct sensor rgb_sensor;
+static uint64_t rgb_reading;
+static struct history_block rgb_log[HISTORY_RAM_BLOCKS];
+static uint8_t rgb_tx[NOTIFY_SLOTS(1, sizeof(rgb_reading))];
+static struct deadband rgb_deadband;
+
+/* broadcast payload */
+static struct proximity_broadcast {
+        uint16_t proximity;
+        uint64_t rgb;
+} __attribute__((__packed__)) proximity_broadcast;
+
+/* both services share the sensor, one task serves their requests together */
+static struct tcs3771_job {
+        struct task task;
+        struct task_event int_event;
+        uint8_t pending;
+        uint8_t current;
+        bool ok;
+} tcs3771_job;
 
-struct proximity_ctx {
-        struct service_desc;
-        struct char_desc proximity;
-        struct char_desc sampling_period_char;
-        uint16_t proximity_value;
-        uint32_t sampling_period;
-};
-
-struct rgb_ctx {
-        struct service_desc;
-        struct char_desc rgb;
-        struct char_desc sampling_period_char;
-        uint64_t rgb_value;
-        uint32_t sampling_period;
-};
-
-static struct proximity_ctx proximity_ctx;
-static struct rgb_ctx rgb_ctx;
-
-static void
-proximity_update(struct proximity_ctx *ctx, uint16_t val)
-{
-        simble_srv_char_update(&ctx->proximity, &val);
-}
-
-static void
-proximity_disconnected(struct service_desc *s)
+void
+GPIOTE_IRQHandler(void)
 {
-        rtc_update_cfg(proximity_ctx.sampling_period, (uint8_t)NOTIF_TIMER_ID_PROX, false);
+        if (NRF_GPIOTE->EVENTS_IN[TCS37717_INT_GPIOTE] == 0)
+                return;
+        NRF_GPIOTE->EVENTS_IN[TCS37717_INT_GPIOTE] = 0;
+        task_event_signal(&tcs3771_job.int_event);
 }
 
+/*
+ * An IN channel keeps the HFCLK running on the nRF51, so it is only
+ * configured while a conversion is pending.
+ */
 static void
-proximity_read(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
-{
-        struct proximity_ctx *ctx = (void *)s;
-
-        enable_i2c();
-        tcs3771_init();
-        while(nrf_gpio_pin_read(TCS37717_INT_PIN) == 1) {
-                /* NOTHING */
+tcs3771_int_enable(bool enable)
+{
+        if (enable) {
+                NRF_GPIOTE->EVENTS_IN[TCS37717_INT_GPIOTE] = 0;
+                NRF_GPIOTE->CONFIG[TCS37717_INT_GPIOTE] =
+                        (GPIOTE_CONFIG_MODE_Event << GPIOTE_CONFIG_MODE_Pos) |
+                        (TCS37717_INT_PIN << GPIOTE_CONFIG_PSEL_Pos) |
+                        (GPIOTE_CONFIG_POLARITY_HiToLo << GPIOTE_CONFIG_POLARITY_Pos);
+                NRF_GPIOTE->INTENSET = 1 << TCS37717_INT_GPIOTE;
+        } else {
+                NRF_GPIOTE->INTENCLR = 1 << TCS37717_INT_GPIOTE;
+                NRF_GPIOTE->CONFIG[TCS37717_INT_GPIOTE] = 0;
         }
-        ctx->proximity_value = tcs3771_proximity_data();
-        *lenp = sizeof(ctx->proximity_value);
-        *valp = &ctx->proximity_value;
-        tcs3771_stop();
-        disable_i2c();
 }
 
-static void
-proximity_sampling_period_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
-{
-	struct proximity_ctx *ctx = (struct proximity_ctx *)s;
-	*valp = &ctx->sampling_period;
-	*lenp = sizeof(ctx->sampling_period);
+static enum task_status
+tcs3771_task(struct task *t)
+{
+        struct tcs3771_job *job = &tcs3771_job;
+
+        TASK_BEGIN(t);
+        while (job->pending) {
+                job->current = job->pending;
+                job->pending = 0;
+                TASK_POWER_GET(t, &i2c_power);
+                task_event_clear(&job->int_event);
+                tcs3771_int_enable(true);
+                tcs3771_init();
+                if (job->current & TCS3771_REQ_RGB)
+                        power_get(&led_power);
+                job->ok = true;
+                if (nrf_gpio_pin_read(TCS37717_INT_PIN) == 1) {
+                        TASK_AWAIT(t, &job->int_event, 2 * TCS3771_LATENCY);
+                        job->ok = !task_timed_out(t);
+                }
+                tcs3771_int_enable(false);
+                if (job->current & TCS3771_REQ_PROX) {
+                        if (job->ok)
+                                proximity_reading = tcs3771_proximity_data();
+                        sensor_ready(&proximity_sensor, job->ok);
+                }
+                if (job->current & TCS3771_REQ_RGB) {
+                        if (job->ok)
+                                rgb_reading = tcs3771_rgb_data();
+                        power_put(&led_power);
+                        sensor_ready(&rgb_sensor, job->ok);
+                }
+                tcs3771_stop();
+                power_put(&i2c_power);
+        }
+        TASK_END(t);
 }
 
 static void
-proximity_sampling_period_write_cb(struct service_desc *s, struct char_desc *c,
-        const void *val, const uint16_t len)
+i2c_power_set(bool on)
 {
-	struct proximity_ctx *ctx = (struct proximity_ctx *)s;
-        if (*(uint32_t*)val > MIN_SAMPLING_PERIOD)
-                ctx->sampling_period = *(uint32_t*)val;
+        if (on)
+                enable_i2c();
         else
-                ctx->sampling_period = MIN_SAMPLING_PERIOD;
-        rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID_PROX, true);
-}
-
-void
-proximity_notify_status_cb(struct service_desc *s, struct char_desc *c, const int8_t status)
-{
-        struct proximity_ctx *ctx = (struct proximity_ctx *)s;
-
-        if (status & BLE_GATT_HVX_NOTIFICATION)
-                rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID_PROX, true);
-        else     //disable NOTIFICATION_TIMER
-                rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID_PROX, false);
+                disable_i2c();
 }
 
 static void
-proximity_notif_timer_cb(struct rtc_ctx *ctx)
+led_power_set(bool on)
 {
-        void *val = &proximity_ctx.proximity_value;
-	uint16_t len = sizeof(proximity_ctx.proximity_value);
-	proximity_read(&proximity_ctx, &proximity_ctx.proximity, &val, &len);
-	simble_srv_char_notify(&proximity_ctx.proximity, false, len, val);
+        nrf_gpio_pin_write(WLED_CTRL_PIN, on);
 }
 
 static void
-proximity_init(struct proximity_ctx *ctx)
+tcs3771_request(uint8_t req)
 {
-        simble_srv_init(ctx, simble_get_vendor_uuid_class(), VENDOR_UUID_SENSOR_SERVICE);
-        simble_srv_char_add(ctx, &ctx->proximity,
-                     simble_get_vendor_uuid_class(), VENDOR_UUID_PROXIMITY_CHAR,
-                     u8"Proximity",
-                     2);
+        uint8_t nested;
 
-        simble_srv_char_add(ctx, &ctx->sampling_period_char,
-		simble_get_vendor_uuid_class(), VENDOR_UUID_SAMPLING_PERIOD_CHAR,
-		u8"sampling period",
-		sizeof(ctx->sampling_period)); // size in bytes
-        // Resolution: 1ms, max value: 16777216 (4 hours)
-        // A value of 0 will disable periodic notifications
-        simble_srv_char_attach_format(&ctx->sampling_period_char,
-		BLE_GATT_CPF_FORMAT_UINT24, 0, ORG_BLUETOOTH_UNIT_UNITLESS);
-        ctx->disconnect_cb = proximity_disconnected;
-        ctx->proximity.read_cb = proximity_read;
-        ctx->proximity.notify = 1;
-        ctx->proximity.notify_status_cb = proximity_notify_status_cb;
-        ctx->sampling_period_char.read_cb = proximity_sampling_period_read_cb;
-	ctx->sampling_period_char.write_cb = proximity_sampling_period_write_cb;
-        simble_srv_register(ctx);
+        /* the task clears bits from SWI3, read callbacks set them from thread mode */
+        sd_nvic_critical_region_enter(&nested);
+        tcs3771_job.pending |= req;
+        sd_nvic_critical_region_exit(nested);
+        task_kick(&tcs3771_job.task, tcs3771_task);
 }
 
-
 static void
-rgb_update(struct rgb_ctx *ctx, uint8_t *val)
+proximity_acquire(struct sensor *s)
 {
-        simble_srv_char_update(&ctx->rgb, val);
+        tcs3771_request(TCS3771_REQ_PROX);
 }
 
 static void
-rgb_disconnected(struct service_desc *s)
-{
-        rtc_update_cfg(rgb_ctx.sampling_period, (uint8_t)NOTIF_TIMER_ID_RGB, false);
-}
-
-static void
-rgb_read(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
-{
-        struct rgb_ctx *ctx = (void *)s;
-
-        enable_i2c();
-        tcs3771_init();
-        nrf_gpio_pin_write(WLED_CTRL_PIN, true);
-        while(nrf_gpio_pin_read(TCS37717_INT_PIN) == 1) {
-                /* NOTHING */
-        }
-        ctx->rgb_value = tcs3771_rgb_data();
-        nrf_gpio_pin_write(WLED_CTRL_PIN, false);
-        *lenp = sizeof(ctx->rgb_value);
-        *valp = &ctx->rgb_value;
-        tcs3771_stop();
-        disable_i2c();
-}
-
-static void
-rgb_sampling_period_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
-{
-	struct rgb_ctx *ctx = (struct rgb_ctx *)s;
-	*valp = &ctx->sampling_period;
-	*lenp = sizeof(ctx->sampling_period);
-}
-
-static void
-rgb_sampling_period_write_cb(struct service_desc *s, struct char_desc *c,
-        const void *val, const uint16_t len)
-{
-	struct rgb_ctx *ctx = (struct rgb_ctx *)s;
-        if (*(uint32_t*)val > MIN_SAMPLING_PERIOD)
-                ctx->sampling_period = *(uint32_t*)val;
-        else
-                ctx->sampling_period = MIN_SAMPLING_PERIOD;
-        rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID_RGB, true);
-}
-
-void
-rgb_notify_status_cb(struct service_desc *s, struct char_desc *c, const int8_t status)
-{
-        struct rgb_ctx *ctx = (struct rgb_ctx *)s;
-
-        if (status & BLE_GATT_HVX_NOTIFICATION)
-                rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID_RGB, true);
-        else     //disable NOTIFICATION_TIMER
-                rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID_RGB, false);
-}
+proximity_deliver(struct sensor *s)
+{
+        proximity_broadcast.proximity = proximity_reading;
+        broadcast_update(&proximity_broadcast, sizeof(proximity_broadcast));
+}
+
+static const struct sensor_desc proximity_desc = {
+        .service_uuid = VENDOR_UUID_SENSOR_SERVICE,
+        .char_uuid = VENDOR_UUID_PROXIMITY_CHAR,
+        .name = u8"Proximity",
+        .value = &proximity_reading,
+        .size = sizeof(proximity_reading),
+        .width = 2,
+        .latency = TCS3771_LATENCY,
+        .flags = SENSOR_BROADCAST_CHAR | SENSOR_POWER_CHAR | SENSOR_CONN_CHAR,
+        .tx_depth = 1,
+        .tx_slots = proximity_tx,
+        .log = proximity_log,
+        .flash_first = 0,
+        .flash_pages = FLASH_HISTORY_PAGES / 2,
+        .deadband = &proximity_deadband,
+        .stats = &proximity_stats,
+        .acquire = proximity_acquire,
+        .deliver = proximity_deliver,
+};
 
 static void
-rgb_init(struct rgb_ctx *ctx)
+rgb_acquire(struct sensor *s)
 {
-        simble_srv_init(ctx, simble_get_vendor_uuid_class(), VENDOR_UUID_SENSOR_SERVICE_2);
-        simble_srv_char_add(ctx, &ctx->rgb,
-                     simble_get_vendor_uuid_class(), VENDOR_UUID_COLOR_CHAR,
-                     u8"RGB",
-                     8);
-        simble_srv_char_add(ctx, &ctx->sampling_period_char,
-		simble_get_vendor_uuid_class(), VENDOR_UUID_SAMPLING_PERIOD_CHAR,
-		u8"sampling period",
-		sizeof(ctx->sampling_period)); // size in bytes
-        // Resolution: 1ms, max value: 16777216 (4 hours)
-        // A value of 0 will disable periodic notifications
-        simble_srv_char_attach_format(&ctx->sampling_period_char,
-		BLE_GATT_CPF_FORMAT_UINT24, 0, ORG_BLUETOOTH_UNIT_UNITLESS);
-        ctx->disconnect_cb = rgb_disconnected;
-        ctx->rgb.read_cb = rgb_read;
-        ctx->rgb.notify = 1;
-        ctx->rgb.notify_status_cb = rgb_notify_status_cb;
-        ctx->sampling_period_char.read_cb = rgb_sampling_period_read_cb;
-	ctx->sampling_period_char.write_cb = rgb_sampling_period_write_cb;
-        simble_srv_register(ctx);
+        tcs3771_request(TCS3771_REQ_RGB);
 }
 
 static void
-rgb_notif_timer_cb(struct rtc_ctx *ctx)
-{
-        void *val = &rgb_ctx.rgb_value;
-	uint16_t len = sizeof(rgb_ctx.rgb_value);
-	rgb_read(&rgb_ctx, &rgb_ctx.rgb, &val, &len);
-	simble_srv_char_notify(&rgb_ctx.rgb, false, len, val);
-}
+rgb_deliver(struct sensor *s)
+{
+        proximity_broadcast.rgb = rgb_reading;
+        broadcast_update(&proximity_broadcast, sizeof(proximity_broadcast));
+}
+
+static const struct sensor_desc rgb_desc = {
+        .service_uuid = VENDOR_UUID_SENSOR_SERVICE_2,
+        .char_uuid = VENDOR_UUID_COLOR_CHAR,
+        .name = u8"RGB",
+        .value = &rgb_reading,
+        .size = sizeof(rgb_reading),
+        .width = 2,
+        .latency = TCS3771_LATENCY,
+        .tx_depth = 1,
+        .tx_slots = rgb_tx,
+        .log = rgb_log,
+        .flash_first = FLASH_HISTORY_PAGES / 2,
+        .flash_pages = FLASH_HISTORY_PAGES / 2,
+        .deadband = &rgb_deadband,
+        .acquire = rgb_acquire,
+        .deliver = rgb_deliver,
+};
 
 void
 main(void)
@@ -239,32 +225,27 @@ main(void)
         nrf_gpio_cfg_output(WLED_CTRL_PIN);
 
         twi_master_init();
-        disable_i2c();
+        power_init(&i2c_power, i2c_power_set, 0, TCS3771_I2C_LINGER);
+        /* the LED lights the RGB integration only, never lingers */
+        power_init(&led_power, led_power_set, 0, 0);
 
         simble_init("RGB/Proximity");
-        proximity_ctx.sampling_period = DEFAULT_SAMPLING_PERIOD;
-        rgb_ctx.sampling_period = DEFAULT_SAMPLING_PERIOD;
-        //Set the timer parameters and initialize it.
+        broadcast_init("RGB/Proximity", BROADCAST_PROXIMITY_RGB, sensor_broadcast_cb);
+        task_init();
+        sd_nvic_SetPriority(GPIOTE_IRQn, NRF_APP_PRIORITY_LOW);
+        sd_nvic_EnableIRQ(GPIOTE_IRQn);
+        //Both notification timers share one RTC slot through vtimer.
         struct rtc_ctx rtc_ctx = {
-                .rtc_x[NOTIF_TIMER_ID_PROX] = {
-                        .type = PERIODIC,
-                        .period = proximity_ctx.sampling_period,
-                        .enabled = false,
-                        .cb = proximity_notif_timer_cb,
-                },
-                .rtc_x[NOTIF_TIMER_ID_RGB] = {
-                        .type = PERIODIC,
-                        .period = rgb_ctx.sampling_period,
-                        .enabled = false,
-                        .cb = rgb_notif_timer_cb,
-                }
+                .rtc_x[VTIMER_RTC_ID] = VTIMER_RTC_SLOT,
         };
+        vtimer_init(VTIMER_RTC_ID);
         batt_serv_init(&rtc_ctx);
         rtc_init(&rtc_ctx);
         ind_init();
-        proximity_init(&proximity_ctx);
-        rgb_init(&rgb_ctx);
-        simble_adv_start();
+        sensor_init(&proximity_sensor, &proximity_desc);
+        sensor_init(&rgb_sensor, &rgb_desc);
+        twi_trace_init();
+        broadcast_start();
 
         simble_process_event_loop();
 }
@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include <twi_master.h>
+#include "twi_trace.h"
 #include <nrf_gpio.h>
 
 #define TCS3771 (0x29 << 1)
@@ -105,12 +106,7 @@ tcs3771_init(void)
         };
         tcs3771_write_register(TCS3771_PERS, data5, sizeof(data5));
 
-        uint8_t data1[] = {
-                TCS3771_ENABLE_PON | TCS3771_ENABLE_PEN | TCS3771_ENABLE_WEN | TCS3771_ENABLE_AEN | TCS3771_ENABLE_PIEN | TCS3771_ENABLE_AIEN
-        };
-        tcs3771_write_register(TCS3771_ENABLE, data1, sizeof(data1));
-
-        //reset RGBC and PROX INTs
+        /* the last cycle's interrupt would pull INT low as soon as they are enabled */
         uint8_t int_reset[] = {
                 // 0x05 CLEAR PROX INT
                 // 0x06 CLEAR RGBC INT
@@ -118,7 +114,12 @@ tcs3771_init(void)
                 TCS3771_COMMAND_SELECT | TCS3771_COMMAND_TYPE_SPECIAL | 0x07
         };
         twi_master_transfer(TCS3771, int_reset, sizeof(int_reset), TWI_ISSUE_STOP);
-        
+
+        uint8_t data1[] = {
+                TCS3771_ENABLE_PON | TCS3771_ENABLE_PEN | TCS3771_ENABLE_WEN | TCS3771_ENABLE_AEN | TCS3771_ENABLE_PIEN | TCS3771_ENABLE_AIEN
+        };
+        tcs3771_write_register(TCS3771_ENABLE, data1, sizeof(data1));
+
         uint8_t rgb_cycles[] = {
                 252
         };
@@ -1,3 +1,9 @@
+/*
+ * ms from tcs3771_init() to the first interrupt: proximity, wait
+ * ((256 - 216) * 2.72 ms) and RGBC integration, plus start-up.
+ */
+#define TCS3771_LATENCY 130
+
 void tcs3771_init(void);
 void tcs3771_stop(void);
 uint16_t tcs3771_proximity_data(void);
@@ -1,14 +1,11 @@
 #include <twi_master.h>
+#include "twi_trace.h"
 
 #include "htu21.h"
 #include "util.h"
 #include <nrf_delay.h>
 #include "i2c.h"
 
-#define HTU21_WAKEUP_TIME 15000
-#define TEMP_MEAS_TIME 50000
-#define RH_MEAS_TIME 16000
-
 static inline uint8_t rotl(uint8_t value, uint8_t shift)
 {
 	return (value << shift) | (value >> (sizeof(value) * 8 - shift));
@@ -21,7 +18,7 @@ static inline uint8_t rotr(uint8_t value, uint8_t shift)
 
 static bool htu21_block_reading(enum htu21_command_t cmd, uint16_t *reading)
 {
-	uint8_t result[3];
+	uint8_t result[HTU21_RESULT_SIZE];
 	enable_i2c();
 	nrf_delay_us(HTU21_WAKEUP_TIME);
 	if (!(twi_master_transfer(HTU21_ADDRESS, &cmd, 1, TWI_DONT_ISSUE_STOP))) {
@@ -35,6 +32,11 @@ static bool htu21_block_reading(enum htu21_command_t cmd, uint16_t *reading)
 		return false;
 	}
 	disable_i2c();
+	return htu21_decode(result, reading);
+}
+
+bool htu21_decode(const uint8_t *result, uint16_t *reading)
+{
 	// checksum src: HTU21D Humidity Sensor Library, SparkFun Electronics
 	uint16_t raw = (result[0] << 8) | result[1];
 	uint32_t remainder = raw << 8 | result[2];
@@ -53,6 +55,23 @@ static bool htu21_block_reading(enum htu21_command_t cmd, uint16_t *reading)
 	}
 }
 
+bool htu21_start_measurement(enum htu21_command_t cmd)
+{
+	return twi_master_transfer(HTU21_ADDRESS, &cmd, 1, TWI_ISSUE_STOP);
+}
+
+int8_t htu21_temperature(uint16_t reading)
+{
+	return ROUNDED_DIV( ((21965 * reading) >> 13) - 46850, 1000 );
+	// = -46.85 + 175.72 * (reading / (1 << 16));
+}
+
+uint8_t htu21_humidity(uint16_t reading)
+{
+	return ROUNDED_DIV( ((15625 * reading) >> 13) - 6000, 1000 );
+	// = -6 + 125 * (reading / (1 << 16));
+}
+
 void htu21_reset()
 {
 	enum htu21_command_t cmd = HTU21_SOFT_RESET;
@@ -65,8 +84,7 @@ bool htu21_read_temperature(int8_t *value)
 	if (!htu21_block_reading(HTU21_READ_TEMPERATURE_BLOCKING, &reading)) {
 		return false;
 	}
-	*value = ROUNDED_DIV( ((21965 * reading) >> 13) - 46850, 1000 );
-	// = -46.85 + 175.72 * (reading / (1 << 16));
+	*value = htu21_temperature(reading);
 	return true;
 }
 
@@ -76,8 +94,7 @@ bool htu21_read_humidity(uint8_t *value)
 	if (!htu21_block_reading(HTU21_READ_HUMIDITY_BLOCKING, &reading)) {
 		return false;
 	}
-	*value = ROUNDED_DIV( ((15625 * reading) >> 13) - 6000, 1000 );
-	// = -6 + 125 * (reading / (1 << 16));
+	*value = htu21_humidity(reading);
 	return true;
 }
 
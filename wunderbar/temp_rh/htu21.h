@@ -5,6 +5,16 @@
 #include <stdbool.h>
 
 #define HTU21_ADDRESS 0x80
+/* measurement MSB, LSB and CRC */
+#define HTU21_RESULT_SIZE 3
+
+#define HTU21_WAKEUP_TIME 15000
+#define TEMP_MEAS_TIME 50000
+#define RH_MEAS_TIME 16000
+
+/* ms from power-up to a result, used to pre-warm periodic samples */
+#define HTU21_TEMPERATURE_LATENCY ((HTU21_WAKEUP_TIME + TEMP_MEAS_TIME) / 1000 + 1)
+#define HTU21_HUMIDITY_LATENCY ((HTU21_WAKEUP_TIME + RH_MEAS_TIME) / 1000 + 1)
 
 enum htu21_command_t {
 	HTU21_READ_TEMPERATURE_BLOCKING = 0xE3,
@@ -41,4 +51,14 @@ bool htu21_read_humidity(uint8_t *value);
 bool htu21_read_user_register(struct htu21_user_register_t* user_reg);
 bool htu21_write_user_register(struct htu21_user_register_t* user_reg);
 
+/*
+ * Split steps for callers that wait without blocking: send a no-hold
+ * command, wait the measurement time, read HTU21_RESULT_SIZE bytes and
+ * pass them to htu21_decode().
+ */
+bool htu21_start_measurement(enum htu21_command_t cmd);
+bool htu21_decode(const uint8_t *result, uint16_t *reading);
+int8_t htu21_temperature(uint16_t reading);
+uint8_t htu21_humidity(uint16_t reading);
+
 #endif /* HTU21_H */
\ No newline at end of file
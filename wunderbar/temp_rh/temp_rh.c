@@ -10,273 +10,216 @@
 #include "batt_serv.h"
 #include "rtc.h"
 #include "i2c.h"
-
-#define DEFAULT_SAMPLING_PERIOD 1000UL
-#define MIN_SAMPLING_PERIOD 250UL
-
-#define NOTIF_TIMER_ID  0
-
-struct rh_ctx {
-	struct service_desc;
-	struct char_desc rh;
-	struct char_desc sampling_period_rh;
-	uint8_t last_reading;
-	uint32_t sampling_period;
-};
-
-struct temp_ctx {
-	struct service_desc;
-	struct char_desc temp;
-	struct char_desc sampling_period_temp;
-	int8_t last_reading;
-	uint32_t sampling_period;
-};
-
-static struct rh_ctx rh_ctx;
-static struct temp_ctx temp_ctx;
-
-
-static bool
-rh_reading(struct rh_ctx *ctx)
-{
-	return htu21_read_humidity(&ctx->last_reading);
-}
-
-static void
-rh_char_srv_update(struct rh_ctx *ctx)
-{
-	if (rh_reading(ctx)) {
-		simble_srv_char_update(&ctx->rh, &ctx->last_reading);
-	}
-}
-
-static void
-rh_connected(struct service_desc *s)
-{
-	rh_char_srv_update((struct rh_ctx *) s);
-}
-
-static void
-rh_disconnected(struct service_desc *s)
-{
-	rtc_update_cfg(rh_ctx.sampling_period, (uint8_t)NOTIF_TIMER_ID, false);
-	rtc_update_cfg(temp_ctx.sampling_period, (uint8_t)NOTIF_TIMER_ID+1, false);
-}
-
-static void
-rh_read_cb(struct service_desc *s, struct char_desc *c, void **val, uint16_t *len)
-{
-	struct rh_ctx *ctx = (struct rh_ctx *) s;
-	if (rh_reading(ctx)) {
-		*len = 1;
-		*val = &ctx->last_reading;
+#include "twi_trace.h"
+#include "sensor.h"
+#include "broadcast.h"
+#include "task.h"
+#include "twi_async.h"
+#include "power.h"
+
+#define VTIMER_RTC_ID 0
+
+#define HTU21_REQ_TEMP 0x1
+#define HTU21_REQ_RH 0x2
+
+/* the bus powers the sensor; staying up is cheaper than another wakeup */
+#define HTU21_I2C_LINGER (HTU21_WAKEUP_TIME / 1000)
+
+static struct power_domain i2c_power;
+
+static struct sensor rh_sensor;
+static uint8_t rh_reading;
+static struct history_block rh_log[HISTORY_RAM_BLOCKS];
+static uint8_t rh_tx[NOTIFY_SLOTS(1, sizeof(rh_reading))];
+static struct deadband rh_deadband;
+static struct stats rh_stats;
+static struct predict rh_predict;
+
+static struct sensor temp_sensor;
+static int8_t temp_reading;
+static struct history_block temp_log[HISTORY_RAM_BLOCKS];
+static uint8_t temp_tx[NOTIFY_SLOTS(1, sizeof(temp_reading))];
+static struct deadband temp_deadband;
+static struct stats temp_stats;
+static struct predict temp_predict;
+
+/* broadcast payload */
+static struct temp_rh_broadcast {
+	int8_t temp;
+	uint8_t rh;
+} __attribute__((__packed__)) temp_rh_broadcast;
+
+/* both services share the sensor, one task serves their requests in turn */
+static struct htu21_job {
+	struct task task;
+	struct task_event twi_done;
+	uint8_t pending;
+	uint8_t current;
+	bool started;
+	uint8_t result[HTU21_RESULT_SIZE];
+} htu21_job;
+
+static enum task_status
+htu21_task(struct task *t)
+{
+	struct htu21_job *job = &htu21_job;
+	uint16_t reading;
+	bool ok;
+
+	TASK_BEGIN(t);
+	TASK_POWER_GET(t, &i2c_power);
+	while (job->pending) {
+		if (job->pending & HTU21_REQ_TEMP) {
+			job->current = HTU21_REQ_TEMP;
+			job->pending &= ~HTU21_REQ_TEMP;
+			job->started = htu21_start_measurement(HTU21_READ_TEMPERATURE);
+			if (job->started)
+				TASK_SLEEP(t, TEMP_MEAS_TIME / 1000);
+		} else {
+			job->current = HTU21_REQ_RH;
+			job->pending &= ~HTU21_REQ_RH;
+			job->started = htu21_start_measurement(HTU21_READ_HUMIDITY);
+			if (job->started)
+				TASK_SLEEP(t, RH_MEAS_TIME / 1000);
+		}
+		/* a NAKed command leaves nothing to read back */
+		if (job->started)
+			TASK_AWAIT_TWI(t, &job->twi_done, HTU21_ADDRESS | TWI_READ_BIT,
+				job->result, sizeof(job->result), TWI_ISSUE_STOP);
+		ok = job->started && twi_async_result() &&
+			htu21_decode(job->result, &reading);
+		if (job->current == HTU21_REQ_TEMP) {
+			if (ok)
+				temp_reading = htu21_temperature(reading);
+			sensor_ready(&temp_sensor, ok);
+		} else {
+			if (ok)
+				rh_reading = htu21_humidity(reading);
+			sensor_ready(&rh_sensor, ok);
+		}
 	}
+	power_put(&i2c_power);
+	TASK_END(t);
 }
 
 static void
-rh_sampling_period_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
-{
-	struct rh_ctx *ctx = (struct rh_ctx *)s;
-	*valp = &ctx->sampling_period;
-	*lenp = sizeof(ctx->sampling_period);
-}
-
-static void
-rh_sampling_period_write_cb(struct service_desc *s, struct char_desc *c,
-        const void *val, const uint16_t len)
+i2c_power_set(bool on)
 {
-	struct rh_ctx *ctx = (struct rh_ctx *)s;
-	if (*(uint32_t*)val > MIN_SAMPLING_PERIOD)
-		ctx->sampling_period = *(uint32_t*)val;
+	if (on)
+		enable_i2c();
 	else
-		ctx->sampling_period = MIN_SAMPLING_PERIOD;
-	rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID, true);
-}
-
-void
-rh_notify_status_cb(struct service_desc *s, struct char_desc *c, const int8_t status)
-{
-        struct rh_ctx *ctx = (struct rh_ctx *)s;
-
-        if (status & BLE_GATT_HVX_NOTIFICATION)
-                rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID, true);
-        else     //disable NOTIFICATION_TIMER
-                rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID, false);
+		disable_i2c();
 }
 
 static void
-rh_notif_timer_cb(struct rtc_ctx *ctx)
+htu21_request(uint8_t req)
 {
-	void *val = &rh_ctx.last_reading;
-	uint16_t len = sizeof(rh_ctx.last_reading);
-	rh_read_cb(&rh_ctx, &rh_ctx.rh, &val, &len);
-	simble_srv_char_notify(&rh_ctx.rh, false, len, val);
-}
+	uint8_t nested;
 
-static void
-rh_init(struct rh_ctx *ctx)
-{
-	simble_srv_init(ctx, simble_get_vendor_uuid_class(), VENDOR_UUID_SENSOR_SERVICE);
-	simble_srv_char_add(ctx, &ctx->rh,
-		simble_get_vendor_uuid_class(), VENDOR_UUID_HUMID_CHAR,
-		u8"Relative Humidity",
-		1);
-	simble_srv_char_attach_format(&ctx->rh,
-		BLE_GATT_CPF_FORMAT_UINT8,
-		0,
-		ORG_BLUETOOTH_UNIT_PERCENTAGE);
-	simble_srv_char_add(ctx, &ctx->sampling_period_rh,
-		simble_get_vendor_uuid_class(), VENDOR_UUID_SAMPLING_PERIOD_CHAR,
-		u8"sampling period",
-		sizeof(ctx->sampling_period)); // size in bytes
-	ctx->connect_cb = rh_connected;
-	ctx->disconnect_cb = rh_disconnected;
-	ctx->rh.read_cb = rh_read_cb;
-	ctx->rh.notify = 1;
-	ctx->rh.notify_status_cb = rh_notify_status_cb;
-	ctx->sampling_period_rh.read_cb = rh_sampling_period_read_cb;
-	ctx->sampling_period_rh.write_cb = rh_sampling_period_write_cb;
-	simble_srv_register(ctx);
-}
-
-static bool
-temp_reading(struct temp_ctx *ctx)
-{
-	return htu21_read_temperature(&ctx->last_reading);
+	/* called from thread mode as well as from the timers */
+	sd_nvic_critical_region_enter(&nested);
+	htu21_job.pending |= req;
+	sd_nvic_critical_region_exit(nested);
+	task_kick(&htu21_job.task, htu21_task);
 }
 
 static void
-temp_char_srv_update(struct temp_ctx *ctx)
+rh_acquire(struct sensor *s)
 {
-	if (temp_reading(ctx)) {
-		simble_srv_char_update(&ctx->temp, &ctx->last_reading);
-	}
-}
-
-static void
-temp_connected(struct service_desc *s)
-{
-	temp_char_srv_update((struct temp_ctx *) s);
+	htu21_request(HTU21_REQ_RH);
 }
 
 static void
-temp_disconnected(struct service_desc *s)
-{
-	rtc_update_cfg(temp_ctx.sampling_period, (uint8_t)NOTIF_TIMER_ID, false);}
-
-static void
-temp_read_cb(struct service_desc *s, struct char_desc *c, void **val, uint16_t *len)
+rh_deliver(struct sensor *s)
 {
-	struct temp_ctx *ctx = (struct temp_ctx *) s;
-	if (temp_reading(ctx)) {
-		*len = 1;
-		*val = &ctx->last_reading;
-	}
+	temp_rh_broadcast.rh = rh_reading;
+	broadcast_update(&temp_rh_broadcast, sizeof(temp_rh_broadcast));
 }
 
-static void
-temp_sampling_period_read_cb(struct service_desc *s, struct char_desc *c, void **valp, uint16_t *lenp)
-{
-	struct temp_ctx *ctx = (struct temp_ctx *)s;
-	*valp = &ctx->sampling_period;
-	*lenp = sizeof(ctx->sampling_period);
-}
+static const struct sensor_desc rh_desc = {
+	.service_uuid = VENDOR_UUID_SENSOR_SERVICE,
+	.char_uuid = VENDOR_UUID_HUMID_CHAR,
+	.name = u8"Relative Humidity",
+	.value = &rh_reading,
+	.size = sizeof(rh_reading),
+	.width = 1,
+	.format = BLE_GATT_CPF_FORMAT_UINT8,
+	.unit = ORG_BLUETOOTH_UNIT_PERCENTAGE,
+	.latency = HTU21_HUMIDITY_LATENCY,
+	.flags = SENSOR_BROADCAST_CHAR | SENSOR_POWER_CHAR | SENSOR_CONN_CHAR,
+	.tx_depth = 1,
+	.tx_slots = rh_tx,
+	.log = rh_log,
+	.flash_first = 0,
+	.flash_pages = FLASH_HISTORY_PAGES / 2,
+	.deadband = &rh_deadband,
+	.stats = &rh_stats,
+	.predict = &rh_predict,
+	.acquire = rh_acquire,
+	.deliver = rh_deliver,
+	.connect = rh_acquire,
+};
 
 static void
-temp_sampling_period_write_cb(struct service_desc *s, struct char_desc *c,
-        const void *val, const uint16_t len)
+temp_acquire(struct sensor *s)
 {
-	struct temp_ctx *ctx = (struct temp_ctx *)s;
-	if (*(uint32_t*)val > MIN_SAMPLING_PERIOD)
-                ctx->sampling_period = *(uint32_t*)val;
-        else
-                ctx->sampling_period = MIN_SAMPLING_PERIOD;
-        rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID+1, true);
+	htu21_request(HTU21_REQ_TEMP);
 }
 
-
-void
-temp_notify_status_cb(struct service_desc *s, struct char_desc *c, const int8_t status)
-{
-        struct temp_ctx *ctx = (struct temp_ctx *)s;
-
-        if (status & BLE_GATT_HVX_NOTIFICATION)
-                rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID+1, true);
-        else     //disable NOTIFICATION_TIMER
-                rtc_update_cfg(ctx->sampling_period, (uint8_t)NOTIF_TIMER_ID+1, false);
-}
-
-
 static void
-temp_init(struct temp_ctx *ctx)
+temp_deliver(struct sensor *s)
 {
-	simble_srv_init(ctx, simble_get_vendor_uuid_class(), VENDOR_UUID_SENSOR_SERVICE_2);
-	simble_srv_char_add(ctx, &ctx->temp,
-		simble_get_vendor_uuid_class(), VENDOR_UUID_TEMP_CHAR,
-		u8"Temperature",
-		1);
-	simble_srv_char_attach_format(&ctx->temp,
-		BLE_GATT_CPF_FORMAT_SINT8,
-		0,
-		ORG_BLUETOOTH_UNIT_DEGREE_CELSIUS);
-	simble_srv_char_add(ctx, &ctx->sampling_period_temp,
-		simble_get_vendor_uuid_class(), VENDOR_UUID_SAMPLING_PERIOD_CHAR,
-		u8"sampling period",
-		sizeof(ctx->sampling_period)); // size in bytes
-        // Resolution: 1ms, max value: 16777216 (4 hours)
-        // A value of 0 will disable periodic notifications
-        simble_srv_char_attach_format(&ctx->sampling_period_temp,
-		BLE_GATT_CPF_FORMAT_UINT24, 0, ORG_BLUETOOTH_UNIT_UNITLESS);
-	ctx->connect_cb = temp_connected;
-	ctx->disconnect_cb = temp_disconnected;
-	ctx->temp.read_cb = temp_read_cb;
-	ctx->temp.notify = 1;
-	ctx->temp.notify_status_cb = temp_notify_status_cb;
-        ctx->sampling_period_temp.read_cb = temp_sampling_period_read_cb;
-	ctx->sampling_period_temp.write_cb = temp_sampling_period_write_cb;
-	simble_srv_register(ctx);
+	temp_rh_broadcast.temp = temp_reading;
+	broadcast_update(&temp_rh_broadcast, sizeof(temp_rh_broadcast));
 }
 
-static void
-temp_notif_timer_cb(struct rtc_ctx *ctx)
-{
-	void *val = &temp_ctx.last_reading;
-	uint16_t len = sizeof(temp_ctx.last_reading);
-	temp_read_cb(&temp_ctx, &temp_ctx.temp, &val, &len);
-	simble_srv_char_notify(&temp_ctx.temp, false, len, val);
-}
+static const struct sensor_desc temp_desc = {
+	.service_uuid = VENDOR_UUID_SENSOR_SERVICE_2,
+	.char_uuid = VENDOR_UUID_TEMP_CHAR,
+	.name = u8"Temperature",
+	.value = &temp_reading,
+	.size = sizeof(temp_reading),
+	.width = 1,
+	.is_signed = 1,
+	.format = BLE_GATT_CPF_FORMAT_SINT8,
+	.unit = ORG_BLUETOOTH_UNIT_DEGREE_CELSIUS,
+	.latency = HTU21_TEMPERATURE_LATENCY,
+	.tx_depth = 1,
+	.tx_slots = temp_tx,
+	.log = temp_log,
+	.flash_first = FLASH_HISTORY_PAGES / 2,
+	.flash_pages = FLASH_HISTORY_PAGES / 2,
+	.deadband = &temp_deadband,
+	.stats = &temp_stats,
+	.predict = &temp_predict,
+	.acquire = temp_acquire,
+	.deliver = temp_deliver,
+	.connect = temp_acquire,
+};
 
 void
 main(void)
 {
 	twi_master_init();
+	power_init(&i2c_power, i2c_power_set, HTU21_WAKEUP_TIME / 1000, HTU21_I2C_LINGER);
 
 	simble_init("Temperature/RH");
+	broadcast_init("Temperature/RH", BROADCAST_TEMP_RH, sensor_broadcast_cb);
+	task_init();
 
-	rh_ctx.sampling_period = DEFAULT_SAMPLING_PERIOD;
-	temp_ctx.sampling_period = DEFAULT_SAMPLING_PERIOD;
-	//Set the timer parameters and initialize it.
+	//Both notification timers share one RTC slot through vtimer.
 	struct rtc_ctx rtc_ctx = {
-		.rtc_x[NOTIF_TIMER_ID] = {
-			.type = PERIODIC,
-                        .period = rh_ctx.sampling_period,
-                        .enabled = false,
-                        .cb = rh_notif_timer_cb,
-		},
-		.rtc_x[NOTIF_TIMER_ID+1] = {
-			.type = PERIODIC,
-                        .period = temp_ctx.sampling_period,
-                        .enabled = false,
-                        .cb = temp_notif_timer_cb,
-		}
+		.rtc_x[VTIMER_RTC_ID] = VTIMER_RTC_SLOT,
 	};
+	vtimer_init(VTIMER_RTC_ID);
 	batt_serv_init(&rtc_ctx);
 	rtc_init(&rtc_ctx);
 
 	ind_init();
-	rh_init(&rh_ctx);
-	temp_init(&temp_ctx);
-	simble_adv_start();
+	sensor_init(&rh_sensor, &rh_desc);
+	sensor_init(&temp_sensor, &temp_desc);
+	twi_trace_init();
+	broadcast_start();
 
 	simble_process_event_loop();
 }